@@ -302,6 +302,69 @@ xmmsc_coll_query (xmmsc_connection_t *conn, xmmsv_t *coll, xmmsv_t *fetch)
 	                       XMMSV_LIST_END);
 }
 
+/**
+ * Open a cursor over the media in the collection. The rows are then
+ * retrieved page by page with #xmmsc_coll_query_fetch, which keeps the
+ * memory used by huge queries bounded on both sides.
+ *
+ * @param conn  The connection to the server.
+ * @param coll  The collection used to query.
+ * @param fetch The fetch specification applied to each row.
+ * @return A dict with the cursor id ("id") and number of rows ("count").
+ */
+xmmsc_result_t*
+xmmsc_coll_query_open (xmmsc_connection_t *conn, xmmsv_t *coll, xmmsv_t *fetch)
+{
+	x_check_conn (conn, NULL);
+	x_api_error_if (!coll, "with a NULL collection", NULL);
+	x_api_error_if (!fetch, "with a NULL fetch specification", NULL);
+
+	return xmmsc_send_cmd (conn, XMMS_IPC_OBJECT_COLLECTION,
+	                       XMMS_IPC_COMMAND_COLLECTION_QUERY_OPEN,
+	                       XMMSV_LIST_ENTRY (xmmsv_ref (coll)),
+	                       XMMSV_LIST_ENTRY (xmmsv_ref (fetch)),
+	                       XMMSV_LIST_END);
+}
+
+/**
+ * Fetch the next rows of a cursor opened with #xmmsc_coll_query_open.
+ *
+ * @param conn  The connection to the server.
+ * @param cursor  The id of the cursor.
+ * @param count  The maximum number of rows to fetch.
+ * @return A list with one entry per row, empty once the cursor is exhausted.
+ */
+xmmsc_result_t*
+xmmsc_coll_query_fetch (xmmsc_connection_t *conn, int cursor, int count)
+{
+	x_check_conn (conn, NULL);
+	x_api_error_if (count <= 0, "with an invalid number of rows", NULL);
+
+	return xmmsc_send_cmd (conn, XMMS_IPC_OBJECT_COLLECTION,
+	                       XMMS_IPC_COMMAND_COLLECTION_QUERY_FETCH,
+	                       XMMSV_LIST_ENTRY_INT (cursor),
+	                       XMMSV_LIST_ENTRY_INT (count),
+	                       XMMSV_LIST_END);
+}
+
+/**
+ * Close a cursor opened with #xmmsc_coll_query_open. Cursors still open
+ * are closed by the server when the client disconnects.
+ *
+ * @param conn  The connection to the server.
+ * @param cursor  The id of the cursor.
+ */
+xmmsc_result_t*
+xmmsc_coll_query_close (xmmsc_connection_t *conn, int cursor)
+{
+	x_check_conn (conn, NULL);
+
+	return xmmsc_send_cmd (conn, XMMS_IPC_OBJECT_COLLECTION,
+	                       XMMS_IPC_COMMAND_COLLECTION_QUERY_CLOSE,
+	                       XMMSV_LIST_ENTRY_INT (cursor),
+	                       XMMSV_LIST_END);
+}
+
 /**
  * Request the collection changed broadcast from the server. Everytime someone
  * manipulates a collection this will be emitted.
@@ -107,6 +107,20 @@ xmmsc_config_list_values (xmmsc_connection_t *c)
 	return xmmsc_send_msg_no_arg (c, XMMS_IPC_OBJECT_CONFIG, XMMS_IPC_COMMAND_CONFIG_LIST_VALUES);
 }
 
+/**
+ * Tells the server to write pending configuration changes to disk
+ * immediately.
+ *
+ * @param c The connection structure.
+ */
+xmmsc_result_t *
+xmmsc_config_sync (xmmsc_connection_t *c)
+{
+	x_check_conn (c, NULL);
+
+	return xmmsc_send_msg_no_arg (c, XMMS_IPC_OBJECT_CONFIG, XMMS_IPC_COMMAND_CONFIG_SYNC);
+}
+
 /**
  * Requests the config_value_changed broadcast. This will be called when a configvalue
  * has been updated.
@@ -33,11 +33,28 @@
 #include <xmmsc/xmmsc_sockets.h>
 
 
+/* Initial number of buckets of the cookie -> result table.
+ * Must be a power of two. */
+#define XMMSC_IPC_RESULTS_SIZE 64
+
 struct xmmsc_ipc_St {
 	xmms_ipc_transport_t *transport;
 	xmms_ipc_msg_t *read_msg;
-	x_list_t *results_list;
+
+	/* Results by cookie. Cookies are handed out sequentially, so the
+	 * low bits of the cookie spread them evenly over the buckets. */
+	x_list_t **results;
+	unsigned int results_size;
+	unsigned int results_count;
+
 	x_queue_t *out_msg;
+	xmmsc_ipc_shm_t *shm;
+
+	/* REPLY_PART pieces of the reply being put back together */
+	unsigned char *part;
+	unsigned int part_len;
+	unsigned int part_size;
+	uint32_t part_cookie;
 	char *error;
 	bool disconnect;
 	void *lockdata;
@@ -135,6 +152,29 @@ xmmsc_ipc_fd_get (xmmsc_ipc_t *ipc)
 	return xmms_ipc_transport_fd_get (ipc->transport);
 }
 
+/**
+ * Map the shared memory segment named by the server, replies found in
+ * #XMMS_IPC_COMMAND_SHM_REPLY descriptors are read from it.
+ */
+bool
+xmmsc_ipc_shm_attach (xmmsc_ipc_t *ipc, const char *name)
+{
+	x_return_val_if_fail (ipc, false);
+	x_return_val_if_fail (name, false);
+	x_return_val_if_fail (!ipc->shm, false);
+
+	ipc->shm = xmmsc_ipc_shm_open (name);
+
+	return ipc->shm != NULL;
+}
+
+bool
+xmmsc_ipc_shm_attached (xmmsc_ipc_t *ipc)
+{
+	x_return_val_if_fail (ipc, false);
+	return ipc->shm != NULL;
+}
+
 
 const char *
 xmmsc_ipc_error_get (xmmsc_ipc_t *ipc)
@@ -170,7 +210,8 @@ xmmsc_ipc_init (void)
 	xmmsc_ipc_t *ipc;
 	ipc = x_new0 (xmmsc_ipc_t, 1);
 	ipc->disconnect = false;
-	ipc->results_list = NULL;
+	ipc->results_size = XMMSC_IPC_RESULTS_SIZE;
+	ipc->results = x_new0 (x_list_t *, ipc->results_size);
 	ipc->out_msg = x_queue_new ();
 
 	return ipc;
@@ -202,6 +243,92 @@ xmmsc_ipc_lock_set (xmmsc_ipc_t *ipc, void *lock, void (*lockfunc)(void *), void
 	ipc->unlockfunc = unlockfunc;
 }
 
+/**
+ * Double the number of buckets once there are as many results as
+ * buckets. Should hold the ipc lock.
+ */
+static void
+xmmsc_ipc_results_grow (xmmsc_ipc_t *ipc)
+{
+	x_list_t **results, *n, *next;
+	unsigned int i, size, mask;
+
+	size = ipc->results_size * 2;
+	mask = size - 1;
+
+	results = x_new0 (x_list_t *, size);
+	if (!results) {
+		/* keep the current table, it just gets slower */
+		return;
+	}
+
+	for (i = 0; i < ipc->results_size; i++) {
+		for (n = ipc->results[i]; n; n = next) {
+			unsigned int b;
+
+			next = x_list_next (n);
+
+			b = xmmsc_result_cookie_get (n->data) & mask;
+			results[b] = x_list_prepend (results[b], n->data);
+		}
+		x_list_free (ipc->results[i]);
+	}
+
+	free (ipc->results);
+	ipc->results = results;
+	ipc->results_size = size;
+}
+
+static x_list_t **
+xmmsc_ipc_results_bucket (xmmsc_ipc_t *ipc, uint32_t cookie)
+{
+	return &ipc->results[cookie & (ipc->results_size - 1)];
+}
+
+/**
+ * Remove a result from the bucket of the given cookie.
+ * Should hold the ipc lock.
+ *
+ * @returns true if the result was found.
+ */
+static bool
+xmmsc_ipc_results_remove (xmmsc_ipc_t *ipc, xmmsc_result_t *res,
+                          uint32_t cookie)
+{
+	x_list_t **bucket, *n;
+
+	bucket = xmmsc_ipc_results_bucket (ipc, cookie);
+
+	for (n = *bucket; n; n = x_list_next (n)) {
+		if (n->data == res) {
+			*bucket = x_list_delete_link (*bucket, n);
+			ipc->results_count--;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/**
+ * Add a result to the bucket of the given cookie.
+ * Should hold the ipc lock.
+ */
+static void
+xmmsc_ipc_results_insert (xmmsc_ipc_t *ipc, xmmsc_result_t *res,
+                          uint32_t cookie)
+{
+	x_list_t **bucket;
+
+	if (ipc->results_count >= ipc->results_size) {
+		xmmsc_ipc_results_grow (ipc);
+	}
+
+	bucket = xmmsc_ipc_results_bucket (ipc, cookie);
+	*bucket = x_list_prepend (*bucket, res);
+	ipc->results_count++;
+}
+
 void
 xmmsc_ipc_result_register (xmmsc_ipc_t *ipc, xmmsc_result_t *res)
 {
@@ -209,7 +336,25 @@ xmmsc_ipc_result_register (xmmsc_ipc_t *ipc, xmmsc_result_t *res)
 	x_return_if_fail (res);
 
 	xmmsc_ipc_lock (ipc);
-	ipc->results_list = x_list_prepend (ipc->results_list, res);
+	xmmsc_ipc_results_insert (ipc, res, xmmsc_result_cookie_get (res));
+	xmmsc_ipc_unlock (ipc);
+}
+
+/**
+ * Move a registered result to its new cookie, after a signal result
+ * has been restarted.
+ */
+void
+xmmsc_ipc_result_rekey (xmmsc_ipc_t *ipc, xmmsc_result_t *res,
+                        uint32_t old_cookie)
+{
+	x_return_if_fail (ipc);
+	x_return_if_fail (res);
+
+	xmmsc_ipc_lock (ipc);
+	if (xmmsc_ipc_results_remove (ipc, res, old_cookie)) {
+		xmmsc_ipc_results_insert (ipc, res, xmmsc_result_cookie_get (res));
+	}
 	xmmsc_ipc_unlock (ipc);
 }
 
@@ -223,7 +368,7 @@ xmmsc_ipc_result_lookup (xmmsc_ipc_t *ipc, uint32_t cookie)
 
 	xmmsc_ipc_lock (ipc);
 
-	for (n = ipc->results_list; n; n = x_list_next (n)) {
+	for (n = *xmmsc_ipc_results_bucket (ipc, cookie); n; n = x_list_next (n)) {
 		xmmsc_result_t *tmp = n->data;
 
 		if (cookie == xmmsc_result_cookie_get (tmp)) {
@@ -240,21 +385,13 @@ xmmsc_ipc_result_lookup (xmmsc_ipc_t *ipc, uint32_t cookie)
 void
 xmmsc_ipc_result_unregister (xmmsc_ipc_t *ipc, xmmsc_result_t *res)
 {
-	x_list_t *n;
-
 	x_return_if_fail (ipc);
 	x_return_if_fail (res);
 
 	xmmsc_ipc_lock (ipc);
 
-	for (n = ipc->results_list; n; n = x_list_next (n)) {
-		xmmsc_result_t *tmp = n->data;
-
-		if (xmmsc_result_cookie_get (res) == xmmsc_result_cookie_get (tmp)) {
-			ipc->results_list = x_list_delete_link (ipc->results_list, n);
-			xmmsc_result_clear_weakrefs (res);
-			break;
-		}
+	if (xmmsc_ipc_results_remove (ipc, res, xmmsc_result_cookie_get (res))) {
+		xmmsc_result_clear_weakrefs (res);
 	}
 
 	xmmsc_ipc_unlock (ipc);
@@ -325,16 +462,21 @@ void
 xmmsc_ipc_destroy (xmmsc_ipc_t *ipc)
 {
 	x_list_t *n;
+	unsigned int i;
 
 	if (!ipc)
 		return;
 
-	for (n = ipc->results_list; n; n = x_list_next (n)) {
-		xmmsc_result_t *tmp = n->data;
-		xmmsc_result_clear_weakrefs (tmp);
+	for (i = 0; i < ipc->results_size; i++) {
+		for (n = ipc->results[i]; n; n = x_list_next (n)) {
+			xmmsc_result_t *tmp = n->data;
+			xmmsc_result_clear_weakrefs (tmp);
+		}
+
+		x_list_free (ipc->results[i]);
 	}
 
-	x_list_free (ipc->results_list);
+	free (ipc->results);
 	if (ipc->transport) {
 		xmms_ipc_transport_destroy (ipc->transport);
 	}
@@ -347,6 +489,12 @@ xmmsc_ipc_destroy (xmmsc_ipc_t *ipc)
 		xmms_ipc_msg_destroy (ipc->read_msg);
 	}
 
+	if (ipc->shm) {
+		xmmsc_ipc_shm_close (ipc->shm);
+	}
+
+	free (ipc->part);
+
 	if (ipc->error) {
 		free (ipc->error);
 	}
@@ -392,11 +540,175 @@ xmmsc_ipc_unlock (xmmsc_ipc_t *ipc)
 		ipc->unlockfunc (ipc->lockdata);
 }
 
+/* Run the reply a SHM_REPLY descriptor points at and release it. */
+static void
+xmmsc_ipc_exec_shm_msg (xmmsc_ipc_t *ipc, xmms_ipc_msg_t *desc)
+{
+	xmmsc_result_t *res;
+	xmms_ipc_msg_t *msg = NULL;
+	uint32_t size = 0;
+
+	if (ipc->shm) {
+		msg = xmmsc_ipc_shm_msg_get (ipc->shm, desc, &size);
+	}
+
+	xmms_ipc_msg_destroy (desc);
+
+	/* the segment can't be trusted anymore */
+	if (!msg) {
+		xmmsc_ipc_disconnect (ipc);
+		return;
+	}
+
+	res = xmmsc_ipc_result_lookup (ipc, xmms_ipc_msg_get_cookie (msg));
+
+	/* the message is parsed and destroyed before callbacks run */
+	if (res) {
+		xmmsc_result_run (res, msg);
+	} else {
+		xmms_ipc_msg_destroy (msg);
+	}
+
+	xmmsc_ipc_shm_release (ipc->shm, size);
+}
+
+/* Run the message a COMPRESSED message carries. */
+static void
+xmmsc_ipc_exec_compressed_msg (xmmsc_ipc_t *ipc, xmms_ipc_msg_t *compressed)
+{
+	xmms_ipc_msg_t *msg = NULL;
+	unsigned char *data;
+	unsigned int len;
+
+	data = xmms_ipc_msg_decompress (compressed, &len);
+	xmms_ipc_msg_destroy (compressed);
+
+	if (data) {
+		msg = xmms_ipc_msg_new_ro (data, len);
+	}
+
+	/* compressed twice can only be garbage */
+	if (msg && xmms_ipc_msg_get_cmd (msg) == XMMS_IPC_COMMAND_COMPRESSED) {
+		xmms_ipc_msg_destroy (msg);
+		msg = NULL;
+	}
+
+	if (!msg) {
+		free (data);
+		xmmsc_ipc_disconnect (ipc);
+		return;
+	}
+
+	/* the message is parsed and destroyed before callbacks run */
+	xmmsc_ipc_exec_msg (ipc, msg);
+
+	free (data);
+}
+
+/* Add a REPLY_PART piece to the reply being put back together, and run
+ * the reply once all of it has arrived. The pieces of one reply are
+ * sent back to back, though other replies may come in between. */
+static void
+xmmsc_ipc_exec_part_msg (xmmsc_ipc_t *ipc, xmms_ipc_msg_t *part)
+{
+	xmms_ipc_msg_t *msg;
+	const unsigned char *data;
+	unsigned int len, need;
+	uint32_t cookie;
+	xmmsv_t *bin = NULL;
+	bool ok;
+
+	cookie = xmms_ipc_msg_get_cookie (part);
+
+	ok = xmms_ipc_msg_get_value (part, &bin);
+	xmms_ipc_msg_destroy (part);
+
+	if (ok) {
+		ok = xmmsv_get_bin (bin, &data, &len) &&
+		     (ipc->part_len == 0 || ipc->part_cookie == cookie);
+	}
+
+	if (ok && ipc->part_len + len > ipc->part_size) {
+		unsigned int size = ipc->part_size ? ipc->part_size : len;
+		unsigned char *tmp;
+
+		while (size < ipc->part_len + len) {
+			size *= 2;
+		}
+
+		tmp = realloc (ipc->part, size);
+		if (tmp) {
+			ipc->part = tmp;
+			ipc->part_size = size;
+		} else {
+			ok = false;
+		}
+	}
+
+	if (ok) {
+		memcpy (ipc->part + ipc->part_len, data, len);
+		ipc->part_len += len;
+		ipc->part_cookie = cookie;
+	}
+
+	if (bin) {
+		xmmsv_unref (bin);
+	}
+
+	if (!ok) {
+		xmmsc_ipc_disconnect (ipc);
+		return;
+	}
+
+	if (ipc->part_len < XMMS_IPC_MSG_HEAD_LEN) {
+		return;
+	}
+
+	/* the length field of the reply's header */
+	data = ipc->part + 12;
+	need = XMMS_IPC_MSG_HEAD_LEN +
+	       (((uint32_t) data[0] << 24) | (data[1] << 16) | (data[2] << 8) | data[3]);
+
+	if (ipc->part_len < need) {
+		return;
+	}
+
+	msg = NULL;
+	if (ipc->part_len == need) {
+		msg = xmms_ipc_msg_new_ro (ipc->part, ipc->part_len);
+	}
+
+	ipc->part_len = 0;
+
+	if (!msg) {
+		xmmsc_ipc_disconnect (ipc);
+		return;
+	}
+
+	/* the reply may itself be compressed */
+	xmmsc_ipc_exec_msg (ipc, msg);
+}
+
 static void
 xmmsc_ipc_exec_msg (xmmsc_ipc_t *ipc, xmms_ipc_msg_t *msg)
 {
 	xmmsc_result_t *res;
 
+	if (xmms_ipc_msg_get_cmd (msg) == XMMS_IPC_COMMAND_SHM_REPLY) {
+		xmmsc_ipc_exec_shm_msg (ipc, msg);
+		return;
+	}
+
+	if (xmms_ipc_msg_get_cmd (msg) == XMMS_IPC_COMMAND_REPLY_PART) {
+		xmmsc_ipc_exec_part_msg (ipc, msg);
+		return;
+	}
+
+	if (xmms_ipc_msg_get_cmd (msg) == XMMS_IPC_COMMAND_COMPRESSED) {
+		xmmsc_ipc_exec_compressed_msg (ipc, msg);
+		return;
+	}
+
 	res = xmmsc_ipc_result_lookup (ipc, xmms_ipc_msg_get_cookie (msg));
 
 	if (!res) {
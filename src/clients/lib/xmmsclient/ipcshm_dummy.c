@@ -0,0 +1,40 @@
+/*  XMMS2 - X Music Multiplexer System
+ *  Copyright (C) 2003-2020 XMMS2 Team
+ *
+ *  PLUGINS ARE NOT CONSIDERED TO BE DERIVED WORK !!!
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ */
+
+#include <xmmsclientpriv/xmmsclient_ipc.h>
+
+xmmsc_ipc_shm_t *
+xmmsc_ipc_shm_open (const char *name)
+{
+	return NULL;
+}
+
+xmms_ipc_msg_t *
+xmmsc_ipc_shm_msg_get (xmmsc_ipc_shm_t *shm, xmms_ipc_msg_t *desc,
+                       uint32_t *size)
+{
+	return NULL;
+}
+
+void
+xmmsc_ipc_shm_release (xmmsc_ipc_shm_t *shm, uint32_t size)
+{
+}
+
+void
+xmmsc_ipc_shm_close (xmmsc_ipc_shm_t *shm)
+{
+}
@@ -0,0 +1,157 @@
+/*  XMMS2 - X Music Multiplexer System
+ *  Copyright (C) 2003-2020 XMMS2 Team
+ *
+ *  PLUGINS ARE NOT CONSIDERED TO BE DERIVED WORK !!!
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ */
+
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <xmmsclientpriv/xmmsclient_ipc.h>
+#include <xmmsc/xmmsc_ipc_shm.h>
+#include <xmmscpriv/xmmsc_util.h>
+
+struct xmmsc_ipc_shm_St {
+	int fd;
+	unsigned char *base;
+	size_t size;
+};
+
+static bool
+xmmsc_ipc_shm_map (xmmsc_ipc_shm_t *shm)
+{
+	struct stat st;
+	unsigned char *base;
+
+	if (fstat (shm->fd, &st) == -1 || st.st_size < XMMS_IPC_SHM_DATA_OFFSET) {
+		return false;
+	}
+
+	base = mmap (NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, shm->fd, 0);
+	if (base == MAP_FAILED) {
+		return false;
+	}
+
+	if (shm->base) {
+		munmap (shm->base, shm->size);
+	}
+
+	shm->base = base;
+	shm->size = st.st_size;
+
+	return true;
+}
+
+/**
+ * @internal
+ * Map the segment the server created for our large replies. The name
+ * is unlinked right away, so the segment goes away with the last
+ * mapping.
+ */
+xmmsc_ipc_shm_t *
+xmmsc_ipc_shm_open (const char *name)
+{
+	xmmsc_ipc_shm_t *shm;
+
+	shm = x_new0 (xmmsc_ipc_shm_t, 1);
+	if (!shm) {
+		return NULL;
+	}
+
+	shm->fd = shm_open (name, O_RDWR, 0);
+	if (shm->fd == -1) {
+		free (shm);
+		return NULL;
+	}
+
+	shm_unlink (name);
+
+	if (!xmmsc_ipc_shm_map (shm) ||
+	    ((xmms_ipc_shm_header_t *) shm->base)->magic != XMMS_IPC_SHM_MAGIC) {
+		xmmsc_ipc_shm_close (shm);
+		return NULL;
+	}
+
+	return shm;
+}
+
+/**
+ * @internal
+ * Resolve an #XMMS_IPC_COMMAND_SHM_REPLY descriptor to the reply it
+ * points at. The returned message reads straight from the segment, so
+ * it must be destroyed before the reply is released with
+ * #xmmsc_ipc_shm_release.
+ *
+ * @param size Set to the number of bytes to release.
+ */
+xmms_ipc_msg_t *
+xmmsc_ipc_shm_msg_get (xmmsc_ipc_shm_t *shm, xmms_ipc_msg_t *desc,
+                       uint32_t *size)
+{
+	xmmsv_t *val;
+	int64_t offset, len;
+	bool ok;
+
+	if (!xmms_ipc_msg_get_value (desc, &val)) {
+		return NULL;
+	}
+
+	ok = xmmsv_list_get_int64 (val, 0, &offset) &&
+	     xmmsv_list_get_int64 (val, 1, &len);
+	xmmsv_unref (val);
+
+	if (!ok || offset < XMMS_IPC_SHM_DATA_OFFSET || len <= 0 || len > UINT32_MAX) {
+		return NULL;
+	}
+
+	/* the server grew the segment since we mapped it */
+	if (offset + len > shm->size && !xmmsc_ipc_shm_map (shm)) {
+		return NULL;
+	}
+
+	if (offset + len > shm->size) {
+		return NULL;
+	}
+
+	*size = XMMS_IPC_SHM_ALIGN (len);
+
+	return xmms_ipc_msg_new_ro (shm->base + offset, len);
+}
+
+/**
+ * @internal
+ * Hand size bytes of the segment back to the server.
+ */
+void
+xmmsc_ipc_shm_release (xmmsc_ipc_shm_t *shm, uint32_t size)
+{
+	xmms_ipc_shm_header_t *header = (xmms_ipc_shm_header_t *) shm->base;
+
+	__atomic_store_n (&header->consumed, header->consumed + size,
+	                  __ATOMIC_RELEASE);
+}
+
+void
+xmmsc_ipc_shm_close (xmmsc_ipc_shm_t *shm)
+{
+	if (shm->base) {
+		munmap (shm->base, shm->size);
+	}
+
+	close (shm->fd);
+	free (shm);
+}
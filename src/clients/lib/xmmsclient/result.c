@@ -46,6 +46,7 @@ typedef struct xmmsc_result_callback_St {
 } xmmsc_result_callback_t;
 
 static void xmmsc_result_restart (xmmsc_result_t *res);
+static void xmmsc_result_notify (xmmsc_result_t *res);
 static void xmmsc_result_notifier_add (xmmsc_result_t *res, xmmsc_result_callback_t *cb);
 static void xmmsc_result_notifier_remove (xmmsc_result_t *res, x_list_t *node);
 static void xmmsc_result_notifier_delete (xmmsc_result_t *res, x_list_t *node);
@@ -202,6 +203,8 @@ xmmsc_result_disconnect (xmmsc_result_t *res)
 static void
 xmmsc_result_restart (xmmsc_result_t *res)
 {
+	uint32_t old_cookie;
+
 	x_return_if_fail (res);
 	x_return_if_fail (res->c);
 
@@ -210,7 +213,13 @@ xmmsc_result_restart (xmmsc_result_t *res)
 		return;
 	}
 
+	old_cookie = res->cookie;
 	res->cookie = xmmsc_write_signal_msg (res->c, res->restart_signal);
+
+	/* the ipc finds results by cookie */
+	if (res->ipc) {
+		xmmsc_ipc_result_rekey (res->ipc, res, old_cookie);
+	}
 }
 
 static bool
@@ -539,9 +548,6 @@ xmmsc_result_run_callback (xmmsc_result_t *res, xmmsc_result_callback_t *cb)
 void
 xmmsc_result_run (xmmsc_result_t *res, xmms_ipc_msg_t *msg)
 {
-	x_list_t *n, *next;
-	xmmsc_result_callback_t *cb;
-
 	x_return_if_fail (res);
 	x_return_if_fail (msg);
 
@@ -552,6 +558,39 @@ xmmsc_result_run (xmmsc_result_t *res, xmms_ipc_msg_t *msg)
 
 	xmms_ipc_msg_destroy (msg);
 
+	xmmsc_result_notify (res);
+}
+
+/**
+ * @internal
+ * Complete a result with a value that didn't arrive in a message of
+ * its own, e.g. one entry of a batch reply.
+ */
+void
+xmmsc_result_run_value (xmmsc_result_t *res, xmmsv_t *val)
+{
+	x_return_if_fail (res);
+	x_return_if_fail (val);
+
+	if (res->data) {
+		xmmsv_unref (res->data);
+	}
+	res->data = xmmsv_ref (val);
+	res->parsed = true;
+
+	xmmsc_result_notify (res);
+}
+
+/**
+ * Helper for xmmsc_result_run.
+ * Runs the notifiers of a result that has just got its value.
+ */
+static void
+xmmsc_result_notify (xmmsc_result_t *res)
+{
+	x_list_t *n, *next;
+	xmmsc_result_callback_t *cb;
+
 	xmmsc_result_ref (res);
 
 	/* Run all notifiers and check for positive return values */
@@ -55,6 +55,42 @@ xmmsc_main_stats (xmmsc_connection_t *c)
 	return xmmsc_send_msg_no_arg (c, XMMS_IPC_OBJECT_MAIN, XMMS_IPC_COMMAND_MAIN_STATS);
 }
 
+/**
+ * Recompute the library statistics from scratch on the server. This scans
+ * the whole media library and should only be used to check or repair the
+ * statistics returned by #xmmsc_main_stats.
+ */
+xmmsc_result_t *
+xmmsc_main_verify_stats (xmmsc_connection_t *c)
+{
+	x_check_conn (c, NULL);
+
+	return xmmsc_send_msg_no_arg (c, XMMS_IPC_OBJECT_MAIN, XMMS_IPC_COMMAND_MAIN_VERIFY_STATS);
+}
+
+/**
+ * Get the number of calls, errors and a latency histogram of each
+ * command the server ran since the counters were last reset.
+ */
+xmmsc_result_t *
+xmmsc_main_command_stats (xmmsc_connection_t *c)
+{
+	x_check_conn (c, NULL);
+
+	return xmmsc_send_msg_no_arg (c, XMMS_IPC_OBJECT_MAIN, XMMS_IPC_COMMAND_MAIN_COMMAND_STATS);
+}
+
+/**
+ * Clear the per command counters returned by #xmmsc_main_command_stats.
+ */
+xmmsc_result_t *
+xmmsc_main_reset_command_stats (xmmsc_connection_t *c)
+{
+	x_check_conn (c, NULL);
+
+	return xmmsc_send_msg_no_arg (c, XMMS_IPC_OBJECT_MAIN, XMMS_IPC_COMMAND_MAIN_RESET_COMMAND_STATS);
+}
+
 /**
  * Request status for the mediainfo reader. It can be idle or working
  */
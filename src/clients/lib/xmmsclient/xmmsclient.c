@@ -271,6 +271,11 @@ xmmsc_deinit (xmmsc_connection_t *c)
 		xmmsc_sc_interface_entity_destroy (c->sc_root);
 	}
 
+	if (c->batch) {
+		xmmsv_unref (c->batch);
+		xmmsv_unref (c->batch_cookies);
+	}
+
 	free (c->error);
 	free (c->clientname);
 	free (c);
@@ -317,6 +322,257 @@ xmmsc_broadcast_quit (xmmsc_connection_t *c)
 	return xmmsc_send_broadcast_msg (c, XMMS_IPC_SIGNAL_MAIN_QUIT);
 }
 
+/**
+ * Request a broadcast, limiting how often its values are delivered.
+ * Useful for broadcasts that can arrive faster than the client cares
+ * to handle them, such as entry updates during an import.
+ *
+ * @param c The connection structure.
+ * @param broadcastid The #xmms_ipc_signal_t of the broadcast.
+ * @param interval The least time between two values, in milliseconds.
+ * Values arriving sooner are held back, and only the newest one is
+ * delivered once the interval has passed.
+ * @param coalesce If TRUE, the server keeps only the newest value
+ * while the previous one hasn't been written to the client yet.
+ */
+xmmsc_result_t *
+xmmsc_broadcast_throttled (xmmsc_connection_t *c, int broadcastid,
+                           int interval, int coalesce)
+{
+	x_check_conn (c, NULL);
+	x_api_error_if (broadcastid < 0 || broadcastid >= XMMS_IPC_SIGNAL_END,
+	                "with an invalid broadcast id", NULL);
+
+	return xmmsc_send_cmd (c, XMMS_IPC_OBJECT_SIGNAL, XMMS_IPC_COMMAND_BROADCAST,
+	                       XMMSV_LIST_ENTRY_INT (broadcastid),
+	                       XMMSV_LIST_ENTRY_INT (interval),
+	                       XMMSV_LIST_ENTRY_INT (coalesce),
+	                       XMMSV_LIST_END);
+}
+
+/**
+ * Request a signal, limiting how often its values are delivered, e.g.
+ * the playtime signal for a client that only shows whole seconds.
+ * The limit stays in effect when the signal is restarted.
+ *
+ * @param c The connection structure.
+ * @param signalid The #xmms_ipc_signal_t of the signal.
+ * @param interval The least time between two values, in milliseconds.
+ */
+xmmsc_result_t *
+xmmsc_signal_throttled (xmmsc_connection_t *c, int signalid, int interval)
+{
+	xmmsc_result_t *res;
+
+	x_check_conn (c, NULL);
+	x_api_error_if (signalid < 0 || signalid >= XMMS_IPC_SIGNAL_END,
+	                "with an invalid signal id", NULL);
+
+	res = xmmsc_send_cmd (c, XMMS_IPC_OBJECT_SIGNAL, XMMS_IPC_COMMAND_SIGNAL,
+	                      XMMSV_LIST_ENTRY_INT (signalid),
+	                      XMMSV_LIST_ENTRY_INT (interval),
+	                      XMMSV_LIST_END);
+
+	xmmsc_result_restartable (res, signalid);
+
+	return res;
+}
+
+/**
+ * Announce the optional protocol features this client understands.
+ * For example, with #XMMS_IPC_CAPABILITY_PLAYLIST_CHANGED_BATCH the
+ * playlist changed broadcast reports bulk inserts as a single
+ * #XMMS_PLAYLIST_CHANGED_INSERT_RANGE message carrying the list of
+ * inserted ids, instead of one #XMMS_PLAYLIST_CHANGED_INSERT per entry.
+ * With #XMMS_IPC_CAPABILITY_REPLY_PARTS large replies are sent in
+ * pieces, so replies to playback commands don't wait behind them.
+ * With #XMMS_IPC_CAPABILITY_COMPRESSION large replies are compressed,
+ * which pays off for clients connected over the network. It is left out
+ * if the library was built without compression support.
+ *
+ * @param c The connection structure.
+ * @param capabilities A bitmask of #xmms_ipc_capability_t values.
+ */
+xmmsc_result_t *
+xmmsc_main_set_capabilities (xmmsc_connection_t *c, int capabilities)
+{
+	x_check_conn (c, NULL);
+
+	if (!xmms_ipc_msg_compress_supported ()) {
+		capabilities &= ~XMMS_IPC_CAPABILITY_COMPRESSION;
+	}
+
+	c->capabilities = capabilities;
+
+	/* keep shared memory replies going once attached */
+	if (xmmsc_ipc_shm_attached (c->ipc)) {
+		capabilities |= XMMS_IPC_CAPABILITY_SHM_REPLY;
+	}
+
+	return xmmsc_send_cmd (c, XMMS_IPC_OBJECT_MAIN,
+	                       XMMS_IPC_COMMAND_MAIN_SET_CAPABILITIES,
+	                       XMMSV_LIST_ENTRY_INT (capabilities),
+	                       XMMSV_LIST_END);
+}
+
+/**
+ * Have the server place large replies in shared memory instead of
+ * sending them through the socket. Only works for clients on the same
+ * host, connected through a unix socket. Blocks until the segment is
+ * set up.
+ *
+ * @param c The connection structure.
+ * @returns TRUE on success, FALSE otherwise. Replies keep going through
+ * the socket on failure, see #xmmsc_get_last_error.
+ */
+int
+xmmsc_shm_attach (xmmsc_connection_t *c)
+{
+	xmmsc_result_t *result;
+	xmmsv_t *value;
+	const char *buf;
+	int ret = false;
+
+	x_check_conn (c, false);
+	x_api_error_if (c->batch, "while batching commands", false);
+
+	if (xmmsc_ipc_shm_attached (c->ipc)) {
+		return true;
+	}
+
+	result = xmmsc_send_msg_no_arg (c, XMMS_IPC_OBJECT_MAIN,
+	                                XMMS_IPC_COMMAND_MAIN_SHM_ATTACH);
+	xmmsc_result_wait (result);
+	value = xmmsc_result_get_value (result);
+
+	if (xmmsv_get_error (value, &buf)) {
+		free (c->error);
+		c->error = strdup (buf);
+	} else if (!xmmsv_get_string (value, &buf) ||
+	           !xmmsc_ipc_shm_attach (c->ipc, buf)) {
+		free (c->error);
+		c->error = strdup ("Couldn't map the shared memory segment");
+	} else {
+		ret = true;
+	}
+
+	xmmsc_result_unref (result);
+
+	/* the server only starts using the segment now that we have it */
+	if (ret) {
+		xmmsc_result_unref (xmmsc_main_set_capabilities (c, c->capabilities));
+	}
+
+	return ret;
+}
+
+/**
+ * Start collecting commands into a batch. Until #xmmsc_batch_end is
+ * called, commands on this connection aren't sent but recorded, and
+ * then go to the server together in one message, saving a round trip
+ * per command.
+ *
+ * Each command still returns its own result, which gets its value once
+ * the reply to the batch arrives. Signals, broadcasts and client to
+ * client messages are sent right away as usual.
+ *
+ * @param c The connection structure.
+ */
+void
+xmmsc_batch_begin (xmmsc_connection_t *c)
+{
+	x_check_conn (c,);
+	x_api_error_if (c->batch, "while already batching commands",);
+
+	c->batch = xmmsv_new_list ();
+	c->batch_cookies = xmmsv_new_list ();
+}
+
+typedef struct xmmsc_batch_St {
+	xmmsc_connection_t *c;
+	xmmsv_t *cookies;
+} xmmsc_batch_t;
+
+static void
+xmmsc_batch_free (void *udata)
+{
+	xmmsc_batch_t *batch = udata;
+
+	xmmsv_unref (batch->cookies);
+	free (batch);
+}
+
+/* Hand each command in the batch its part of the reply */
+static int
+xmmsc_batch_dispatch (xmmsv_t *val, void *udata)
+{
+	xmmsc_batch_t *batch = udata;
+	int64_t cookie;
+	int i;
+
+	for (i = 0; xmmsv_list_get_int64 (batch->cookies, i, &cookie); i++) {
+		xmmsc_result_t *res;
+		xmmsv_t *entry;
+
+		/* the result may be gone already */
+		res = xmmsc_ipc_result_lookup (batch->c->ipc, cookie);
+		if (!res) {
+			continue;
+		}
+
+		if (xmmsv_is_error (val)) {
+			xmmsc_result_run_value (res, val);
+		} else if (xmmsv_list_get (val, i, &entry)) {
+			xmmsc_result_run_value (res, entry);
+		} else {
+			entry = xmmsv_new_error ("Missing reply in batch");
+			xmmsc_result_run_value (res, entry);
+			xmmsv_unref (entry);
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * Send the commands collected since #xmmsc_batch_begin.
+ *
+ * @param c The connection structure.
+ * @returns A result that gets the list of return values once all the
+ * results of the batched commands have theirs.
+ */
+xmmsc_result_t *
+xmmsc_batch_end (xmmsc_connection_t *c)
+{
+	xmmsc_result_t *res;
+	xmmsc_batch_t *batch;
+	xmmsv_t *commands;
+
+	x_check_conn (c, NULL);
+	x_api_error_if (!c->batch, "without batching commands", NULL);
+
+	batch = x_new0 (xmmsc_batch_t, 1);
+	if (!batch) {
+		x_oom ();
+		return NULL;
+	}
+
+	batch->c = c;
+	batch->cookies = c->batch_cookies;
+
+	commands = c->batch;
+	c->batch = NULL;
+	c->batch_cookies = NULL;
+
+	res = xmmsc_send_cmd (c, XMMS_IPC_OBJECT_MAIN, XMMS_IPC_COMMAND_MAIN_BATCH,
+	                      XMMSV_LIST_ENTRY (commands), XMMSV_LIST_END);
+
+	xmmsc_result_notifier_set_default_full (res, xmmsc_batch_dispatch,
+	                                        batch, xmmsc_batch_free);
+
+	return res;
+}
+
 /**
  * Get the absolute path to the user config dir.
  *
@@ -355,6 +611,27 @@ xmmsc_write_msg_to_ipc (xmmsc_connection_t *c, xmms_ipc_msg_t *msg)
 	return cookie;
 }
 
+/* Record a command for the batch instead of sending it */
+static xmmsc_result_t *
+xmmsc_batch_add (xmmsc_connection_t *c, int obj, int cmd, xmmsv_t *args)
+{
+	uint32_t cookie;
+	xmmsv_t *command;
+
+	cookie = xmmsc_next_id (c);
+
+	command = xmmsv_build_list (XMMSV_LIST_ENTRY_INT (obj),
+	                            XMMSV_LIST_ENTRY_INT (cmd),
+	                            XMMSV_LIST_ENTRY (xmmsv_ref (args)),
+	                            XMMSV_LIST_END);
+	xmmsv_list_append (c->batch, command);
+	xmmsv_unref (command);
+
+	xmmsv_list_append_int (c->batch_cookies, cookie);
+
+	return xmmsc_result_new (c, XMMSC_RESULT_CLASS_DEFAULT, cookie);
+}
+
 xmmsc_result_t *
 xmmsc_send_broadcast_msg (xmmsc_connection_t *c, int signalid)
 {
@@ -404,6 +681,16 @@ xmmsc_send_msg_no_arg (xmmsc_connection_t *c, int object, int method)
 	xmms_ipc_msg_t *msg;
 	xmmsv_t *args;
 
+	if (c->batch && object != XMMS_IPC_OBJECT_SIGNAL) {
+		xmmsc_result_t *res;
+
+		args = xmmsv_new_list ();
+		res = xmmsc_batch_add (c, object, method, args);
+		xmmsv_unref (args);
+
+		return res;
+	}
+
 	msg = xmms_ipc_msg_new (object, method);
 
 	args = xmmsv_new_list ();
@@ -443,13 +730,22 @@ xmmsc_send_cmd (xmmsc_connection_t *c, int obj, int cmd, ...)
 	xmmsv_t *args;
 	va_list ap;
 
-	msg = xmms_ipc_msg_new (obj, cmd);
-
 	va_start (ap, cmd);
 	first_arg = va_arg (ap, xmmsv_t *);
 	args = xmmsv_build_list_va (first_arg, ap);
 	va_end (ap);
 
+	if (c->batch && obj != XMMS_IPC_OBJECT_SIGNAL) {
+		xmmsc_result_t *res;
+
+		res = xmmsc_batch_add (c, obj, cmd, args);
+		xmmsv_unref (args);
+
+		return res;
+	}
+
+	msg = xmms_ipc_msg_new (obj, cmd);
+
 	xmms_ipc_msg_put_value (msg, args);
 	xmmsv_unref (args);
 
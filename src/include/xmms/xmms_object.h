@@ -33,6 +33,9 @@ G_BEGIN_DECLS
 struct xmms_object_St;
 typedef struct xmms_object_St xmms_object_t;
 
+struct xmms_object_cmd_desc_St;
+typedef struct xmms_object_cmd_desc_St xmms_object_cmd_desc_t;
+
 typedef void (*xmms_object_destroy_func_t) (xmms_object_t *object);
 
 /** @addtogroup Object
@@ -43,7 +46,7 @@ struct xmms_object_St {
 	GMutex mutex;
 
 	GTree *signals;
-	GTree *cmds;
+	const xmms_object_cmd_desc_t *cmds[XMMS_IPC_COMMAND_OBJECT_MAX];
 
 	gint ref;
 	xmms_object_destroy_func_t destroy_func;
@@ -74,6 +77,19 @@ typedef struct {
 
 typedef void (*xmms_object_cmd_func_t) (xmms_object_t *object, xmms_object_cmd_arg_t *arg);
 
+/* Accept an argument of any type */
+#define XMMS_OBJECT_CMD_ARG_ANY XMMSV_TYPE_END
+
+/**
+ * A command as generated from ipc.xml, the arguments are checked
+ * against it before func is called.
+ */
+struct xmms_object_cmd_desc_St {
+	xmms_object_cmd_func_t func;
+	gint nargs;
+	xmmsv_type_t args[XMMS_OBJECT_CMD_MAX_ARGS];
+};
+
 #define XMMS_OBJECT(p) ((xmms_object_t *)p)
 #define XMMS_IS_OBJECT(p) (XMMS_OBJECT (p)->id == XMMS_OBJECT_MID)
 
@@ -84,10 +100,16 @@ void xmms_object_connect (xmms_object_t *object, guint32 signalid, xmms_object_h
 void xmms_object_disconnect (xmms_object_t *object, guint32 signalid, xmms_object_handler_t handler, gpointer userdata) XMMS_PUBLIC;
 
 void xmms_object_emit (xmms_object_t *object, guint32 signalid, xmmsv_t *data);
+void xmms_object_emit_queued (xmms_object_t *object, guint32 signalid, xmmsv_t *data, gboolean coalesce);
+
+void xmms_object_dispatch_start (void);
+void xmms_object_dispatch_stop (void);
 
 void xmms_object_cmd_arg_init (xmms_object_cmd_arg_t *arg);
 
-void xmms_object_cmd_add (xmms_object_t *object, guint cmdid, const xmms_object_cmd_func_t desc);
+void xmms_object_cmd_add (xmms_object_t *object, guint cmdid, const xmms_object_cmd_desc_t *desc);
+
+const xmms_object_cmd_desc_t *xmms_object_cmd_lookup (xmms_object_t *object, guint cmdid);
 
 void xmms_object_cmd_call (xmms_object_t *object, guint cmdid, xmms_object_cmd_arg_t *arg);
 
@@ -37,13 +37,21 @@ void xmms_ipc_msg_set_cookie (xmms_ipc_msg_t *msg, uint32_t cookie);
 
 xmms_ipc_msg_t *xmms_ipc_msg_new (uint32_t object, uint32_t cmd);
 xmms_ipc_msg_t * xmms_ipc_msg_alloc (void);
+xmms_ipc_msg_t *xmms_ipc_msg_new_ro (const unsigned char *data, unsigned int len);
 void xmms_ipc_msg_destroy (xmms_ipc_msg_t *msg);
 
 bool xmms_ipc_msg_write_transport (xmms_ipc_msg_t *msg, xmms_ipc_transport_t *transport, bool *disconnected);
+int xmms_ipc_msg_write_transport_many (xmms_ipc_msg_t **msgs, int count, xmms_ipc_transport_t *transport, bool *disconnected);
+const unsigned char *xmms_ipc_msg_get_data (xmms_ipc_msg_t *msg, unsigned int *len);
+
 bool xmms_ipc_msg_read_transport (xmms_ipc_msg_t *msg, xmms_ipc_transport_t *transport, bool *disconnected);
 
 uint32_t xmms_ipc_msg_put_value (xmms_ipc_msg_t *msg, xmmsv_t* v);
 
 bool xmms_ipc_msg_get_value (xmms_ipc_msg_t *msg, xmmsv_t **val);
 
+bool xmms_ipc_msg_compress_supported (void);
+xmms_ipc_msg_t *xmms_ipc_msg_compress (xmms_ipc_msg_t *msg);
+unsigned char *xmms_ipc_msg_decompress (xmms_ipc_msg_t *msg, unsigned int *len);
+
 #endif 
@@ -0,0 +1,53 @@
+/*  XMMS2 - X Music Multiplexer System
+ *  Copyright (C) 2003-2020 XMMS2 Team
+ *
+ *  PLUGINS ARE NOT CONSIDERED TO BE DERIVED WORK !!!
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ */
+
+#ifndef __XMMSC_IPC_SHM_H__
+#define __XMMSC_IPC_SHM_H__
+
+#include <xmmsc/xmmsc_stdint.h>
+
+/*
+ * Layout of the shared memory segment used for large replies to local
+ * clients. The server copies serialized reply messages, header
+ * included, into the data area and sends a small
+ * XMMS_IPC_COMMAND_SHM_REPLY message carrying [offset, length] on the
+ * socket instead. The client adds the aligned length of every reply
+ * it is done with to consumed, and once consumed catches up with
+ * produced the server starts over at the beginning of the data area.
+ *
+ * The server may grow the segment while it is drained, so the client
+ * must remap when a reply ends beyond its current mapping.
+ */
+
+#define XMMS_IPC_SHM_MAGIC 0x584d5332 /* XMS2 */
+#define XMMS_IPC_SHM_DATA_OFFSET 128
+#define XMMS_IPC_SHM_ALIGN(len) (((len) + 7) & ~((uint64_t) 7))
+
+typedef struct xmms_ipc_shm_header_St {
+	uint32_t magic;
+	uint32_t reserved;
+
+	/* bytes placed in the data area, only written by the server */
+	uint64_t produced;
+
+	/* keep the counters on separate cache lines */
+	uint8_t pad[48];
+
+	/* bytes released by the client, only written by the client */
+	uint64_t consumed;
+} xmms_ipc_shm_header_t;
+
+#endif
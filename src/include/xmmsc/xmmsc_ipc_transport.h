@@ -21,16 +21,26 @@
 #include <xmmsc/xmmsc_stdint.h>
 #include <xmmsc/xmmsc_sockets.h>
 
+/* Upper bound for the number of buffers passed to a vectored write */
+#define XMMS_IPC_IOVEC_MAX 64
+
 typedef struct xmms_ipc_transport_St xmms_ipc_transport_t;
 
+typedef struct xmms_ipc_iovec_St {
+	char *base;
+	int len;
+} xmms_ipc_iovec_t;
+
 typedef int (*xmms_ipc_read_func) (xmms_ipc_transport_t *, char *, int);
 typedef int (*xmms_ipc_write_func) (xmms_ipc_transport_t *, char *, int);
+typedef int (*xmms_ipc_writev_func) (xmms_ipc_transport_t *, xmms_ipc_iovec_t *, int);
 typedef xmms_ipc_transport_t *(*xmms_ipc_accept_func) (xmms_ipc_transport_t *);
 typedef void (*xmms_ipc_destroy_func) (xmms_ipc_transport_t *);
 
 void xmms_ipc_transport_destroy (xmms_ipc_transport_t *ipct);
 int xmms_ipc_transport_read (xmms_ipc_transport_t *ipct, char *buffer, int len);
 int xmms_ipc_transport_write (xmms_ipc_transport_t *ipct, char *buffer, int len);
+int xmms_ipc_transport_writev (xmms_ipc_transport_t *ipct, xmms_ipc_iovec_t *iov, int iovcnt);
 xmms_socket_t xmms_ipc_transport_fd_get (xmms_ipc_transport_t *ipct);
 xmms_ipc_transport_t * xmms_ipc_server_accept (xmms_ipc_transport_t *ipct);
 xmms_ipc_transport_t * xmms_ipc_client_init (const char *path);
@@ -46,6 +56,7 @@ struct xmms_ipc_transport_St {
 
 	xmms_ipc_accept_func accept_func;
 	xmms_ipc_write_func write_func;
+	xmms_ipc_writev_func writev_func;
 	xmms_ipc_read_func read_func;
 	xmms_ipc_destroy_func destroy_func;
 };
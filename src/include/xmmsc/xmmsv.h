@@ -23,6 +23,7 @@
 #include <xmmsc/xmmsv_dict.h>
 #include <xmmsc/xmmsv_coll.h>
 #include <xmmsc/xmmsv_bitbuffer.h>
+#include <xmmsc/xmmsv_string_pool.h>
 
 #include <xmmsc/xmmsv_util.h>
 #include <xmmsc/xmmsv_build.h>
@@ -0,0 +1,47 @@
+/*  XMMS2 - X Music Multiplexer System
+ *  Copyright (C) 2003-2020 XMMS2 Team
+ *
+ *  PLUGINS ARE NOT CONSIDERED TO BE DERIVED WORK !!!
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ */
+
+#ifndef __XMMSV_STRING_POOL_H__
+#define __XMMSV_STRING_POOL_H__
+
+#include <xmmsc/xmmsv_general.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @defgroup StringPool String pool
+ * @ingroup ValueType
+ * @{
+ */
+
+typedef struct xmmsv_string_pool_St xmmsv_string_pool_t;
+
+xmmsv_string_pool_t *xmmsv_string_pool_new (void) XMMS_PUBLIC;
+void xmmsv_string_pool_free (xmmsv_string_pool_t *pool) XMMS_PUBLIC;
+int xmmsv_string_pool_get_size (xmmsv_string_pool_t *pool) XMMS_PUBLIC;
+
+xmmsv_t *xmmsv_string_pool_new_string (xmmsv_string_pool_t *pool, const char *s) XMMS_PUBLIC;
+xmmsv_t *xmmsv_string_pool_deserialize (xmmsv_string_pool_t *pool, xmmsv_t *v) XMMS_PUBLIC;
+
+/** @} */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -65,6 +65,15 @@ xmmsc_result_t *xmmsc_quit(xmmsc_connection_t *c) XMMS_PUBLIC;
 
 xmmsc_result_t *xmmsc_broadcast_quit (xmmsc_connection_t *c) XMMS_PUBLIC;
 
+xmmsc_result_t *xmmsc_broadcast_throttled (xmmsc_connection_t *c, int broadcastid, int interval, int coalesce) XMMS_PUBLIC;
+xmmsc_result_t *xmmsc_signal_throttled (xmmsc_connection_t *c, int signalid, int interval) XMMS_PUBLIC;
+
+xmmsc_result_t *xmmsc_main_set_capabilities (xmmsc_connection_t *c, int capabilities) XMMS_PUBLIC;
+int xmmsc_shm_attach (xmmsc_connection_t *c) XMMS_PUBLIC;
+
+void xmmsc_batch_begin (xmmsc_connection_t *c) XMMS_PUBLIC;
+xmmsc_result_t *xmmsc_batch_end (xmmsc_connection_t *c) XMMS_PUBLIC;
+
 /* get user config dir */
 const char *xmmsc_userconfdir_get (char *buf, int len) XMMS_PUBLIC;
 
@@ -153,6 +162,7 @@ xmmsc_result_t *xmmsc_config_set_value (xmmsc_connection_t *c, const char *key,
 xmmsc_result_t *xmmsc_config_list_values (xmmsc_connection_t *c) XMMS_PUBLIC;
 xmmsc_result_t *xmmsc_config_get_value (xmmsc_connection_t *c, const char *key) XMMS_PUBLIC;
 xmmsc_result_t *xmmsc_config_register_value (xmmsc_connection_t *c, const char *valuename, const char *defaultvalue) XMMS_PUBLIC;
+xmmsc_result_t *xmmsc_config_sync (xmmsc_connection_t *c) XMMS_PUBLIC;
 
 /* broadcasts */
 xmmsc_result_t *xmmsc_broadcast_config_value_changed (xmmsc_connection_t *c) XMMS_PUBLIC;
@@ -166,6 +176,9 @@ xmmsc_result_t *xmmsc_broadcast_config_value_changed (xmmsc_connection_t *c) XMM
 xmmsc_result_t *xmmsc_main_list_plugins (xmmsc_connection_t *c, xmms_plugin_type_t type) XMMS_PUBLIC;
 
 xmmsc_result_t *xmmsc_main_stats (xmmsc_connection_t *c) XMMS_PUBLIC;
+xmmsc_result_t *xmmsc_main_verify_stats (xmmsc_connection_t *c) XMMS_PUBLIC;
+xmmsc_result_t *xmmsc_main_command_stats (xmmsc_connection_t *c) XMMS_PUBLIC;
+xmmsc_result_t *xmmsc_main_reset_command_stats (xmmsc_connection_t *c) XMMS_PUBLIC;
 
 /* broadcasts */
 xmmsc_result_t *xmmsc_broadcast_mediainfo_reader_status (xmmsc_connection_t *c) XMMS_PUBLIC;
@@ -267,6 +280,9 @@ xmmsc_result_t* xmmsc_coll_sync (xmmsc_connection_t *conn) XMMS_PUBLIC;
 xmmsc_result_t* xmmsc_coll_query_ids (xmmsc_connection_t *conn, xmmsv_t *coll, xmmsv_t *order, int limit_start, int limit_len) XMMS_PUBLIC;
 xmmsc_result_t* xmmsc_coll_query_infos (xmmsc_connection_t *conn, xmmsv_t *coll, xmmsv_t *order, int limit_start, int limit_len, xmmsv_t *fetch, xmmsv_t *group) XMMS_PUBLIC XMMS_DEPRECATED;
 xmmsc_result_t* xmmsc_coll_query (xmmsc_connection_t *conn, xmmsv_t *coll, xmmsv_t *fetch) XMMS_PUBLIC;
+xmmsc_result_t* xmmsc_coll_query_open (xmmsc_connection_t *conn, xmmsv_t *coll, xmmsv_t *fetch) XMMS_PUBLIC;
+xmmsc_result_t* xmmsc_coll_query_fetch (xmmsc_connection_t *conn, int cursor, int count) XMMS_PUBLIC;
+xmmsc_result_t* xmmsc_coll_query_close (xmmsc_connection_t *conn, int cursor) XMMS_PUBLIC;
 
 /* string-to-collection parser */
 typedef enum {
@@ -61,6 +61,13 @@ struct xmmsc_connection_St {
 	/* this client's id, assigned by the server */
 	int64_t id;
 
+	/* capabilities announced with xmmsc_main_set_capabilities */
+	int capabilities;
+
+	/* commands recorded since xmmsc_batch_begin, and their cookies */
+	xmmsv_t *batch;
+	xmmsv_t *batch_cookies;
+
 	/* anonymous root namespace */
 	xmmsc_sc_interface_entity_t *sc_root;
 
@@ -74,6 +81,7 @@ uint32_t xmmsc_result_cookie_get (xmmsc_result_t *result);
 void xmmsc_result_c2c_set (xmmsc_result_t *res);
 xmmsc_result_type_t xmmsc_result_type_set (xmmsc_result_t *res, xmmsc_result_type_t new);
 void xmmsc_result_run (xmmsc_result_t *res, xmms_ipc_msg_t *msg);
+void xmmsc_result_run_value (xmmsc_result_t *res, xmmsv_t *val);
 
 xmmsc_result_t *xmmsc_send_cmd (xmmsc_connection_t *c, int obj, int cmd, ...) XMMS_SENTINEL(0);
 uint32_t xmmsc_send_cmd_cookie (xmmsc_connection_t *c, int obj, int cmd, ...) XMMS_SENTINEL(0);
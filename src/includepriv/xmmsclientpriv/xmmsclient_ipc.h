@@ -50,7 +50,18 @@ xmms_socket_t xmmsc_ipc_fd_get (xmmsc_ipc_t *ipc);
 void xmmsc_ipc_result_register (xmmsc_ipc_t *ipc, xmmsc_result_t *res);
 xmmsc_result_t *xmmsc_ipc_result_lookup (xmmsc_ipc_t *ipc, uint32_t cookie);
 void xmmsc_ipc_result_unregister (xmmsc_ipc_t *ipc, xmmsc_result_t *res);
+void xmmsc_ipc_result_rekey (xmmsc_ipc_t *ipc, xmmsc_result_t *res, uint32_t old_cookie);
 void xmmsc_ipc_wait_for_event (xmmsc_ipc_t *ipc, unsigned int timeout);
+bool xmmsc_ipc_shm_attach (xmmsc_ipc_t *ipc, const char *name);
+bool xmmsc_ipc_shm_attached (xmmsc_ipc_t *ipc);
+
+struct xmmsc_ipc_shm_St;
+typedef struct xmmsc_ipc_shm_St xmmsc_ipc_shm_t;
+
+xmmsc_ipc_shm_t *xmmsc_ipc_shm_open (const char *name);
+xmms_ipc_msg_t *xmmsc_ipc_shm_msg_get (xmmsc_ipc_shm_t *shm, xmms_ipc_msg_t *desc, uint32_t *size);
+void xmmsc_ipc_shm_release (xmmsc_ipc_shm_t *shm, uint32_t size);
+void xmmsc_ipc_shm_close (xmmsc_ipc_shm_t *shm);
 
 /* FIXME: The proper place would be in a new header
  * xmmsclientpriv/xmmsclient_result.h  */
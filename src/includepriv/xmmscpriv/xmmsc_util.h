@@ -51,6 +51,18 @@ typedef void (*XDestroyNotify) (void *data);
 #define x_malloc0(size) calloc (1, size)
 #define x_malloc(size) malloc (size)
 
+/* atomic integers, for counts shared between threads */
+#ifdef _MSC_VER
+#  include <intrin.h>
+#  define x_atomic_int_get(p) ((int) _InterlockedOr ((volatile long *) (p), 0))
+#  define x_atomic_int_inc(p) ((void) _InterlockedIncrement ((volatile long *) (p)))
+#  define x_atomic_int_dec_and_test(p) (_InterlockedDecrement ((volatile long *) (p)) == 0)
+#else
+#  define x_atomic_int_get(p) (__sync_fetch_and_add ((p), 0))
+#  define x_atomic_int_inc(p) ((void) __sync_fetch_and_add ((p), 1))
+#  define x_atomic_int_dec_and_test(p) (__sync_sub_and_fetch ((p), 1) == 0)
+#endif
+
 /* utility functions */
 char *x_vasprintf (const char *fmt, va_list args) XMMS_FORMAT(printf, 1, 0);
 char *x_asprintf (const char *fmt, ...) XMMS_FORMAT(printf, 1, 2);
@@ -31,7 +31,7 @@ struct xmmsv_St {
 		char *error;
 		int64_t int64;
 		float flt32;
-		char *string;
+		char *string; /* shared, see _xmmsv_string_new */
 		xmmsv_coll_internal_t *coll;
 		xmmsv_list_internal_t *list;
 		xmmsv_dict_internal_t *dict;
@@ -59,5 +59,14 @@ xmmsv_t *_xmmsv_new (xmmsv_type_t type);
 void _xmmsv_list_free (xmmsv_list_internal_t *dict);
 void _xmmsv_dict_free (xmmsv_dict_internal_t *dict);
 void _xmmsv_coll_free (xmmsv_coll_internal_t *coll);
+void _xmmsv_coll_idlist_copy (xmmsv_t *coll, xmmsv_t *source);
+
+char *_xmmsv_string_new (const char *s, unsigned int len);
+char *_xmmsv_string_ref (char *str);
+void _xmmsv_string_unref (char *str);
+
+uint32_t _xmmsv_dict_hash (const void *key, int len);
+int _xmmsv_dict_set_shared (xmmsv_t *dictv, char *key, uint32_t hash, xmmsv_t *val);
+int _xmmsv_string_pool_dict_set (xmmsv_string_pool_t *pool, xmmsv_t *dictv, const char *key, xmmsv_t *val);
 
 #endif
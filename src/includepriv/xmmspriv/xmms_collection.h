@@ -26,6 +26,9 @@
 
 #define XMMS_COLLECTION_NUM_NAMESPACES  2
 
+/* Upper bound on the number of rows returned by one cursor fetch */
+#define XMMS_COLLECTION_CURSOR_MAX_ROWS  1024
+
 typedef enum {
 	XMMS_COLLECTION_NSID_COLLECTIONS,
 	XMMS_COLLECTION_NSID_PLAYLISTS,
@@ -48,6 +51,9 @@ typedef struct xmms_coll_dag_St xmms_coll_dag_t;
 
 typedef void (*FuncApplyToColl)(xmms_coll_dag_t *dag, xmmsv_t *coll, xmmsv_t *parent, void *udata);
 
+/* Blocks (lock TRUE) or allows again in place edits of the playlists */
+typedef void (*xmms_collection_edit_lock_func_t) (gboolean lock, gpointer udata);
+
 
 /*
  * Public functions
@@ -58,6 +64,8 @@ xmms_coll_dag_t * xmms_collection_init (xmms_medialib_t *medialib);
 xmmsv_t* xmms_collection_query_ids (xmms_coll_dag_t *dag, xmmsv_t *coll, xmms_error_t *err);
 
 
+void xmms_collection_edit_lock_func_set (xmms_coll_dag_t *dag, xmms_collection_edit_lock_func_t func, gpointer udata);
+
 void xmms_collection_foreach_in_namespace (xmms_coll_dag_t *dag, xmms_collection_namespace_id_t nsid, GHFunc f, void *udata);
 void xmms_collection_apply_to_all_collections (xmms_coll_dag_t *dag, FuncApplyToColl f, void *udata);
 void xmms_collection_apply_to_collection (xmms_coll_dag_t *dag, xmmsv_t *coll, FuncApplyToColl f, void *udata);
@@ -66,6 +74,7 @@ xmmsv_t * xmms_collection_get_pointer (xmms_coll_dag_t *dag, const gchar *collna
 void xmms_collection_update_pointer (xmms_coll_dag_t *dag, const gchar *name, xmms_collection_namespace_id_t nsid, xmmsv_t *newtarget);
 gchar * xmms_collection_find_alias (xmms_coll_dag_t *dag, xmms_collection_namespace_id_t nsid, xmmsv_t *value, const gchar *key);
 xmms_medialib_entry_t xmms_collection_get_random_media (xmms_coll_dag_t *dag, xmmsv_t *source);
+xmms_medialib_entry_t xmms_collection_get_weighted_random_media (xmms_coll_dag_t *dag, xmmsv_t *source, const gchar *weight);
 
 xmms_collection_namespace_id_t xmms_collection_get_namespace_id (const gchar *namespace);
 const gchar *xmms_collection_get_namespace_string (xmms_collection_namespace_id_t nsid);
@@ -76,7 +85,8 @@ gboolean xmms_collection_set_int_attr (xmmsv_t *coll, const gchar *attrname, gin
 xmmsv_t *xmms_collection_changed_msg_new (xmms_collection_changed_action_t type, const gchar *plname, const gchar *namespace);
 void xmms_collection_changed_msg_send (xmms_coll_dag_t *colldag, xmmsv_t *dict);
 
-xmmsv_t *xmms_collection_snapshot (xmms_coll_dag_t *dag);
+xmmsv_t *xmms_collection_snapshot (xmms_coll_dag_t *dag, GHashTable *written);
+xmmsv_t *xmms_collection_snapshot_partial (xmms_coll_dag_t *dag, GHashTable **names, GHashTable *written);
 void xmms_collection_restore (xmms_coll_dag_t *dag, xmmsv_t *snapshot);
 
 #define XMMS_COLLECTION_PLAYLIST_CHANGED_MSG(dag, name) xmms_collection_changed_msg_send (dag, xmms_collection_changed_msg_new (XMMS_COLLECTION_CHANGED_UPDATE, name, XMMS_COLLECTION_NS_PLAYLISTS))
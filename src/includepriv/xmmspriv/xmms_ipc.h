@@ -9,6 +9,7 @@ typedef struct xmms_ipc_St xmms_ipc_t;
 xmms_ipc_t *xmms_ipc_init (void);
 void xmms_ipc_shutdown (void);
 void on_config_ipcsocket_change (xmms_object_t *object, xmmsv_t *data, gpointer udata);
+void on_config_ipc_command_stats_change (xmms_object_t *object, xmmsv_t *data, gpointer udata);
 gboolean xmms_ipc_setup_server (const gchar *path);
 
 typedef struct xmms_ipc_manager_St xmms_ipc_manager_t;
@@ -18,5 +19,22 @@ gboolean xmms_ipc_has_pending (guint signalid);
 void xmms_ipc_send_message (gint cli, xmms_ipc_msg_t *msg, xmms_error_t *err);
 void xmms_ipc_send_broadcast (guint broadcastid, gint cli, xmmsv_t *arg, xmms_error_t *err);
 GList *xmms_ipc_get_connected_clients (void);
+void xmms_ipc_client_set_capabilities (gint32 cli, guint32 capabilities, xmms_error_t *err);
+gint xmms_ipc_client_queue_length (gint32 cli);
+xmmsv_t *xmms_ipc_client_queue_stats (void);
+void xmms_ipc_command_stats_enable (gboolean enable);
+xmmsv_t *xmms_ipc_command_stats (void);
+void xmms_ipc_command_stats_reset (void);
+gchar *xmms_ipc_client_shm_attach (gint32 cli, xmms_error_t *err);
+xmmsv_t *xmms_ipc_batch_call (gint32 cli, uint32_t cookie, xmmsv_t *commands, xmms_error_t *err);
+
+typedef xmmsv_t *(*xmms_ipc_broadcast_compat_func_t) (xmmsv_t *arg);
+
+typedef struct xmms_ipc_broadcast_compat_St {
+	guint32 capability;
+	xmms_ipc_broadcast_compat_func_t func;
+} xmms_ipc_broadcast_compat_t;
+
+void xmms_ipc_broadcast_compat_register (xmms_ipc_signal_t signalid, guint32 capability, xmms_ipc_broadcast_compat_func_t func);
 
 #endif
@@ -0,0 +1,35 @@
+/*  XMMS2 - X Music Multiplexer System
+ *  Copyright (C) 2003-2020 XMMS2 Team
+ *
+ *  PLUGINS ARE NOT CONSIDERED TO BE DERIVED WORK !!!
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ */
+
+
+
+
+#ifndef __XMMS_IPC_SHM_H__
+#define __XMMS_IPC_SHM_H__
+
+#include <glib.h>
+#include <xmms/xmms_error.h>
+#include <xmmsc/xmmsc_ipc_msg.h>
+#include <xmmsc/xmmsc_sockets.h>
+
+typedef struct xmms_ipc_shm_St xmms_ipc_shm_t;
+
+xmms_ipc_shm_t *xmms_ipc_shm_new (xmms_socket_t fd, gint32 clientid, guint threshold, gsize max_size, xmms_error_t *err);
+const gchar *xmms_ipc_shm_get_name (xmms_ipc_shm_t *shm);
+xmms_ipc_msg_t *xmms_ipc_shm_place (xmms_ipc_shm_t *shm, xmms_ipc_msg_t *msg);
+void xmms_ipc_shm_destroy (xmms_ipc_shm_t *shm);
+
+#endif
@@ -30,9 +30,27 @@ typedef struct xmms_medialib_session_St xmms_medialib_session_t;
 #include <xmmspriv/xmms_fetch_spec.h>
 #include <s4.h>
 
+/* Library wide aggregates, maintained incrementally on each commit */
+typedef enum {
+	XMMS_MEDIALIB_STATS_SIZE,
+	XMMS_MEDIALIB_STATS_DURATION,
+	XMMS_MEDIALIB_STATS_PLAYTIME,
+	XMMS_MEDIALIB_STATS_END
+} xmms_medialib_stats_field_t;
+
+/* Returns a reference to the id set kept for a collection, or NULL */
+typedef GHashTable *(*xmms_medialib_materialized_func_t) (xmmsv_t *coll, gpointer udata);
+
+/* Called once per committed session with the ids of the entries it removed */
+typedef void (*xmms_medialib_removed_func_t) (GHashTable *entries, gpointer udata);
+
 xmms_medialib_t *xmms_medialib_init (void);
 s4_t *xmms_medialib_get_database_backend (xmms_medialib_t *medialib);
 s4_sourcepref_t *xmms_medialib_get_source_preferences (xmms_medialib_t *medialib);
+void xmms_medialib_materialized_func_set (xmms_medialib_t *medialib, xmms_medialib_materialized_func_t func, gpointer udata);
+GHashTable *xmms_medialib_get_materialized (xmms_medialib_t *medialib, xmmsv_t *coll);
+void xmms_medialib_removed_func_set (xmms_medialib_t *medialib, xmms_medialib_removed_func_t func, gpointer udata);
+void xmms_medialib_entries_removed (xmms_medialib_t *medialib, GHashTable *entries);
 char *xmms_medialib_uuid (xmms_medialib_t *mlib);
 s4_resultset_t *xmms_medialib_session_query (xmms_medialib_session_t *s, s4_fetchspec_t *spec, s4_condition_t *cond);
 
@@ -63,6 +81,15 @@ xmmsv_t *xmms_medialib_add_recursive (xmms_medialib_t *medialib, const gchar *pa
 
 xmms_medialib_entry_t xmms_medialib_query_random_id (xmms_medialib_session_t *s, xmmsv_t *coll);
 
+gboolean xmms_medialib_stats_is_tracked (const gchar *key);
+void xmms_medialib_entry_stats_get (xmms_medialib_session_t *s, xmms_medialib_entry_t entry, gint64 *values);
+void xmms_medialib_stats_get (xmms_medialib_t *medialib, gint64 *values);
+void xmms_medialib_stats_lock (xmms_medialib_t *medialib);
+void xmms_medialib_stats_unlock (xmms_medialib_t *medialib);
+void xmms_medialib_stats_add (xmms_medialib_t *medialib, const gint64 *delta);
+void xmms_medialib_stats_flush (xmms_medialib_t *medialib, gboolean force);
+gboolean xmms_medialib_stats_verify (xmms_medialib_t *medialib, gint64 *values, xmms_error_t *err);
+
 xmmsv_t *xmms_medialib_query (xmms_medialib_session_t *s, xmmsv_t *coll, xmmsv_t *fetch, xmms_error_t *err);
 s4_resultset_t *xmms_medialib_query_recurs (xmms_medialib_session_t *session, xmmsv_t *coll, xmms_fetch_info_t *fetch);
 xmmsv_t *xmms_medialib_query_to_xmmsv (s4_resultset_t *set, xmms_fetch_spec_t *spec);
@@ -70,13 +97,17 @@ xmmsv_t *xmms_medialib_query_to_xmmsv (s4_resultset_t *set, xmms_fetch_spec_t *s
 
 xmms_medialib_session_t *xmms_medialib_session_begin (xmms_medialib_t *mlib);
 xmms_medialib_session_t *xmms_medialib_session_begin_ro (xmms_medialib_t *medialib);
+xmms_medialib_session_t *xmms_medialib_session_begin_internal (xmms_medialib_t *medialib);
 void xmms_medialib_session_abort (xmms_medialib_session_t *session);
 gboolean xmms_medialib_session_commit (xmms_medialib_session_t *session);
 s4_resultset_t *xmms_medialib_session_query (xmms_medialib_session_t *session, s4_fetchspec_t *specification, s4_condition_t *condition);
 s4_sourcepref_t *xmms_medialib_session_get_source_preferences (xmms_medialib_session_t *session);
+GHashTable *xmms_medialib_session_get_materialized (xmms_medialib_session_t *session, xmmsv_t *coll);
 void xmms_medialib_session_track_garbage (xmms_medialib_session_t *session, xmmsv_t *data);
 gint xmms_medialib_session_property_set (xmms_medialib_session_t *session, xmms_medialib_entry_t entry, const gchar *key, const s4_val_t *value, const gchar *source);
 gint xmms_medialib_session_property_unset (xmms_medialib_session_t *session, xmms_medialib_entry_t entry, const gchar *key, const s4_val_t *value, const gchar *source);
+gboolean xmms_medialib_session_stats_get (xmms_medialib_session_t *session, gint64 *values);
+void xmms_medialib_session_stats_set (xmms_medialib_session_t *session, const gint64 *values);
 
 #define xmms_medialib_entry_status_set(s, e, st) xmms_medialib_entry_property_set_int_source(s, e, XMMS_MEDIALIB_ENTRY_PROPERTY_STATUS, st, "server") /** @todo: hardcoded server id might be bad? */
 
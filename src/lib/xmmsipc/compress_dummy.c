@@ -0,0 +1,39 @@
+/*  XMMS2 - X Music Multiplexer System
+ *  Copyright (C) 2003-2020 XMMS2 Team
+ *
+ *  PLUGINS ARE NOT CONSIDERED TO BE DERIVED WORK !!!
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ */
+
+/** @file
+ * Dummy used when compressed messages are not supported.
+ */
+
+#include <xmmsc/xmmsc_ipc_msg.h>
+
+bool
+xmms_ipc_msg_compress_supported (void)
+{
+	return false;
+}
+
+xmms_ipc_msg_t *
+xmms_ipc_msg_compress (xmms_ipc_msg_t *msg)
+{
+	return NULL;
+}
+
+unsigned char *
+xmms_ipc_msg_decompress (xmms_ipc_msg_t *msg, unsigned int *len)
+{
+	return NULL;
+}
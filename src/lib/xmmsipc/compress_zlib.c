@@ -0,0 +1,138 @@
+/*  XMMS2 - X Music Multiplexer System
+ *  Copyright (C) 2003-2020 XMMS2 Team
+ *
+ *  PLUGINS ARE NOT CONSIDERED TO BE DERIVED WORK !!!
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ */
+
+/** @file
+ * Compressed messages, using zlib.
+ *
+ * A #XMMS_IPC_COMMAND_COMPRESSED message carries a binary value made of
+ * the length of the original message, as 32 bits in network order,
+ * followed by the zlib stream of the original message, header included.
+ */
+
+#include <stdlib.h>
+
+#include <zlib.h>
+
+#include <xmmsc/xmmsc_ipc_msg.h>
+#include <xmmsc/xmmsc_idnumbers.h>
+#include <xmmscpriv/xmmsc_util.h>
+#include <xmmsc/xmmsv.h>
+
+#define XMMS_IPC_COMPRESS_PREFIX 4
+
+bool
+xmms_ipc_msg_compress_supported (void)
+{
+	return true;
+}
+
+/**
+ * Compress a complete message into a #XMMS_IPC_COMMAND_COMPRESSED
+ * message with the same object and cookie.
+ *
+ * @returns the new message, or NULL if the message doesn't get any
+ * smaller.
+ */
+xmms_ipc_msg_t *
+xmms_ipc_msg_compress (xmms_ipc_msg_t *msg)
+{
+	xmms_ipc_msg_t *ret;
+	const unsigned char *data;
+	unsigned char *buf;
+	unsigned int len;
+	uLongf size;
+	xmmsv_t *bin;
+
+	x_return_val_if_fail (msg, NULL);
+
+	data = xmms_ipc_msg_get_data (msg, &len);
+
+	size = compressBound (len);
+	buf = malloc (XMMS_IPC_COMPRESS_PREFIX + size);
+	if (!buf) {
+		return NULL;
+	}
+
+	if (compress2 (buf + XMMS_IPC_COMPRESS_PREFIX, &size, data, len,
+	               Z_BEST_SPEED) != Z_OK || size >= len) {
+		free (buf);
+		return NULL;
+	}
+
+	buf[0] = (len >> 24) & 0xff;
+	buf[1] = (len >> 16) & 0xff;
+	buf[2] = (len >> 8) & 0xff;
+	buf[3] = len & 0xff;
+
+	ret = xmms_ipc_msg_new (xmms_ipc_msg_get_object (msg),
+	                        XMMS_IPC_COMMAND_COMPRESSED);
+	xmms_ipc_msg_set_cookie (ret, xmms_ipc_msg_get_cookie (msg));
+
+	bin = xmmsv_new_bin (buf, XMMS_IPC_COMPRESS_PREFIX + size);
+	xmms_ipc_msg_put_value (ret, bin);
+	xmmsv_unref (bin);
+
+	free (buf);
+
+	return ret;
+}
+
+/**
+ * Restore the message a #XMMS_IPC_COMMAND_COMPRESSED message carries.
+ *
+ * @returns the original message, header included, to be freed by the
+ * caller. NULL if it can't be restored.
+ */
+unsigned char *
+xmms_ipc_msg_decompress (xmms_ipc_msg_t *msg, unsigned int *len)
+{
+	const unsigned char *data;
+	unsigned char *buf = NULL;
+	unsigned int data_len;
+	uLongf size;
+	xmmsv_t *bin;
+
+	x_return_val_if_fail (msg, NULL);
+	x_return_val_if_fail (len, NULL);
+
+	if (!xmms_ipc_msg_get_value (msg, &bin)) {
+		return NULL;
+	}
+
+	if (xmmsv_get_bin (bin, &data, &data_len) &&
+	    data_len > XMMS_IPC_COMPRESS_PREFIX) {
+		size = ((uint32_t) data[0] << 24) | (data[1] << 16) |
+		       (data[2] << 8) | data[3];
+
+		if (size >= XMMS_IPC_MSG_HEAD_LEN) {
+			buf = malloc (size);
+		}
+
+		if (buf) {
+			*len = size;
+			if (uncompress (buf, &size, data + XMMS_IPC_COMPRESS_PREFIX,
+			                data_len - XMMS_IPC_COMPRESS_PREFIX) != Z_OK ||
+			    size != *len) {
+				free (buf);
+				buf = NULL;
+			}
+		}
+	}
+
+	xmmsv_unref (bin);
+
+	return buf;
+}
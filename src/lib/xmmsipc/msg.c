@@ -175,6 +175,48 @@ xmms_ipc_msg_new (uint32_t object, uint32_t cmd)
 	return msg;
 }
 
+/**
+ * Wrap a complete serialized message, header included, without copying
+ * it. The data must outlive the message, which can only be read from.
+ */
+xmms_ipc_msg_t *
+xmms_ipc_msg_new_ro (const unsigned char *data, unsigned int len)
+{
+	xmms_ipc_msg_t *msg;
+
+	x_return_val_if_fail (data, NULL);
+	x_return_val_if_fail (len >= XMMS_IPC_MSG_HEAD_LEN, NULL);
+
+	msg = x_new0 (xmms_ipc_msg_t, 1);
+	msg->bb = xmmsv_new_bitbuffer_ro (data, len);
+	msg->xfered = len;
+
+	if (xmms_ipc_msg_get_length (msg) != len - XMMS_IPC_MSG_HEAD_LEN) {
+		xmms_ipc_msg_destroy (msg);
+		return NULL;
+	}
+
+	xmmsv_bitbuffer_goto (msg->bb, XMMS_IPC_MSG_HEAD_LEN * 8);
+
+	return msg;
+}
+
+/**
+ * Get the serialized message, header included.
+ */
+const unsigned char *
+xmms_ipc_msg_get_data (xmms_ipc_msg_t *msg, unsigned int *len)
+{
+	x_return_val_if_fail (msg, NULL);
+	x_return_val_if_fail (len, NULL);
+
+	xmmsv_bitbuffer_align (msg->bb);
+
+	*len = xmmsv_bitbuffer_len (msg->bb) / 8;
+
+	return xmmsv_bitbuffer_buffer (msg->bb);
+}
+
 
 /**
  * Try to write message to transport. If full message isn't written
@@ -225,6 +267,75 @@ xmms_ipc_msg_write_transport (xmms_ipc_msg_t *msg,
 	return (len == msg->xfered);
 }
 
+/**
+ * Try to write a batch of messages to transport with a single vectored
+ * write. Like #xmms_ipc_msg_write_transport, messages that were only
+ * partly written keep track of the amount of data written, so the
+ * batch can be retried with the same messages later on.
+ *
+ * At most #XMMS_IPC_IOVEC_MAX messages are considered.
+ *
+ * @returns the number of leading messages that were fully written.
+ *          disconnected is set if transport was disconnected
+ */
+int
+xmms_ipc_msg_write_transport_many (xmms_ipc_msg_t **msgs, int count,
+                                   xmms_ipc_transport_t *transport,
+                                   bool *disconnected)
+{
+	xmms_ipc_iovec_t iov[XMMS_IPC_IOVEC_MAX];
+	unsigned int len;
+	int i, ret, done;
+
+	x_return_val_if_fail (msgs, 0);
+	x_return_val_if_fail (transport, 0);
+
+	if (count > XMMS_IPC_IOVEC_MAX) {
+		count = XMMS_IPC_IOVEC_MAX;
+	}
+
+	for (i = 0; i < count; i++) {
+		xmmsv_bitbuffer_align (msgs[i]->bb);
+
+		len = xmmsv_bitbuffer_len (msgs[i]->bb) / 8;
+
+		iov[i].base = (char *) (xmmsv_bitbuffer_buffer (msgs[i]->bb) + msgs[i]->xfered);
+		iov[i].len = len - msgs[i]->xfered;
+	}
+
+	ret = xmms_ipc_transport_writev (transport, iov, count);
+
+	if (ret == SOCKET_ERROR) {
+		if (xmms_socket_error_recoverable ()) {
+			return 0;
+		}
+
+		if (disconnected) {
+			*disconnected = true;
+		}
+
+		return 0;
+	} else if (!ret) {
+		if (disconnected) {
+			*disconnected = true;
+		}
+	}
+
+	/* hand out the written bytes in order, the first message that
+	 * didn't fit completely ends the batch */
+	for (done = 0; done < count; done++) {
+		if (ret < iov[done].len) {
+			msgs[done]->xfered += ret;
+			break;
+		}
+
+		msgs[done]->xfered += iov[done].len;
+		ret -= iov[done].len;
+	}
+
+	return done;
+}
+
 /**
  * Try to read message from transport into msg.
  *
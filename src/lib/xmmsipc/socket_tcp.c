@@ -21,6 +21,10 @@
 #include <signal.h>
 #include <assert.h>
 
+#ifndef HAVE_WINSOCK2
+#include <sys/uio.h>
+#endif
+
 #include <xmmsc/xmmsc_ipc_transport.h>
 #include <xmmsc/xmmsc_util.h>
 #include <xmmsc/xmmsc_sockets.h>
@@ -65,6 +69,31 @@ xmms_ipc_tcp_write (xmms_ipc_transport_t *ipct, char *buffer, int len)
 
 }
 
+#ifndef HAVE_WINSOCK2
+static int
+xmms_ipc_tcp_writev (xmms_ipc_transport_t *ipct,
+                     xmms_ipc_iovec_t *iov, int iovcnt)
+{
+	struct iovec vec[XMMS_IPC_IOVEC_MAX];
+	struct msghdr mh;
+	int i;
+
+	x_return_val_if_fail (ipct, -1);
+	x_return_val_if_fail (iovcnt <= XMMS_IPC_IOVEC_MAX, -1);
+
+	for (i = 0; i < iovcnt; i++) {
+		vec[i].iov_base = iov[i].base;
+		vec[i].iov_len = iov[i].len;
+	}
+
+	memset (&mh, 0, sizeof (mh));
+	mh.msg_iov = vec;
+	mh.msg_iovlen = iovcnt;
+
+	return sendmsg (ipct->fd, &mh, 0);
+}
+#endif
+
 xmms_ipc_transport_t *
 xmms_ipc_tcp_client_init (const xmms_url_t *url, int ipv6)
 {
@@ -125,6 +154,9 @@ xmms_ipc_tcp_client_init (const xmms_url_t *url, int ipv6)
 	ipct->path = strdup (url->host);
 	ipct->read_func = xmms_ipc_tcp_read;
 	ipct->write_func = xmms_ipc_tcp_write;
+#ifndef HAVE_WINSOCK2
+	ipct->writev_func = xmms_ipc_tcp_writev;
+#endif
 	ipct->destroy_func = xmms_ipc_tcp_destroy;
 
 	return ipct;
@@ -161,6 +193,9 @@ xmms_ipc_tcp_accept (xmms_ipc_transport_t *transport)
 		ret->fd = fd;
 		ret->read_func = xmms_ipc_tcp_read;
 		ret->write_func = xmms_ipc_tcp_write;
+#ifndef HAVE_WINSOCK2
+		ret->writev_func = xmms_ipc_tcp_writev;
+#endif
 		ret->destroy_func = xmms_ipc_tcp_destroy;
 
 		return ret;
@@ -232,6 +267,9 @@ xmms_ipc_tcp_server_init (const xmms_url_t *url, int ipv6)
 	ipct->path = strdup (url->host);
 	ipct->read_func = xmms_ipc_tcp_read;
 	ipct->write_func = xmms_ipc_tcp_write;
+#ifndef HAVE_WINSOCK2
+	ipct->writev_func = xmms_ipc_tcp_writev;
+#endif
 	ipct->accept_func = xmms_ipc_tcp_accept;
 	ipct->destroy_func = xmms_ipc_tcp_destroy;
 
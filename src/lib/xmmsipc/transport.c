@@ -47,6 +47,32 @@ xmms_ipc_transport_write (xmms_ipc_transport_t *ipct, char *buffer, int len)
 	return ipct->write_func (ipct, buffer, len);
 }
 
+/**
+ * Write several buffers with a single call. Transports that can't
+ * gather writes fall back to writing the first non-empty buffer, so
+ * callers must be prepared to handle short writes either way.
+ */
+int
+xmms_ipc_transport_writev (xmms_ipc_transport_t *ipct,
+                           xmms_ipc_iovec_t *iov, int iovcnt)
+{
+	int i;
+
+	x_return_val_if_fail (iovcnt <= XMMS_IPC_IOVEC_MAX, -1);
+
+	if (ipct->writev_func) {
+		return ipct->writev_func (ipct, iov, iovcnt);
+	}
+
+	for (i = 0; i < iovcnt; i++) {
+		if (iov[i].len > 0) {
+			return ipct->write_func (ipct, iov[i].base, iov[i].len);
+		}
+	}
+
+	return 0;
+}
+
 xmms_socket_t
 xmms_ipc_transport_fd_get (xmms_ipc_transport_t *ipct)
 {
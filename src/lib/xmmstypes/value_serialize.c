@@ -19,6 +19,7 @@
 
 #include <xmmsc/xmmsc_stdbool.h>
 #include <xmmsc/xmmsv.h>
+#include <xmmscpriv/xmmsv.h>
 #include <xmmscpriv/xmmsc_util.h>
 
 static bool _internal_put_on_bb_bin (xmmsv_t *bb, const unsigned char *data, unsigned int len);
@@ -40,11 +41,12 @@ static bool _internal_get_from_bb_int32_positive (xmmsv_t *bb, int32_t *v);
 static bool _internal_get_from_bb_int64 (xmmsv_t *bb, int64_t *v);
 static bool _internal_get_from_bb_float (xmmsv_t *bb, float *v);
 static bool _internal_get_from_bb_string_alloc (xmmsv_t *bb, char **buf, unsigned int *len);
-static bool _internal_get_from_bb_collection_alloc (xmmsv_t *bb, xmmsv_t **coll);
-static bool _internal_get_from_bb_value_dict_alloc (xmmsv_t *bb, xmmsv_t **val);
-static bool _internal_get_from_bb_value_list_alloc (xmmsv_t *bb, xmmsv_t **val);
+static bool _internal_get_from_bb_collection_alloc (xmmsv_t *bb, xmmsv_string_pool_t *pool, xmmsv_t **coll);
+static bool _internal_get_from_bb_value_dict_alloc (xmmsv_t *bb, xmmsv_string_pool_t *pool, xmmsv_t **val);
+static bool _internal_get_from_bb_value_list_alloc (xmmsv_t *bb, xmmsv_string_pool_t *pool, xmmsv_t **val);
 
-static bool _internal_get_from_bb_value_of_type_alloc (xmmsv_t *bb, xmmsv_type_t type, xmmsv_t **val);
+static bool _internal_get_from_bb_value_of_type_alloc (xmmsv_t *bb, xmmsv_string_pool_t *pool, xmmsv_type_t type, xmmsv_t **val);
+static bool _internal_get_from_bb_value_alloc (xmmsv_t *bb, xmmsv_string_pool_t *pool, xmmsv_t **val);
 
 
 static bool
@@ -128,6 +130,34 @@ _internal_put_on_bb_string (xmmsv_t *bb, const char *str)
 	return xmmsv_bitbuffer_put_data (bb, (const unsigned char *) str, strlen (str) + 1);
 }
 
+/* Same format as a list restricted to integers, without boxing the ids */
+static bool
+_internal_put_on_bb_coll_idlist (xmmsv_t *bb, xmmsv_t *coll)
+{
+	int64_t id;
+	int i, size;
+
+	if (!xmmsv_bitbuffer_put_bits (bb, 32, XMMSV_TYPE_INT64)) {
+		return false;
+	}
+
+	size = xmmsv_coll_idlist_get_size (coll);
+	if (!xmmsv_bitbuffer_put_bits (bb, 32, size)) {
+		return false;
+	}
+
+	for (i = 0; i < size; i++) {
+		if (!xmmsv_coll_idlist_get_index_int64 (coll, i, &id)) {
+			return false;
+		}
+		if (!_internal_put_on_bb_int64 (bb, id)) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
 static bool
 _internal_put_on_bb_collection (xmmsv_t *bb, xmmsv_t *coll)
 {
@@ -146,7 +176,7 @@ _internal_put_on_bb_collection (xmmsv_t *bb, xmmsv_t *coll)
 	}
 
 	/* idlist */
-	if (!_internal_put_on_bb_value_list (bb, xmmsv_coll_idlist_get (coll))) {
+	if (!_internal_put_on_bb_coll_idlist (bb, coll)) {
 		return false;
 	}
 
@@ -369,7 +399,36 @@ _internal_get_from_bb_bin_alloc (xmmsv_t *bb,
 }
 
 static bool
-_internal_get_from_bb_collection_alloc (xmmsv_t *bb, xmmsv_t **coll)
+_internal_get_from_bb_coll_idlist (xmmsv_t *bb, xmmsv_t *coll)
+{
+	int32_t len, type;
+	int64_t id;
+
+	if (!_internal_get_from_bb_int32_positive (bb, &type)) {
+		return false;
+	}
+
+	if (!_internal_get_from_bb_int32_positive (bb, &len)) {
+		return false;
+	}
+
+	if (type != XMMSV_TYPE_INT64) {
+		return false;
+	}
+
+	while (len--) {
+		if (!_internal_get_from_bb_int64 (bb, &id)) {
+			return false;
+		}
+		xmmsv_coll_idlist_append (coll, id);
+	}
+
+	return true;
+}
+
+static bool
+_internal_get_from_bb_collection_alloc (xmmsv_t *bb, xmmsv_string_pool_t *pool,
+                                        xmmsv_t **coll)
 {
 	xmmsv_t *dict, *list;
 	int32_t type;
@@ -382,19 +441,17 @@ _internal_get_from_bb_collection_alloc (xmmsv_t *bb, xmmsv_t **coll)
 	*coll = xmmsv_new_coll (type);
 
 	/* Get the attributes */
-	if (!_internal_get_from_bb_value_dict_alloc (bb, &dict)) {
+	if (!_internal_get_from_bb_value_dict_alloc (bb, pool, &dict)) {
 		goto err;
 	}
 	xmmsv_coll_attributes_set (*coll, dict);
 	xmmsv_unref (dict);
 
-	if (!_internal_get_from_bb_value_list_alloc (bb, &list)) {
+	if (!_internal_get_from_bb_coll_idlist (bb, *coll)) {
 		goto err;
 	}
-	xmmsv_coll_idlist_set (*coll, list);
-	xmmsv_unref (list);
 
-	if (!_internal_get_from_bb_value_list_alloc (bb, &list)) {
+	if (!_internal_get_from_bb_value_list_alloc (bb, pool, &list)) {
 		goto err;
 	}
 	xmmsv_coll_operands_set (*coll, list);
@@ -410,7 +467,8 @@ err:
 
 
 static bool
-_internal_get_from_bb_value_dict_alloc (xmmsv_t *bb, xmmsv_t **val)
+_internal_get_from_bb_value_dict_alloc (xmmsv_t *bb, xmmsv_string_pool_t *pool,
+                                        xmmsv_t **val)
 {
 	xmmsv_t *dict;
 	int32_t len;
@@ -430,12 +488,16 @@ _internal_get_from_bb_value_dict_alloc (xmmsv_t *bb, xmmsv_t **val)
 			goto err;
 		}
 
-		if (!xmmsv_bitbuffer_deserialize_value (bb, &v)) {
+		if (!_internal_get_from_bb_value_alloc (bb, pool, &v)) {
 			free (key);
 			goto err;
 		}
 
-		xmmsv_dict_set (dict, key, v);
+		if (pool) {
+			_xmmsv_string_pool_dict_set (pool, dict, key, v);
+		} else {
+			xmmsv_dict_set (dict, key, v);
+		}
 		free (key);
 		xmmsv_unref (v);
 	}
@@ -451,7 +513,8 @@ err:
 }
 
 static bool
-_internal_get_from_bb_value_list_alloc (xmmsv_t *bb, xmmsv_t **val)
+_internal_get_from_bb_value_list_alloc (xmmsv_t *bb, xmmsv_string_pool_t *pool,
+                                        xmmsv_t **val)
 {
 	xmmsv_t *list;
 	int32_t len, type;
@@ -472,7 +535,7 @@ _internal_get_from_bb_value_list_alloc (xmmsv_t *bb, xmmsv_t **val)
 
 		while (len--) {
 			xmmsv_t *v;
-			if (!_internal_get_from_bb_value_of_type_alloc (bb, type, &v)) {
+			if (!_internal_get_from_bb_value_of_type_alloc (bb, pool, type, &v)) {
 				goto err;
 			}
 			xmmsv_list_append (list, v);
@@ -481,7 +544,7 @@ _internal_get_from_bb_value_list_alloc (xmmsv_t *bb, xmmsv_t **val)
 	} else {
 		while (len--) {
 			xmmsv_t *v;
-			if (!xmmsv_bitbuffer_deserialize_value (bb, &v)) {
+			if (!_internal_get_from_bb_value_alloc (bb, pool, &v)) {
 				goto err;
 			}
 			xmmsv_list_append (list, v);
@@ -500,8 +563,8 @@ err:
 }
 
 static bool
-_internal_get_from_bb_value_of_type_alloc (xmmsv_t *bb, xmmsv_type_t type,
-                                           xmmsv_t **val)
+_internal_get_from_bb_value_of_type_alloc (xmmsv_t *bb, xmmsv_string_pool_t *pool,
+                                           xmmsv_type_t type, xmmsv_t **val)
 {
 	int64_t i;
 	float f;
@@ -533,23 +596,27 @@ _internal_get_from_bb_value_of_type_alloc (xmmsv_t *bb, xmmsv_type_t type,
 			if (!_internal_get_from_bb_string_alloc (bb, &s, &len)) {
 				return false;
 			}
-			*val = xmmsv_new_string (s);
+			if (pool) {
+				*val = xmmsv_string_pool_new_string (pool, s);
+			} else {
+				*val = xmmsv_new_string (s);
+			}
 			free (s);
 			break;
 		case XMMSV_TYPE_DICT:
-			if (!_internal_get_from_bb_value_dict_alloc (bb, val)) {
+			if (!_internal_get_from_bb_value_dict_alloc (bb, pool, val)) {
 				return false;
 			}
 			break;
 
 		case XMMSV_TYPE_LIST :
-			if (!_internal_get_from_bb_value_list_alloc (bb, val)) {
+			if (!_internal_get_from_bb_value_list_alloc (bb, pool, val)) {
 				return false;
 			}
 			break;
 
 		case XMMSV_TYPE_COLL:
-			if (!_internal_get_from_bb_collection_alloc (bb, val)) {
+			if (!_internal_get_from_bb_collection_alloc (bb, pool, val)) {
 				return false;
 			}
 			break;
@@ -646,8 +713,9 @@ xmmsv_bitbuffer_serialize_value (xmmsv_t *bb, xmmsv_t *v)
 }
 
 
-int
-xmmsv_bitbuffer_deserialize_value (xmmsv_t *bb, xmmsv_t **val)
+static bool
+_internal_get_from_bb_value_alloc (xmmsv_t *bb, xmmsv_string_pool_t *pool,
+                                   xmmsv_t **val)
 {
 	int32_t type;
 
@@ -655,7 +723,13 @@ xmmsv_bitbuffer_deserialize_value (xmmsv_t *bb, xmmsv_t **val)
 		return false;
 	}
 
-	return _internal_get_from_bb_value_of_type_alloc (bb, type, val);
+	return _internal_get_from_bb_value_of_type_alloc (bb, pool, type, val);
+}
+
+int
+xmmsv_bitbuffer_deserialize_value (xmmsv_t *bb, xmmsv_t **val)
+{
+	return _internal_get_from_bb_value_alloc (bb, NULL, val);
 }
 
 
@@ -704,3 +778,38 @@ xmmsv_deserialize (xmmsv_t *v)
 	xmmsv_unref (bb);
 	return res;
 }
+
+/**
+ * Deserialize a value like #xmmsv_deserialize, taking its strings and
+ * dict keys from a pool. Equal strings within the value, and within
+ * other values deserialized through the same pool, are then kept once.
+ *
+ * This saves memory on large results where strings repeat, like lists
+ * of medialib entries, at some cost in CPU for the unique ones.
+ *
+ * @param pool The pool to take the strings from.
+ * @param v The serialized value, a bin.
+ * @return The value, or NULL on error.
+ */
+xmmsv_t *
+xmmsv_string_pool_deserialize (xmmsv_string_pool_t *pool, xmmsv_t *v)
+{
+	xmmsv_t *bb;
+	xmmsv_t *res;
+	const unsigned char *data;
+	uint32_t len;
+
+	x_return_val_if_fail (pool, NULL);
+
+	if (!xmmsv_get_bin (v, &data, &len))
+		return NULL;
+
+	bb = xmmsv_new_bitbuffer_ro (data, len);
+
+	if (!_internal_get_from_bb_value_alloc (bb, pool, &res)) {
+		xmmsv_unref (bb);
+		return NULL;
+	}
+	xmmsv_unref (bb);
+	return res;
+}
@@ -22,18 +22,35 @@
 #include <xmmsc/xmmsc_idnumbers.h>
 #include <xmmsc/xmmsv.h>
 #include <xmmsc/xmmsv_coll.h>
-#include <xmmsc/xmmsc_util.h>
+#include <xmmscpriv/xmmsc_util.h>
 #include <xmmscpriv/xmmsv.h>
 #include <xmmscpriv/xmms_list.h>
 
+/* Packed id storage, shared between copies of a collection until
+ * one of them is modified. Copies may be dropped on other threads than
+ * the one modifying the collection, so the reference count is atomic.
+ * Copies must still not be taken while the collection is modified. */
+typedef struct xmmsv_coll_ids_St {
+	int ref;
+	int allocated;
+	int64_t *data;
+} xmmsv_coll_ids_t;
+
 struct xmmsv_coll_internal_St {
 	xmmsv_coll_type_t type;
 	xmmsv_t *operands;
 	xmmsv_t *attributes;
+
+	/* The ids are kept in a packed array, and only boxed into a list
+	 * of xmmsv_t when asked for by #xmmsv_coll_idlist_get. The boxed
+	 * list is then used from there on, as its owner may modify it. */
+	xmmsv_coll_ids_t *ids;
+	int ids_size;
 	xmmsv_t *idlist;
 };
 
 static xmmsv_coll_internal_t *_xmmsv_coll_new (xmmsv_coll_type_t type);
+static void _xmmsv_coll_ids_unref (xmmsv_coll_ids_t *ids);
 
 
 /**
@@ -128,9 +145,6 @@ _xmmsv_coll_new (xmmsv_coll_type_t type)
 
 	coll->type = type;
 
-	coll->idlist = xmmsv_new_list ();
-	xmmsv_list_restrict_type (coll->idlist, XMMSV_TYPE_INT64);
-
 	coll->operands = xmmsv_new_list ();
 	xmmsv_list_restrict_type (coll->operands, XMMSV_TYPE_COLL);
 
@@ -154,8 +168,12 @@ _xmmsv_coll_free (xmmsv_coll_internal_t *coll)
 	/* Unref all the operands and attributes */
 	xmmsv_unref (coll->operands);
 	xmmsv_unref (coll->attributes);
-	xmmsv_unref (coll->idlist);
 
+	if (coll->idlist) {
+		xmmsv_unref (coll->idlist);
+	}
+
+	_xmmsv_coll_ids_unref (coll->ids);
 	free (coll);
 }
 
@@ -172,10 +190,106 @@ xmmsv_coll_set_idlist (xmmsv_t *coll, int ids[])
 {
 	unsigned int i;
 
-	xmmsv_list_clear (coll->value.coll->idlist);
+	xmmsv_coll_idlist_clear (coll);
 	for (i = 0; ids[i]; i++) {
-		xmmsv_list_append_int (coll->value.coll->idlist, ids[i]);
+		xmmsv_coll_idlist_append (coll, ids[i]);
+	}
+}
+
+static int
+_xmmsv_coll_idlist_position_normalize (int *pos, int size, int allow_append)
+{
+	x_return_val_if_fail (size >= 0, 0);
+
+	if (*pos < 0) {
+		if (-*pos > size)
+			return 0;
+		*pos = size + *pos;
+	}
+
+	if (*pos > size)
+		return 0;
+
+	if (!allow_append && *pos == size)
+		return 0;
+
+	return 1;
+}
+
+static void
+_xmmsv_coll_ids_unref (xmmsv_coll_ids_t *ids)
+{
+	if (ids && x_atomic_int_dec_and_test (&ids->ref)) {
+		free (ids->data);
+		free (ids);
+	}
+}
+
+/* Whether the ids are only held by the collection asking, so that it
+ * may modify them in place. */
+static int
+_xmmsv_coll_ids_exclusive (xmmsv_coll_ids_t *ids)
+{
+	return ids && x_atomic_int_get (&ids->ref) == 1;
+}
+
+/**
+ * Make sure the packed ids have room for size entries and aren't
+ * shared with another collection, so that they may be modified.
+ */
+static int
+_xmmsv_coll_idlist_reserve (xmmsv_coll_internal_t *coll, int size)
+{
+	xmmsv_coll_ids_t *ids;
+	int64_t *data;
+	int allocated;
+
+	if (_xmmsv_coll_ids_exclusive (coll->ids) && size <= coll->ids->allocated) {
+		return 1;
+	}
+
+	allocated = coll->ids && coll->ids->allocated > 0 ? coll->ids->allocated : 8;
+	while (allocated < size) {
+		allocated <<= 1;
+	}
+
+	if (_xmmsv_coll_ids_exclusive (coll->ids)) {
+		data = realloc (coll->ids->data, allocated * sizeof (int64_t));
+		if (!data) {
+			x_oom ();
+			return 0;
+		}
+
+		coll->ids->data = data;
+		coll->ids->allocated = allocated;
+
+		return 1;
 	}
+
+	ids = x_new0 (xmmsv_coll_ids_t, 1);
+	if (!ids) {
+		x_oom ();
+		return 0;
+	}
+
+	ids->data = malloc (allocated * sizeof (int64_t));
+	if (!ids->data) {
+		x_oom ();
+		free (ids);
+		return 0;
+	}
+
+	ids->ref = 1;
+	ids->allocated = allocated;
+
+	if (coll->ids) {
+		memcpy (ids->data, coll->ids->data, coll->ids_size * sizeof (int64_t));
+		_xmmsv_coll_ids_unref (coll->ids);
+	}
+
+	coll->ids = ids;
+
+	return 1;
 }
 
 static int
@@ -247,30 +361,63 @@ xmmsv_coll_remove_operand (xmmsv_t *coll, xmmsv_t *op)
 /**
  * Append a value to the idlist.
  * @param coll  The collection to update.
- * @param id    The id to append to the idlist.
+ * @param id    The id to append to the idlist.
  * @return  TRUE on success, false otherwise.
  */
 int
 xmmsv_coll_idlist_append (xmmsv_t *coll, int64_t id)
 {
+	xmmsv_coll_internal_t *c;
+
 	x_return_val_if_fail (coll, 0);
 
-	return xmmsv_list_append_int (coll->value.coll->idlist, id);
+	c = coll->value.coll;
+	if (c->idlist) {
+		return xmmsv_list_append_int (c->idlist, id);
+	}
+
+	if (!_xmmsv_coll_idlist_reserve (c, c->ids_size + 1)) {
+		return 0;
+	}
+
+	c->ids->data[c->ids_size++] = id;
+
+	return 1;
 }
 
 /**
  * Insert a value at a given position in the idlist.
  * @param coll  The collection to update.
- * @param id    The id to insert in the idlist.
- * @param index The position at which to insert the value.
+ * @param id    The id to insert in the idlist.
+ * @param index The position at which to insert the value.
  * @return  TRUE on success, false otherwise.
  */
 int
 xmmsv_coll_idlist_insert (xmmsv_t *coll, int index, int64_t id)
 {
+	xmmsv_coll_internal_t *c;
+
 	x_return_val_if_fail (coll, 0);
 
-	return xmmsv_list_insert_int (coll->value.coll->idlist, index, id);
+	c = coll->value.coll;
+	if (c->idlist) {
+		return xmmsv_list_insert_int (c->idlist, index, id);
+	}
+
+	if (!_xmmsv_coll_idlist_position_normalize (&index, c->ids_size, 1)) {
+		return 0;
+	}
+
+	if (!_xmmsv_coll_idlist_reserve (c, c->ids_size + 1)) {
+		return 0;
+	}
+
+	memmove (c->ids->data + index + 1, c->ids->data + index,
+	         (c->ids_size - index) * sizeof (int64_t));
+	c->ids->data[index] = id;
+	c->ids_size++;
+
+	return 1;
 }
 
 /**
@@ -283,9 +430,38 @@ xmmsv_coll_idlist_insert (xmmsv_t *coll, int index, int64_t id)
 int
 xmmsv_coll_idlist_move (xmmsv_t *coll, int index, int newindex)
 {
+	xmmsv_coll_internal_t *c;
+	int64_t id;
+
 	x_return_val_if_fail (coll, 0);
 
-	return xmmsv_list_move (coll->value.coll->idlist, index, newindex);
+	c = coll->value.coll;
+	if (c->idlist) {
+		return xmmsv_list_move (c->idlist, index, newindex);
+	}
+
+	if (!_xmmsv_coll_idlist_position_normalize (&index, c->ids_size, 0)) {
+		return 0;
+	}
+	if (!_xmmsv_coll_idlist_position_normalize (&newindex, c->ids_size, 0)) {
+		return 0;
+	}
+
+	if (!_xmmsv_coll_idlist_reserve (c, c->ids_size)) {
+		return 0;
+	}
+
+	id = c->ids->data[index];
+	if (index < newindex) {
+		memmove (c->ids->data + index, c->ids->data + index + 1,
+		         (newindex - index) * sizeof (int64_t));
+	} else {
+		memmove (c->ids->data + newindex + 1, c->ids->data + newindex,
+		         (index - newindex) * sizeof (int64_t));
+	}
+	c->ids->data[newindex] = id;
+
+	return 1;
 }
 
 /**
@@ -297,9 +473,28 @@ xmmsv_coll_idlist_move (xmmsv_t *coll, int index, int newindex)
 int
 xmmsv_coll_idlist_remove (xmmsv_t *coll, int index)
 {
+	xmmsv_coll_internal_t *c;
+
 	x_return_val_if_fail (coll, 0);
 
-	return xmmsv_list_remove (coll->value.coll->idlist, index);
+	c = coll->value.coll;
+	if (c->idlist) {
+		return xmmsv_list_remove (c->idlist, index);
+	}
+
+	if (!_xmmsv_coll_idlist_position_normalize (&index, c->ids_size, 0)) {
+		return 0;
+	}
+
+	if (!_xmmsv_coll_idlist_reserve (c, c->ids_size)) {
+		return 0;
+	}
+
+	c->ids_size--;
+	memmove (c->ids->data + index, c->ids->data + index + 1,
+	         (c->ids_size - index) * sizeof (int64_t));
+
+	return 1;
 }
 
 /**
@@ -310,9 +505,20 @@ xmmsv_coll_idlist_remove (xmmsv_t *coll, int index)
 int
 xmmsv_coll_idlist_clear (xmmsv_t *coll)
 {
+	xmmsv_coll_internal_t *c;
+
 	x_return_val_if_fail (coll, 0);
 
-	return xmmsv_list_clear (coll->value.coll->idlist);
+	c = coll->value.coll;
+	if (c->idlist) {
+		return xmmsv_list_clear (c->idlist);
+	}
+
+	_xmmsv_coll_ids_unref (c->ids);
+	c->ids = NULL;
+	c->ids_size = 0;
+
+	return 1;
 }
 
 /**
@@ -327,7 +533,7 @@ xmmsv_coll_idlist_get_index_int32 (xmmsv_t *coll, int index, int32_t *val)
 {
 	int64_t raw_val;
 	x_return_val_if_fail (coll, 0);
-	if (xmmsv_list_get_int (coll->value.coll->idlist, index, &raw_val)) {
+	if (xmmsv_coll_idlist_get_index_int64 (coll, index, &raw_val)) {
 		*val = INT64_TO_INT32 (raw_val);
 		return true;
 	}
@@ -344,8 +550,22 @@ xmmsv_coll_idlist_get_index_int32 (xmmsv_t *coll, int index, int32_t *val)
 int
 xmmsv_coll_idlist_get_index_int64 (xmmsv_t *coll, int index, int64_t *val)
 {
+	xmmsv_coll_internal_t *c;
+
 	x_return_val_if_fail (coll, 0);
-	return xmmsv_list_get_int (coll->value.coll->idlist, index, val);
+
+	c = coll->value.coll;
+	if (c->idlist) {
+		return xmmsv_list_get_int (c->idlist, index, val);
+	}
+
+	if (!_xmmsv_coll_idlist_position_normalize (&index, c->ids_size, 0)) {
+		return 0;
+	}
+
+	*val = c->ids->data[index];
+
+	return 1;
 }
 
 /**
@@ -358,9 +578,26 @@ xmmsv_coll_idlist_get_index_int64 (xmmsv_t *coll, int index, int64_t *val)
 int
 xmmsv_coll_idlist_set_index (xmmsv_t *coll, int index, int64_t val)
 {
+	xmmsv_coll_internal_t *c;
+
 	x_return_val_if_fail (coll, 0);
 
-	return xmmsv_list_set_int (coll->value.coll->idlist, index, val);
+	c = coll->value.coll;
+	if (c->idlist) {
+		return xmmsv_list_set_int (c->idlist, index, val);
+	}
+
+	if (!_xmmsv_coll_idlist_position_normalize (&index, c->ids_size, 0)) {
+		return 0;
+	}
+
+	if (!_xmmsv_coll_idlist_reserve (c, c->ids_size)) {
+		return 0;
+	}
+
+	c->ids->data[index] = val;
+
+	return 1;
 }
 
 /**
@@ -373,7 +610,11 @@ xmmsv_coll_idlist_get_size (xmmsv_t *coll)
 {
 	x_return_val_if_fail (coll, 0);
 
-	return xmmsv_list_get_size (coll->value.coll->idlist);
+	if (coll->value.coll->idlist) {
+		return xmmsv_list_get_size (coll->value.coll->idlist);
+	}
+
+	return coll->value.coll->ids_size;
 }
 
 /**
@@ -412,15 +653,36 @@ xmmsv_coll_get_type (xmmsv_t *coll)
  * Note that this must not be confused with the content of the collection,
  * which must be queried using xmmsc_coll_query_ids!
  *
+ * The ids are boxed into a list on the first call, prefer the
+ * xmmsv_coll_idlist_get_index and xmmsv_coll_idlist_get_size functions
+ * when only reading the ids.
+ *
  * @param coll  The collection to consider.
  * @return The 0-terminated list of ids.
  */
 xmmsv_t *
 xmmsv_coll_idlist_get (xmmsv_t *coll)
 {
+	xmmsv_coll_internal_t *c;
+	int i;
+
 	x_return_null_if_fail (coll);
 
-	return coll->value.coll->idlist;
+	c = coll->value.coll;
+	if (!c->idlist) {
+		c->idlist = xmmsv_new_list ();
+		xmmsv_list_restrict_type (c->idlist, XMMSV_TYPE_INT64);
+
+		for (i = 0; i < c->ids_size; i++) {
+			xmmsv_list_append_int (c->idlist, c->ids->data[i]);
+		}
+
+		_xmmsv_coll_ids_unref (c->ids);
+		c->ids = NULL;
+		c->ids_size = 0;
+	}
+
+	return c->idlist;
 }
 
 /**
@@ -440,7 +702,52 @@ xmmsv_coll_idlist_set (xmmsv_t *coll, xmmsv_t *idlist)
 
 	old = coll->value.coll->idlist;
 	coll->value.coll->idlist = xmmsv_ref (idlist);
-	xmmsv_unref (old);
+	if (old) {
+		xmmsv_unref (old);
+	}
+
+	_xmmsv_coll_ids_unref (coll->value.coll->ids);
+	coll->value.coll->ids = NULL;
+	coll->value.coll->ids_size = 0;
+}
+
+/**
+ * Replace the idlist of a collection by a copy of another's. The packed
+ * ids are shared until either collection is modified. The source must
+ * not be modified by another thread meanwhile.
+ *
+ * @param coll The collection in which to set the idlist.
+ * @param source The collection to copy the idlist from.
+ */
+void
+_xmmsv_coll_idlist_copy (xmmsv_t *coll, xmmsv_t *source)
+{
+	xmmsv_coll_internal_t *c, *s;
+	int64_t id;
+	int i;
+
+	x_return_if_fail (coll);
+	x_return_if_fail (source);
+
+	c = coll->value.coll;
+	s = source->value.coll;
+
+	xmmsv_coll_idlist_clear (coll);
+
+	/* A boxed list may be modified behind our back, copy the values. */
+	if (c->idlist || s->idlist) {
+		for (i = 0; xmmsv_coll_idlist_get_index_int64 (source, i, &id); i++) {
+			xmmsv_coll_idlist_append (coll, id);
+		}
+		return;
+	}
+
+	if (s->ids) {
+		x_atomic_int_inc (&s->ids->ref);
+	}
+
+	c->ids = s->ids;
+	c->ids_size = s->ids_size;
 }
 
 xmmsv_t *
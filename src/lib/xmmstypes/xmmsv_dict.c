@@ -22,7 +22,7 @@
 
 typedef struct xmmsv_dict_data_St {
 	uint32_t hash;
-	char *str;
+	char *str; /* shared, see _xmmsv_string_new */
 	xmmsv_t *value;
 } xmmsv_dict_data_t;
 
@@ -48,7 +48,7 @@ static void _xmmsv_dict_iter_free (xmmsv_dict_iter_t *it);
 #define START_SIZE 2
 
 /* MurmurHash2, by Austin Appleby */
-static uint32_t
+uint32_t
 _xmmsv_dict_hash (const void *key, int len)
 {
 	/* 'm' and 'r' are mixing constants generated offline.
@@ -157,10 +157,13 @@ _xmmsv_dict_insert (xmmsv_dict_internal_t *dict, xmmsv_dict_data_t data, int all
 		/* If the key already exists we change the data*/
 		xmmsv_unref (dict->data[pos].value);
 		dict->data[pos].value = data.value;
+		/* and the key we were handed isn't needed */
+		if (!alloc)
+			_xmmsv_string_unref (data.str);
 	} else {
 		/* Otherwise we insert a new entry */
 		if (alloc)
-			data.str = strdup (data.str);
+			data.str = _xmmsv_string_new (data.str, strlen (data.str));
 		dict->elems++;
 		/* If we found a deleted entry before an empty one we use the free entry */
 		if (deleted != -1) {
@@ -176,7 +179,7 @@ _xmmsv_dict_insert (xmmsv_dict_internal_t *dict, xmmsv_dict_data_t data, int all
 static void
 _xmmsv_dict_remove (xmmsv_dict_internal_t *dict, int pos)
 {
-	free ((void*)dict->data[pos].str);
+	_xmmsv_string_unref (dict->data[pos].str);
 	dict->data[pos].str = DELETED_STR;
 	xmmsv_unref (dict->data[pos].value);
 	dict->data[pos].value = NULL;
@@ -246,7 +249,7 @@ _xmmsv_dict_free (xmmsv_dict_internal_t *dict)
 	for (i = (1 << dict->size) - 1; i >= 0; i--) {
 		if (dict->data[i].str != NULL) {
 			if (dict->data[i].str != DELETED_STR) {
-				free (dict->data[i].str);
+				_xmmsv_string_unref (dict->data[i].str);
 				xmmsv_unref (dict->data[i].value);
 			}
 			dict->data[i].str = NULL;
@@ -432,6 +435,39 @@ xmmsv_dict_set (xmmsv_t *dictv, const char *key, xmmsv_t *val)
 	return ret;
 }
 
+/**
+ * Like #xmmsv_dict_set, but the dict shares the key instead of
+ * copying it.
+ * @internal
+ *
+ * @param key A string made with #_xmmsv_string_new.
+ * @param hash The hash of the key, from #_xmmsv_dict_hash.
+ */
+int
+_xmmsv_dict_set_shared (xmmsv_t *dictv, char *key, uint32_t hash, xmmsv_t *val)
+{
+	xmmsv_dict_internal_t *dict;
+	xmmsv_dict_data_t data;
+
+	x_return_val_if_fail (key, 0);
+	x_return_val_if_fail (val, 0);
+	x_return_val_if_fail (dictv, 0);
+	x_return_val_if_fail (xmmsv_is_type (dictv, XMMSV_TYPE_DICT), 0);
+
+	data.hash = hash;
+	data.str = _xmmsv_string_ref (key);
+	data.value = xmmsv_ref (val);
+	dict = dictv->value.dict;
+
+	if (((dict->elems * 10) >> dict->size) > HASH_FILL_LIM) {
+		_xmmsv_dict_resize (dict);
+	}
+
+	_xmmsv_dict_insert (dict, data, 0);
+
+	return 1;
+}
+
 /**
  * Remove the element corresponding to a given key in the dict
  * #xmmsv_t (if it exists).
@@ -483,7 +519,7 @@ xmmsv_dict_clear (xmmsv_t *dictv)
 	for (i = (1 << dict->size) - 1; i >= 0; i--) {
 		if (dict->data[i].str != NULL) {
 			if (dict->data[i].str != DELETED_STR) {
-				free (dict->data[i].str);
+				_xmmsv_string_unref (dict->data[i].str);
 				xmmsv_unref (dict->data[i].value);
 			}
 			dict->data[i].str = NULL;
@@ -79,7 +79,7 @@ _xmmsv_free (xmmsv_t *val)
 			val->value.error = NULL;
 			break;
 		case XMMSV_TYPE_STRING :
-			free (val->value.string);
+			_xmmsv_string_unref (val->value.string);
 			val->value.string = NULL;
 			break;
 		case XMMSV_TYPE_COLL:
@@ -194,7 +194,7 @@ xmmsv_new_string (const char *s)
 
 	val = _xmmsv_new (XMMSV_TYPE_STRING);
 	if (val) {
-		val->value.string = strdup (s);
+		val->value.string = _xmmsv_string_new (s, strlen (s));
 	}
 
 	return val;
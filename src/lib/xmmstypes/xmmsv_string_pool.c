@@ -0,0 +1,317 @@
+/*  XMMS2 - X Music Multiplexer System
+ *  Copyright (C) 2003-2020 XMMS2 Team
+ *
+ *  PLUGINS ARE NOT CONSIDERED TO BE DERIVED WORK !!!
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ */
+
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+
+#include <xmmscpriv/xmmsv.h>
+#include <xmmscpriv/xmmsc_util.h>
+
+#include <xmmsc/xmmsv.h>
+
+/** @file
+ * Strings shared between values.
+ *
+ * The strings of string values and the keys of dicts are immutable and
+ * reference counted, so that the same string can back any number of
+ * them. A string pool hands out the same string value for equal
+ * strings, and dicts filled through it share their keys with these
+ * values. A large result, where a few keys and artist names repeat in
+ * every entry, then holds each of them only once.
+ *
+ * Like values themselves, pools are not thread safe. The strings are
+ * reference counted atomically, so values sharing them may still be
+ * dropped from different threads.
+ */
+
+typedef struct xmmsv_string_St {
+	int ref;
+	char str[];
+} xmmsv_string_t;
+
+#define STRING(s) ((xmmsv_string_t *) ((s) - offsetof (xmmsv_string_t, str)))
+
+typedef struct xmmsv_string_pool_entry_St {
+	uint32_t hash;
+	xmmsv_t *value;
+} xmmsv_string_pool_entry_t;
+
+struct xmmsv_string_pool_St {
+	int elems;
+	int size;
+	xmmsv_string_pool_entry_t *data;
+};
+
+#define POOL_START_SIZE 4
+
+/**
+ * Copy a string into a new shared string.
+ * @internal
+ *
+ * @param s The string to copy.
+ * @param len The length of s, not counting the terminating NUL.
+ * @return The string, with one reference held by the caller.
+ */
+char *
+_xmmsv_string_new (const char *s, unsigned int len)
+{
+	xmmsv_string_t *string;
+
+	string = malloc (offsetof (xmmsv_string_t, str) + len + 1);
+	if (!string) {
+		x_oom ();
+		return NULL;
+	}
+
+	string->ref = 1;
+	memcpy (string->str, s, len);
+	string->str[len] = '\0';
+
+	return string->str;
+}
+
+/**
+ * Reference a string made with #_xmmsv_string_new.
+ * @internal
+ */
+char *
+_xmmsv_string_ref (char *str)
+{
+	x_return_val_if_fail (str, NULL);
+
+	x_atomic_int_inc (&STRING (str)->ref);
+
+	return str;
+}
+
+/**
+ * Drop a reference to a string made with #_xmmsv_string_new, freeing
+ * it with the last one.
+ * @internal
+ */
+void
+_xmmsv_string_unref (char *str)
+{
+	xmmsv_string_t *string;
+
+	if (!str) {
+		return;
+	}
+
+	string = STRING (str);
+	if (x_atomic_int_dec_and_test (&string->ref)) {
+		free (string);
+	}
+}
+
+/**
+ * Allocates a new string pool.
+ * @return The new pool. Must be freed with #xmmsv_string_pool_free.
+ */
+xmmsv_string_pool_t *
+xmmsv_string_pool_new (void)
+{
+	xmmsv_string_pool_t *pool;
+
+	pool = x_new0 (xmmsv_string_pool_t, 1);
+	if (!pool) {
+		x_oom ();
+		return NULL;
+	}
+
+	return pool;
+}
+
+/**
+ * Free a string pool. Values made through the pool, and dicts sharing
+ * its keys, stay valid.
+ *
+ * @param pool The pool to free.
+ */
+void
+xmmsv_string_pool_free (xmmsv_string_pool_t *pool)
+{
+	int i;
+
+	x_return_if_fail (pool);
+
+	if (pool->data) {
+		for (i = 0; i < (1 << pool->size); i++) {
+			if (pool->data[i].value) {
+				xmmsv_unref (pool->data[i].value);
+			}
+		}
+		free (pool->data);
+	}
+
+	free (pool);
+}
+
+/**
+ * Get the number of distinct strings in the pool.
+ *
+ * @param pool The pool.
+ * @return The number of strings, or -1 on error.
+ */
+int
+xmmsv_string_pool_get_size (xmmsv_string_pool_t *pool)
+{
+	x_return_val_if_fail (pool, -1);
+
+	return pool->elems;
+}
+
+/* Doubles the size of the table, starting it if there is none */
+static int
+_xmmsv_string_pool_resize (xmmsv_string_pool_t *pool)
+{
+	xmmsv_string_pool_entry_t *old_data;
+	int i, old_size, mask, bucket;
+
+	old_data = pool->data;
+	old_size = pool->data ? 1 << pool->size : 0;
+
+	pool->size = pool->data ? pool->size + 1 : POOL_START_SIZE;
+	pool->data = x_new0 (xmmsv_string_pool_entry_t, 1 << pool->size);
+	if (!pool->data) {
+		x_oom ();
+		pool->data = old_data;
+		pool->size--;
+		return 0;
+	}
+
+	mask = (1 << pool->size) - 1;
+	for (i = 0; i < old_size; i++) {
+		if (old_data[i].value) {
+			bucket = old_data[i].hash & mask;
+			while (pool->data[bucket].value) {
+				bucket = (bucket + 1) & mask;
+			}
+			pool->data[bucket] = old_data[i];
+		}
+	}
+
+	free (old_data);
+
+	return 1;
+}
+
+/* Finds the string value for s, adding it to the pool if it isn't there
+ * yet, and its hash. Returns a borrowed reference, or NULL if s is not
+ * valid UTF-8.
+ */
+static xmmsv_t *
+_xmmsv_string_pool_lookup (xmmsv_string_pool_t *pool, const char *s,
+                           uint32_t *hash)
+{
+	xmmsv_t *value;
+	unsigned int len;
+	int mask, bucket;
+
+	len = strlen (s);
+	*hash = _xmmsv_dict_hash (s, len);
+
+	/* Keep the table at most half full */
+	if (pool->elems * 2 >= (pool->data ? 1 << pool->size : 0)) {
+		if (!_xmmsv_string_pool_resize (pool)) {
+			return NULL;
+		}
+	}
+
+	mask = (1 << pool->size) - 1;
+	bucket = *hash & mask;
+
+	while ((value = pool->data[bucket].value) != NULL) {
+		if (pool->data[bucket].hash == *hash &&
+		    strcmp (value->value.string, s) == 0) {
+			return value;
+		}
+		bucket = (bucket + 1) & mask;
+	}
+
+	/* Equal strings were validated when they entered the pool */
+	if (!xmmsv_utf8_validate (s)) {
+		return NULL;
+	}
+
+	value = _xmmsv_new (XMMSV_TYPE_STRING);
+	if (!value) {
+		return NULL;
+	}
+
+	value->value.string = _xmmsv_string_new (s, len);
+
+	pool->data[bucket].hash = *hash;
+	pool->data[bucket].value = value;
+	pool->elems++;
+
+	return value;
+}
+
+/**
+ * Get a string #xmmsv_t from the pool, holding a copy of the string.
+ * Equal strings give the same value.
+ *
+ * @param pool The pool to get the value from.
+ * @param s The string.
+ * @return The string #xmmsv_t. Must be unreferenced with
+ * #xmmsv_unref.
+ */
+xmmsv_t *
+xmmsv_string_pool_new_string (xmmsv_string_pool_t *pool, const char *s)
+{
+	xmmsv_t *value;
+	uint32_t hash;
+
+	x_return_val_if_fail (pool, NULL);
+	x_return_val_if_fail (s, NULL);
+
+	value = _xmmsv_string_pool_lookup (pool, s, &hash);
+	x_return_val_if_fail (value, NULL);
+
+	return xmmsv_ref (value);
+}
+
+/**
+ * Insert an element under the given key in the dict #xmmsv_t, like
+ * #xmmsv_dict_set, sharing the key with the string in the pool.
+ * @internal
+ *
+ * @param pool The pool to get the key from.
+ * @param dictv A #xmmsv_t containing a dict.
+ * @param key The key in the dict.
+ * @param val The new element to insert in the dict.
+ * @return 1 upon success otherwise 0
+ */
+int
+_xmmsv_string_pool_dict_set (xmmsv_string_pool_t *pool, xmmsv_t *dictv,
+                             const char *key, xmmsv_t *val)
+{
+	xmmsv_t *value;
+	uint32_t hash;
+
+	x_return_val_if_fail (pool, 0);
+	x_return_val_if_fail (key, 0);
+
+	value = _xmmsv_string_pool_lookup (pool, key, &hash);
+	if (!value) {
+		/* not something a string value can hold, keep a copy */
+		return xmmsv_dict_set (dictv, key, val);
+	}
+
+	return _xmmsv_dict_set_shared (dictv, value->value.string, hash, val);
+}
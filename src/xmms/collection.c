@@ -30,6 +30,7 @@
 #include <xmmspriv/xmms_xform.h>
 #include <xmmspriv/xmms_streamtype.h>
 #include <xmmspriv/xmms_medialib.h>
+#include <xmmspriv/xmms_ipc.h>
 #include <xmms/xmms_ipc.h>
 #include <xmms/xmms_log.h>
 
@@ -72,12 +73,81 @@ typedef enum {
 	XMMS_COLLECTION_FIND_STATE_NOMATCH,
 } coll_find_state_t;
 
+/* What a find result depends on besides the collection and the media
+ * itself, stored next to the state in the find cache.
+ */
+typedef enum {
+	XMMS_COLLECTION_FIND_DEPENDS_REFS = 1 << 2,
+	XMMS_COLLECTION_FIND_DEPENDS_MEDIALIB = 1 << 3,
+	XMMS_COLLECTION_FIND_UNCACHEABLE = 1 << 4,
+} coll_find_flags_t;
+
+#define XMMS_COLLECTION_FIND_STATE_MASK 0x3
+
+/* Cached media ids per namespace before the cache is flushed */
+#define XMMS_COLLECTION_FIND_CACHE_SIZE 1024
+
+/** The collections checked by a single find, done once pending is 0 */
+typedef struct {
+	guint pending;
+	GMutex mutex;
+	GCond cond;
+} coll_find_batch_t;
+
+/** A single collection to check for a media in find */
+typedef struct {
+	xmms_coll_dag_t *dag;
+	coll_find_batch_t *batch;
+	xmms_medialib_entry_t mid;
+	gchar *name;
+	xmmsv_t *coll;
+	guint result;
+} coll_find_job_t;
+
+typedef struct {
+	const gchar *name;
+	guint flags;
+} coll_find_drop_t;
+
+/** The id set kept in memory for a materialized collection */
+typedef struct {
+	xmmsv_t *coll;
+	/* id -> position in list + 1, shared with running queries */
+	GHashTable *ids;
+	/* the same ids, for constant time random picks */
+	GArray *list;
+	/* ids changed since the set was last brought up to date */
+	GHashTable *pending;
+	/* "namespace/name" of the saved collections the set is built from */
+	GHashTable *depends;
+	/* the set has to be computed from scratch */
+	gboolean stale;
+	/* property the weights were read from, and the weight of each id */
+	gchar *weight;
+	GHashTable *weights;
+	/* alias table over list for weighted picks, see coll_materialized_alias */
+	gdouble *alias_prob;
+	guint *alias;
+	gboolean alias_valid;
+} coll_materialized_t;
+
+/* Changed ids to re-test before recomputing the whole set instead */
+#define XMMS_COLLECTION_MATERIALIZED_MAX_PENDING 1024
+
 typedef struct add_metadata_from_tree_user_data_St {
 	xmms_medialib_entry_t entry;
 	xmms_medialib_session_t *session;
 	const gchar* src;
 } add_metadata_from_tree_user_data_t;
 
+/** An open query cursor, rows are built from the ids when fetched */
+typedef struct {
+	gint32 client;
+	xmmsv_t *fetch;
+	GArray *ids;
+	guint position;
+} coll_cursor_t;
+
 
 /* Functions */
 
@@ -103,10 +173,27 @@ static void bind_all_references (xmms_coll_dag_t *dag, xmmsv_t *coll, xmmsv_t *p
 static void unbind_all_references (xmms_coll_dag_t *dag, xmmsv_t *coll, xmmsv_t *parent, void *udata);
 
 static void coll_unref (void *coll);
-
-static void build_match_table (gpointer key, gpointer value, gpointer udata);
-static gboolean find_unchecked (gpointer name, gpointer value, gpointer udata);
-static void build_list_matches (gpointer key, gpointer value, gpointer udata);
+static void coll_cursor_free (gpointer data);
+static gboolean coll_cursor_match_client (gpointer key, gpointer value, gpointer udata);
+static void on_client_disconnected (xmms_object_t *object, xmmsv_t *val, gpointer udata);
+
+static coll_find_state_t xmms_collection_find_eval (xmms_coll_dag_t *dag, xmmsv_t *coll, xmms_medialib_entry_t mid, guint *flags);
+static void xmms_collection_find_job (gpointer data, gpointer udata);
+static void xmms_collection_find_cache_drop (xmms_coll_dag_t *dag, xmms_collection_namespace_id_t nsid, const gchar *name, guint flags);
+static void on_medialib_entry_changed (xmms_object_t *object, xmmsv_t *val, gpointer udata);
+
+static coll_materialized_t *coll_materialized_new (xmmsv_t *coll);
+static void coll_materialized_free (gpointer data);
+static gboolean coll_materialized_pick (xmms_coll_dag_t *dag, coll_materialized_t *mat, const gchar *weight, xmms_medialib_entry_t *entry);
+static void xmms_collection_materialized_compute (xmms_coll_dag_t *dag, coll_materialized_t *mat);
+static gboolean xmms_collection_materialized_reachable (xmms_coll_dag_t *dag, xmmsv_t *coll);
+static void xmms_collection_materialized_oneoff (xmms_coll_dag_t *dag, xmmsv_t *coll);
+static void xmms_collection_materialized_refresh (xmms_coll_dag_t *dag, xmmsv_t *coll);
+static void xmms_collection_materialized_invalidate (xmms_coll_dag_t *dag, const gchar *name, const gchar *namespace);
+static void xmms_collection_materialized_update (xmms_coll_dag_t *dag, xmmsv_t *coll);
+static gboolean xmms_collection_materialized_pick (xmms_coll_dag_t *dag, xmmsv_t *coll, const gchar *weight, xmms_medialib_entry_t *entry);
+static GHashTable *xmms_collection_materialized_lookup (xmmsv_t *coll, gpointer udata);
+static void xmms_collection_edit_lock (xmms_coll_dag_t *dag, gboolean lock);
 
 static xmmsv_t * xmms_collection_client_get (xmms_coll_dag_t *dag, const gchar *collname, const gchar *namespace, xmms_error_t *error);
 static xmmsv_t * xmms_collection_client_list (xmms_coll_dag_t *dag, const gchar *namespace, xmms_error_t *error);
@@ -118,6 +205,9 @@ static void xmms_collection_client_rename (xmms_coll_dag_t *dag, const gchar *fr
 static xmmsv_t * xmms_collection_client_query_infos (xmms_coll_dag_t *dag, xmmsv_t *coll, int limit_start, int limit_len, xmmsv_t *fetch, xmmsv_t *group, xmms_error_t *err);
 static xmmsv_t * xmms_collection_client_query (xmms_coll_dag_t *dag, xmmsv_t *coll, xmmsv_t *fetch, xmms_error_t *err);
 static xmmsv_t *xmms_collection_client_idlist_from_playlist (xmms_coll_dag_t *dag, const gchar *mediainfo, xmms_error_t *err);
+static xmmsv_t *xmms_collection_client_query_open (xmms_coll_dag_t *dag, xmmsv_t *coll, xmmsv_t *fetch, gint32 client, xmms_error_t *err);
+static xmmsv_t *xmms_collection_client_query_fetch (xmms_coll_dag_t *dag, gint32 cursorid, gint32 count, gint32 client, xmms_error_t *err);
+static void xmms_collection_client_query_close (xmms_coll_dag_t *dag, gint32 cursorid, gint32 client, xmms_error_t *err);
 
 
 #include "collection_ipc.c"
@@ -135,9 +225,26 @@ xmms_collection_changed_msg_new (xmms_collection_changed_action_t type,
 void
 xmms_collection_changed_msg_send (xmms_coll_dag_t *colldag, xmmsv_t *dict)
 {
+	const gchar *name, *namespace;
+	xmms_collection_namespace_id_t nsid = XMMS_COLLECTION_NSID_INVALID;
+
 	g_return_if_fail (colldag);
 	g_return_if_fail (dict);
 
+	/* Anything referencing the changed collection may have changed too */
+	if (xmmsv_dict_entry_get_string (dict, "name", &name) &&
+	    xmmsv_dict_entry_get_string (dict, "namespace", &namespace)) {
+		nsid = xmms_collection_get_namespace_id (namespace);
+	}
+	if (nsid == XMMS_COLLECTION_NSID_INVALID) {
+		name = NULL;
+	} else {
+		xmms_collection_materialized_invalidate (colldag, name, namespace);
+	}
+
+	xmms_collection_find_cache_drop (colldag, nsid, name,
+	                                 XMMS_COLLECTION_FIND_DEPENDS_REFS);
+
 	xmms_object_emit (XMMS_OBJECT (colldag),
 	                  XMMS_IPC_SIGNAL_COLLECTION_CHANGED,
 	                  dict);
@@ -165,6 +272,33 @@ struct xmms_coll_dag_St {
 
 	GMutex mutex;
 
+	/* open query cursors, by cursor id */
+	GHashTable *cursors;
+	gint32 next_cursor;
+	GMutex cursor_mutex;
+
+	/* find results, by media id then collection name, per namespace */
+	GHashTable *find_cache[XMMS_COLLECTION_NUM_NAMESPACES];
+	guint find_generation;
+	GMutex find_mutex;
+	GThreadPool *find_pool;
+
+	/* id sets of materialized collections, by collection */
+	GHashTable *materialized;
+	gboolean materialized_purge;
+	GMutex materialized_mutex;
+	/* the source of random picks outside any saved collection, whose
+	 * id set is kept until picks move on to another such source */
+	xmmsv_t *materialized_oneoff;
+
+	/* saved collections and their operands, rebuilt once dirty */
+	GHashTable *reachable;
+	gint reachable_dirty;
+
+	/* blocks the in place edits of playlists, provided by the playlist */
+	xmms_collection_edit_lock_func_t edit_lock;
+	gpointer edit_lock_udata;
+
 	xmms_medialib_t *medialib;
 };
 
@@ -176,10 +310,14 @@ xmms_coll_dag_t *
 xmms_collection_init (xmms_medialib_t *medialib)
 {
 	xmms_coll_dag_t *ret;
+	xmms_ipc_manager_t *manager;
 	gint i;
 
 	ret = xmms_object_new (xmms_coll_dag_t, xmms_collection_destroy);
 	g_mutex_init (&ret->mutex);
+	g_mutex_init (&ret->cursor_mutex);
+	g_mutex_init (&ret->find_mutex);
+	g_mutex_init (&ret->materialized_mutex);
 
 	xmms_object_ref (medialib);
 	ret->medialib = medialib;
@@ -187,6 +325,39 @@ xmms_collection_init (xmms_medialib_t *medialib)
 	for (i = 0; i < XMMS_COLLECTION_NUM_NAMESPACES; ++i) {
 		ret->collrefs[i] = g_hash_table_new_full (g_str_hash, g_str_equal,
 		                                          g_free, coll_unref);
+		ret->find_cache[i] = g_hash_table_new_full (NULL, NULL, NULL,
+		                                            (GDestroyNotify) g_hash_table_destroy);
+	}
+
+	ret->find_pool = g_thread_pool_new (xmms_collection_find_job, NULL,
+	                                    g_get_num_processors (), FALSE, NULL);
+
+	xmms_object_connect (XMMS_OBJECT (medialib),
+	                     XMMS_IPC_SIGNAL_MEDIALIB_ENTRY_ADDED,
+	                     on_medialib_entry_changed, ret);
+
+	xmms_object_connect (XMMS_OBJECT (medialib),
+	                     XMMS_IPC_SIGNAL_MEDIALIB_ENTRY_CHANGED,
+	                     on_medialib_entry_changed, ret);
+
+	xmms_object_connect (XMMS_OBJECT (medialib),
+	                     XMMS_IPC_SIGNAL_MEDIALIB_ENTRY_REMOVED,
+	                     on_medialib_entry_changed, ret);
+
+	ret->cursors = g_hash_table_new_full (NULL, NULL, NULL, coll_cursor_free);
+	ret->materialized = g_hash_table_new_full (NULL, NULL, NULL, coll_materialized_free);
+	ret->reachable = g_hash_table_new_full (NULL, NULL, coll_unref, NULL);
+	ret->reachable_dirty = TRUE;
+
+	xmms_medialib_materialized_func_set (medialib,
+	                                     xmms_collection_materialized_lookup,
+	                                     ret);
+
+	manager = xmms_ipc_manager_get ();
+	if (manager != NULL) {
+		xmms_object_connect (XMMS_OBJECT (manager),
+		                     XMMS_IPC_SIGNAL_IPC_MANAGER_CLIENT_DISCONNECTED,
+		                     on_client_disconnected, ret);
 	}
 
 	xmms_collection_register_ipc_commands (XMMS_OBJECT (ret));
@@ -457,6 +628,10 @@ xmms_collection_client_get (xmms_coll_dag_t *dag, const gchar *name,
 		return NULL;
 	}
 
+	if (nsid != XMMS_COLLECTION_NSID_COLLECTIONS) {
+		xmms_collection_edit_lock (dag, TRUE);
+	}
+
 	g_mutex_lock (&dag->mutex);
 
 	coll = xmms_collection_get_pointer (dag, name, nsid);
@@ -470,6 +645,10 @@ xmms_collection_client_get (xmms_coll_dag_t *dag, const gchar *name,
 
 	g_mutex_unlock (&dag->mutex);
 
+	if (nsid != XMMS_COLLECTION_NSID_COLLECTIONS) {
+		xmms_collection_edit_lock (dag, FALSE);
+	}
+
 	return result;
 }
 
@@ -509,6 +688,11 @@ xmms_collection_client_list (xmms_coll_dag_t *dag, const gchar *namespace,
 
 
 /** Find all collections in the given namespace that contain a given media.
+ *
+ * Rather than querying each collection, the collection trees are
+ * evaluated against the single media, short-circuiting at each operator.
+ * The collections are checked in parallel on private copies, and the
+ * results are cached until the collection or the media changes.
  *
  * @param dag  The collection DAG.
  * @param mid  The id of the media.
@@ -521,11 +705,16 @@ xmms_collection_client_find (xmms_coll_dag_t *dag, gint32 mid, const gchar *name
                              xmms_error_t *err)
 {
 	xmms_collection_namespace_id_t nsid;
+	xmms_medialib_session_t *session;
+	GHashTable *cached;
+	GHashTableIter iter;
+	GPtrArray *jobs;
+	coll_find_batch_t batch;
+	gpointer name, coll, value;
+	coll_find_job_t *job;
 	xmmsv_t *result;
-	gchar *open_name;
-	GHashTable *match_table;
-	xmmsv_t *coll, *filter_coll;
-	xmmsv_t *idlist;
+	gboolean valid;
+	guint generation, pending, i;
 
 	/* Verify namespace */
 	nsid = xmms_collection_get_namespace_id (namespace);
@@ -538,40 +727,127 @@ xmms_collection_client_find (xmms_coll_dag_t *dag, gint32 mid, const gchar *name
 		return NULL;
 	}
 
-	/* Prepare the match table of all collections for the given namespace */
-	match_table = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
-	xmms_collection_foreach_in_namespace (dag, nsid, build_match_table, match_table);
+	result = xmmsv_new_list ();
+
+	do {
+		session = xmms_medialib_session_begin_ro (dag->medialib);
+		valid = xmms_medialib_check_id (session, mid);
+	} while (!xmms_medialib_session_commit (session));
+
+	/* No such media, no collection can contain it */
+	if (!valid) {
+		return result;
+	}
+
+	jobs = g_ptr_array_new ();
+	pending = 0;
 
-	filter_coll = xmmsv_new_coll (XMMS_COLLECTION_TYPE_EQUALS);
-	xmmsv_coll_attribute_set_string (filter_coll, "type", "id");
-	xmms_collection_set_int_attr (filter_coll, "value", mid);
+	/* Take cached results, and private copies of the collections to check */
+	if (nsid == XMMS_COLLECTION_NSID_PLAYLISTS) {
+		xmms_collection_edit_lock (dag, TRUE);
+	}
+
+	g_mutex_lock (&dag->mutex);
+	g_mutex_lock (&dag->find_mutex);
 
-	/* While not all collections have been checked, check next */
-	while (g_hash_table_find (match_table, find_unchecked, &open_name) != NULL) {
-		coll_find_state_t *match = g_new (coll_find_state_t, 1);
-		coll = xmms_collection_get_pointer (dag, open_name, nsid);
+	generation = dag->find_generation;
+	cached = g_hash_table_lookup (dag->find_cache[nsid], GINT_TO_POINTER (mid));
 
-		xmmsv_coll_add_operand (filter_coll, coll);
-		idlist = xmms_collection_query_ids (dag, coll, err);
+	g_hash_table_iter_init (&iter, dag->collrefs[nsid]);
+	while (g_hash_table_iter_next (&iter, &name, &coll)) {
+		job = g_new0 (coll_find_job_t, 1);
+		job->dag = dag;
+		job->mid = mid;
+		job->name = g_strdup (name);
 
-		if (xmmsv_list_get_size (idlist) > 0) {
-			*match = XMMS_COLLECTION_FIND_STATE_MATCH;
+		if (cached != NULL &&
+		    (value = g_hash_table_lookup (cached, name)) != NULL) {
+			job->result = GPOINTER_TO_UINT (value);
 		} else {
-			*match = XMMS_COLLECTION_FIND_STATE_NOMATCH;
+			job->coll = xmmsv_copy (coll);
+			pending++;
 		}
 
-		xmmsv_unref (idlist);
-		xmmsv_coll_remove_operand (filter_coll, coll);
-		g_hash_table_replace (match_table, g_strdup (open_name), match);
+		g_ptr_array_add (jobs, job);
 	}
 
-	xmmsv_unref (filter_coll);
+	g_mutex_unlock (&dag->find_mutex);
+	g_mutex_unlock (&dag->mutex);
 
-	result = xmmsv_new_list ();
+	if (nsid == XMMS_COLLECTION_NSID_PLAYLISTS) {
+		xmms_collection_edit_lock (dag, FALSE);
+	}
+
+	/* Evaluate the uncached collections, without holding the DAG */
+	if (pending > 1) {
+		batch.pending = pending;
+		g_mutex_init (&batch.mutex);
+		g_cond_init (&batch.cond);
+
+		for (i = 0; i < jobs->len; i++) {
+			job = g_ptr_array_index (jobs, i);
+			if (job->coll != NULL) {
+				job->batch = &batch;
+				g_thread_pool_push (dag->find_pool, job, NULL);
+			}
+		}
+
+		g_mutex_lock (&batch.mutex);
+		while (batch.pending > 0) {
+			g_cond_wait (&batch.cond, &batch.mutex);
+		}
+		g_mutex_unlock (&batch.mutex);
+
+		g_cond_clear (&batch.cond);
+		g_mutex_clear (&batch.mutex);
+	} else {
+		for (i = 0; i < jobs->len; i++) {
+			job = g_ptr_array_index (jobs, i);
+			if (job->coll != NULL) {
+				xmms_collection_find_job (job, NULL);
+			}
+		}
+	}
+
+	g_mutex_lock (&dag->find_mutex);
+
+	/* Only keep the results if nothing changed while evaluating */
+	if (pending > 0 && generation == dag->find_generation) {
+		cached = g_hash_table_lookup (dag->find_cache[nsid], GINT_TO_POINTER (mid));
+		if (cached == NULL) {
+			if (g_hash_table_size (dag->find_cache[nsid]) >= XMMS_COLLECTION_FIND_CACHE_SIZE) {
+				g_hash_table_remove_all (dag->find_cache[nsid]);
+			}
+			cached = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+			g_hash_table_insert (dag->find_cache[nsid], GINT_TO_POINTER (mid), cached);
+		}
+
+		for (i = 0; i < jobs->len; i++) {
+			job = g_ptr_array_index (jobs, i);
+			if (job->coll != NULL &&
+			    !(job->result & XMMS_COLLECTION_FIND_UNCACHEABLE)) {
+				g_hash_table_replace (cached, g_strdup (job->name),
+				                      GUINT_TO_POINTER (job->result));
+			}
+		}
+	}
+
+	g_mutex_unlock (&dag->find_mutex);
 
 	/* List matching collections */
-	g_hash_table_foreach (match_table, build_list_matches, result);
-	g_hash_table_destroy (match_table);
+	for (i = 0; i < jobs->len; i++) {
+		job = g_ptr_array_index (jobs, i);
+		if ((job->result & XMMS_COLLECTION_FIND_STATE_MASK) == XMMS_COLLECTION_FIND_STATE_MATCH) {
+			xmmsv_list_append_string (result, job->name);
+		}
+		if (job->coll != NULL) {
+			xmmsv_unref (job->coll);
+		}
+		g_free (job->name);
+		g_free (job);
+	}
+
+	g_ptr_array_free (jobs, TRUE);
 
 	return result;
 }
@@ -638,6 +914,26 @@ xmms_collection_client_rename (xmms_coll_dag_t *dag, const gchar *from_name,
 
 }
 
+/* Fetch specification for the list of ids matched by a collection */
+static xmmsv_t *
+xmms_collection_query_ids_spec (void)
+{
+	xmmsv_t *metadata, *get;
+
+	get = xmmsv_build_list (XMMSV_LIST_ENTRY_STR ("id"),
+	                        XMMSV_LIST_END);
+
+	metadata = xmmsv_build_dict (XMMSV_DICT_ENTRY_STR ("type", "metadata"),
+	                             XMMSV_DICT_ENTRY_STR ("aggregate", "first"),
+	                             XMMSV_DICT_ENTRY ("get", get),
+	                             XMMSV_DICT_END);
+
+	return xmmsv_build_dict (XMMSV_DICT_ENTRY_STR ("type", "cluster-list"),
+	                         XMMSV_DICT_ENTRY_STR ("cluster-by", "position"),
+	                         XMMSV_DICT_ENTRY ("data", metadata),
+	                         XMMSV_DICT_END);
+}
+
 /** Find the ids of the media matched by a collection.
  *
  * @param dag  The collection DAG.
@@ -652,21 +948,9 @@ xmmsv_t *
 xmms_collection_query_ids (xmms_coll_dag_t *dag, xmmsv_t *coll,
                            xmms_error_t *err)
 {
-	xmmsv_t *ret, *spec, *metadata, *get;
-
-	get = xmmsv_build_list (XMMSV_LIST_ENTRY_STR ("id"),
-	                        XMMSV_LIST_END);
-
-	metadata = xmmsv_build_dict (XMMSV_DICT_ENTRY_STR ("type", "metadata"),
-	                             XMMSV_DICT_ENTRY_STR ("aggregate", "first"),
-	                             XMMSV_DICT_ENTRY ("get", get),
-	                             XMMSV_DICT_END);
-
-	spec = xmmsv_build_dict (XMMSV_DICT_ENTRY_STR ("type", "cluster-list"),
-	                         XMMSV_DICT_ENTRY_STR ("cluster-by", "position"),
-	                         XMMSV_DICT_ENTRY ("data", metadata),
-	                         XMMSV_DICT_END);
+	xmmsv_t *ret, *spec;
 
+	spec = xmms_collection_query_ids_spec ();
 	ret = xmms_collection_client_query (dag, coll, spec, err);
 	xmmsv_unref (spec);
 
@@ -824,6 +1108,7 @@ xmms_collection_client_query (xmms_coll_dag_t *dag, xmmsv_t *coll,
 	g_mutex_lock (&dag->mutex);
 
 	xmms_collection_apply_to_collection (dag, coll, bind_all_references, NULL);
+	xmms_collection_materialized_refresh (dag, coll);
 
 	do {
 		session = xmms_medialib_session_begin_ro (dag->medialib);
@@ -835,6 +1120,205 @@ xmms_collection_client_query (xmms_coll_dag_t *dag, xmmsv_t *coll,
 	return ret;
 }
 
+/** Check that a fetch specification is valid, without running a query.
+ *
+ * @param dag  The collection DAG.
+ * @param fetch  The fetch specification to check.
+ * @param err  If the specification is invalid, a message is stored in it.
+ * @return TRUE if the fetch specification is valid.
+ */
+static gboolean
+xmms_collection_validate_fetch (xmms_coll_dag_t *dag, xmmsv_t *fetch,
+                                xmms_error_t *err)
+{
+	s4_sourcepref_t *sourcepref;
+	xmms_fetch_info_t *info;
+	xmms_fetch_spec_t *spec;
+	gboolean valid;
+
+	sourcepref = xmms_medialib_get_source_preferences (dag->medialib);
+
+	info = xmms_fetch_info_new (sourcepref);
+	spec = xmms_fetch_spec_new (fetch, info, sourcepref, err);
+	valid = (spec != NULL);
+
+	s4_sourcepref_unref (sourcepref);
+	xmms_fetch_spec_free (spec);
+	xmms_fetch_info_free (info);
+
+	return valid;
+}
+
+/** Open a cursor over the media matched by a collection.
+ *
+ * Only the ordered media ids are kept with the cursor, the rows are
+ * built page by page by #xmms_collection_client_query_fetch, so the
+ * memory used by a query is bounded by the page size.
+ *
+ * @param dag  The collection DAG.
+ * @param coll  The collection to query.
+ * @param fetch  The fetch specification applied to each row.
+ * @param client  The client owning the cursor.
+ * @param err  If an error occurs, a message is stored in it.
+ * @return A dict with the cursor id and the number of rows.
+ */
+static xmmsv_t *
+xmms_collection_client_query_open (xmms_coll_dag_t *dag, xmmsv_t *coll,
+                                   xmmsv_t *fetch, gint32 client,
+                                   xmms_error_t *err)
+{
+	coll_cursor_t *cursor;
+	xmmsv_t *ids;
+	gint32 id, cursorid, count;
+	gint i;
+
+	if (!xmms_collection_validate_fetch (dag, fetch, err)) {
+		return NULL;
+	}
+
+	ids = xmms_collection_query_ids (dag, coll, err);
+	if (ids == NULL) {
+		return NULL;
+	}
+
+	count = xmmsv_list_get_size (ids);
+
+	cursor = g_new0 (coll_cursor_t, 1);
+	cursor->client = client;
+	cursor->fetch = xmmsv_ref (fetch);
+	cursor->ids = g_array_sized_new (FALSE, FALSE, sizeof (gint32), count);
+
+	for (i = 0; xmmsv_list_get_int (ids, i, &id); i++) {
+		g_array_append_val (cursor->ids, id);
+	}
+
+	xmmsv_unref (ids);
+
+	g_mutex_lock (&dag->cursor_mutex);
+
+	do {
+		cursorid = ++dag->next_cursor;
+		if (cursorid <= 0) {
+			cursorid = dag->next_cursor = 1;
+		}
+	} while (g_hash_table_lookup (dag->cursors, GINT_TO_POINTER (cursorid)));
+
+	g_hash_table_insert (dag->cursors, GINT_TO_POINTER (cursorid), cursor);
+
+	g_mutex_unlock (&dag->cursor_mutex);
+
+	return xmmsv_build_dict (XMMSV_DICT_ENTRY_INT ("id", cursorid),
+	                         XMMSV_DICT_ENTRY_INT ("count", count),
+	                         XMMSV_DICT_END);
+}
+
+/** Fetch the next rows of an open cursor.
+ *
+ * @param dag  The collection DAG.
+ * @param cursorid  The id of the cursor.
+ * @param count  The maximum number of rows to fetch.
+ * @param client  The client owning the cursor.
+ * @param err  If an error occurs, a message is stored in it.
+ * @return A list with one entry per row, empty when the cursor is exhausted.
+ */
+static xmmsv_t *
+xmms_collection_client_query_fetch (xmms_coll_dag_t *dag, gint32 cursorid,
+                                    gint32 count, gint32 client,
+                                    xmms_error_t *err)
+{
+	coll_cursor_t *cursor;
+	xmmsv_t *idlist, *fetch, *spec, *ret;
+	guint i, end;
+
+	if (count <= 0) {
+		xmms_error_set (err, XMMS_ERROR_INVAL, "invalid number of rows");
+		return NULL;
+	}
+
+	count = MIN (count, XMMS_COLLECTION_CURSOR_MAX_ROWS);
+
+	g_mutex_lock (&dag->cursor_mutex);
+
+	cursor = g_hash_table_lookup (dag->cursors, GINT_TO_POINTER (cursorid));
+	if (cursor == NULL || cursor->client != client) {
+		g_mutex_unlock (&dag->cursor_mutex);
+		xmms_error_set (err, XMMS_ERROR_NOENT, "no such cursor");
+		return NULL;
+	}
+
+	idlist = xmmsv_new_coll (XMMS_COLLECTION_TYPE_IDLIST);
+
+	end = MIN (cursor->position + count, cursor->ids->len);
+	for (i = cursor->position; i < end; i++) {
+		xmmsv_coll_idlist_append (idlist, g_array_index (cursor->ids, gint32, i));
+	}
+	cursor->position = end;
+
+	fetch = xmmsv_ref (cursor->fetch);
+
+	g_mutex_unlock (&dag->cursor_mutex);
+
+	if (xmmsv_coll_idlist_get_size (idlist) == 0) {
+		xmmsv_unref (fetch);
+		xmmsv_unref (idlist);
+		return xmmsv_new_list ();
+	}
+
+	/* The idlist keeps the order of the page, cluster it by position to
+	 * get one result per row. */
+	spec = xmmsv_build_dict (XMMSV_DICT_ENTRY_STR ("type", "cluster-list"),
+	                         XMMSV_DICT_ENTRY_STR ("cluster-by", "position"),
+	                         XMMSV_DICT_ENTRY ("data", fetch),
+	                         XMMSV_DICT_END);
+
+	ret = xmms_collection_client_query (dag, idlist, spec, err);
+
+	xmmsv_unref (spec);
+	xmmsv_unref (idlist);
+
+	return ret;
+}
+
+/** Close an open cursor.
+ *
+ * @param dag  The collection DAG.
+ * @param cursorid  The id of the cursor.
+ * @param client  The client owning the cursor.
+ * @param err  If an error occurs, a message is stored in it.
+ */
+static void
+xmms_collection_client_query_close (xmms_coll_dag_t *dag, gint32 cursorid,
+                                    gint32 client, xmms_error_t *err)
+{
+	coll_cursor_t *cursor;
+
+	g_mutex_lock (&dag->cursor_mutex);
+
+	cursor = g_hash_table_lookup (dag->cursors, GINT_TO_POINTER (cursorid));
+	if (cursor == NULL || cursor->client != client) {
+		xmms_error_set (err, XMMS_ERROR_NOENT, "no such cursor");
+	} else {
+		g_hash_table_remove (dag->cursors, GINT_TO_POINTER (cursorid));
+	}
+
+	g_mutex_unlock (&dag->cursor_mutex);
+}
+
+/** Close all the cursors left open by a disconnected client. */
+static void
+on_client_disconnected (xmms_object_t *object, xmmsv_t *val, gpointer udata)
+{
+	xmms_coll_dag_t *dag = (xmms_coll_dag_t *) udata;
+	gint32 client;
+
+	g_return_if_fail (xmmsv_get_int32 (val, &client));
+
+	g_mutex_lock (&dag->cursor_mutex);
+	g_hash_table_foreach_remove (dag->cursors, coll_cursor_match_client,
+	                             GINT_TO_POINTER (client));
+	g_mutex_unlock (&dag->cursor_mutex);
+}
+
 /**
  * Update a reference to point to a new collection.
  *
@@ -849,6 +1333,8 @@ xmms_collection_update_pointer (xmms_coll_dag_t *dag, const gchar *name,
 {
 	g_hash_table_replace (dag->collrefs[nsid], g_strdup (name), newtarget);
 	xmmsv_ref (newtarget);
+
+	g_atomic_int_set (&dag->reachable_dirty, TRUE);
 }
 
 /** Find the collection structure corresponding to the given name in the given namespace.
@@ -967,12 +1453,55 @@ xmms_collection_find_alias (xmms_coll_dag_t *dag, xmms_collection_namespace_id_t
  */
 xmms_medialib_entry_t
 xmms_collection_get_random_media (xmms_coll_dag_t *dag, xmmsv_t *source)
+{
+	return xmms_collection_get_weighted_random_media (dag, source, NULL);
+}
+
+/**
+ * Get a random media entry from the given collection, weighted by an
+ * integer property of the media.
+ *
+ * The ids of the source are kept in memory, like a materialized
+ * collection, so each pick is a draw from an array (or alias table when
+ * weighted) rather than a query.
+ *
+ * @param dag  The collection DAG.
+ * @param source  The collection to query.
+ * @param weight  The property to weight by (value + 1, missing counts as
+ *                0), or NULL to pick uniformly.
+ * @return  A random media from the source collection, or 0 if none found.
+ */
+xmms_medialib_entry_t
+xmms_collection_get_weighted_random_media (xmms_coll_dag_t *dag,
+                                           xmmsv_t *source,
+                                           const gchar *weight)
 {
 	xmms_medialib_session_t *session;
 	xmms_medialib_entry_t ret;
+	gboolean picked;
+	xmmsv_t *target;
 
 	g_mutex_lock (&dag->mutex);
 	xmms_collection_apply_to_collection (dag, source, bind_all_references, NULL);
+	xmms_collection_materialized_refresh (dag, source);
+
+	/* Keep the ids of the source, materialized or not, and pick from them */
+	target = source;
+	if (xmmsv_coll_is_type (source, XMMS_COLLECTION_TYPE_REFERENCE)) {
+		xmmsv_list_get (xmmsv_coll_operands_get (source), 0, &target);
+	}
+
+	if (!xmms_collection_materialized_reachable (dag, target)) {
+		xmms_collection_materialized_oneoff (dag, target);
+	}
+
+	xmms_collection_materialized_update (dag, target);
+	picked = xmms_collection_materialized_pick (dag, target, weight, &ret);
+
+	if (picked) {
+		g_mutex_unlock (&dag->mutex);
+		return ret;
+	}
 
 	do {
 		session = xmms_medialib_session_begin_ro (dag->medialib);
@@ -996,15 +1525,50 @@ static void
 xmms_collection_destroy (xmms_object_t *object)
 {
 	xmms_coll_dag_t *dag = (xmms_coll_dag_t *)object;
+	xmms_ipc_manager_t *manager;
 	gint i;
 
 	XMMS_DBG ("Deactivating collection object.");
 
 	g_return_if_fail (dag);
 
+	manager = xmms_ipc_manager_get ();
+	if (manager != NULL) {
+		xmms_object_disconnect (XMMS_OBJECT (manager),
+		                        XMMS_IPC_SIGNAL_IPC_MANAGER_CLIENT_DISCONNECTED,
+		                        on_client_disconnected, dag);
+	}
+
+	g_hash_table_destroy (dag->cursors);
+	g_mutex_clear (&dag->cursor_mutex);
+
+	xmms_object_disconnect (XMMS_OBJECT (dag->medialib),
+	                        XMMS_IPC_SIGNAL_MEDIALIB_ENTRY_REMOVED,
+	                        on_medialib_entry_changed, dag);
+
+	xmms_object_disconnect (XMMS_OBJECT (dag->medialib),
+	                        XMMS_IPC_SIGNAL_MEDIALIB_ENTRY_CHANGED,
+	                        on_medialib_entry_changed, dag);
+
+	xmms_object_disconnect (XMMS_OBJECT (dag->medialib),
+	                        XMMS_IPC_SIGNAL_MEDIALIB_ENTRY_ADDED,
+	                        on_medialib_entry_changed, dag);
+
+	xmms_medialib_materialized_func_set (dag->medialib, NULL, NULL);
+	g_hash_table_destroy (dag->materialized);
+	g_mutex_clear (&dag->materialized_mutex);
+	g_hash_table_destroy (dag->reachable);
+
 	xmms_object_unref (dag->medialib);
 	g_mutex_clear (&dag->mutex);
 
+	g_thread_pool_free (dag->find_pool, FALSE, TRUE);
+
+	for (i = 0; i < XMMS_COLLECTION_NUM_NAMESPACES; ++i) {
+		g_hash_table_destroy (dag->find_cache[i]);
+	}
+	g_mutex_clear (&dag->find_mutex);
+
 	for (i = 0; i < XMMS_COLLECTION_NUM_NAMESPACES; ++i) {
 		g_hash_table_destroy (dag->collrefs[i]);  /* dag is freed here */
 	}
@@ -1461,6 +2025,33 @@ xmms_collection_has_reference_to (xmms_coll_dag_t *dag, xmmsv_t *coll,
 }
 
 
+/** Set the function that blocks the in place edits of playlists.
+ *
+ * Playlists are edited in place holding only the lock of the playlist,
+ * not the DAG. Copies of playlists share their ids with the original,
+ * so they are taken while edits are blocked, before locking the DAG.
+ *
+ * @param dag  The collection DAG.
+ * @param func  The function, or NULL to remove it.
+ * @param udata  User data passed to the function.
+ */
+void
+xmms_collection_edit_lock_func_set (xmms_coll_dag_t *dag,
+                                    xmms_collection_edit_lock_func_t func,
+                                    gpointer udata)
+{
+	dag->edit_lock = func;
+	dag->edit_lock_udata = udata;
+}
+
+static void
+xmms_collection_edit_lock (xmms_coll_dag_t *dag, gboolean lock)
+{
+	if (dag->edit_lock != NULL) {
+		dag->edit_lock (lock, dag->edit_lock_udata);
+	}
+}
+
 /** Apply a function to all the collections in a given namespace.
  *
  * @param dag  The collection DAG.
@@ -1592,14 +2183,42 @@ value_match_save_key (gpointer key, gpointer val, gpointer udata)
 	return found;
 }
 
-xmmsv_t *
-xmms_collection_snapshot (xmms_coll_dag_t *dag)
+/**
+ * Drop the bound reference targets from a copied collection, references
+ * are stored by name.
+ */
+static void
+unbind_copied_references (const gchar *name, xmmsv_t *coll, void *udata)
 {
-	GHashTableIter iter;
-	xmmsv_t *result, *collections, *playlists, *coll, *active_playlist;
-	gchar *name;
+	xmms_coll_dag_t *dag = (xmms_coll_dag_t *) udata;
 
-	result = xmmsv_new_dict ();
+	if (xmmsv_is_type (coll, XMMSV_TYPE_COLL)) {
+		xmms_collection_apply_to_collection (dag, coll, unbind_all_references, NULL);
+	}
+}
+
+/**
+ * Take a snapshot of all collections and playlists.
+ *
+ * Copying a collection shares its ids with the original until either
+ * is modified, so the DAG is only locked for as long as it takes to
+ * copy the collection trees. The live collections are left untouched.
+ * The caller blocks the edits of playlists meanwhile, see
+ * #xmms_playlist_lock.
+ *
+ * @param dag  The collection DAG.
+ * @param written  If not NULL, a table from playlist names to the
+ * collections they are, filled with the playlists in the snapshot.
+ * @returns  The snapshot.
+ */
+xmmsv_t *
+xmms_collection_snapshot (xmms_coll_dag_t *dag, GHashTable *written)
+{
+	GHashTableIter iter;
+	xmmsv_t *result, *collections, *playlists, *coll, *active_playlist;
+	gchar *name;
+
+	result = xmmsv_new_dict ();
 
 	collections = xmmsv_new_dict ();
 	xmmsv_dict_set (result, "collections", collections);
@@ -1611,8 +2230,6 @@ xmms_collection_snapshot (xmms_coll_dag_t *dag)
 
 	g_mutex_lock (&dag->mutex);
 
-	xmms_collection_apply_to_all_collections (dag, unbind_all_references, NULL);
-
 	g_hash_table_iter_init (&iter, dag->collrefs[XMMS_COLLECTION_NSID_COLLECTIONS]);
 	while (g_hash_table_iter_next (&iter, (gpointer *) &name, (gpointer *) &coll)) {
 		xmmsv_t *copy = xmmsv_copy (coll);
@@ -1623,12 +2240,20 @@ xmms_collection_snapshot (xmms_coll_dag_t *dag)
 	active_playlist = xmms_collection_get_pointer (dag, XMMS_ACTIVE_PLAYLIST,
 	                                               XMMS_COLLECTION_NSID_PLAYLISTS);
 
+	if (written != NULL) {
+		g_hash_table_remove_all (written);
+	}
+
 	g_hash_table_iter_init (&iter, dag->collrefs[XMMS_COLLECTION_NSID_PLAYLISTS]);
 	while (g_hash_table_iter_next (&iter, (gpointer *) &name, (gpointer *) &coll)) {
 		if (coll != active_playlist || strcmp (name, XMMS_ACTIVE_PLAYLIST) != 0) {
 			xmmsv_t *copy = xmmsv_copy (coll);
 			xmmsv_dict_set (playlists, name, copy);
 			xmmsv_unref (copy);
+
+			if (written != NULL) {
+				g_hash_table_insert (written, g_strdup (name), xmmsv_ref (coll));
+			}
 		}
 	}
 
@@ -1637,10 +2262,100 @@ xmms_collection_snapshot (xmms_coll_dag_t *dag)
 	xmmsv_dict_set_string (result, "active-playlist", name);
 	g_free (name);
 
-	xmms_collection_apply_to_all_collections (dag, bind_all_references, NULL);
+	g_mutex_unlock (&dag->mutex);
+
+	xmmsv_dict_foreach (collections, unbind_copied_references, dag);
+	xmmsv_dict_foreach (playlists, unbind_copied_references, dag);
+
+	return result;
+}
+
+/**
+ * Take a snapshot of only the given collections, laid out like the
+ * one returned by #xmms_collection_snapshot. Names that don't exist
+ * anymore are recorded as none, so that applying the result on top of
+ * an older snapshot removes them.
+ *
+ * Playlists that are still the collection they were last written as,
+ * according to written, are left out. Their edits are recorded
+ * elsewhere. The table is updated for the playlists that are written.
+ * As with #xmms_collection_snapshot, playlist edits must be blocked.
+ *
+ * @param dag  The collection DAG.
+ * @param names  A set of collection names for each namespace.
+ * @param written  A table from playlist names to the collections they
+ * were last written as, or NULL to write all given playlists.
+ * @returns  The partial snapshot.
+ */
+xmmsv_t *
+xmms_collection_snapshot_partial (xmms_coll_dag_t *dag, GHashTable **names,
+                                  GHashTable *written)
+{
+	static const gchar *keys[XMMS_COLLECTION_NUM_NAMESPACES] = {
+		"collections", "playlists"
+	};
+	GHashTableIter iter;
+	xmmsv_t *result, *dict, *coll, *copy, *active_playlist;
+	gchar *name;
+	gint nsid;
+
+	result = xmmsv_new_dict ();
+
+	g_mutex_lock (&dag->mutex);
+
+	for (nsid = 0; nsid < XMMS_COLLECTION_NUM_NAMESPACES; nsid++) {
+		dict = xmmsv_new_dict ();
+		xmmsv_dict_set (result, keys[nsid], dict);
+		xmmsv_unref (dict);
+
+		g_hash_table_iter_init (&iter, names[nsid]);
+		while (g_hash_table_iter_next (&iter, (gpointer *) &name, NULL)) {
+			if (nsid == XMMS_COLLECTION_NSID_PLAYLISTS &&
+			    strcmp (name, XMMS_ACTIVE_PLAYLIST) == 0) {
+				continue;
+			}
+
+			coll = g_hash_table_lookup (dag->collrefs[nsid], name);
+
+			if (nsid == XMMS_COLLECTION_NSID_PLAYLISTS && written != NULL) {
+				if (coll != NULL && g_hash_table_lookup (written, name) == coll) {
+					continue;
+				}
+				if (coll != NULL) {
+					g_hash_table_insert (written, g_strdup (name), xmmsv_ref (coll));
+				} else {
+					g_hash_table_remove (written, name);
+				}
+			}
+
+			if (coll == NULL) {
+				copy = xmmsv_new_none ();
+			} else {
+				copy = xmmsv_copy (coll);
+			}
+
+			xmmsv_dict_set (dict, name, copy);
+			xmmsv_unref (copy);
+		}
+	}
+
+	active_playlist = xmms_collection_get_pointer (dag, XMMS_ACTIVE_PLAYLIST,
+	                                               XMMS_COLLECTION_NSID_PLAYLISTS);
+
+	name = xmms_collection_find_alias (dag, XMMS_COLLECTION_NSID_PLAYLISTS,
+	                                   active_playlist, XMMS_ACTIVE_PLAYLIST);
+	if (name != NULL) {
+		xmmsv_dict_set_string (result, "active-playlist", name);
+		g_free (name);
+	}
 
 	g_mutex_unlock (&dag->mutex);
 
+	for (nsid = 0; nsid < XMMS_COLLECTION_NUM_NAMESPACES; nsid++) {
+		xmmsv_dict_get (result, keys[nsid], &dict);
+		xmmsv_dict_foreach (dict, unbind_copied_references, dag);
+	}
+
 	return result;
 }
 
@@ -1923,41 +2638,925 @@ coll_unref (void *coll)
 }
 
 
+/** Free an open query cursor.
+ *
+ * @param data  The cursor to free.
+ */
+static void
+coll_cursor_free (gpointer data)
+{
+	coll_cursor_t *cursor = data;
+
+	xmmsv_unref (cursor->fetch);
+	g_array_free (cursor->ids, TRUE);
+	g_free (cursor);
+}
+
+/* Match the cursors owned by the client given as udata. */
+static gboolean
+coll_cursor_match_client (gpointer key, gpointer value, gpointer udata)
+{
+	coll_cursor_t *cursor = value;
+
+	return cursor->client == GPOINTER_TO_INT (udata);
+}
+
+
 
 /* ============  FIND / COLLECTION MATCH FUNCTIONS ============ */
 
-/* Generate a build_match hashtable, states initialized to UNCHECKED. */
+/* Check whether the media is matched by a collection by querying it,
+ * narrowed down to that single media. Without a collection, check the
+ * media exists at all.
+ */
+static coll_find_state_t
+xmms_collection_find_query (xmms_coll_dag_t *dag, xmmsv_t *coll,
+                            xmms_medialib_entry_t mid, guint *flags)
+{
+	xmms_medialib_session_t *session;
+	xmms_error_t err;
+	xmmsv_t *filter, *spec, *ids;
+	coll_find_state_t state;
+
+	filter = xmmsv_new_coll (XMMS_COLLECTION_TYPE_EQUALS);
+	xmmsv_coll_attribute_set_string (filter, "type", "id");
+	xmms_collection_set_int_attr (filter, "value", mid);
+
+	if (coll != NULL) {
+		xmmsv_coll_add_operand (filter, coll);
+	} else {
+		xmmsv_t *universe = xmmsv_new_coll (XMMS_COLLECTION_TYPE_UNIVERSE);
+		xmmsv_coll_add_operand (filter, universe);
+		xmmsv_unref (universe);
+	}
+
+	spec = xmms_collection_query_ids_spec ();
+
+	do {
+		xmms_error_reset (&err);
+		session = xmms_medialib_session_begin_ro (dag->medialib);
+		ids = xmms_medialib_query (session, filter, spec, &err);
+	} while (!xmms_medialib_session_commit (session));
+
+	if (ids != NULL && xmmsv_list_get_size (ids) > 0) {
+		state = XMMS_COLLECTION_FIND_STATE_MATCH;
+	} else {
+		state = XMMS_COLLECTION_FIND_STATE_NOMATCH;
+	}
+
+	/* Don't remember a failed query as a mismatch */
+	if (xmms_error_iserror (&err)) {
+		*flags |= XMMS_COLLECTION_FIND_UNCACHEABLE;
+	}
+
+	if (ids != NULL) {
+		xmmsv_unref (ids);
+	}
+	xmmsv_unref (spec);
+	xmmsv_unref (filter);
+
+	return state;
+}
+
+/* Evaluate a (private, bound) collection tree against a single media,
+ * stopping as soon as the result of an operator is known. Only filters
+ * need to look at the media properties, and only once their operand
+ * matched. The dependencies of the result are added to flags.
+ */
+static coll_find_state_t
+xmms_collection_find_eval (xmms_coll_dag_t *dag, xmmsv_t *coll,
+                           xmms_medialib_entry_t mid, guint *flags)
+{
+	xmmsv_t *operands, *operand, *probe, *universe;
+	coll_find_state_t state;
+	const gchar *target;
+	gint64 id;
+	gint i;
+
+	operands = xmmsv_coll_operands_get (coll);
+
+	switch (xmmsv_coll_get_type (coll)) {
+		case XMMS_COLLECTION_TYPE_UNIVERSE:
+			return XMMS_COLLECTION_FIND_STATE_MATCH;
+
+		case XMMS_COLLECTION_TYPE_REFERENCE:
+			if (xmmsv_coll_attribute_get_string (coll, "reference", &target) &&
+			    strcmp (target, "All Media") == 0) {
+				return XMMS_COLLECTION_FIND_STATE_MATCH;
+			}
+			*flags |= XMMS_COLLECTION_FIND_DEPENDS_REFS;
+			if (!xmmsv_list_get (operands, 0, &operand)) {
+				return XMMS_COLLECTION_FIND_STATE_NOMATCH;
+			}
+			return xmms_collection_find_eval (dag, operand, mid, flags);
+
+		case XMMS_COLLECTION_TYPE_UNION:
+			for (i = 0; xmmsv_list_get (operands, i, &operand); i++) {
+				state = xmms_collection_find_eval (dag, operand, mid, flags);
+				if (state == XMMS_COLLECTION_FIND_STATE_MATCH) {
+					return state;
+				}
+			}
+			return XMMS_COLLECTION_FIND_STATE_NOMATCH;
+
+		case XMMS_COLLECTION_TYPE_INTERSECTION:
+			for (i = 0; xmmsv_list_get (operands, i, &operand); i++) {
+				state = xmms_collection_find_eval (dag, operand, mid, flags);
+				if (state != XMMS_COLLECTION_FIND_STATE_MATCH) {
+					return state;
+				}
+			}
+			return i > 0 ? XMMS_COLLECTION_FIND_STATE_MATCH : XMMS_COLLECTION_FIND_STATE_NOMATCH;
+
+		case XMMS_COLLECTION_TYPE_COMPLEMENT:
+			if (!xmmsv_list_get (operands, 0, &operand)) {
+				break;
+			}
+			state = xmms_collection_find_eval (dag, operand, mid, flags);
+			if (state == XMMS_COLLECTION_FIND_STATE_MATCH) {
+				return XMMS_COLLECTION_FIND_STATE_NOMATCH;
+			}
+			return XMMS_COLLECTION_FIND_STATE_MATCH;
+
+		/* Ordering doesn't change which media are matched */
+		case XMMS_COLLECTION_TYPE_ORDER:
+		case XMMS_COLLECTION_TYPE_MEDIASET:
+			if (!xmmsv_list_get (operands, 0, &operand)) {
+				break;
+			}
+			return xmms_collection_find_eval (dag, operand, mid, flags);
+
+		case XMMS_COLLECTION_TYPE_IDLIST:
+			for (i = 0; xmmsv_coll_idlist_get_index_int64 (coll, i, &id); i++) {
+				if (id == mid) {
+					return XMMS_COLLECTION_FIND_STATE_MATCH;
+				}
+			}
+			return XMMS_COLLECTION_FIND_STATE_NOMATCH;
+
+		case XMMS_COLLECTION_TYPE_HAS:
+		case XMMS_COLLECTION_TYPE_MATCH:
+		case XMMS_COLLECTION_TYPE_TOKEN:
+		case XMMS_COLLECTION_TYPE_EQUALS:
+		case XMMS_COLLECTION_TYPE_NOTEQUAL:
+		case XMMS_COLLECTION_TYPE_SMALLER:
+		case XMMS_COLLECTION_TYPE_SMALLEREQ:
+		case XMMS_COLLECTION_TYPE_GREATER:
+		case XMMS_COLLECTION_TYPE_GREATEREQ:
+			if (xmmsv_list_get (operands, 0, &operand)) {
+				state = xmms_collection_find_eval (dag, operand, mid, flags);
+				if (state != XMMS_COLLECTION_FIND_STATE_MATCH) {
+					return state;
+				}
+			}
+
+			/* Apply the filter alone to the media */
+			universe = xmmsv_new_coll (XMMS_COLLECTION_TYPE_UNIVERSE);
+			probe = xmmsv_new_coll (xmmsv_coll_get_type (coll));
+			xmmsv_coll_attributes_set (probe, xmmsv_coll_attributes_get (coll));
+			xmmsv_coll_add_operand (probe, universe);
+			xmmsv_unref (universe);
+			state = xmms_collection_find_query (dag, probe, mid, flags);
+			xmmsv_unref (probe);
+
+			return state;
+
+		default:
+			break;
+	}
+
+	/* Membership depends on the other media too (LIMIT), query it */
+	*flags |= XMMS_COLLECTION_FIND_DEPENDS_MEDIALIB;
+
+	return xmms_collection_find_query (dag, coll, mid, flags);
+}
+
+/* Thread pool function evaluating a single find job. */
 static void
-build_match_table (gpointer key, gpointer value, gpointer udata)
+xmms_collection_find_job (gpointer data, gpointer udata)
 {
-	GHashTable *match_table = udata;
-	coll_find_state_t *match = g_new (coll_find_state_t, 1);
-	*match = XMMS_COLLECTION_FIND_STATE_UNCHECKED;
-	g_hash_table_replace (match_table, g_strdup (key), match);
+	coll_find_job_t *job = data;
+	coll_find_state_t state;
+	guint flags = 0;
+
+	state = xmms_collection_find_eval (job->dag, job->coll, job->mid, &flags);
+	job->result = state | flags;
+
+	if (job->batch != NULL) {
+		g_mutex_lock (&job->batch->mutex);
+		if (--job->batch->pending == 0) {
+			g_cond_signal (&job->batch->cond);
+		}
+		g_mutex_unlock (&job->batch->mutex);
+	}
+}
+
+static gboolean
+find_cache_entry_match (gpointer key, gpointer value, gpointer udata)
+{
+	coll_find_drop_t *drop = udata;
+
+	if (GPOINTER_TO_UINT (value) & drop->flags) {
+		return TRUE;
+	}
+
+	return drop->name != NULL && strcmp (key, drop->name) == 0;
 }
 
-/* Return the first unchecked element from the match_table, set the
- * udata pointer to contain the key of that element.
+/* Drop the cached find results for a collection (if name is not NULL) and
+ * all results depending on any of the given flags.
  */
+static void
+xmms_collection_find_cache_drop (xmms_coll_dag_t *dag,
+                                 xmms_collection_namespace_id_t nsid,
+                                 const gchar *name, guint flags)
+{
+	GHashTableIter iter;
+	gpointer entries;
+	coll_find_drop_t drop;
+	gint i;
+
+	g_mutex_lock (&dag->find_mutex);
+
+	dag->find_generation++;
+
+	for (i = 0; i < XMMS_COLLECTION_NUM_NAMESPACES; i++) {
+		drop.name = (i == nsid) ? name : NULL;
+		drop.flags = flags;
+
+		if (drop.name == NULL && drop.flags == 0) {
+			continue;
+		}
+
+		g_hash_table_iter_init (&iter, dag->find_cache[i]);
+		while (g_hash_table_iter_next (&iter, NULL, &entries)) {
+			g_hash_table_foreach_remove (entries, find_cache_entry_match, &drop);
+		}
+	}
+
+	g_mutex_unlock (&dag->find_mutex);
+}
+
+/* A media changed, forget where it was found, and anything that depends
+ * on the rest of the medialib.
+ */
+static void
+on_medialib_entry_changed (xmms_object_t *object, xmmsv_t *val, gpointer udata)
+{
+	xmms_coll_dag_t *dag = udata;
+	coll_materialized_t *mat;
+	GHashTableIter iter;
+	gint mid, i;
+
+	if (!xmmsv_get_int (val, &mid)) {
+		return;
+	}
+
+	/* Re-test the media against materialized collections when next used */
+	g_mutex_lock (&dag->materialized_mutex);
+	g_hash_table_iter_init (&iter, dag->materialized);
+	while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &mat)) {
+		if (mat->stale) {
+			continue;
+		}
+		if (g_hash_table_size (mat->pending) >= XMMS_COLLECTION_MATERIALIZED_MAX_PENDING) {
+			g_hash_table_remove_all (mat->pending);
+			mat->stale = TRUE;
+		} else {
+			g_hash_table_add (mat->pending, GINT_TO_POINTER (mid));
+		}
+	}
+	g_mutex_unlock (&dag->materialized_mutex);
+
+	g_mutex_lock (&dag->find_mutex);
+	for (i = 0; i < XMMS_COLLECTION_NUM_NAMESPACES; i++) {
+		g_hash_table_remove (dag->find_cache[i], GINT_TO_POINTER (mid));
+	}
+	g_mutex_unlock (&dag->find_mutex);
+
+	xmms_collection_find_cache_drop (dag, XMMS_COLLECTION_NSID_INVALID, NULL,
+	                                 XMMS_COLLECTION_FIND_DEPENDS_MEDIALIB);
+}
+
+
+
+/* ============  MATERIALIZED COLLECTIONS ============ */
+
+/* Saved collections with the "materialized" attribute set to "true" keep
+ * their id set in memory. Changed media are re-tested against the
+ * collection when it's next used, and the set is computed again when a
+ * collection it's built from changes. Queries referencing it, and random
+ * picks from it, then use the set instead of evaluating the collection.
+ */
+
 static gboolean
-find_unchecked (gpointer name, gpointer value, gpointer udata)
+xmms_collection_is_materialized (xmmsv_t *coll)
 {
-	coll_find_state_t *match = value;
-	gchar **open = udata;
-	*open = name;
-	return (*match == XMMS_COLLECTION_FIND_STATE_UNCHECKED);
+	const gchar *value;
+
+	return xmmsv_coll_attribute_get_string (coll, "materialized", &value) &&
+	       strcmp (value, "true") == 0;
+}
+
+static coll_materialized_t *
+coll_materialized_new (xmmsv_t *coll)
+{
+	coll_materialized_t *mat;
+
+	mat = g_new0 (coll_materialized_t, 1);
+	mat->coll = xmmsv_ref (coll);
+	mat->ids = g_hash_table_new (NULL, NULL);
+	mat->list = g_array_new (FALSE, FALSE, sizeof (gint));
+	mat->pending = g_hash_table_new (NULL, NULL);
+	mat->depends = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+	mat->stale = TRUE;
+
+	return mat;
 }
 
-/* Build a list of all matched entries of the match_table in the udata
- * pointer.
+static void
+coll_materialized_free (gpointer data)
+{
+	coll_materialized_t *mat = data;
+
+	xmmsv_unref (mat->coll);
+	g_hash_table_unref (mat->ids);
+	g_array_free (mat->list, TRUE);
+	g_hash_table_destroy (mat->pending);
+	g_hash_table_destroy (mat->depends);
+	if (mat->weights != NULL) {
+		g_hash_table_destroy (mat->weights);
+	}
+	g_free (mat->weight);
+	g_free (mat->alias_prob);
+	g_free (mat->alias);
+	g_free (mat);
+}
+
+/* Forget the weights, they are read again on the next weighted pick. */
+static void
+coll_materialized_drop_weights (coll_materialized_t *mat)
+{
+	if (mat->weights != NULL) {
+		g_hash_table_destroy (mat->weights);
+		mat->weights = NULL;
+	}
+	g_free (mat->weight);
+	mat->weight = NULL;
+	mat->alias_valid = FALSE;
+}
+
+/* Weight of a media for weighted picks: its property value + 1, so media
+ * without the property (or at 0) can still be picked.
+ */
+static gint
+xmms_collection_media_weight (xmms_medialib_session_t *session,
+                              xmms_medialib_entry_t id, const gchar *property)
+{
+	return MAX (xmms_medialib_entry_property_get_int (session, id, property), 0) + 1;
+}
+
+/* Build the alias table (Vose's method) over the weights of the ids, so
+ * a weighted pick is a single draw: pick a slot uniformly, then keep its
+ * id with probability alias_prob, else take the id in alias.
  */
 static void
-build_list_matches (gpointer key, gpointer value, gpointer udata)
+coll_materialized_alias (coll_materialized_t *mat)
 {
-	coll_find_state_t *state = value;
-	xmmsv_t *list = (xmmsv_t *) udata;
-	gchar *coll_name = key;
-	if (*state == XMMS_COLLECTION_FIND_STATE_MATCH) {
-		xmmsv_list_insert_string (list, 0, coll_name);
+	guint *small, *large;
+	gdouble *scaled, total = 0;
+	guint n, i, s = 0, l = 0;
+	gint id;
+
+	n = mat->list->len;
+
+	g_free (mat->alias_prob);
+	g_free (mat->alias);
+	mat->alias_prob = g_new (gdouble, n);
+	mat->alias = g_new (guint, n);
+
+	scaled = g_new (gdouble, n);
+	small = g_new (guint, n);
+	large = g_new (guint, n);
+
+	for (i = 0; i < n; i++) {
+		id = g_array_index (mat->list, gint, i);
+		scaled[i] = GPOINTER_TO_INT (g_hash_table_lookup (mat->weights,
+		                                                  GINT_TO_POINTER (id)));
+		total += scaled[i];
 	}
+
+	for (i = 0; i < n; i++) {
+		scaled[i] = scaled[i] * n / total;
+		if (scaled[i] < 1.0) {
+			small[s++] = i;
+		} else {
+			large[l++] = i;
+		}
+	}
+
+	while (s > 0 && l > 0) {
+		guint less = small[--s];
+		guint more = large[--l];
+
+		mat->alias_prob[less] = scaled[less];
+		mat->alias[less] = more;
+
+		scaled[more] = (scaled[more] + scaled[less]) - 1.0;
+		if (scaled[more] < 1.0) {
+			small[s++] = more;
+		} else {
+			large[l++] = more;
+		}
+	}
+
+	/* What's left is 1 up to rounding errors */
+	while (l > 0) {
+		i = large[--l];
+		mat->alias_prob[i] = 1.0;
+		mat->alias[i] = i;
+	}
+	while (s > 0) {
+		i = small[--s];
+		mat->alias_prob[i] = 1.0;
+		mat->alias[i] = i;
+	}
+
+	g_free (scaled);
+	g_free (small);
+	g_free (large);
+
+	mat->alias_valid = TRUE;
+}
+
+/* Add or remove an id from the set, swapping the last id into the hole. */
+static void
+coll_materialized_set (coll_materialized_t *mat, xmms_medialib_entry_t id,
+                       gboolean member)
+{
+	gpointer position;
+	guint index;
+	gint last;
+
+	position = g_hash_table_lookup (mat->ids, GINT_TO_POINTER (id));
+
+	if (member && position == NULL) {
+		g_array_append_val (mat->list, id);
+		g_hash_table_insert (mat->ids, GINT_TO_POINTER (id),
+		                     GUINT_TO_POINTER (mat->list->len));
+	} else if (!member && position != NULL) {
+		index = GPOINTER_TO_UINT (position) - 1;
+		last = g_array_index (mat->list, gint, mat->list->len - 1);
+
+		g_array_index (mat->list, gint, index) = last;
+		g_hash_table_insert (mat->ids, GINT_TO_POINTER (last),
+		                     GUINT_TO_POINTER (index + 1));
+
+		g_array_set_size (mat->list, mat->list->len - 1);
+		g_hash_table_remove (mat->ids, GINT_TO_POINTER (id));
+
+		if (mat->weights != NULL) {
+			g_hash_table_remove (mat->weights, GINT_TO_POINTER (id));
+		}
+	}
+
+	mat->alias_valid = FALSE;
+}
+
+/* Collect the "namespace/name" of every saved collection coll is built
+ * from, following the (bound) references.
+ */
+static void
+xmms_collection_materialized_depends (xmmsv_t *coll, GHashTable *depends)
+{
+	const gchar *name, *namespace;
+	xmmsv_t *operand;
+	gint i;
+
+	if (xmmsv_coll_is_type (coll, XMMS_COLLECTION_TYPE_REFERENCE) &&
+	    xmmsv_coll_attribute_get_string (coll, "reference", &name) &&
+	    xmmsv_coll_attribute_get_string (coll, "namespace", &namespace)) {
+		g_hash_table_add (depends, g_strconcat (namespace, "/", name, NULL));
+	}
+
+	for (i = 0; xmmsv_list_get (xmmsv_coll_operands_get (coll), i, &operand); i++) {
+		xmms_collection_materialized_depends (operand, depends);
+	}
+}
+
+/* Compute the id set of a materialized collection from scratch. */
+static void
+xmms_collection_materialized_compute (xmms_coll_dag_t *dag,
+                                      coll_materialized_t *mat)
+{
+	xmms_medialib_session_t *session;
+	xmms_error_t err;
+	GHashTableIter iter;
+	GHashTable *depends, *ids;
+	GArray *list;
+	gpointer key, value;
+	xmmsv_t *spec, *result;
+	gint i, id;
+
+	spec = xmms_collection_query_ids_spec ();
+
+	do {
+		xmms_error_reset (&err);
+		session = xmms_medialib_session_begin_ro (dag->medialib);
+		result = xmms_medialib_query (session, mat->coll, spec, &err);
+	} while (!xmms_medialib_session_commit (session));
+
+	xmmsv_unref (spec);
+
+	if (result == NULL || xmms_error_iserror (&err)) {
+		xmms_log_error ("Could not materialize collection: %s",
+		                xmms_error_message_get (&err));
+		g_mutex_lock (&dag->materialized_mutex);
+		mat->stale = TRUE;
+		g_mutex_unlock (&dag->materialized_mutex);
+		if (result != NULL) {
+			xmmsv_unref (result);
+		}
+		return;
+	}
+
+	ids = g_hash_table_new (NULL, NULL);
+	list = g_array_sized_new (FALSE, FALSE, sizeof (gint),
+	                          xmmsv_list_get_size (result));
+
+	for (i = 0; xmmsv_list_get_int (result, i, &id); i++) {
+		if (g_hash_table_lookup (ids, GINT_TO_POINTER (id)) == NULL) {
+			g_array_append_val (list, id);
+			g_hash_table_insert (ids, GINT_TO_POINTER (id),
+			                     GUINT_TO_POINTER (list->len));
+		}
+	}
+
+	xmmsv_unref (result);
+
+	/* The set depends on the collection itself under all its names */
+	depends = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+	xmms_collection_materialized_depends (mat->coll, depends);
+	for (i = 0; i < XMMS_COLLECTION_NUM_NAMESPACES; i++) {
+		g_hash_table_iter_init (&iter, dag->collrefs[i]);
+		while (g_hash_table_iter_next (&iter, &key, &value)) {
+			if (value == mat->coll) {
+				g_hash_table_add (depends,
+				                  g_strconcat (xmms_collection_get_namespace_string (i),
+				                               "/", key, NULL));
+			}
+		}
+	}
+
+	g_mutex_lock (&dag->materialized_mutex);
+	g_hash_table_unref (mat->ids);
+	g_array_free (mat->list, TRUE);
+	g_hash_table_destroy (mat->depends);
+	mat->ids = ids;
+	mat->list = list;
+	mat->depends = depends;
+	coll_materialized_drop_weights (mat);
+	g_mutex_unlock (&dag->materialized_mutex);
+}
+
+/* Bring the id set of a materialized collection up to date, re-testing
+ * only the media that changed since it was last used.
+ */
+static void
+xmms_collection_materialized_update (xmms_coll_dag_t *dag, xmmsv_t *coll)
+{
+	xmms_medialib_session_t *session;
+	coll_materialized_t *mat;
+	GHashTableIter iter;
+	GHashTable *pending, *members, *weights;
+	gpointer key, value;
+	gboolean full, valid;
+	guint flags;
+	gint id, weight;
+
+	g_mutex_lock (&dag->materialized_mutex);
+
+	mat = g_hash_table_lookup (dag->materialized, coll);
+	if (mat == NULL) {
+		mat = coll_materialized_new (coll);
+		g_hash_table_insert (dag->materialized, coll, mat);
+	}
+
+	full = mat->stale;
+	pending = mat->pending;
+	mat->pending = g_hash_table_new (NULL, NULL);
+	mat->stale = FALSE;
+
+	g_mutex_unlock (&dag->materialized_mutex);
+
+	members = g_hash_table_new (NULL, NULL);
+	weights = g_hash_table_new (NULL, NULL);
+
+	g_hash_table_iter_init (&iter, pending);
+	while (!full && g_hash_table_iter_next (&iter, &key, NULL)) {
+		id = GPOINTER_TO_INT (key);
+
+		do {
+			session = xmms_medialib_session_begin_ro (dag->medialib);
+			valid = xmms_medialib_check_id (session, id);
+		} while (!xmms_medialib_session_commit (session));
+
+		flags = 0;
+		if (valid &&
+		    xmms_collection_find_eval (dag, coll, id, &flags) == XMMS_COLLECTION_FIND_STATE_MATCH) {
+			g_hash_table_insert (members, key, GINT_TO_POINTER (TRUE));
+
+			/* The weight may be what changed */
+			if (mat->weight != NULL) {
+				do {
+					session = xmms_medialib_session_begin_ro (dag->medialib);
+					weight = xmms_collection_media_weight (session, id, mat->weight);
+				} while (!xmms_medialib_session_commit (session));
+
+				g_hash_table_insert (weights, key, GINT_TO_POINTER (weight));
+			}
+		} else {
+			g_hash_table_insert (members, key, GINT_TO_POINTER (FALSE));
+		}
+
+		/* A change can move other media in or out of a LIMIT */
+		if (flags & (XMMS_COLLECTION_FIND_DEPENDS_MEDIALIB |
+		             XMMS_COLLECTION_FIND_UNCACHEABLE)) {
+			full = TRUE;
+		}
+	}
+
+	if (full) {
+		xmms_collection_materialized_compute (dag, mat);
+	} else {
+		g_mutex_lock (&dag->materialized_mutex);
+		g_hash_table_iter_init (&iter, members);
+		while (g_hash_table_iter_next (&iter, &key, &value)) {
+			coll_materialized_set (mat, GPOINTER_TO_INT (key),
+			                       GPOINTER_TO_INT (value));
+		}
+		if (mat->weights != NULL) {
+			g_hash_table_iter_init (&iter, weights);
+			while (g_hash_table_iter_next (&iter, &key, &value)) {
+				g_hash_table_insert (mat->weights, key, value);
+			}
+		}
+		g_mutex_unlock (&dag->materialized_mutex);
+	}
+
+	g_hash_table_destroy (weights);
+	g_hash_table_destroy (members);
+	g_hash_table_destroy (pending);
+}
+
+/* Add tree and its operands to reachable. References are not followed,
+ * their targets are saved collections of their own.
+ */
+static void
+coll_materialized_collect (xmmsv_t *tree, GHashTable *reachable)
+{
+	xmmsv_t *operand;
+	gint i;
+
+	if (g_hash_table_contains (reachable, tree)) {
+		return;
+	}
+
+	g_hash_table_add (reachable, xmmsv_ref (tree));
+
+	if (xmmsv_coll_is_type (tree, XMMS_COLLECTION_TYPE_REFERENCE)) {
+		return;
+	}
+
+	for (i = 0; xmmsv_list_get (xmmsv_coll_operands_get (tree), i, &operand); i++) {
+		coll_materialized_collect (operand, reachable);
+	}
+}
+
+/* Whether coll is a saved collection or part of one, such as the source
+ * of a party shuffle playlist. Only the id sets of those are kept, as
+ * they can be dropped once the collection is replaced or removed. The
+ * set of those is rebuilt after collections were saved, removed or
+ * changed. Must be called with the DAG locked.
+ */
+static gboolean
+xmms_collection_materialized_reachable (xmms_coll_dag_t *dag, xmmsv_t *coll)
+{
+	GHashTableIter iter;
+	gpointer value;
+	gint i;
+
+	if (g_atomic_int_get (&dag->reachable_dirty)) {
+		g_atomic_int_set (&dag->reachable_dirty, FALSE);
+		g_hash_table_remove_all (dag->reachable);
+
+		for (i = 0; i < XMMS_COLLECTION_NUM_NAMESPACES; i++) {
+			g_hash_table_iter_init (&iter, dag->collrefs[i]);
+			while (g_hash_table_iter_next (&iter, NULL, &value)) {
+				coll_materialized_collect (value, dag->reachable);
+			}
+		}
+	}
+
+	return g_hash_table_contains (dag->reachable, coll);
+}
+
+/* Keep the id set of a source outside any saved collection, in place of
+ * the previous one. Nothing would tell when to drop it otherwise. Must
+ * be called with the DAG locked.
+ */
+static void
+xmms_collection_materialized_oneoff (xmms_coll_dag_t *dag, xmmsv_t *coll)
+{
+	g_mutex_lock (&dag->materialized_mutex);
+	if (dag->materialized_oneoff != coll) {
+		if (dag->materialized_oneoff != NULL) {
+			g_hash_table_remove (dag->materialized, dag->materialized_oneoff);
+		}
+		dag->materialized_oneoff = coll;
+	}
+	g_mutex_unlock (&dag->materialized_mutex);
+}
+
+/* Drop the id sets of collections that are no longer saved, or part of
+ * a saved collection. */
+static void
+xmms_collection_materialized_purge (xmms_coll_dag_t *dag)
+{
+	coll_materialized_t *mat;
+	GHashTableIter iter;
+
+	g_mutex_lock (&dag->materialized_mutex);
+
+	g_hash_table_iter_init (&iter, dag->materialized);
+	while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &mat)) {
+		if (mat->coll != dag->materialized_oneoff &&
+		    !xmms_collection_materialized_reachable (dag, mat->coll)) {
+			g_hash_table_iter_remove (&iter);
+		}
+	}
+
+	dag->materialized_purge = FALSE;
+
+	g_mutex_unlock (&dag->materialized_mutex);
+}
+
+/* Bring up to date the materialized collections a (bound) collection
+ * references, innermost first. Must be called with the DAG locked, which
+ * is also what keeps the id set entries alive.
+ */
+static void
+xmms_collection_materialized_refresh (xmms_coll_dag_t *dag, xmmsv_t *coll)
+{
+	xmmsv_t *operand;
+	gint i;
+
+	if (dag->materialized_purge) {
+		xmms_collection_materialized_purge (dag);
+	}
+
+	for (i = 0; xmmsv_list_get (xmmsv_coll_operands_get (coll), i, &operand); i++) {
+		xmms_collection_materialized_refresh (dag, operand);
+
+		/* Only saved collections, the targets of references, are kept */
+		if (xmmsv_coll_is_type (coll, XMMS_COLLECTION_TYPE_REFERENCE) &&
+		    xmms_collection_is_materialized (operand)) {
+			xmms_collection_materialized_update (dag, operand);
+		}
+	}
+}
+
+/* Mark the id sets built from the given saved collection for
+ * recomputation. The collection may also have been replaced or removed,
+ * along with the sources kept within it, so purge the id sets that are
+ * no longer used. They are only freed with the DAG locked.
+ */
+static void
+xmms_collection_materialized_invalidate (xmms_coll_dag_t *dag,
+                                         const gchar *name,
+                                         const gchar *namespace)
+{
+	coll_materialized_t *mat;
+	GHashTableIter iter;
+	gchar *key;
+
+	key = g_strconcat (namespace, "/", name, NULL);
+
+	g_mutex_lock (&dag->materialized_mutex);
+	g_hash_table_iter_init (&iter, dag->materialized);
+	while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &mat)) {
+		if (g_hash_table_contains (mat->depends, key)) {
+			g_hash_table_remove_all (mat->pending);
+			mat->stale = TRUE;
+		}
+	}
+	if (g_hash_table_size (dag->materialized) > 0) {
+		dag->materialized_purge = TRUE;
+	}
+	g_mutex_unlock (&dag->materialized_mutex);
+
+	g_atomic_int_set (&dag->reachable_dirty, TRUE);
+
+	g_free (key);
+}
+
+/* Pick a random id from an up to date materialized collection, weighted
+ * by a property if weight isn't NULL. Must be called with the DAG locked,
+ * which is what keeps the id list from changing.
+ */
+static gboolean
+xmms_collection_materialized_pick (xmms_coll_dag_t *dag, xmmsv_t *coll,
+                                   const gchar *weight,
+                                   xmms_medialib_entry_t *entry)
+{
+	coll_materialized_t *mat;
+	gboolean current;
+
+	g_mutex_lock (&dag->materialized_mutex);
+	mat = g_hash_table_lookup (dag->materialized, coll);
+	current = mat != NULL && !mat->stale && g_hash_table_size (mat->pending) == 0;
+	g_mutex_unlock (&dag->materialized_mutex);
+
+	if (!current) {
+		return FALSE;
+	}
+
+	return coll_materialized_pick (dag, mat, weight, entry);
+}
+
+/* Pick a random id from an id set, see xmms_collection_materialized_pick. */
+static gboolean
+coll_materialized_pick (xmms_coll_dag_t *dag, coll_materialized_t *mat,
+                        const gchar *weight, xmms_medialib_entry_t *entry)
+{
+	xmms_medialib_session_t *session;
+	GHashTable *weights;
+	guint i, slot;
+	gint id;
+
+	if (mat->list->len == 0) {
+		*entry = 0;
+		return TRUE;
+	}
+
+	slot = g_random_int_range (0, mat->list->len);
+
+	if (weight == NULL) {
+		*entry = g_array_index (mat->list, gint, slot);
+		return TRUE;
+	}
+
+	/* Read all weights once, they're then kept up to date with the set */
+	if (g_strcmp0 (mat->weight, weight) != 0) {
+		weights = g_hash_table_new (NULL, NULL);
+
+		do {
+			session = xmms_medialib_session_begin_ro (dag->medialib);
+			for (i = 0; i < mat->list->len; i++) {
+				id = g_array_index (mat->list, gint, i);
+				g_hash_table_insert (weights, GINT_TO_POINTER (id),
+				                     GINT_TO_POINTER (xmms_collection_media_weight (session, id, weight)));
+			}
+		} while (!xmms_medialib_session_commit (session));
+
+		g_mutex_lock (&dag->materialized_mutex);
+		coll_materialized_drop_weights (mat);
+		mat->weight = g_strdup (weight);
+		mat->weights = weights;
+		g_mutex_unlock (&dag->materialized_mutex);
+	}
+
+	if (!mat->alias_valid) {
+		coll_materialized_alias (mat);
+	}
+
+	if (g_random_double () >= mat->alias_prob[slot]) {
+		slot = mat->alias[slot];
+	}
+
+	*entry = g_array_index (mat->list, gint, slot);
+
+	return TRUE;
+}
+
+/* Medialib hook, returns the id set of an up to date materialized
+ * collection.
+ */
+static GHashTable *
+xmms_collection_materialized_lookup (xmmsv_t *coll, gpointer udata)
+{
+	xmms_coll_dag_t *dag = udata;
+	coll_materialized_t *mat;
+	GHashTable *ret = NULL;
+
+	g_mutex_lock (&dag->materialized_mutex);
+
+	mat = g_hash_table_lookup (dag->materialized, coll);
+	if (mat != NULL && !mat->stale && g_hash_table_size (mat->pending) == 0) {
+		ret = g_hash_table_ref (mat->ids);
+	}
+
+	g_mutex_unlock (&dag->materialized_mutex);
+
+	return ret;
 }
@@ -18,9 +18,18 @@
 /** @file
  *  Manages the synchronization of collections to the database at 10 seconds
  *  after the last collections-change.
+ *
+ *  Changes since the last sync are appended as a record to a journal next to
+ *  the snapshot. Entries inserted, removed or moved in a playlist are recorded
+ *  as such, taken from the signals telling about them. Collections, and
+ *  playlists replaced or renamed through the collection API, are written as a
+ *  whole. Once the journal grows larger than the snapshot, a full snapshot is
+ *  written and the journal is started over. On startup the journal is
+ *  replayed on top of the snapshot.
  */
 
 #include <xmmspriv/xmms_collsync.h>
+#include <xmmspriv/xmms_playlist.h>
 #include <xmmspriv/xmms_utils.h>
 
 #include <xmms/xmms_config.h>
@@ -28,6 +37,13 @@
 #include <xmms/xmms_log.h>
 
 #include <errno.h>
+#include <stdio.h>
+#ifdef G_OS_WIN32
+# include <io.h>
+#else
+# include <unistd.h>
+#endif
+#include <string.h>
 
 #include <glib.h>
 #include <glib/gstdio.h>
@@ -35,7 +51,14 @@
 
 #define XMMS_COLL_SYNC_DELAY 10 * G_TIME_SPAN_SECOND
 
+/* Never compact a journal smaller than this, even if the snapshot is */
+#define XMMS_COLL_SYNC_JOURNAL_MIN_SIZE (1024 * 1024)
+
 static void xmms_coll_sync_schedule_sync (xmms_object_t *object, xmmsv_t *val, gpointer udata);
+static void xmms_coll_sync_schedule_compact (xmms_object_t *object, xmmsv_t *val, gpointer udata);
+static void xmms_coll_sync_collection_changed (xmms_object_t *object, xmmsv_t *val, gpointer udata);
+static void xmms_coll_sync_playlist_changed (xmms_object_t *object, xmmsv_t *val, gpointer udata);
+static void xmms_coll_sync_playlist_position_changed (xmms_object_t *object, xmmsv_t *val, gpointer udata);
 static gpointer xmms_coll_sync_loop (gpointer udata);
 static void xmms_coll_sync_destroy (xmms_object_t *object);
 
@@ -68,6 +91,22 @@ struct xmms_coll_sync_St {
 	GCond cond;
 
 	xmms_coll_sync_state_t state;
+
+	/* names changed since the last sync, for each namespace */
+	GHashTable *dirty[XMMS_COLLECTION_NUM_NAMESPACES];
+	/* playlists that changed, but may still be the collection last
+	 * written, with their edits in 'ops' */
+	GHashTable *updated;
+	/* edits made to playlists since the last sync, in order */
+	xmmsv_t *ops;
+	/* set when the next sync has to write a full snapshot */
+	gboolean compact;
+
+	/* only touched by the sync thread, or before it's started */
+	GHashTable *written;
+	gint generation;
+	gsize snapshot_size;
+	gsize journal_size;
 };
 
 #include "collsync_ipc.c"
@@ -80,6 +119,7 @@ xmms_coll_sync_init (const gchar *uuid, xmms_coll_dag_t *dag, xmms_playlist_t *p
 {
 	xmms_coll_sync_t *sync;
 	gchar *path;
+	gint i;
 
 	sync = xmms_object_new (xmms_coll_sync_t, xmms_coll_sync_destroy);
 
@@ -88,6 +128,16 @@ xmms_coll_sync_init (const gchar *uuid, xmms_coll_dag_t *dag, xmms_playlist_t *p
 	g_cond_init (&sync->cond);
 	g_mutex_init (&sync->mutex);
 
+	for (i = 0; i < XMMS_COLLECTION_NUM_NAMESPACES; i++) {
+		sync->dirty[i] = g_hash_table_new_full (g_str_hash, g_str_equal,
+		                                        g_free, NULL);
+	}
+	sync->updated = g_hash_table_new_full (g_str_hash, g_str_equal,
+	                                       g_free, NULL);
+	sync->ops = xmmsv_new_list ();
+	sync->written = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+	                                       (GDestroyNotify) xmmsv_unref);
+
 	xmms_object_ref (dag);
 	sync->dag = dag;
 
@@ -96,22 +146,22 @@ xmms_coll_sync_init (const gchar *uuid, xmms_coll_dag_t *dag, xmms_playlist_t *p
 
 	path = XMMS_BUILD_PATH ("collections", "${uuid}.db");
 	sync->config = xmms_config_property_register ("collection.directory", path,
-	                                              xmms_coll_sync_schedule_sync, sync);
+	                                              xmms_coll_sync_schedule_compact, sync);
 	g_free (path);
 
 	/* Connection coll_sync_cb to some signals */
 	xmms_object_connect (XMMS_OBJECT (dag),
 	                     XMMS_IPC_SIGNAL_COLLECTION_CHANGED,
-	                     xmms_coll_sync_schedule_sync, sync);
+	                     xmms_coll_sync_collection_changed, sync);
 
 	/* FIXME: These signals should trigger COLLECTION_CHANGED */
 	xmms_object_connect (XMMS_OBJECT (playlist),
 	                     XMMS_IPC_SIGNAL_PLAYLIST_CHANGED,
-	                     xmms_coll_sync_schedule_sync, sync);
+	                     xmms_coll_sync_playlist_changed, sync);
 
 	xmms_object_connect (XMMS_OBJECT (playlist),
 	                     XMMS_IPC_SIGNAL_PLAYLIST_CURRENT_POS,
-	                     xmms_coll_sync_schedule_sync, sync);
+	                     xmms_coll_sync_playlist_position_changed, sync);
 
 	xmms_object_connect (XMMS_OBJECT (playlist),
 	                     XMMS_IPC_SIGNAL_PLAYLIST_LOADED,
@@ -134,6 +184,7 @@ static void
 xmms_coll_sync_destroy (xmms_object_t *object)
 {
 	xmms_coll_sync_t *sync = (xmms_coll_sync_t *) object;
+	gint i;
 
 	g_return_if_fail (sync);
 
@@ -142,16 +193,16 @@ xmms_coll_sync_destroy (xmms_object_t *object)
 	xmms_coll_sync_unregister_ipc_commands ();
 
 	xmms_config_property_callback_remove (sync->config,
-	                                      xmms_coll_sync_schedule_sync,
+	                                      xmms_coll_sync_schedule_compact,
 	                                      sync);
 
 	xmms_object_disconnect (XMMS_OBJECT (sync->playlist),
 	                        XMMS_IPC_SIGNAL_PLAYLIST_CHANGED,
-	                        xmms_coll_sync_schedule_sync, sync);
+	                        xmms_coll_sync_playlist_changed, sync);
 
 	xmms_object_disconnect (XMMS_OBJECT (sync->playlist),
 	                        XMMS_IPC_SIGNAL_PLAYLIST_CURRENT_POS,
-	                        xmms_coll_sync_schedule_sync, sync);
+	                        xmms_coll_sync_playlist_position_changed, sync);
 
 	xmms_object_disconnect (XMMS_OBJECT (sync->playlist),
 	                        XMMS_IPC_SIGNAL_PLAYLIST_LOADED,
@@ -159,13 +210,20 @@ xmms_coll_sync_destroy (xmms_object_t *object)
 
 	xmms_object_disconnect (XMMS_OBJECT (sync->dag),
 	                        XMMS_IPC_SIGNAL_COLLECTION_CHANGED,
-	                        xmms_coll_sync_schedule_sync, sync);
+	                        xmms_coll_sync_collection_changed, sync);
 
 	xmms_coll_sync_stop (sync);
 
 	xmms_object_unref (sync->playlist);
 	xmms_object_unref (sync->dag);
 
+	for (i = 0; i < XMMS_COLLECTION_NUM_NAMESPACES; i++) {
+		g_hash_table_destroy (sync->dirty[i]);
+	}
+	g_hash_table_destroy (sync->updated);
+	g_hash_table_destroy (sync->written);
+	xmmsv_unref (sync->ops);
+
 	g_mutex_clear (&sync->mutex);
 	g_cond_clear (&sync->cond);
 	g_free (sync->uuid);
@@ -334,6 +392,12 @@ xmms_coll_sync_get_path (xmms_coll_sync_t *sync)
 	return g_string_free (result, FALSE);
 }
 
+static gchar *
+xmms_coll_sync_get_journal_path (const gchar *path)
+{
+	return g_strconcat (path, ".journal", NULL);
+}
+
 static void
 xmms_coll_sync_set_state (xmms_coll_sync_t *sync, xmms_coll_sync_state_t state)
 {
@@ -388,6 +452,246 @@ xmms_coll_sync_schedule_sync (xmms_object_t *object, xmmsv_t *val,
 	xmms_coll_sync_set_state (sync, XMMS_COLL_SYNC_STATE_DELAYED);
 }
 
+/**
+ * Schedule a synchronization that writes a full snapshot, used when the
+ * database path changes.
+ */
+static void
+xmms_coll_sync_schedule_compact (xmms_object_t *object, xmmsv_t *val,
+                                 gpointer udata)
+{
+	xmms_coll_sync_t *sync = (xmms_coll_sync_t *) udata;
+
+	g_return_if_fail (sync);
+
+	g_mutex_lock (&sync->mutex);
+	sync->compact = TRUE;
+	g_mutex_unlock (&sync->mutex);
+
+	xmms_coll_sync_set_state (sync, XMMS_COLL_SYNC_STATE_DELAYED);
+}
+
+/**
+ * Remember which collection changed, and schedule a synchronization.
+ */
+static void
+xmms_coll_sync_collection_changed (xmms_object_t *object, xmmsv_t *val,
+                                   gpointer udata)
+{
+	xmms_coll_sync_t *sync = (xmms_coll_sync_t *) udata;
+	xmms_collection_namespace_id_t nsid;
+	const gchar *namespace, *name;
+	gint type;
+
+	g_return_if_fail (sync);
+
+	g_mutex_lock (&sync->mutex);
+
+	nsid = XMMS_COLLECTION_NSID_INVALID;
+	if (xmmsv_dict_entry_get_string (val, "namespace", &namespace)) {
+		nsid = xmms_collection_get_namespace_id (namespace);
+	}
+
+	if (!xmmsv_dict_entry_get_int (val, "type", &type)) {
+		type = -1;
+	}
+
+	if (nsid == XMMS_COLLECTION_NSID_PLAYLISTS &&
+	    type == XMMS_COLLECTION_CHANGED_UPDATE) {
+		/* Every playlist edit is announced like this too, only a
+		 * playlist that was replaced has to be written as a whole. */
+		if (xmmsv_dict_entry_get_string (val, "name", &name)) {
+			g_hash_table_add (sync->updated, g_strdup (name));
+		}
+	} else if (nsid == XMMS_COLLECTION_NSID_COLLECTIONS ||
+	           nsid == XMMS_COLLECTION_NSID_PLAYLISTS) {
+		if (xmmsv_dict_entry_get_string (val, "name", &name)) {
+			g_hash_table_add (sync->dirty[nsid], g_strdup (name));
+		}
+		if (xmmsv_dict_entry_get_string (val, "newname", &name)) {
+			g_hash_table_add (sync->dirty[nsid], g_strdup (name));
+		}
+	} else {
+		/* Can't tell what changed, play it safe. */
+		sync->compact = TRUE;
+	}
+
+	g_mutex_unlock (&sync->mutex);
+
+	xmms_coll_sync_set_state (sync, XMMS_COLL_SYNC_STATE_DELAYED);
+}
+
+/**
+ * Record an edit of a playlist, merging entries inserted one after the
+ * other into a single insertion, and keeping only the latest position
+ * of each playlist.
+ */
+static void
+xmms_coll_sync_add_op (xmms_coll_sync_t *sync, xmmsv_t *op)
+{
+	const gchar *name, *last_name, *type, *last_type;
+	gint i, size, position, last_position;
+	xmmsv_t *last, *ids, *last_ids, *id;
+
+	/* A position is replayed as is, so an earlier one is overwritten
+	 * whatever was edited in between.
+	 */
+	if (xmmsv_dict_entry_get_string (op, "op", &type) &&
+	    strcmp (type, "position") == 0 &&
+	    xmmsv_dict_entry_get_string (op, "name", &name)) {
+		for (i = 0; xmmsv_list_get (sync->ops, i, &last); i++) {
+			if (xmmsv_dict_entry_get_string (last, "op", &last_type) &&
+			    strcmp (last_type, "position") == 0 &&
+			    xmmsv_dict_entry_get_string (last, "name", &last_name) &&
+			    strcmp (name, last_name) == 0) {
+				xmmsv_list_remove (sync->ops, i);
+				break;
+			}
+		}
+	}
+
+	size = xmmsv_list_get_size (sync->ops);
+
+	if (size > 0 &&
+	    xmmsv_list_get (sync->ops, size - 1, &last) &&
+	    xmmsv_dict_entry_get_string (op, "op", &type) &&
+	    xmmsv_dict_entry_get_string (last, "op", &last_type) &&
+	    strcmp (type, "insert") == 0 && strcmp (last_type, "insert") == 0 &&
+	    xmmsv_dict_entry_get_string (op, "name", &name) &&
+	    xmmsv_dict_entry_get_string (last, "name", &last_name) &&
+	    strcmp (name, last_name) == 0 &&
+	    xmmsv_dict_entry_get_int (op, "position", &position) &&
+	    xmmsv_dict_entry_get_int (last, "position", &last_position) &&
+	    xmmsv_dict_get (op, "ids", &ids) &&
+	    xmmsv_dict_get (last, "ids", &last_ids) &&
+	    position == last_position + xmmsv_list_get_size (last_ids)) {
+		for (i = 0; xmmsv_list_get (ids, i, &id); i++) {
+			xmmsv_list_append (last_ids, id);
+		}
+		return;
+	}
+
+	xmmsv_list_append (sync->ops, op);
+}
+
+/**
+ * Record how a playlist was edited, or remember that it has to be
+ * written as a whole, and schedule a synchronization.
+ */
+static void
+xmms_coll_sync_playlist_changed (xmms_object_t *object, xmmsv_t *val,
+                                 gpointer udata)
+{
+	xmms_coll_sync_t *sync = (xmms_coll_sync_t *) udata;
+	gint type, id, position, newposition;
+	xmmsv_t *op = NULL, *ids;
+	const gchar *name;
+
+	g_return_if_fail (sync);
+
+	if (!xmmsv_dict_entry_get_string (val, "name", &name)) {
+		xmms_coll_sync_set_state (sync, XMMS_COLL_SYNC_STATE_DELAYED);
+		return;
+	}
+
+	if (!xmmsv_dict_entry_get_int (val, "type", &type)) {
+		type = -1;
+	}
+
+	switch (type) {
+		case XMMS_PLAYLIST_CHANGED_ADD:
+		case XMMS_PLAYLIST_CHANGED_INSERT:
+			if (xmmsv_dict_entry_get_int (val, "id", &id) &&
+			    xmmsv_dict_entry_get_int (val, "position", &position)) {
+				op = xmmsv_build_dict (XMMSV_DICT_ENTRY_STR ("op", "insert"),
+				                       XMMSV_DICT_ENTRY_STR ("name", name),
+				                       XMMSV_DICT_ENTRY_INT ("position", position),
+				                       XMMSV_DICT_ENTRY ("ids", xmmsv_build_list (XMMSV_LIST_ENTRY_INT (id),
+				                                                                  XMMSV_LIST_END)),
+				                       XMMSV_DICT_END);
+			}
+			break;
+		case XMMS_PLAYLIST_CHANGED_INSERT_RANGE:
+			if (xmmsv_dict_get (val, "ids", &ids) &&
+			    xmmsv_dict_entry_get_int (val, "position", &position)) {
+				op = xmmsv_build_dict (XMMSV_DICT_ENTRY_STR ("op", "insert"),
+				                       XMMSV_DICT_ENTRY_STR ("name", name),
+				                       XMMSV_DICT_ENTRY_INT ("position", position),
+				                       XMMSV_DICT_ENTRY ("ids", xmmsv_copy (ids)),
+				                       XMMSV_DICT_END);
+			}
+			break;
+		case XMMS_PLAYLIST_CHANGED_REMOVE:
+			if (xmmsv_dict_entry_get_int (val, "position", &position)) {
+				op = xmmsv_build_dict (XMMSV_DICT_ENTRY_STR ("op", "remove"),
+				                       XMMSV_DICT_ENTRY_STR ("name", name),
+				                       XMMSV_DICT_ENTRY_INT ("position", position),
+				                       XMMSV_DICT_END);
+			}
+			break;
+		case XMMS_PLAYLIST_CHANGED_MOVE:
+			if (xmmsv_dict_entry_get_int (val, "position", &position) &&
+			    xmmsv_dict_entry_get_int (val, "newposition", &newposition)) {
+				op = xmmsv_build_dict (XMMSV_DICT_ENTRY_STR ("op", "move"),
+				                       XMMSV_DICT_ENTRY_STR ("name", name),
+				                       XMMSV_DICT_ENTRY_INT ("position", position),
+				                       XMMSV_DICT_ENTRY_INT ("newposition", newposition),
+				                       XMMSV_DICT_END);
+			}
+			break;
+		default:
+			break;
+	}
+
+	g_mutex_lock (&sync->mutex);
+
+	if (op != NULL) {
+		xmms_coll_sync_add_op (sync, op);
+		xmmsv_unref (op);
+	} else if (type == XMMS_PLAYLIST_CHANGED_UPDATE) {
+		g_hash_table_add (sync->updated, g_strdup (name));
+	} else {
+		g_hash_table_add (sync->dirty[XMMS_COLLECTION_NSID_PLAYLISTS],
+		                  g_strdup (name));
+	}
+
+	g_mutex_unlock (&sync->mutex);
+
+	xmms_coll_sync_set_state (sync, XMMS_COLL_SYNC_STATE_DELAYED);
+}
+
+/**
+ * Record the new current position of a playlist, and schedule a
+ * synchronization.
+ */
+static void
+xmms_coll_sync_playlist_position_changed (xmms_object_t *object, xmmsv_t *val,
+                                          gpointer udata)
+{
+	xmms_coll_sync_t *sync = (xmms_coll_sync_t *) udata;
+	const gchar *name;
+	gint position;
+	xmmsv_t *op;
+
+	g_return_if_fail (sync);
+
+	if (xmmsv_dict_entry_get_string (val, "name", &name) &&
+	    xmmsv_dict_entry_get_int (val, "position", &position)) {
+		op = xmmsv_build_dict (XMMSV_DICT_ENTRY_STR ("op", "position"),
+		                       XMMSV_DICT_ENTRY_STR ("name", name),
+		                       XMMSV_DICT_ENTRY_INT ("position", position),
+		                       XMMSV_DICT_END);
+
+		g_mutex_lock (&sync->mutex);
+		xmms_coll_sync_add_op (sync, op);
+		g_mutex_unlock (&sync->mutex);
+
+		xmmsv_unref (op);
+	}
+
+	xmms_coll_sync_set_state (sync, XMMS_COLL_SYNC_STATE_DELAYED);
+}
+
 /**
  * Schedule a collection-to-database-synchronization right away.
  */
@@ -399,32 +703,247 @@ xmms_coll_sync_client_sync (xmms_coll_sync_t *sync, xmms_error_t *err)
 	xmms_coll_sync_set_state (sync, XMMS_COLL_SYNC_STATE_IMMEDIATE);
 }
 
+/**
+ * Push what has been written to a file down to the disk, so that a
+ * record survives a crash once it has been written.
+ */
+static gboolean
+xmms_coll_sync_file_flush (FILE *fp)
+{
+	if (fflush (fp) != 0) {
+		return FALSE;
+	}
+
+#ifdef G_OS_WIN32
+	return _commit (_fileno (fp)) == 0;
+#elif defined(_POSIX_SYNCHRONIZED_IO) && _POSIX_SYNCHRONIZED_IO > 0
+	return fdatasync (fileno (fp)) == 0;
+#else
+	return fsync (fileno (fp)) == 0;
+#endif
+}
+
+/**
+ * Write a length prefixed record to the journal, either appending to it
+ * or starting it over.
+ */
+static gboolean
+xmms_coll_sync_journal_write (const gchar *path, xmmsv_t *record,
+                              gboolean truncate, gsize *written,
+                              GError **error)
+{
+	xmmsv_t *serialized;
+	const guchar *buffer;
+	guint32 header;
+	guint length;
+	gboolean ret;
+	FILE *fp;
+
+	fp = g_fopen (path, truncate ? "wb" : "ab");
+	if (fp == NULL) {
+		g_set_error (error, G_FILE_ERROR,
+		             g_file_error_from_errno (errno),
+		             "%s", g_strerror (errno));
+		return FALSE;
+	}
+
+	serialized = xmmsv_serialize (record);
+	xmmsv_get_bin (serialized, &buffer, &length);
+
+	header = GUINT32_TO_BE (length);
+
+	ret = fwrite (&header, sizeof (header), 1, fp) == 1 &&
+	      fwrite (buffer, 1, length, fp) == length &&
+	      xmms_coll_sync_file_flush (fp);
+
+	if (fclose (fp) != 0) {
+		ret = FALSE;
+	}
+
+	if (!ret) {
+		g_set_error (error, G_FILE_ERROR,
+		             g_file_error_from_errno (errno),
+		             "%s", g_strerror (errno));
+	} else {
+		*written = sizeof (header) + length;
+	}
+
+	xmmsv_unref (serialized);
+
+	return ret;
+}
+
+/**
+ * Write a full snapshot, and start a new journal on top of it.
+ *
+ * The snapshot and the journal share a generation number, so that a
+ * journal left behind by a crash in between is never replayed on top
+ * of the newer snapshot.
+ */
+static gboolean
+xmms_coll_sync_save_snapshot (xmms_coll_sync_t *sync, xmmsv_t *snapshot,
+                              const gchar *path, const gchar *journal,
+                              GError **error)
+{
+	xmmsv_t *serialized, *header;
+	const guchar *buffer;
+	guint length;
+	gint generation;
+	gboolean ret;
+
+	generation = sync->generation + 1;
+
+	xmmsv_dict_set_int (snapshot, "journal-generation", generation);
+
+	serialized = xmmsv_serialize (snapshot);
+	xmmsv_get_bin (serialized, &buffer, &length);
+
+	ret = g_file_set_contents (path, (const gchar *) buffer, (gssize) length, error);
+
+	xmmsv_unref (serialized);
+
+	if (!ret) {
+		return FALSE;
+	}
+
+	sync->generation = generation;
+	sync->snapshot_size = length;
+
+	header = xmmsv_build_dict (XMMSV_DICT_ENTRY_INT ("journal-generation", generation),
+	                           XMMSV_DICT_END);
+	ret = xmms_coll_sync_journal_write (journal, header, TRUE,
+	                                    &sync->journal_size, error);
+	xmmsv_unref (header);
+
+	return ret;
+}
+
+/**
+ * Take the changes made since the last sync, as a full snapshot when
+ * compacting, or else as a journal record.
+ *
+ * Playlist edits are blocked meanwhile, so that every edit is either
+ * part of the playlists written here or recorded for the next sync.
+ */
+static xmmsv_t *
+xmms_coll_sync_take_changes (xmms_coll_sync_t *sync, gboolean *compact)
+{
+	GHashTable *dirty[XMMS_COLLECTION_NUM_NAMESPACES];
+	GHashTable *updated;
+	GHashTableIter iter;
+	xmmsv_t *changes, *ops, *op, *written, *kept;
+	const gchar *name;
+	gpointer key;
+	gint i;
+
+	xmms_playlist_lock (sync->playlist);
+
+	g_mutex_lock (&sync->mutex);
+	for (i = 0; i < XMMS_COLLECTION_NUM_NAMESPACES; i++) {
+		dirty[i] = sync->dirty[i];
+		sync->dirty[i] = g_hash_table_new_full (g_str_hash, g_str_equal,
+		                                        g_free, NULL);
+	}
+	updated = sync->updated;
+	sync->updated = g_hash_table_new_full (g_str_hash, g_str_equal,
+	                                       g_free, NULL);
+	ops = sync->ops;
+	sync->ops = xmmsv_new_list ();
+	*compact = *compact || sync->compact;
+	sync->compact = FALSE;
+	g_mutex_unlock (&sync->mutex);
+
+	if (*compact) {
+		changes = xmms_collection_snapshot (sync->dag, sync->written);
+	} else {
+		/* Written as a whole, whatever collection they were before. */
+		g_hash_table_iter_init (&iter, dirty[XMMS_COLLECTION_NSID_PLAYLISTS]);
+		while (g_hash_table_iter_next (&iter, &key, NULL)) {
+			g_hash_table_remove (sync->written, key);
+		}
+
+		g_hash_table_iter_init (&iter, updated);
+		while (g_hash_table_iter_next (&iter, &key, NULL)) {
+			g_hash_table_add (dirty[XMMS_COLLECTION_NSID_PLAYLISTS], g_strdup (key));
+		}
+
+		changes = xmms_collection_snapshot_partial (sync->dag, dirty, sync->written);
+	}
+
+	xmms_playlist_unlock (sync->playlist);
+
+	if (!*compact) {
+		/* Edits of playlists written as a whole are part of them already */
+		xmmsv_dict_get (changes, "playlists", &written);
+
+		kept = xmmsv_new_list ();
+		for (i = 0; xmmsv_list_get (ops, i, &op); i++) {
+			if (xmmsv_dict_entry_get_string (op, "name", &name) &&
+			    !xmmsv_dict_has_key (written, name)) {
+				xmmsv_list_append (kept, op);
+			}
+		}
+
+		if (xmmsv_list_get_size (kept) > 0) {
+			xmmsv_dict_set (changes, "ops", kept);
+		}
+		xmmsv_unref (kept);
+	}
+
+	for (i = 0; i < XMMS_COLLECTION_NUM_NAMESPACES; i++) {
+		g_hash_table_destroy (dirty[i]);
+	}
+	g_hash_table_destroy (updated);
+	xmmsv_unref (ops);
+
+	return changes;
+}
+
 static void
 xmms_coll_sync_save (xmms_coll_sync_t *sync)
 {
 	GError *error = NULL;
+	gboolean compact;
+	gchar *journal;
 
 	gchar *path = xmms_coll_sync_get_path (sync);
 
-	XMMS_DBG ("Syncing collections to '%s'.", path);
+	journal = xmms_coll_sync_get_journal_path (path);
+
+	compact = sync->journal_size > MAX (sync->snapshot_size,
+	                                    XMMS_COLL_SYNC_JOURNAL_MIN_SIZE);
 
 	if (xmms_coll_sync_prepare_path (path, &error)) {
-		xmmsv_t *snapshot, *serialized;
-		const guchar *buffer;
-		guint length;
+		gboolean success;
+		xmmsv_t *changes;
 
-		snapshot = xmms_collection_snapshot (sync->dag);
+		changes = xmms_coll_sync_take_changes (sync, &compact);
 
-		serialized = xmmsv_serialize (snapshot);
-		xmmsv_unref (snapshot);
+		if (compact) {
+			XMMS_DBG ("Syncing collections to '%s'.", path);
+			success = xmms_coll_sync_save_snapshot (sync, changes, path,
+			                                        journal, &error);
+		} else {
+			gsize written = 0;
 
-		xmmsv_get_bin (serialized, &buffer, &length);
+			XMMS_DBG ("Journaling collection changes to '%s'.", journal);
 
-		if (!g_file_set_contents (path, (const gchar *) buffer, (gssize) length, &error)) {
-			xmms_log_error ("Could not save collections to disk.");
+			success = xmms_coll_sync_journal_write (journal, changes, FALSE,
+			                                        &written, &error);
+
+			sync->journal_size += written;
 		}
 
-		xmmsv_unref (serialized);
+		xmmsv_unref (changes);
+
+		if (!success) {
+			xmms_log_error ("Could not save collections to disk.");
+
+			/* The journal may be torn, start over on the next sync. */
+			g_mutex_lock (&sync->mutex);
+			sync->compact = TRUE;
+			g_mutex_unlock (&sync->mutex);
+		}
 	}
 
 	if (error != NULL) {
@@ -432,9 +951,205 @@ xmms_coll_sync_save (xmms_coll_sync_t *sync)
 		g_error_free (error);
 	}
 
+	g_free (journal);
 	g_free (path);
 }
 
+static void
+xmms_coll_sync_journal_apply_changes (const gchar *name, xmmsv_t *coll,
+                                      void *udata)
+{
+	xmmsv_t *target = (xmmsv_t *) udata;
+
+	if (xmmsv_is_type (coll, XMMSV_TYPE_NONE)) {
+		xmmsv_dict_remove (target, name);
+	} else {
+		xmmsv_dict_set (target, name, coll);
+	}
+}
+
+/**
+ * Apply a recorded playlist edit.
+ */
+static gboolean
+xmms_coll_sync_journal_apply_op (xmmsv_t *playlists, xmmsv_t *op)
+{
+	const gchar *type, *name;
+	gint i, position, newposition, id;
+	xmmsv_t *coll, *ids;
+
+	if (!xmmsv_dict_entry_get_string (op, "op", &type) ||
+	    !xmmsv_dict_entry_get_string (op, "name", &name) ||
+	    !xmmsv_dict_entry_get_int (op, "position", &position) ||
+	    !xmmsv_dict_get (playlists, name, &coll) ||
+	    !xmmsv_is_type (coll, XMMSV_TYPE_COLL)) {
+		return FALSE;
+	}
+
+	if (strcmp (type, "insert") == 0) {
+		if (!xmmsv_dict_get (op, "ids", &ids)) {
+			return FALSE;
+		}
+		for (i = 0; xmmsv_list_get_int (ids, i, &id); i++) {
+			if (!xmmsv_coll_idlist_insert (coll, position + i, id)) {
+				return FALSE;
+			}
+		}
+		return TRUE;
+	}
+
+	if (strcmp (type, "remove") == 0) {
+		return xmmsv_coll_idlist_remove (coll, position);
+	}
+
+	if (strcmp (type, "move") == 0) {
+		return xmmsv_dict_entry_get_int (op, "newposition", &newposition) &&
+		       xmmsv_coll_idlist_move (coll, position, newposition);
+	}
+
+	if (strcmp (type, "position") == 0) {
+		return xmms_collection_set_int_attr (coll, "position", position);
+	}
+
+	return FALSE;
+}
+
+/**
+ * Apply a journal record on top of a snapshot: first the collections
+ * written as a whole, then the playlist edits.
+ *
+ * @returns FALSE if the record doesn't fit the snapshot.
+ */
+static gboolean
+xmms_coll_sync_journal_apply (xmmsv_t *snapshot, xmmsv_t *changes)
+{
+	static const gchar *keys[] = { "collections", "playlists" };
+	xmmsv_t *target, *source, *value, *ops, *op;
+	guint i;
+
+	for (i = 0; i < G_N_ELEMENTS (keys); i++) {
+		if (xmmsv_dict_get (snapshot, keys[i], &target) &&
+		    xmmsv_dict_get (changes, keys[i], &source) &&
+		    xmmsv_is_type (target, XMMSV_TYPE_DICT) &&
+		    xmmsv_is_type (source, XMMSV_TYPE_DICT)) {
+			xmmsv_dict_foreach (source, xmms_coll_sync_journal_apply_changes, target);
+		}
+	}
+
+	if (xmmsv_dict_get (changes, "active-playlist", &value)) {
+		xmmsv_dict_set (snapshot, "active-playlist", value);
+	}
+
+	if (xmmsv_dict_get (changes, "ops", &ops)) {
+		if (!xmmsv_dict_get (snapshot, "playlists", &target)) {
+			return FALSE;
+		}
+		for (i = 0; xmmsv_list_get (ops, i, &op); i++) {
+			if (!xmms_coll_sync_journal_apply_op (target, op)) {
+				return FALSE;
+			}
+		}
+	}
+
+	return TRUE;
+}
+
+/**
+ * Replay the journal on top of the snapshot it belongs to.
+ *
+ * A journal that is missing, belongs to another snapshot, or ends in a
+ * partially written record makes the next sync write a full snapshot,
+ * so that new records are never appended after garbage.
+ */
+static void
+xmms_coll_sync_journal_replay (xmms_coll_sync_t *sync, const gchar *path,
+                               xmmsv_t *snapshot)
+{
+	GError *error = NULL;
+	gboolean clean = FALSE;
+	gint generation, records;
+	gsize length, offset;
+	gchar *buffer;
+
+	if (!xmmsv_dict_entry_get_int (snapshot, "journal-generation", &generation)) {
+		generation = 0;
+	}
+
+	sync->generation = generation;
+	sync->journal_size = 0;
+
+	if (!g_file_get_contents (path, &buffer, &length, &error)) {
+		XMMS_DBG ("%s", error->message);
+		g_error_free (error);
+		sync->compact = TRUE;
+		return;
+	}
+
+	for (offset = 0, records = 0; offset < length; records++) {
+		xmmsv_t *serialized, *record;
+		guint32 header;
+		gint value;
+
+		if (length - offset < sizeof (header)) {
+			break;
+		}
+
+		memcpy (&header, buffer + offset, sizeof (header));
+		header = GUINT32_FROM_BE (header);
+
+		if (length - offset - sizeof (header) < header) {
+			break;
+		}
+
+		serialized = xmmsv_new_bin ((const guchar *) buffer + offset + sizeof (header), header);
+		record = xmmsv_deserialize (serialized);
+		xmmsv_unref (serialized);
+
+		if (record == NULL) {
+			break;
+		}
+
+		if (records == 0) {
+			/* The first record tells which snapshot the journal belongs to. */
+			if (!xmmsv_dict_entry_get_int (record, "journal-generation", &value) ||
+			    value != generation) {
+				xmmsv_unref (record);
+				break;
+			}
+		} else if (!xmms_coll_sync_journal_apply (snapshot, record)) {
+			xmmsv_unref (record);
+			break;
+		}
+
+		xmmsv_unref (record);
+
+		offset += sizeof (header) + header;
+	}
+
+	if (offset == length && records > 0) {
+		clean = TRUE;
+		sync->journal_size = length;
+	} else {
+		xmms_log_info ("Discarding unusable collection journal after %d records.", records);
+		sync->compact = TRUE;
+	}
+
+	XMMS_DBG ("Replayed %d journal records from '%s'%s.",
+	          MAX (records - 1, 0), path, clean ? "" : " (incomplete)");
+
+	g_free (buffer);
+}
+
+static void
+xmms_coll_sync_remember_written (gpointer key, gpointer value, gpointer udata)
+{
+	xmms_coll_sync_t *sync = (xmms_coll_sync_t *) udata;
+
+	if (strcmp (key, XMMS_ACTIVE_PLAYLIST) != 0) {
+		g_hash_table_insert (sync->written, g_strdup (key), xmmsv_ref (value));
+	}
+}
+
 static void
 xmms_coll_sync_restore (xmms_coll_sync_t *sync, gboolean sad_hack)
 {
@@ -480,11 +1195,24 @@ xmms_coll_sync_restore (xmms_coll_sync_t *sync, gboolean sad_hack)
 	}
 
 	if (snapshot != NULL) {
+		gchar *journal = xmms_coll_sync_get_journal_path (path);
+
+		sync->snapshot_size = length;
+		xmms_coll_sync_journal_replay (sync, journal, snapshot);
+		g_free (journal);
+
 		xmms_collection_restore (sync->dag, snapshot);
 		xmmsv_unref (snapshot);
+
+		/* The playlists are what the snapshot and journal say now */
+		xmms_collection_foreach_in_namespace (sync->dag,
+		                                      XMMS_COLLECTION_NSID_PLAYLISTS,
+		                                      xmms_coll_sync_remember_written,
+		                                      sync);
 	} else {
 		xmms_log_error ("Could not restore collections from disk.");
 		xmms_collection_restore (sync->dag, NULL);
+		sync->compact = TRUE;
 	}
 
 	g_free (path);
@@ -0,0 +1,49 @@
+/*  XMMS2 - X Music Multiplexer System
+ *  Copyright (C) 2003-2020 XMMS2 Team
+ *
+ *  PLUGINS ARE NOT CONSIDERED TO BE DERIVED WORK !!!
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ */
+
+
+/** @file
+ * Dummy used when shared memory replies are not supported.
+ */
+
+
+#include <xmmspriv/xmms_ipc_shm.h>
+
+xmms_ipc_shm_t *
+xmms_ipc_shm_new (xmms_socket_t fd, gint32 clientid, guint threshold,
+                  gsize max_size, xmms_error_t *err)
+{
+	xmms_error_set (err, XMMS_ERROR_GENERIC,
+	                "shared memory replies are not supported");
+	return NULL;
+}
+
+const gchar *
+xmms_ipc_shm_get_name (xmms_ipc_shm_t *shm)
+{
+	return NULL;
+}
+
+xmms_ipc_msg_t *
+xmms_ipc_shm_place (xmms_ipc_shm_t *shm, xmms_ipc_msg_t *msg)
+{
+	return NULL;
+}
+
+void
+xmms_ipc_shm_destroy (xmms_ipc_shm_t *shm)
+{
+}
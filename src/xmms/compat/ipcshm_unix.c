@@ -0,0 +1,254 @@
+/*  XMMS2 - X Music Multiplexer System
+ *  Copyright (C) 2003-2020 XMMS2 Team
+ *
+ *  PLUGINS ARE NOT CONSIDERED TO BE DERIVED WORK !!!
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ */
+
+
+/** @file
+ * Places large replies to local clients in a POSIX shared memory
+ * segment, see xmmsc/xmmsc_ipc_shm.h for the layout.
+ */
+
+
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+
+#include <xmms/xmms_log.h>
+#include <xmmspriv/xmms_ipc_shm.h>
+#include <xmmsc/xmmsc_idnumbers.h>
+#include <xmmsc/xmmsc_ipc_shm.h>
+
+/* initial size of a segment, it grows on demand up to max_size */
+#define XMMS_IPC_SHM_INITIAL_SIZE (1024 * 1024)
+
+struct xmms_ipc_shm_St {
+	gchar *name;
+	gint fd;
+
+	guchar *base;
+	gsize size;
+	gsize max_size;
+
+	/** Replies smaller than this go through the socket */
+	guint threshold;
+
+	/** Where the next reply is placed */
+	guint64 head;
+	/** Our copy of header->produced */
+	guint64 produced;
+
+	/** Replies are placed from several threads, this serializes
+	 * reserving room for them. The copies run without it. */
+	GMutex mutex;
+};
+
+static gboolean
+xmms_ipc_shm_map (xmms_ipc_shm_t *shm, gsize size)
+{
+	guchar *base;
+
+	if (ftruncate (shm->fd, size) == -1) {
+		return FALSE;
+	}
+
+	base = mmap (NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, shm->fd, 0);
+	if (base == MAP_FAILED) {
+		return FALSE;
+	}
+
+	if (shm->base) {
+		munmap (shm->base, shm->size);
+	}
+
+	shm->base = base;
+	shm->size = size;
+
+	return TRUE;
+}
+
+/**
+ * Create a segment for the client connected on fd. Only clients on the
+ * same host, connected through a unix socket, can use one.
+ */
+xmms_ipc_shm_t *
+xmms_ipc_shm_new (xmms_socket_t fd, gint32 clientid, guint threshold,
+                  gsize max_size, xmms_error_t *err)
+{
+	struct sockaddr_storage addr;
+	socklen_t addrlen = sizeof (addr);
+	xmms_ipc_shm_header_t *header;
+	xmms_ipc_shm_t *shm;
+
+	if (getsockname (fd, (struct sockaddr *) &addr, &addrlen) == -1 ||
+	    addr.ss_family != AF_UNIX) {
+		xmms_error_set (err, XMMS_ERROR_INVAL,
+		                "shared memory replies need a unix socket connection");
+		return NULL;
+	}
+
+	shm = g_new0 (xmms_ipc_shm_t, 1);
+	shm->threshold = MAX (threshold, XMMS_IPC_MSG_HEAD_LEN);
+	shm->max_size = MAX (max_size, XMMS_IPC_SHM_INITIAL_SIZE);
+	shm->head = XMMS_IPC_SHM_DATA_OFFSET;
+	g_mutex_init (&shm->mutex);
+	shm->name = g_strdup_printf ("/xmms2-%d-%d-%08x", (gint) getpid (),
+	                             clientid, g_random_int ());
+
+	shm->fd = shm_open (shm->name, O_RDWR | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR);
+	if (shm->fd == -1) {
+		xmms_error_set (err, XMMS_ERROR_GENERIC,
+		                "couldn't create shared memory segment");
+		g_mutex_clear (&shm->mutex);
+		g_free (shm->name);
+		g_free (shm);
+		return NULL;
+	}
+
+	if (!xmms_ipc_shm_map (shm, XMMS_IPC_SHM_INITIAL_SIZE)) {
+		xmms_error_set (err, XMMS_ERROR_GENERIC,
+		                "couldn't map shared memory segment");
+		xmms_ipc_shm_destroy (shm);
+		return NULL;
+	}
+
+	header = (xmms_ipc_shm_header_t *) shm->base;
+	header->magic = XMMS_IPC_SHM_MAGIC;
+
+	return shm;
+}
+
+const gchar *
+xmms_ipc_shm_get_name (xmms_ipc_shm_t *shm)
+{
+	return shm->name;
+}
+
+/**
+ * Copy a reply into the segment. May be called from several threads
+ * at once.
+ *
+ * @returns a descriptor to send in place of msg, or NULL if msg should
+ * be sent through the socket; because it is small, not a reply, or
+ * there is no room left until the client catches up.
+ */
+xmms_ipc_msg_t *
+xmms_ipc_shm_place (xmms_ipc_shm_t *shm, xmms_ipc_msg_t *msg)
+{
+	xmms_ipc_shm_header_t *header;
+	const guchar *data;
+	guchar *dest;
+	xmms_ipc_msg_t *desc;
+	xmmsv_t *val;
+	guint64 consumed, offset, aligned;
+	guint len;
+
+	if (xmms_ipc_msg_get_cmd (msg) != XMMS_IPC_COMMAND_REPLY) {
+		return NULL;
+	}
+
+	data = xmms_ipc_msg_get_data (msg, &len);
+	if (len < shm->threshold) {
+		return NULL;
+	}
+
+	aligned = XMMS_IPC_SHM_ALIGN (len);
+
+	g_mutex_lock (&shm->mutex);
+
+	header = (xmms_ipc_shm_header_t *) shm->base;
+	consumed = __atomic_load_n (&header->consumed, __ATOMIC_ACQUIRE);
+
+	/* everything handed out has been released, start over */
+	if (consumed == shm->produced) {
+		shm->head = XMMS_IPC_SHM_DATA_OFFSET;
+	}
+
+	if (shm->head + aligned > shm->size) {
+		gsize size = shm->size;
+
+		/* only grow while the client holds nothing, and no other
+		 * reply is being copied into the segment */
+		if (shm->head != XMMS_IPC_SHM_DATA_OFFSET) {
+			g_mutex_unlock (&shm->mutex);
+			return NULL;
+		}
+
+		while (size < XMMS_IPC_SHM_DATA_OFFSET + aligned && size < shm->max_size) {
+			size *= 2;
+		}
+		size = MIN (size, shm->max_size);
+
+		if (XMMS_IPC_SHM_DATA_OFFSET + aligned > size) {
+			g_mutex_unlock (&shm->mutex);
+			return NULL;
+		}
+
+		if (!xmms_ipc_shm_map (shm, size)) {
+			xmms_log_error ("Couldn't grow shared memory segment to %"
+			                G_GSIZE_FORMAT " bytes", size);
+			g_mutex_unlock (&shm->mutex);
+			return NULL;
+		}
+
+		header = (xmms_ipc_shm_header_t *) shm->base;
+	}
+
+	/* The room counts as produced until the client releases it, so it
+	 * isn't handed out again, nor the segment moved, while copying. */
+	offset = shm->head;
+	dest = shm->base + offset;
+
+	shm->head += aligned;
+	shm->produced += aligned;
+	__atomic_store_n (&header->produced, shm->produced, __ATOMIC_RELEASE);
+
+	g_mutex_unlock (&shm->mutex);
+
+	memcpy (dest, data, len);
+
+	desc = xmms_ipc_msg_new (xmms_ipc_msg_get_object (msg),
+	                         XMMS_IPC_COMMAND_SHM_REPLY);
+	xmms_ipc_msg_set_cookie (desc, xmms_ipc_msg_get_cookie (msg));
+
+	val = xmmsv_build_list (XMMSV_LIST_ENTRY_INT (offset),
+	                        XMMSV_LIST_ENTRY_INT (len),
+	                        XMMSV_LIST_END);
+	xmms_ipc_msg_put_value (desc, val);
+	xmmsv_unref (val);
+
+	return desc;
+}
+
+void
+xmms_ipc_shm_destroy (xmms_ipc_shm_t *shm)
+{
+	if (shm->base) {
+		munmap (shm->base, shm->size);
+	}
+
+	if (shm->fd != -1) {
+		close (shm->fd);
+	}
+
+	/* the client unlinks it as soon as it has it mapped */
+	shm_unlink (shm->name);
+
+	g_mutex_clear (&shm->mutex);
+	g_free (shm->name);
+	g_free (shm);
+}
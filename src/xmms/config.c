@@ -16,6 +16,7 @@
  */
 
 #include <glib.h>
+#include <glib/gstdio.h>
 
 #include <stdlib.h>
 #include <unistd.h>
@@ -49,7 +50,7 @@ typedef enum {
 } xmms_configparser_state_t;
 
 typedef struct dump_tree_data_St {
-	FILE *fp;
+	GString *str;
 	xmms_configparser_state_t state;
 
 	gchar indent[128];
@@ -64,6 +65,8 @@ static gchar *xmms_config_client_get_value (xmms_config_t *conf, const gchar *ke
 static gchar *xmms_config_client_register_value (xmms_config_t *config, const gchar *name, const gchar *def_value, xmms_error_t *error);
 static gint compare_key (gconstpointer a, gconstpointer b, gpointer user_data);
 static void xmms_config_client_set_value (xmms_config_t *conf, const gchar *key, const gchar *value, xmms_error_t *err);
+static void xmms_config_client_sync (xmms_config_t *conf, xmms_error_t *err);
+static void xmms_config_save_schedule (void);
 
 #include "config_ipc.c"
 
@@ -91,6 +94,21 @@ struct xmms_config_St {
 	/* Lock on globals are great! */
 	GMutex mutex;
 
+	/* protects property values against the background writer */
+	GMutex value_mutex;
+
+	/* background writer */
+	GThread *save_thread;
+	GMutex save_mutex;
+	GCond save_cond;
+	gboolean save_running;
+	gboolean save_pending;
+	gint64 save_deadline;
+	xmms_config_property_t *save_delay;
+
+	/* serializes writes to the config file */
+	GMutex write_mutex;
+
 	/* parsing */
 	gboolean is_parsing;
 	GQueue *states;
@@ -124,6 +142,12 @@ static xmms_config_t *global_config;
  */
 #define XMMS_CONFIG_VERSION 2
 
+/**
+ * Default number of milliseconds changes are collected before the
+ * config file is rewritten.
+ */
+#define XMMS_CONFIG_SAVE_DELAY "1000"
+
 /**
  * @}
  * @addtogroup Config
@@ -201,6 +225,8 @@ xmms_config_property_get_name (const xmms_config_property_t *prop)
 void
 xmms_config_property_set_data (xmms_config_property_t *prop, const gchar *data)
 {
+	gchar *old;
+
 	g_return_if_fail (prop);
 	g_return_if_fail (data);
 
@@ -208,8 +234,15 @@ xmms_config_property_set_data (xmms_config_property_t *prop, const gchar *data)
 	if (prop->value && !strcmp (prop->value, data))
 		return;
 
-	g_free (prop->value);
-	prop->value = g_strdup (data);
+	old = prop->value;
+	if (global_config) {
+		g_mutex_lock (&global_config->value_mutex);
+		prop->value = g_strdup (data);
+		g_mutex_unlock (&global_config->value_mutex);
+	} else {
+		prop->value = g_strdup (data);
+	}
+	g_free (old);
 
 	xmms_object_emit (XMMS_OBJECT (prop),
 	                  XMMS_IPC_SIGNAL_CONFIG_VALUE_CHANGED,
@@ -221,9 +254,10 @@ xmms_config_property_set_data (xmms_config_property_t *prop, const gchar *data)
 	                                    XMMSV_DICT_END));
 
 	/* save the database to disk, so we don't lose any data
-	 * if the daemon crashes
+	 * if the daemon crashes. The writer collects changes for
+	 * core.config_save_delay milliseconds before rewriting the file.
 	 */
-	xmms_config_save ();
+	xmms_config_save_schedule ();
 }
 
 /**
@@ -579,6 +613,24 @@ xmms_config_client_set_value (xmms_config_t *conf,
 
 }
 
+/**
+ * @internal Write pending config changes to disk right away
+ * @param conf The config
+ * @param err To be filled in if an error occurs
+ */
+static void
+xmms_config_client_sync (xmms_config_t *conf, xmms_error_t *err)
+{
+	if (g_strcmp0 (conf->filename, "memory://") == 0) {
+		return;
+	}
+
+	if (!xmms_config_save ()) {
+		xmms_error_set (err, XMMS_ERROR_GENERIC,
+		                "Couldn't write config file");
+	}
+}
+
 /**
  * @internal Convert global config properties dict to a normal dict
  * @param key The dict key
@@ -640,6 +692,10 @@ xmms_config_destroy (xmms_object_t *object)
 	XMMS_DBG ("Deactivating config object.");
 
 	g_mutex_clear (&config->mutex);
+	g_mutex_clear (&config->value_mutex);
+	g_mutex_clear (&config->save_mutex);
+	g_mutex_clear (&config->write_mutex);
+	g_cond_clear (&config->save_cond);
 
 	g_tree_destroy (config->properties);
 
@@ -763,6 +819,67 @@ load_config (xmms_config_t *config, const gchar *filename)
 }
 
 
+/**
+ * @internal Mark the config as changed and wake up the background
+ * writer. Changes made before the writer has been started (e.g. while
+ * the config file is being parsed) are not scheduled.
+ */
+static void
+xmms_config_save_schedule (void)
+{
+	gint delay;
+
+	if (!global_config || !global_config->save_thread)
+		return;
+
+	delay = xmms_config_property_get_int (global_config->save_delay);
+
+	g_mutex_lock (&global_config->save_mutex);
+	if (!global_config->save_pending) {
+		/* the deadline is set by the first change so that a steady
+		 * stream of changes can't postpone the write forever */
+		global_config->save_pending = TRUE;
+		global_config->save_deadline = g_get_monotonic_time () +
+		                               MAX (delay, 0) * G_TIME_SPAN_MILLISECOND;
+		g_cond_signal (&global_config->save_cond);
+	}
+	g_mutex_unlock (&global_config->save_mutex);
+}
+
+/**
+ * @internal Background writer, saves the config once the pending
+ * changes have been collected for the configured delay.
+ */
+static gpointer
+xmms_config_save_thread (gpointer udata)
+{
+	xmms_config_t *config = (xmms_config_t *) udata;
+
+	g_mutex_lock (&config->save_mutex);
+	while (config->save_running) {
+		if (!config->save_pending) {
+			g_cond_wait (&config->save_cond, &config->save_mutex);
+			continue;
+		}
+
+		if (g_cond_wait_until (&config->save_cond, &config->save_mutex,
+		                       config->save_deadline)) {
+			/* woken up early, recheck state */
+			continue;
+		}
+
+		if (!config->save_pending)
+			continue;
+
+		g_mutex_unlock (&config->save_mutex);
+		xmms_config_save ();
+		g_mutex_lock (&config->save_mutex);
+	}
+	g_mutex_unlock (&config->save_mutex);
+
+	return NULL;
+}
+
 /**
  * @internal Initialize and parse the config file. Resets to default config
  * on parse error.
@@ -775,6 +892,10 @@ xmms_config_init (const gchar *filename)
 
 	config = xmms_object_new (xmms_config_t, xmms_config_destroy);
 	g_mutex_init (&config->mutex);
+	g_mutex_init (&config->value_mutex);
+	g_mutex_init (&config->save_mutex);
+	g_mutex_init (&config->write_mutex);
+	g_cond_init (&config->save_cond);
 	config->filename = filename;
 
 	config->properties = create_tree ();
@@ -785,15 +906,46 @@ xmms_config_init (const gchar *filename)
 	xmms_config_register_ipc_commands (XMMS_OBJECT (config));
 
 	load_config (config, filename);
+
+	config->save_delay = xmms_config_property_register ("core.config_save_delay",
+	                                                    XMMS_CONFIG_SAVE_DELAY,
+	                                                    NULL, NULL);
+
+	if (g_strcmp0 (filename, "memory://") != 0) {
+		config->save_running = TRUE;
+		config->save_thread = g_thread_new ("x2 config writer",
+		                                    xmms_config_save_thread,
+		                                    config);
+	}
 }
 
 /**
- * @internal Shut down the config layer - free memory from the global
- * configuration.
+ * @internal Shut down the config layer - write pending changes and
+ * free memory from the global configuration.
  */
 void
 xmms_config_shutdown ()
 {
+	gboolean pending;
+
+	if (global_config->save_thread) {
+		g_mutex_lock (&global_config->save_mutex);
+		global_config->save_running = FALSE;
+		g_cond_signal (&global_config->save_cond);
+		g_mutex_unlock (&global_config->save_mutex);
+
+		g_thread_join (global_config->save_thread);
+		global_config->save_thread = NULL;
+	}
+
+	g_mutex_lock (&global_config->save_mutex);
+	pending = global_config->save_pending;
+	g_mutex_unlock (&global_config->save_mutex);
+
+	if (pending) {
+		xmms_config_save ();
+	}
+
 	xmms_object_unref (global_config);
 
 }
@@ -848,7 +1000,7 @@ dump_tree (gchar *current_key, xmms_config_property_t *prop,
 			/* decrease indent level */
 			data->indent[--data->indent_level] = '\0';
 
-			fprintf (data->fp, "%s</section>\n", data->indent);
+			g_string_append_printf (data->str, "%s</section>\n", data->indent);
 		}
 	}
 
@@ -860,8 +1012,8 @@ dump_tree (gchar *current_key, xmms_config_property_t *prop,
 		strncpy (section, current_last_dot + 1, dot - current_last_dot + 1);
 		section[dot - current_last_dot - 1] = 0;
 
-		fprintf (data->fp, "%s<section name=\"%s\">\n",
-		         data->indent, section);
+		g_string_append_printf (data->str, "%s<section name=\"%s\">\n",
+		                        data->indent, section);
 
 		/* increase indent level */
 		g_assert (data->indent_level < 127);
@@ -874,23 +1026,61 @@ dump_tree (gchar *current_key, xmms_config_property_t *prop,
 
 	data->prev_key = current_key;
 
-	fprintf (data->fp, "%s<property name=\"%s\">%s</property>\n",
-	         data->indent, prop_name + 1,
-	         xmms_config_property_get_string (prop));
+	g_string_append_printf (data->str, "%s<property name=\"%s\">%s</property>\n",
+	                        data->indent, prop_name + 1,
+	                        xmms_config_property_get_string (prop));
 
 	return FALSE; /* keep going */
 }
 
+/**
+ * @internal Write a buffer to a file and make sure it reached the disk.
+ * @param filename The file to write.
+ * @param str The data to write.
+ * @return TRUE on success.
+ */
+static gboolean
+xmms_config_write_file (const gchar *filename, GString *str)
+{
+	FILE *fp;
+	gboolean ret = TRUE;
+
+	if (!(fp = fopen (filename, "w"))) {
+		xmms_log_error ("Couldn't open %s for writing.", filename);
+		return FALSE;
+	}
+
+	if (fwrite (str->str, 1, str->len, fp) != str->len || fflush (fp) != 0) {
+		xmms_log_error ("Couldn't write %s.", filename);
+		ret = FALSE;
+	} else if (fsync (fileno (fp)) != 0) {
+		xmms_log_error ("Couldn't sync %s to disk.", filename);
+		ret = FALSE;
+	}
+
+	if (fclose (fp) != 0) {
+		ret = FALSE;
+	}
+
+	return ret;
+}
+
 /**
  * @internal Save the global configuration to disk.
- * @param file Absolute path to configfile. This will be overwritten.
+ *
+ * The configuration is written to a temporary file next to the config
+ * file which then replaces it, so a crash while saving never leaves a
+ * truncated config behind. Any save scheduled by a changed value is
+ * covered by this call, and scheduled again if writing fails.
+ *
  * @return TRUE on success.
  */
 gboolean
 xmms_config_save (void)
 {
-	FILE *fp = NULL;
 	dump_tree_data_t data;
+	gchar *tmpname;
+	gboolean ret;
 
 	g_return_val_if_fail (global_config, FALSE);
 
@@ -902,24 +1092,29 @@ xmms_config_save (void)
 	if (global_config->is_parsing)
 		return FALSE;
 
-	if (!(fp = fopen (global_config->filename, "w"))) {
-		xmms_log_error ("Couldn't open %s for writing.",
-		                global_config->filename);
-		return FALSE;
-	}
+	/* changes made from here on will schedule a new save */
+	g_mutex_lock (&global_config->save_mutex);
+	global_config->save_pending = FALSE;
+	g_mutex_unlock (&global_config->save_mutex);
 
-	fprintf (fp, "<?xml version=\"1.0\"?>\n<xmms version=\"%i\">\n",
-	         XMMS_CONFIG_VERSION);
+	g_mutex_lock (&global_config->write_mutex);
 
-	data.fp = fp;
+	data.str = g_string_new (NULL);
 	data.state = XMMS_CONFIG_STATE_START;
 	data.prev_key = NULL;
 
 	strcpy (data.indent, "\t");
 	data.indent_level = 1;
 
+	g_string_append_printf (data.str, "<?xml version=\"1.0\"?>\n<xmms version=\"%i\">\n",
+	                        XMMS_CONFIG_VERSION);
+
+	g_mutex_lock (&global_config->mutex);
+	g_mutex_lock (&global_config->value_mutex);
 	g_tree_foreach (global_config->properties,
 	                (GTraverseFunc) dump_tree, &data);
+	g_mutex_unlock (&global_config->value_mutex);
+	g_mutex_unlock (&global_config->mutex);
 
 	/* close the remaining section tags. the final indent level
 	 * was started with the opening xmms tag, so the loop condition
@@ -929,13 +1124,34 @@ xmms_config_save (void)
 		/* decrease indent level */
 		data.indent[--data.indent_level] = '\0';
 
-		fprintf (fp, "%s</section>\n", data.indent);
+		g_string_append_printf (data.str, "%s</section>\n", data.indent);
+	}
+
+	g_string_append (data.str, "</xmms>\n");
+
+	tmpname = g_strconcat (global_config->filename, ".tmp", NULL);
+
+	ret = xmms_config_write_file (tmpname, data.str);
+	if (ret && g_rename (tmpname, global_config->filename) != 0) {
+		xmms_log_error ("Couldn't replace %s.", global_config->filename);
+		ret = FALSE;
 	}
 
-	fprintf (fp, "</xmms>\n");
-	fclose (fp);
+	if (!ret) {
+		g_unlink (tmpname);
+	}
 
-	return TRUE;
+	g_mutex_unlock (&global_config->write_mutex);
+
+	g_free (tmpname);
+	g_string_free (data.str, TRUE);
+
+	/* the changes are still not on disk, try again later */
+	if (!ret) {
+		xmms_config_save_schedule ();
+	}
+
+	return ret;
 }
 
 /*
@@ -20,8 +20,13 @@
 #include <xmms/xmms_log.h>
 #include <xmms/xmms_config.h>
 #include <xmmspriv/xmms_ipc.h>
+#include <xmmspriv/xmms_ipc_shm.h>
 #include <xmmsc/xmmsc_ipc_msg.h>
 
+/* Replies to clients that understand REPLY_PART are sent in pieces of
+ * this many bytes, so urgent replies don't wait for all of them */
+#define XMMS_IPC_REPLY_PART_SIZE (64 * 1024)
+
 
 /**
   * @defgroup IPC IPC
@@ -44,6 +49,7 @@ typedef struct xmms_ipc_object_pool_t {
 	xmms_object_t *objects[XMMS_IPC_OBJECT_END];
 	xmms_object_t *signals[XMMS_IPC_SIGNAL_END];
 	xmms_object_t *broadcasts[XMMS_IPC_SIGNAL_END];
+	xmms_ipc_broadcast_compat_t compat[XMMS_IPC_SIGNAL_END];
 } xmms_ipc_object_pool_t;
 
 
@@ -61,6 +67,31 @@ struct xmms_ipc_St {
 };
 
 
+typedef struct xmms_ipc_subscription_St xmms_ipc_subscription_t;
+
+/* Latencies are counted in buckets of powers of two microseconds. The
+ * first bucket is for under a microsecond, bucket n for [2^(n-1), 2^n)
+ * microseconds and the last one for everything longer. */
+#define XMMS_IPC_CMD_STATS_BUCKETS 24
+#define XMMS_IPC_CMD_STATS_MAX 32
+
+typedef enum {
+	XMMS_IPC_CMD_PHASE_DISPATCH,
+	XMMS_IPC_CMD_PHASE_EXECUTE,
+	XMMS_IPC_CMD_PHASE_SERIALIZE,
+	XMMS_IPC_CMD_PHASE_END
+} xmms_ipc_cmd_phase_t;
+
+/**
+ * Counters of a single command. Updated by the client threads without
+ * locking, so a snapshot may be off by the commands in flight.
+ */
+typedef struct xmms_ipc_cmd_stats_St {
+	guint calls;
+	guint errors;
+	guint histogram[XMMS_IPC_CMD_PHASE_END][XMMS_IPC_CMD_STATS_BUCKETS];
+} xmms_ipc_cmd_stats_t;
+
 /**
  * A IPC client representation.
  */
@@ -72,31 +103,98 @@ typedef struct xmms_ipc_client_St {
 	xmms_ipc_msg_t *read_msg;
 	xmms_ipc_t *ipc;
 
-	/* this lock protects out_msg, pendingsignals and broadcasts,
-	   which can be accessed from other threads than the
-	   client-thread */
+	/* this lock protects out_msg, out_urgent, signals, broadcasts
+	   and the subscriptions in them, which can be accessed from
+	   other threads than the client-thread */
 	GMutex lock;
 
 	/** Messages waiting to be written */
 	GQueue *out_msg;
 
-	guint pendingsignals[XMMS_IPC_SIGNAL_END];
+	/** Replies to control commands, written ahead of out_msg */
+	GQueue *out_urgent;
+
+	/** The queue whose head has only been written in part */
+	GQueue *partial;
+
+	/** Number of messages queued in and written from out_msg so far,
+	 *  counting each part of a split reply. Subscriptions compare them
+	 *  to tell if their last value was written, so urgent replies,
+	 *  which are written out of turn, are not counted. */
+	guint64 queued;
+	guint64 written;
+
+	/** Bytes waiting in both queues. Past the soft limit broadcasts are
+	 *  coalesced, past the hard limit the client is disconnected. */
+	gsize queued_bytes;
+	gsize soft_limit;
+	gsize hard_limit;
+
+	/** Set once the client is being disconnected */
+	gboolean closing;
+
+	xmms_ipc_subscription_t *signals[XMMS_IPC_SIGNAL_END];
 	GList *broadcasts[XMMS_IPC_SIGNAL_END];
 
+	/** Subscriptions holding a value until their last one is written */
+	GList *waiting;
+
+	/** Bitmask of xmms_ipc_capability_t the client understands */
+	guint32 capabilities;
+
+	/** Segment large replies are placed in, see shm_attach */
+	xmms_ipc_shm_t *shm;
+
+	/** Replies of at least this many bytes are compressed for clients
+	 *  announcing #XMMS_IPC_CAPABILITY_COMPRESSION, 0 for never */
+	guint compress_threshold;
+
 	gint32 id;
 } xmms_ipc_client_t;
 
+/**
+ * A client's subscription to a signal or a broadcast.
+ */
+struct xmms_ipc_subscription_St {
+	xmms_ipc_client_t *client;
+
+	/** XMMS_IPC_COMMAND_SIGNAL or XMMS_IPC_COMMAND_BROADCAST */
+	guint32 command;
+	/** 0 while a signal waits to be restarted */
+	guint32 cookie;
+
+	/** Least time between two values, in milliseconds */
+	gint interval;
+	/** Only keep the newest value while the last one is unsent */
+	gboolean coalesce;
+
+	/** When the last value was queued, and its number in out_msg */
+	gint64 sent;
+	guint64 queued;
+
+	/** Newest value held back, and the timer that sends it */
+	xmmsv_t *held;
+	GSource *timer;
+};
+
 /* id 0 is reserved for the server */
 static gint32 next_client_id = 1;
 
 static GMutex ipc_servers_lock;
 static GList *ipc_servers = NULL;
 
+/* client id -> xmms_ipc_client_t of every connected client */
+static GMutex ipc_clients_lock;
+static GHashTable *ipc_clients = NULL;
+
 static xmms_ipc_manager_t *ipc_manager = NULL;
 
 static GMutex ipc_object_pool_lock;
 static struct xmms_ipc_object_pool_t *ipc_object_pool = NULL;
 
+static gint cmd_stats_enabled = TRUE;
+static xmms_ipc_cmd_stats_t cmd_stats[XMMS_IPC_OBJECT_END][XMMS_IPC_CMD_STATS_MAX];
+
 static void xmms_ipc_close (void);
 static void xmms_ipc_client_destroy (xmms_ipc_client_t *client);
 
@@ -104,8 +202,9 @@ static xmms_ipc_client_t *xmms_ipc_lookup_client (gint32 clientid);
 
 static void xmms_ipc_register_signal (xmms_ipc_client_t *client, xmms_ipc_msg_t *msg, xmmsv_t *arguments);
 static void xmms_ipc_register_broadcast (xmms_ipc_client_t *client, xmms_ipc_msg_t *msg, xmmsv_t *arguments);
-static gboolean xmms_ipc_client_msg_write (xmms_ipc_client_t *client, xmms_ipc_msg_t *msg);
-static gboolean xmms_ipc_client_broadcast_write (guint broadcastid, xmms_ipc_client_t *cli, xmmsv_t *arg);
+static gboolean xmms_ipc_client_msg_write (xmms_ipc_client_t *client, xmms_ipc_msg_t *msg, gboolean urgent);
+static gboolean xmms_ipc_client_reply_write (xmms_ipc_client_t *client, xmms_ipc_msg_t *msg, gboolean urgent);
+static gboolean xmms_ipc_client_broadcast_write (guint broadcastid, xmms_ipc_client_t *cli, xmmsv_t *arg, gboolean droppable);
 
 #include "ipc_manager_ipc.c"
 
@@ -117,10 +216,182 @@ xmms_ipc_handle_cmd_value (xmms_ipc_msg_t *msg, xmmsv_t *val)
 	}
 }
 
+static xmms_ipc_subscription_t *
+xmms_ipc_subscription_new (xmms_ipc_client_t *client, guint32 command)
+{
+	xmms_ipc_subscription_t *sub;
+
+	sub = g_new0 (xmms_ipc_subscription_t, 1);
+	sub->client = client;
+	sub->command = command;
+
+	return sub;
+}
+
+static void
+xmms_ipc_subscription_free (xmms_ipc_subscription_t *sub)
+{
+	if (sub->timer) {
+		g_source_destroy (sub->timer);
+		g_source_unref (sub->timer);
+	}
+
+	if (sub->held) {
+		xmmsv_unref (sub->held);
+	}
+
+	g_free (sub);
+}
+
+/**
+ * Read the optional limits following the signal or broadcast id:
+ * the least interval between two values in milliseconds, and whether
+ * to keep only the newest value while the last one is unsent.
+ */
+static void
+xmms_ipc_subscription_set_limits (xmms_ipc_subscription_t *sub,
+                                  xmmsv_t *arguments)
+{
+	gint32 interval, coalesce;
+
+	if (xmmsv_list_get_int32 (arguments, 1, &interval)) {
+		sub->interval = MAX (interval, 0);
+	}
+
+	if (xmmsv_list_get_int32 (arguments, 2, &coalesce)) {
+		sub->coalesce = !!coalesce;
+	}
+}
+
+/**
+ * Check if a client has more bytes waiting than its soft limit.
+ * Should hold client->lock.
+ */
+static gboolean
+xmms_ipc_client_congested (xmms_ipc_client_t *client)
+{
+	return client->soft_limit && client->queued_bytes > client->soft_limit;
+}
+
+static gsize
+xmms_ipc_msg_size (xmms_ipc_msg_t *msg)
+{
+	unsigned int len;
+
+	xmms_ipc_msg_get_data (msg, &len);
+
+	return len;
+}
+
+/**
+ * Queue a value for a subscription.
+ * Should hold client->lock.
+ */
+static void
+xmms_ipc_subscription_send (xmms_ipc_subscription_t *sub, xmmsv_t *val)
+{
+	xmms_ipc_client_t *client = sub->client;
+	xmms_ipc_msg_t *msg;
+
+	msg = xmms_ipc_msg_new (XMMS_IPC_OBJECT_SIGNAL, sub->command);
+	xmms_ipc_msg_set_cookie (msg, sub->cookie);
+	xmms_ipc_handle_cmd_value (msg, val);
+	xmms_ipc_client_msg_write (client, msg, FALSE);
+
+	sub->sent = g_get_monotonic_time ();
+	sub->queued = client->queued;
+
+	/* signals need to be restarted by the client */
+	if (sub->command == XMMS_IPC_COMMAND_SIGNAL) {
+		sub->cookie = 0;
+	}
+}
+
+static gboolean xmms_ipc_subscription_timeout (gpointer data);
+
+/**
+ * Send the held value, unless the subscription's limits keep it back
+ * for now. Then it is sent by the timer or when the last value has
+ * been written.
+ * Should hold client->lock.
+ */
+static void
+xmms_ipc_subscription_flush (xmms_ipc_subscription_t *sub)
+{
+	xmms_ipc_client_t *client = sub->client;
+	gint64 now, due;
+
+	if (!sub->held || sub->timer) {
+		return;
+	}
+
+	if ((sub->coalesce || xmms_ipc_client_congested (client)) &&
+	    client->written < sub->queued) {
+		if (!g_list_find (client->waiting, sub)) {
+			client->waiting = g_list_prepend (client->waiting, sub);
+		}
+		return;
+	}
+
+	now = g_get_monotonic_time ();
+	due = sub->sent + (gint64) sub->interval * 1000;
+
+	if (sub->interval && now < due) {
+		sub->timer = g_timeout_source_new ((due - now + 999) / 1000);
+		g_source_set_callback (sub->timer, xmms_ipc_subscription_timeout,
+		                       sub, NULL);
+		g_source_attach (sub->timer, g_main_loop_get_context (client->ml));
+		return;
+	}
+
+	xmms_ipc_subscription_send (sub, sub->held);
+	xmmsv_unref (sub->held);
+	sub->held = NULL;
+}
+
+static gboolean
+xmms_ipc_subscription_timeout (gpointer data)
+{
+	xmms_ipc_subscription_t *sub = data;
+	xmms_ipc_client_t *client = sub->client;
+
+	g_mutex_lock (&client->lock);
+	g_source_unref (sub->timer);
+	sub->timer = NULL;
+	xmms_ipc_subscription_flush (sub);
+	g_mutex_unlock (&client->lock);
+
+	return FALSE;
+}
+
+/**
+ * Hand a new value to a subscription, replacing any value it holds.
+ * Values that may not be dropped skip the soft limit.
+ * Should hold client->lock.
+ */
+static void
+xmms_ipc_subscription_deliver (xmms_ipc_subscription_t *sub, xmmsv_t *val,
+                               gboolean droppable)
+{
+	if (!sub->interval && !sub->coalesce &&
+	    (!droppable || !xmms_ipc_client_congested (sub->client))) {
+		xmms_ipc_subscription_send (sub, val);
+		return;
+	}
+
+	if (sub->held) {
+		xmmsv_unref (sub->held);
+	}
+	sub->held = xmmsv_ref (val);
+
+	xmms_ipc_subscription_flush (sub);
+}
+
 static void
 xmms_ipc_register_signal (xmms_ipc_client_t *client,
                           xmms_ipc_msg_t *msg, xmmsv_t *arguments)
 {
+	xmms_ipc_subscription_t *sub;
 	xmmsv_t *arg;
 	gint32 signalid;
 	int r;
@@ -143,7 +414,15 @@ xmms_ipc_register_signal (xmms_ipc_client_t *client,
 	}
 
 	g_mutex_lock (&client->lock);
-	client->pendingsignals[signalid] = xmms_ipc_msg_get_cookie (msg);
+	sub = client->signals[signalid];
+	if (!sub) {
+		sub = xmms_ipc_subscription_new (client, XMMS_IPC_COMMAND_SIGNAL);
+		client->signals[signalid] = sub;
+	}
+	sub->cookie = xmms_ipc_msg_get_cookie (msg);
+
+	/* restarts only carry the id, and keep the earlier limits */
+	xmms_ipc_subscription_set_limits (sub, arguments);
 	g_mutex_unlock (&client->lock);
 }
 
@@ -151,6 +430,7 @@ static void
 xmms_ipc_register_broadcast (xmms_ipc_client_t *client,
                              xmms_ipc_msg_t *msg, xmmsv_t *arguments)
 {
+	xmms_ipc_subscription_t *sub;
 	xmmsv_t *arg;
 	gint32 broadcastid;
 	int r;
@@ -172,25 +452,223 @@ xmms_ipc_register_broadcast (xmms_ipc_client_t *client,
 		return;
 	}
 
+	sub = xmms_ipc_subscription_new (client, XMMS_IPC_COMMAND_BROADCAST);
+	sub->cookie = xmms_ipc_msg_get_cookie (msg);
+	xmms_ipc_subscription_set_limits (sub, arguments);
+
 	g_mutex_lock (&client->lock);
 	client->broadcasts[broadcastid] =
-		g_list_append (client->broadcasts[broadcastid],
-		               GUINT_TO_POINTER (xmms_ipc_msg_get_cookie (msg)));
+		g_list_append (client->broadcasts[broadcastid], sub);
 
 	g_mutex_unlock (&client->lock);
 }
 
+/**
+ * Find the object a command is called on.
+ *
+ * @returns the object, or NULL if there is no such command.
+ */
+static xmms_object_t *
+xmms_ipc_lookup_cmd (uint32_t objid, uint32_t cmdid)
+{
+	xmms_object_t *object;
+
+	if (objid >= XMMS_IPC_OBJECT_END) {
+		xmms_log_error ("Bad object id (%d)", objid);
+		return NULL;
+	}
+
+	g_mutex_lock (&ipc_object_pool_lock);
+	object = ipc_object_pool->objects[objid];
+	g_mutex_unlock (&ipc_object_pool_lock);
+	if (!object) {
+		xmms_log_error ("Object %d was not found!", objid);
+		return NULL;
+	}
+
+	if (!xmms_object_cmd_lookup (object, cmdid)) {
+		xmms_log_error ("No such cmd %d on object %d", cmdid, objid);
+		return NULL;
+	}
+
+	return object;
+}
+
+static xmms_ipc_cmd_stats_t *
+xmms_ipc_cmd_stats_lookup (uint32_t objid, uint32_t cmdid)
+{
+	if (!g_atomic_int_get (&cmd_stats_enabled) ||
+	    objid >= XMMS_IPC_OBJECT_END ||
+	    cmdid < XMMS_IPC_COMMAND_FIRST ||
+	    cmdid >= XMMS_IPC_COMMAND_FIRST + XMMS_IPC_CMD_STATS_MAX) {
+		return NULL;
+	}
+
+	return &cmd_stats[objid][cmdid - XMMS_IPC_COMMAND_FIRST];
+}
+
+static void
+xmms_ipc_cmd_stats_record (xmms_ipc_cmd_stats_t *stats,
+                           xmms_ipc_cmd_phase_t phase, gint64 usec)
+{
+	guint bucket = 0;
+
+	if (usec > 0) {
+		bucket = MIN (g_bit_storage (usec), XMMS_IPC_CMD_STATS_BUCKETS - 1);
+	}
+
+	g_atomic_int_inc (&stats->histogram[phase][bucket]);
+}
+
+/**
+ * Call a command, counting it in the command stats.
+ *
+ * @param received When the command came in.
+ * @param finished Set to when the command returned, if it was counted.
+ * @returns the stats the command was counted in, or NULL.
+ */
+static xmms_ipc_cmd_stats_t *
+xmms_ipc_cmd_call_counted (xmms_object_t *object, uint32_t objid,
+                           uint32_t cmdid, xmms_object_cmd_arg_t *arg,
+                           gint64 received, gint64 *finished)
+{
+	xmms_ipc_cmd_stats_t *stats;
+	gint64 started = 0, now;
+
+	stats = xmms_ipc_cmd_stats_lookup (objid, cmdid);
+	if (stats) {
+		started = g_get_monotonic_time ();
+		g_atomic_int_inc (&stats->calls);
+		xmms_ipc_cmd_stats_record (stats, XMMS_IPC_CMD_PHASE_DISPATCH,
+		                           started - received);
+	}
+
+	xmms_object_cmd_call (object, cmdid, arg);
+
+	if (stats) {
+		now = g_get_monotonic_time ();
+		xmms_ipc_cmd_stats_record (stats, XMMS_IPC_CMD_PHASE_EXECUTE,
+		                           now - started);
+		if (xmms_error_iserror (&arg->error)) {
+			g_atomic_int_inc (&stats->errors);
+		}
+		if (finished) {
+			*finished = now;
+		}
+	}
+
+	return stats;
+}
+
+/**
+ * Run a list of [object, command, arguments] commands for a client,
+ * in order.
+ *
+ * @returns the list of return values, with an error value in place of
+ * each command that failed.
+ */
+xmmsv_t *
+xmms_ipc_batch_call (gint32 clientid, uint32_t cookie, xmmsv_t *commands,
+                     xmms_error_t *err)
+{
+	xmmsv_list_iter_t *it;
+	xmmsv_t *results;
+
+	results = xmmsv_new_list ();
+
+	xmmsv_get_list_iter (commands, &it);
+	for (; xmmsv_list_iter_valid (it); xmmsv_list_iter_next (it)) {
+		xmms_object_cmd_arg_t arg;
+		xmms_object_t *object;
+		xmmsv_t *command, *arguments, *result;
+		gint32 objid, cmdid;
+
+		xmmsv_list_iter_entry (it, &command);
+
+		if (!xmmsv_list_get_int32 (command, 0, &objid) ||
+		    !xmmsv_list_get_int32 (command, 1, &cmdid) ||
+		    !xmmsv_list_get (command, 2, &arguments) ||
+		    !xmmsv_is_type (arguments, XMMSV_TYPE_LIST)) {
+			result = xmmsv_new_error ("Malformed batch command");
+			xmmsv_list_append (results, result);
+			xmmsv_unref (result);
+			continue;
+		}
+
+		/* these reply later on, by cookie */
+		if (objid == XMMS_IPC_OBJECT_SIGNAL ||
+		    objid == XMMS_IPC_OBJECT_COURIER ||
+		    (objid == XMMS_IPC_OBJECT_MAIN && cmdid == XMMS_IPC_COMMAND_MAIN_BATCH)) {
+			result = xmmsv_new_error ("Command can't be batched");
+			xmmsv_list_append (results, result);
+			xmmsv_unref (result);
+			continue;
+		}
+
+		object = xmms_ipc_lookup_cmd (objid, cmdid);
+		if (!object) {
+			result = xmmsv_new_error ("No such command");
+			xmmsv_list_append (results, result);
+			xmmsv_unref (result);
+			continue;
+		}
+
+		xmms_object_cmd_arg_init (&arg);
+		arg.args = arguments;
+		arg.client = clientid;
+		arg.cookie = cookie;
+
+		xmms_ipc_cmd_call_counted (object, objid, cmdid, &arg,
+		                           g_get_monotonic_time (), NULL);
+		if (xmms_error_isok (&arg.error)) {
+			result = arg.retval ? arg.retval : xmmsv_new_none ();
+		} else {
+			result = xmmsv_new_error (xmms_error_message_get (&arg.error));
+			if (arg.retval) {
+				xmmsv_unref (arg.retval);
+			}
+		}
+
+		xmmsv_list_append (results, result);
+		xmmsv_unref (result);
+	}
+
+	return results;
+}
+
+/**
+ * Check if a command controls playback, so its reply should not wait
+ * behind bulk replies.
+ */
+static gboolean
+xmms_ipc_cmd_is_control (uint32_t objid, uint32_t cmdid)
+{
+	switch (objid) {
+		case XMMS_IPC_OBJECT_PLAYBACK:
+			return TRUE;
+		case XMMS_IPC_OBJECT_PLAYLIST:
+			return cmdid == XMMS_IPC_COMMAND_PLAYLIST_SET_NEXT ||
+			       cmdid == XMMS_IPC_COMMAND_PLAYLIST_SET_NEXT_REL;
+		default:
+			return FALSE;
+	}
+}
+
 static void
 process_msg (xmms_ipc_client_t *client, xmms_ipc_msg_t *msg)
 {
 	xmms_object_t *object;
 	xmms_object_cmd_arg_t arg;
+	xmms_ipc_cmd_stats_t *stats;
 	xmms_ipc_msg_t *retmsg;
 	xmmsv_t *error, *arguments;
 	uint32_t objid, cmdid;
+	gint64 received, finished = 0;
 
 	g_return_if_fail (msg);
 
+	received = g_get_monotonic_time ();
+
 	objid = xmms_ipc_msg_get_object (msg);
 	cmdid = xmms_ipc_msg_get_cmd (msg);
 
@@ -213,21 +691,8 @@ process_msg (xmms_ipc_client_t *client, xmms_ipc_msg_t *msg)
 		goto out;
 	}
 
-	if (objid >= XMMS_IPC_OBJECT_END) {
-		xmms_log_error ("Bad object id (%d)", objid);
-		goto out;
-	}
-
-	g_mutex_lock (&ipc_object_pool_lock);
-	object = ipc_object_pool->objects[objid];
-	g_mutex_unlock (&ipc_object_pool_lock);
+	object = xmms_ipc_lookup_cmd (objid, cmdid);
 	if (!object) {
-		xmms_log_error ("Object %d was not found!", objid);
-		goto out;
-	}
-
-	if (!g_tree_lookup (object->cmds, GUINT_TO_POINTER (cmdid))) {
-		xmms_log_error ("No such cmd %d on object %d", cmdid, objid);
 		goto out;
 	}
 
@@ -236,7 +701,9 @@ process_msg (xmms_ipc_client_t *client, xmms_ipc_msg_t *msg)
 	arg.client = client->id;
 	arg.cookie = xmms_ipc_msg_get_cookie (msg);
 
-	xmms_object_cmd_call (object, cmdid, &arg);
+	stats = xmms_ipc_cmd_call_counted (object, objid, cmdid, &arg,
+	                                   received, &finished);
+
 	if (xmms_error_isok (&arg.error)) {
 		if (!arg.retval) {
 			/* Skip reply if method is a noreply and didn't fail */
@@ -261,9 +728,13 @@ process_msg (xmms_ipc_client_t *client, xmms_ipc_msg_t *msg)
 		xmmsv_unref (arg.retval);
 
 	xmms_ipc_msg_set_cookie (retmsg, xmms_ipc_msg_get_cookie (msg));
-	g_mutex_lock (&client->lock);
-	xmms_ipc_client_msg_write (client, retmsg);
-	g_mutex_unlock (&client->lock);
+	xmms_ipc_client_reply_write (client, retmsg,
+	                             xmms_ipc_cmd_is_control (objid, cmdid));
+
+	if (stats) {
+		xmms_ipc_cmd_stats_record (stats, XMMS_IPC_CMD_PHASE_SERIALIZE,
+		                           g_get_monotonic_time () - finished);
+	}
 
 out:
 	if (arguments) {
@@ -329,18 +800,68 @@ xmms_ipc_client_write_cb (GIOChannel *iochan,
 	g_return_val_if_fail (client, FALSE);
 
 	while (TRUE) {
-		xmms_ipc_msg_t *msg;
-
+		xmms_ipc_msg_t *msgs[XMMS_IPC_IOVEC_MAX];
+		GQueue *lanes[XMMS_IPC_IOVEC_MAX];
+		gint count = 0, written, i;
+		GList *n;
+
+		/* only this thread removes messages from the queues, so their
+		 * heads stay valid while the lock is dropped. A message written
+		 * in part is finished first, then urgent replies go ahead of
+		 * the rest. */
 		g_mutex_lock (&client->lock);
-		msg = g_queue_peek_head (client->out_msg);
+		if (client->partial) {
+			lanes[count] = client->partial;
+			msgs[count++] = g_queue_peek_head (client->partial);
+		}
+		for (n = client->out_urgent->head; n && count < XMMS_IPC_IOVEC_MAX; n = n->next) {
+			if (client->partial != client->out_urgent || n != client->out_urgent->head) {
+				lanes[count] = client->out_urgent;
+				msgs[count++] = n->data;
+			}
+		}
+		for (n = client->out_msg->head; n && count < XMMS_IPC_IOVEC_MAX; n = n->next) {
+			if (client->partial != client->out_msg || n != client->out_msg->head) {
+				lanes[count] = client->out_msg;
+				msgs[count++] = n->data;
+			}
+		}
 		g_mutex_unlock (&client->lock);
 
-		if (!msg)
+		if (!count)
 			break;
 
-		if (!xmms_ipc_msg_write_transport (msg,
-		                                   client->transport,
-		                                   &disconnect)) {
+		written = xmms_ipc_msg_write_transport_many (msgs, count,
+		                                             client->transport,
+		                                             &disconnect);
+
+		g_mutex_lock (&client->lock);
+		for (i = 0; i < written; i++) {
+			g_queue_pop_head (lanes[i]);
+			client->queued_bytes -= xmms_ipc_msg_size (msgs[i]);
+			if (lanes[i] == client->out_msg) {
+				client->written++;
+			}
+		}
+		client->partial = written < count ? lanes[written] : NULL;
+
+		/* let coalescing subscriptions send their newest value */
+		if (client->waiting) {
+			GList *waiting = client->waiting;
+
+			client->waiting = NULL;
+			for (n = waiting; n; n = n->next) {
+				xmms_ipc_subscription_flush (n->data);
+			}
+			g_list_free (waiting);
+		}
+		g_mutex_unlock (&client->lock);
+
+		for (i = 0; i < written; i++) {
+			xmms_ipc_msg_destroy (msgs[i]);
+		}
+
+		if (written < count) {
 			if (disconnect) {
 				break;
 			} else {
@@ -348,12 +869,6 @@ xmms_ipc_client_write_cb (GIOChannel *iochan,
 				return TRUE;
 			}
 		}
-
-		g_mutex_lock (&client->lock);
-		g_queue_pop_head (client->out_msg);
-		g_mutex_unlock (&client->lock);
-
-		xmms_ipc_msg_destroy (msg);
 	}
 
 	return FALSE;
@@ -391,6 +906,7 @@ xmms_ipc_client_thread (gpointer data)
 static xmms_ipc_client_t *
 xmms_ipc_client_new (xmms_ipc_t *ipc, xmms_ipc_transport_t *transport)
 {
+	xmms_config_property_t *cv;
 	xmms_ipc_client_t *client;
 	GMainContext *context;
 	int fd;
@@ -416,9 +932,26 @@ xmms_ipc_client_new (xmms_ipc_t *ipc, xmms_ipc_transport_t *transport)
 	client->transport = transport;
 	client->ipc = ipc;
 	client->out_msg = g_queue_new ();
+	client->out_urgent = g_queue_new ();
 	g_mutex_init (&client->lock);
 	client->id = next_client_id++;
 
+	/* in kilobytes, 0 for no limit */
+	cv = xmms_config_lookup ("core.ipc_queue_soft_limit");
+	if (cv) {
+		client->soft_limit = (gsize) MAX (0, xmms_config_property_get_int (cv)) * 1024;
+	}
+
+	cv = xmms_config_lookup ("core.ipc_queue_hard_limit");
+	if (cv) {
+		client->hard_limit = (gsize) MAX (0, xmms_config_property_get_int (cv)) * 1024;
+	}
+
+	cv = xmms_config_lookup ("core.ipc_compress_threshold");
+	if (cv) {
+		client->compress_threshold = MAX (0, xmms_config_property_get_int (cv));
+	}
+
 	return client;
 }
 
@@ -435,22 +968,33 @@ xmms_ipc_client_destroy (xmms_ipc_client_t *client)
 		g_mutex_unlock (&client->ipc->mutex_lock);
 	}
 
+	g_mutex_lock (&ipc_clients_lock);
+	if (ipc_clients && g_hash_table_lookup (ipc_clients, GINT_TO_POINTER (client->id)) == client) {
+		g_hash_table_remove (ipc_clients, GINT_TO_POINTER (client->id));
+	}
+	g_mutex_unlock (&ipc_clients_lock);
+
 	g_main_loop_unref (client->ml);
 	g_io_channel_unref (client->iochan);
 
 	xmms_ipc_transport_destroy (client->transport);
 
 	g_mutex_lock (&client->lock);
-	while (!g_queue_is_empty (client->out_msg)) {
-		xmms_ipc_msg_t *msg = g_queue_pop_head (client->out_msg);
-		xmms_ipc_msg_destroy (msg);
-	}
+	g_queue_free_full (client->out_msg, (GDestroyNotify) xmms_ipc_msg_destroy);
+	g_queue_free_full (client->out_urgent, (GDestroyNotify) xmms_ipc_msg_destroy);
 
-	g_queue_free (client->out_msg);
+	if (client->shm) {
+		xmms_ipc_shm_destroy (client->shm);
+	}
 
 	for (i = 0; i < XMMS_IPC_SIGNAL_END; i++) {
-		g_list_free (client->broadcasts[i]);
+		if (client->signals[i]) {
+			xmms_ipc_subscription_free (client->signals[i]);
+		}
+		g_list_free_full (client->broadcasts[i],
+		                  (GDestroyNotify) xmms_ipc_subscription_free);
 	}
+	g_list_free (client->waiting);
 
 	g_mutex_unlock (&client->lock);
 	g_mutex_clear (&client->lock);
@@ -489,7 +1033,7 @@ xmms_ipc_send_broadcast (guint broadcastid, gint32 clientid, xmmsv_t *arg,
 	}
 
 	g_mutex_lock (&cli->lock);
-	ret = xmms_ipc_client_broadcast_write (broadcastid, cli, arg);
+	ret = xmms_ipc_client_broadcast_write (broadcastid, cli, arg, FALSE);
 	g_mutex_unlock (&cli->lock);
 
 	if (!ret) {
@@ -499,6 +1043,229 @@ xmms_ipc_send_broadcast (guint broadcastid, gint32 clientid, xmmsv_t *arg,
 	return;
 }
 
+/**
+ * Get the number of messages waiting to be written to a client.
+ *
+ * @returns the queue length, or -1 if there is no such client.
+ */
+gint
+xmms_ipc_client_queue_length (gint32 clientid)
+{
+	xmms_ipc_client_t *cli;
+	gint length;
+
+	cli = xmms_ipc_lookup_client (clientid);
+	if (cli == NULL) {
+		return -1;
+	}
+
+	g_mutex_lock (&cli->lock);
+	length = g_queue_get_length (cli->out_msg) +
+	         g_queue_get_length (cli->out_urgent);
+	g_mutex_unlock (&cli->lock);
+
+	return length;
+}
+
+/**
+ * Turn the per command counters on or off.
+ */
+void
+xmms_ipc_command_stats_enable (gboolean enable)
+{
+	g_atomic_int_set (&cmd_stats_enabled, enable);
+}
+
+void
+on_config_ipc_command_stats_change (xmms_object_t *object, xmmsv_t *_data,
+                                    gpointer udata)
+{
+	xmms_config_property_t *cv = (xmms_config_property_t *) object;
+
+	xmms_ipc_command_stats_enable (!!xmms_config_property_get_int (cv));
+}
+
+static xmmsv_t *
+xmms_ipc_cmd_stats_histogram (xmms_ipc_cmd_stats_t *stats,
+                              xmms_ipc_cmd_phase_t phase)
+{
+	xmmsv_t *list;
+	gint i;
+
+	list = xmmsv_new_list ();
+	for (i = 0; i < XMMS_IPC_CMD_STATS_BUCKETS; i++) {
+		xmmsv_list_append_int (list, (guint) g_atomic_int_get (&stats->histogram[phase][i]));
+	}
+
+	return list;
+}
+
+/**
+ * Get the counters of every command called since the last reset.
+ *
+ * @returns a list of dicts with the object and command id, the number
+ * of calls and errors, and for dispatch, execute and serialize a list
+ * of #XMMS_IPC_CMD_STATS_BUCKETS latency bucket counts.
+ */
+xmmsv_t *
+xmms_ipc_command_stats (void)
+{
+	xmms_ipc_cmd_stats_t *stats;
+	xmmsv_t *list, *dict;
+	gint objid, i;
+	guint calls;
+
+	list = xmmsv_new_list ();
+
+	for (objid = 0; objid < XMMS_IPC_OBJECT_END; objid++) {
+		for (i = 0; i < XMMS_IPC_CMD_STATS_MAX; i++) {
+			stats = &cmd_stats[objid][i];
+
+			calls = g_atomic_int_get (&stats->calls);
+			if (!calls) {
+				continue;
+			}
+
+			dict = xmmsv_build_dict (XMMSV_DICT_ENTRY_INT ("object", objid),
+			                         XMMSV_DICT_ENTRY_INT ("command", XMMS_IPC_COMMAND_FIRST + i),
+			                         XMMSV_DICT_ENTRY_INT ("calls", calls),
+			                         XMMSV_DICT_ENTRY_INT ("errors", (guint) g_atomic_int_get (&stats->errors)),
+			                         XMMSV_DICT_ENTRY ("dispatch", xmms_ipc_cmd_stats_histogram (stats, XMMS_IPC_CMD_PHASE_DISPATCH)),
+			                         XMMSV_DICT_ENTRY ("execute", xmms_ipc_cmd_stats_histogram (stats, XMMS_IPC_CMD_PHASE_EXECUTE)),
+			                         XMMSV_DICT_ENTRY ("serialize", xmms_ipc_cmd_stats_histogram (stats, XMMS_IPC_CMD_PHASE_SERIALIZE)),
+			                         XMMSV_DICT_END);
+
+			xmmsv_list_append (list, dict);
+			xmmsv_unref (dict);
+		}
+	}
+
+	return list;
+}
+
+/**
+ * Clear the counters of every command.
+ */
+void
+xmms_ipc_command_stats_reset (void)
+{
+	guint *counter, *end;
+
+	/* one counter at a time, so commands in flight may still be counted */
+	counter = (guint *) cmd_stats;
+	end = counter + sizeof (cmd_stats) / sizeof (guint);
+
+	for (; counter < end; counter++) {
+		g_atomic_int_set (counter, 0);
+	}
+}
+
+/**
+ * Get the outbound queue of every connected client.
+ *
+ * @returns a list of dicts with the client id, and the number of
+ * messages and bytes waiting to be written to it.
+ */
+xmmsv_t *
+xmms_ipc_client_queue_stats (void)
+{
+	GHashTableIter iter;
+	xmms_ipc_client_t *cli;
+	xmmsv_t *list, *dict;
+
+	list = xmmsv_new_list ();
+
+	g_mutex_lock (&ipc_clients_lock);
+
+	if (ipc_clients) {
+		g_hash_table_iter_init (&iter, ipc_clients);
+		while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &cli)) {
+			g_mutex_lock (&cli->lock);
+			dict = xmmsv_build_dict (XMMSV_DICT_ENTRY_INT ("id", cli->id),
+			                         XMMSV_DICT_ENTRY_INT ("queued", g_queue_get_length (cli->out_msg) +
+			                                                         g_queue_get_length (cli->out_urgent)),
+			                         XMMSV_DICT_ENTRY_INT ("queued_bytes", cli->queued_bytes),
+			                         XMMSV_DICT_END);
+			g_mutex_unlock (&cli->lock);
+
+			xmmsv_list_append (list, dict);
+			xmmsv_unref (dict);
+		}
+	}
+
+	g_mutex_unlock (&ipc_clients_lock);
+
+	return list;
+}
+
+/**
+ * Set the protocol capabilities a client has opted in to.
+ */
+void
+xmms_ipc_client_set_capabilities (gint32 clientid, guint32 capabilities,
+                                  xmms_error_t *err)
+{
+	xmms_ipc_client_t *cli;
+
+	cli = xmms_ipc_lookup_client (clientid);
+	if (cli == NULL) {
+		xmms_error_set (err, XMMS_ERROR_NOENT, "client not found");
+		return;
+	}
+
+	g_mutex_lock (&cli->lock);
+	cli->capabilities = capabilities;
+	g_mutex_unlock (&cli->lock);
+}
+
+/**
+ * Create a shared memory segment for large replies to a client. It is
+ * used once the client announces #XMMS_IPC_CAPABILITY_SHM_REPLY.
+ *
+ * @returns the name of the segment.
+ */
+gchar *
+xmms_ipc_client_shm_attach (gint32 clientid, xmms_error_t *err)
+{
+	xmms_config_property_t *cv;
+	xmms_ipc_client_t *cli;
+	xmms_ipc_shm_t *shm;
+	guint threshold;
+	gsize max_size;
+
+	cli = xmms_ipc_lookup_client (clientid);
+	if (cli == NULL) {
+		xmms_error_set (err, XMMS_ERROR_NOENT, "client not found");
+		return NULL;
+	}
+
+	cv = xmms_config_lookup ("core.ipc_shm_threshold");
+	threshold = xmms_config_property_get_int (cv);
+
+	cv = xmms_config_lookup ("core.ipc_shm_max_size");
+	max_size = (gsize) xmms_config_property_get_int (cv) * 1024 * 1024;
+
+	g_mutex_lock (&cli->lock);
+
+	if (cli->shm) {
+		xmms_error_set (err, XMMS_ERROR_INVAL, "already attached");
+		g_mutex_unlock (&cli->lock);
+		return NULL;
+	}
+
+	shm = xmms_ipc_shm_new (xmms_ipc_transport_fd_get (cli->transport),
+	                        clientid, threshold, max_size, err);
+	cli->shm = shm;
+
+	g_mutex_unlock (&cli->lock);
+
+	if (shm == NULL) {
+		return NULL;
+	}
+
+	return g_strdup (xmms_ipc_shm_get_name (shm));
+}
+
 /**
  * Send an ipc message to a client.
  */
@@ -514,9 +1281,7 @@ xmms_ipc_send_message (gint32 clientid, xmms_ipc_msg_t *msg, xmms_error_t *err)
 		return;
 	}
 
-	g_mutex_lock (&cli->lock);
-	ret = xmms_ipc_client_msg_write (cli, msg);
-	g_mutex_unlock (&cli->lock);
+	ret = xmms_ipc_client_reply_write (cli, msg, FALSE);
 
 	if (!ret) {
 		xmms_error_set (err, XMMS_ERROR_GENERIC, "failed to write message");
@@ -531,45 +1296,160 @@ xmms_ipc_send_message (gint32 clientid, xmms_ipc_msg_t *msg, xmms_error_t *err)
 static xmms_ipc_client_t *
 xmms_ipc_lookup_client (gint32 id)
 {
-	GList *c, *s;
-	xmms_ipc_t *ipc;
-	xmms_ipc_client_t *cli;
+	xmms_ipc_client_t *cli = NULL;
 
-	g_mutex_lock (&ipc_servers_lock);
-	for (s = ipc_servers; s && s->data; s = g_list_next (s)) {
-		ipc = s->data;
+	g_mutex_lock (&ipc_clients_lock);
+	if (ipc_clients) {
+		cli = g_hash_table_lookup (ipc_clients, GINT_TO_POINTER (id));
+	}
+	g_mutex_unlock (&ipc_clients_lock);
 
-		g_mutex_lock (&ipc->mutex_lock);
-		for (c = ipc->clients; c; c = g_list_next (c)) {
-			cli = c->data;
+	return cli;
+}
 
-			if (cli->id == id) {
-				g_mutex_unlock (&ipc->mutex_lock);
-				g_mutex_unlock (&ipc_servers_lock);
-				return cli;
-			}
+/**
+ * Split a large reply into #XMMS_IPC_COMMAND_REPLY_PART messages, each
+ * carrying the next piece of the serialized reply, so other replies
+ * can be written in between.
+ *
+ * @returns the parts, or NULL if the reply is small enough to be sent
+ * as it is.
+ */
+static GList *
+xmms_ipc_msg_split (xmms_ipc_msg_t *msg)
+{
+	const unsigned char *data;
+	unsigned int len, offset;
+	GList *parts = NULL;
+
+	if (xmms_ipc_msg_get_cmd (msg) != XMMS_IPC_COMMAND_REPLY &&
+	    xmms_ipc_msg_get_cmd (msg) != XMMS_IPC_COMMAND_COMPRESSED) {
+		return NULL;
+	}
+
+	data = xmms_ipc_msg_get_data (msg, &len);
+	if (len <= XMMS_IPC_REPLY_PART_SIZE) {
+		return NULL;
+	}
+
+	for (offset = 0; offset < len; offset += XMMS_IPC_REPLY_PART_SIZE) {
+		xmms_ipc_msg_t *part;
+		xmmsv_t *bin;
+
+		part = xmms_ipc_msg_new (xmms_ipc_msg_get_object (msg),
+		                         XMMS_IPC_COMMAND_REPLY_PART);
+		xmms_ipc_msg_set_cookie (part, xmms_ipc_msg_get_cookie (msg));
+
+		bin = xmmsv_new_bin (data + offset,
+		                     MIN (XMMS_IPC_REPLY_PART_SIZE, len - offset));
+		xmms_ipc_msg_put_value (part, bin);
+		xmmsv_unref (bin);
+
+		parts = g_list_prepend (parts, part);
+	}
+
+	return g_list_reverse (parts);
+}
+
+/**
+ * Turn a reply into what is queued for the client: placed in shared
+ * memory, compressed, or split into parts, as far as the client takes
+ * them. This copies the whole reply, so it runs without client->lock,
+ * and only the result is queued under it.
+ *
+ * @returns the messages to queue in place of msg, in order.
+ */
+static GList *
+xmms_ipc_client_msg_prepare (xmms_ipc_client_t *client, xmms_ipc_msg_t *msg,
+                             gboolean urgent)
+{
+	xmms_ipc_shm_t *shm;
+	guint32 capabilities;
+	GList *parts = NULL;
+
+	g_mutex_lock (&client->lock);
+	shm = client->shm;
+	capabilities = client->capabilities;
+	g_mutex_unlock (&client->lock);
+
+	if (shm && (capabilities & XMMS_IPC_CAPABILITY_SHM_REPLY)) {
+		xmms_ipc_msg_t *desc = xmms_ipc_shm_place (shm, msg);
+		if (desc) {
+			xmms_ipc_msg_destroy (msg);
+			msg = desc;
 		}
-		g_mutex_unlock (&ipc->mutex_lock);
 	}
-	g_mutex_unlock (&ipc_servers_lock);
 
-	return NULL;
+	if (client->compress_threshold &&
+	    (capabilities & XMMS_IPC_CAPABILITY_COMPRESSION) &&
+	    xmms_ipc_msg_get_cmd (msg) == XMMS_IPC_COMMAND_REPLY &&
+	    xmms_ipc_msg_size (msg) >= client->compress_threshold) {
+		xmms_ipc_msg_t *compressed = xmms_ipc_msg_compress (msg);
+		if (compressed) {
+			xmms_ipc_msg_destroy (msg);
+			msg = compressed;
+		}
+	}
+
+	if (!urgent && (capabilities & XMMS_IPC_CAPABILITY_REPLY_PARTS)) {
+		parts = xmms_ipc_msg_split (msg);
+	}
+
+	if (parts) {
+		xmms_ipc_msg_destroy (msg);
+		return parts;
+	}
+
+	return g_list_prepend (NULL, msg);
 }
 
 /**
- * Put a message in the queue awaiting to be sent to the client.
+ * Put messages in the queue awaiting to be sent to the client, next to
+ * each other. Urgent messages are written ahead of the others.
  * Should hold client->lock.
  */
 static gboolean
-xmms_ipc_client_msg_write (xmms_ipc_client_t *client, xmms_ipc_msg_t *msg)
+xmms_ipc_client_msg_queue (xmms_ipc_client_t *client, GList *msgs,
+                           gboolean urgent)
 {
+	GQueue *lane = urgent ? client->out_urgent : client->out_msg;
 	gboolean queue_empty;
+	GList *n;
 
 	g_return_val_if_fail (client, FALSE);
-	g_return_val_if_fail (msg, FALSE);
+	g_return_val_if_fail (msgs, FALSE);
+
+	if (client->closing) {
+		g_list_free_full (msgs, (GDestroyNotify) xmms_ipc_msg_destroy);
+		return FALSE;
+	}
+
+	/* a single large reply may pass, a client that keeps the queue
+	 * full by not reading may not */
+	if (client->hard_limit && client->queued_bytes > client->hard_limit) {
+		xmms_log_error ("Disconnecting client %d, it has %" G_GSIZE_FORMAT
+		                " bytes waiting to be written, more than the limit"
+		                " of %" G_GSIZE_FORMAT " bytes (core.ipc_queue_hard_limit)",
+		                client->id, client->queued_bytes, client->hard_limit);
+		client->closing = TRUE;
+		g_main_loop_quit (client->ml);
+		g_list_free_full (msgs, (GDestroyNotify) xmms_ipc_msg_destroy);
+		return FALSE;
+	}
+
+	queue_empty = g_queue_is_empty (client->out_msg) &&
+	              g_queue_is_empty (client->out_urgent);
+
+	/* parts of one reply must not be interleaved with another's */
+	for (n = msgs; n; n = g_list_next (n)) {
+		g_queue_push_tail (lane, n->data);
+		client->queued_bytes += xmms_ipc_msg_size (n->data);
+		if (!urgent) {
+			client->queued++;
+		}
+	}
 
-	queue_empty = g_queue_is_empty (client->out_msg);
-	g_queue_push_tail (client->out_msg, msg);
+	g_list_free (msgs);
 
 	/* If there's no write in progress, add a new callback */
 	if (queue_empty) {
@@ -589,24 +1469,61 @@ xmms_ipc_client_msg_write (xmms_ipc_client_t *client, xmms_ipc_msg_t *msg)
 	return TRUE;
 }
 
+/**
+ * Put a signal or broadcast in the queue awaiting to be sent to the
+ * client. Replies go through #xmms_ipc_client_reply_write instead.
+ * Should hold client->lock.
+ */
+static gboolean
+xmms_ipc_client_msg_write (xmms_ipc_client_t *client, xmms_ipc_msg_t *msg,
+                           gboolean urgent)
+{
+	g_return_val_if_fail (msg, FALSE);
+
+	return xmms_ipc_client_msg_queue (client, g_list_prepend (NULL, msg),
+	                                  urgent);
+}
+
+/**
+ * Prepare a reply for the client, and put it in the queue awaiting to
+ * be sent to it.
+ * Must not hold client->lock.
+ */
+static gboolean
+xmms_ipc_client_reply_write (xmms_ipc_client_t *client, xmms_ipc_msg_t *msg,
+                             gboolean urgent)
+{
+	GList *msgs;
+	gboolean ret;
+
+	g_return_val_if_fail (client, FALSE);
+	g_return_val_if_fail (msg, FALSE);
+
+	msgs = xmms_ipc_client_msg_prepare (client, msg, urgent);
+
+	g_mutex_lock (&client->lock);
+	ret = xmms_ipc_client_msg_queue (client, msgs, urgent);
+	g_mutex_unlock (&client->lock);
+
+	return ret;
+}
+
 /**
  * Write a broadcast to a single client.
  * Should hold client->lock.
  */
 static gboolean
 xmms_ipc_client_broadcast_write (guint broadcastid, xmms_ipc_client_t *cli,
-                                 xmmsv_t *arg)
+                                 xmmsv_t *arg, gboolean droppable)
 {
 	GList *l;
-	xmms_ipc_msg_t *msg;
+
+	if (cli->closing) {
+		return FALSE;
+	}
 
 	for (l = cli->broadcasts[broadcastid]; l; l = g_list_next (l)) {
-		msg = xmms_ipc_msg_new (XMMS_IPC_OBJECT_SIGNAL, XMMS_IPC_COMMAND_BROADCAST);
-		xmms_ipc_msg_set_cookie (msg, GPOINTER_TO_UINT (l->data));
-		xmms_ipc_handle_cmd_value (msg, arg);
-		if (!xmms_ipc_client_msg_write (cli, msg)) {
-			return FALSE;
-		}
+		xmms_ipc_subscription_deliver (l->data, arg, droppable);
 	}
 
 	return TRUE;
@@ -643,6 +1560,10 @@ xmms_ipc_source_accept (GIOChannel *chan, GIOCondition cond, gpointer data)
 	ipc->clients = g_list_append (ipc->clients, client);
 	g_mutex_unlock (&ipc->mutex_lock);
 
+	g_mutex_lock (&ipc_clients_lock);
+	g_hash_table_insert (ipc_clients, GINT_TO_POINTER (client->id), client);
+	g_mutex_unlock (&ipc_clients_lock);
+
 	/* Now that the client has been registered in the ipc->clients list
 	 * we may safely start its thread.
 	 */
@@ -689,7 +1610,7 @@ xmms_ipc_has_pending (guint signalid)
 		for (c = ipc->clients; c; c = g_list_next (c)) {
 			xmms_ipc_client_t *cli = c->data;
 			g_mutex_lock (&cli->lock);
-			if (cli->pendingsignals[signalid]) {
+			if (cli->signals[signalid] && cli->signals[signalid]->cookie) {
 				g_mutex_unlock (&cli->lock);
 				g_mutex_unlock (&ipc->mutex_lock);
 				g_mutex_unlock (&ipc_servers_lock);
@@ -710,7 +1631,6 @@ xmms_ipc_signal_cb (xmms_object_t *object, xmmsv_t *arg, gpointer userdata)
 	GList *c, *s;
 	guint signalid = GPOINTER_TO_UINT (userdata);
 	xmms_ipc_t *ipc;
-	xmms_ipc_msg_t *msg;
 
 	g_mutex_lock (&ipc_servers_lock);
 
@@ -719,13 +1639,12 @@ xmms_ipc_signal_cb (xmms_object_t *object, xmmsv_t *arg, gpointer userdata)
 		g_mutex_lock (&ipc->mutex_lock);
 		for (c = ipc->clients; c; c = g_list_next (c)) {
 			xmms_ipc_client_t *cli = c->data;
+			xmms_ipc_subscription_t *sub;
+
 			g_mutex_lock (&cli->lock);
-			if (cli->pendingsignals[signalid]) {
-				msg = xmms_ipc_msg_new (XMMS_IPC_OBJECT_SIGNAL, XMMS_IPC_COMMAND_SIGNAL);
-				xmms_ipc_msg_set_cookie (msg, cli->pendingsignals[signalid]);
-				xmms_ipc_handle_cmd_value (msg, arg);
-				xmms_ipc_client_msg_write (cli, msg);
-				cli->pendingsignals[signalid] = 0;
+			sub = cli->signals[signalid];
+			if (sub && sub->cookie) {
+				xmms_ipc_subscription_deliver (sub, arg, TRUE);
 			}
 			g_mutex_unlock (&cli->lock);
 		}
@@ -741,9 +1660,14 @@ xmms_ipc_broadcast_cb (xmms_object_t *object, xmmsv_t *arg, gpointer userdata)
 {
 	GList *c, *s;
 	guint broadcastid = GPOINTER_TO_UINT (userdata);
+	xmms_ipc_broadcast_compat_t compat;
+	xmmsv_t *legacy = NULL;
+	gboolean expanded = FALSE;
 	xmms_ipc_t *ipc;
-	xmms_ipc_msg_t *msg = NULL;
-	GList *l;
+
+	g_mutex_lock (&ipc_object_pool_lock);
+	compat = ipc_object_pool->compat[broadcastid];
+	g_mutex_unlock (&ipc_object_pool_lock);
 
 	g_mutex_lock (&ipc_servers_lock);
 
@@ -752,19 +1676,44 @@ xmms_ipc_broadcast_cb (xmms_object_t *object, xmmsv_t *arg, gpointer userdata)
 		g_mutex_lock (&ipc->mutex_lock);
 		for (c = ipc->clients; c; c = g_list_next (c)) {
 			xmms_ipc_client_t *cli = c->data;
+			xmmsv_list_iter_t *it;
+			xmmsv_t *entry;
 
 			g_mutex_lock (&cli->lock);
-			for (l = cli->broadcasts[broadcastid]; l; l = g_list_next (l)) {
-				msg = xmms_ipc_msg_new (XMMS_IPC_OBJECT_SIGNAL, XMMS_IPC_COMMAND_BROADCAST);
-				xmms_ipc_msg_set_cookie (msg, GPOINTER_TO_UINT (l->data));
-				xmms_ipc_handle_cmd_value (msg, arg);
-				xmms_ipc_client_msg_write (cli, msg);
+
+			if (!cli->broadcasts[broadcastid] || !compat.func ||
+			    (cli->capabilities & compat.capability)) {
+				xmms_ipc_client_broadcast_write (broadcastid, cli, arg, TRUE);
+				g_mutex_unlock (&cli->lock);
+				continue;
+			}
+
+			/* The client doesn't understand this form of the
+			 * broadcast, expand it once and share the result. */
+			if (!expanded) {
+				legacy = compat.func (arg);
+				expanded = TRUE;
+			}
+
+			if (legacy == NULL) {
+				xmms_ipc_client_broadcast_write (broadcastid, cli, arg, TRUE);
+			} else {
+				xmmsv_get_list_iter (legacy, &it);
+				while (xmmsv_list_iter_entry (it, &entry)) {
+					xmms_ipc_client_broadcast_write (broadcastid, cli, entry, TRUE);
+					xmmsv_list_iter_next (it);
+				}
 			}
+
 			g_mutex_unlock (&cli->lock);
 		}
 		g_mutex_unlock (&ipc->mutex_lock);
 	}
 	g_mutex_unlock (&ipc_servers_lock);
+
+	if (legacy != NULL) {
+		xmmsv_unref (legacy);
+	}
 }
 
 /**
@@ -805,6 +1754,29 @@ xmms_ipc_broadcast_unregister (xmms_ipc_signal_t signalid)
 		xmms_object_disconnect (obj, signalid, xmms_ipc_broadcast_cb, GUINT_TO_POINTER (signalid));
 		ipc_object_pool->broadcasts[signalid] = NULL;
 	}
+	ipc_object_pool->compat[signalid].func = NULL;
+	ipc_object_pool->compat[signalid].capability = 0;
+	g_mutex_unlock (&ipc_object_pool_lock);
+}
+
+/**
+ * Register a fallback for clients lacking a capability.
+ *
+ * Clients that haven't announced @a capability receive the
+ * messages returned by @a func instead of the broadcast value. The
+ * function is called at most once per emitted broadcast and returns
+ * a list of values to send in its place, or NULL to send it as is.
+ */
+void
+xmms_ipc_broadcast_compat_register (xmms_ipc_signal_t signalid,
+                                    guint32 capability,
+                                    xmms_ipc_broadcast_compat_func_t func)
+{
+	g_return_if_fail (func);
+
+	g_mutex_lock (&ipc_object_pool_lock);
+	ipc_object_pool->compat[signalid].capability = capability;
+	ipc_object_pool->compat[signalid].func = func;
 	g_mutex_unlock (&ipc_object_pool_lock);
 }
 
@@ -869,7 +1841,9 @@ xmms_ipc_t *
 xmms_ipc_init (void)
 {
 	g_mutex_init (&ipc_servers_lock);
+	g_mutex_init (&ipc_clients_lock);
 	g_mutex_init (&ipc_object_pool_lock);
+	ipc_clients = g_hash_table_new (NULL, NULL);
 	ipc_object_pool = g_new0 (xmms_ipc_object_pool_t, 1);
 
 	ipc_manager = xmms_object_new (xmms_ipc_manager_t, NULL);
@@ -893,11 +1867,14 @@ xmms_ipc_shutdown_server (xmms_ipc_t *ipc)
 	g_io_channel_unref (ipc->chan);
 	xmms_ipc_transport_destroy (ipc->transport);
 
+	g_mutex_lock (&ipc_clients_lock);
 	for (c = ipc->clients; c; c = g_list_next (c)) {
 		co = c->data;
 		if (!co) continue;
 		co->ipc = NULL;
+		g_hash_table_remove (ipc_clients, GINT_TO_POINTER (co->id));
 	}
+	g_mutex_unlock (&ipc_clients_lock);
 
 	g_list_free (ipc->clients);
 	g_mutex_unlock (&ipc->mutex_lock);
@@ -918,6 +1895,12 @@ xmms_ipc_shutdown (void)
 
 	xmms_ipc_close ();
 	g_mutex_clear (&ipc_servers_lock);
+
+	/* the lock stays usable, client threads may still be tearing down */
+	g_mutex_lock (&ipc_clients_lock);
+	g_hash_table_destroy (ipc_clients);
+	ipc_clients = NULL;
+	g_mutex_unlock (&ipc_clients_lock);
 	g_mutex_clear (&ipc_object_pool_lock);
 	g_free (ipc_object_pool);
 	ipc_object_pool = NULL;
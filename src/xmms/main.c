@@ -62,8 +62,14 @@
  */
 static void xmms_main_client_quit (xmms_object_t *object, xmms_error_t *error);
 static xmmsv_t *xmms_main_client_stats (xmms_object_t *object, xmms_error_t *error);
+static xmmsv_t *xmms_main_client_verify_stats (xmms_object_t *object, xmms_error_t *error);
+static xmmsv_t *xmms_main_client_command_stats (xmms_object_t *object, xmms_error_t *error);
+static void xmms_main_client_reset_command_stats (xmms_object_t *object, xmms_error_t *error);
 static xmmsv_t *xmms_main_client_list_plugins (xmms_object_t *main, gint32 type, xmms_error_t *err);
 static gint64 xmms_main_client_hello (xmms_object_t *object, gint protocolver, const gchar *client, gint64 id, xmms_error_t *error);
+static void xmms_main_client_set_capabilities (xmms_object_t *object, gint32 capabilities, gint32 client, xmms_error_t *error);
+static gchar *xmms_main_client_shm_attach (xmms_object_t *object, gint32 client, xmms_error_t *error);
+static xmmsv_t *xmms_main_client_batch (xmms_object_t *object, xmmsv_t *commands, gint32 client, uint32_t cookie, xmms_error_t *error);
 static void install_scripts (const gchar *into_dir);
 static void spawn_script_setup (gpointer data);
 
@@ -110,124 +116,60 @@ static GMainLoop *mainloop;
 /** The path of the configfile */
 static gchar *conffile = NULL;
 
-static void
-query_total_size_duration (xmms_main_t *mainobj, xmms_error_t *error,
-                                      int64_t *size, int64_t *duration)
+/**
+ * This returns the main stats for the server
+ */
+static xmmsv_t *
+xmms_main_client_stats (xmms_object_t *object, xmms_error_t *error)
+{
+	xmms_main_t *mainobj = (xmms_main_t *) object;
+	gint uptime = time (NULL) - mainobj->starttime;
+	gint64 values[XMMS_MEDIALIB_STATS_END];
+
+	xmms_medialib_stats_get (mainobj->medialib_object, values);
+
+	return xmmsv_build_dict (XMMSV_DICT_ENTRY_STR ("version", XMMS_VERSION),
+	                         XMMSV_DICT_ENTRY_INT ("uptime", uptime),
+	                         XMMSV_DICT_ENTRY_INT ("size", values[XMMS_MEDIALIB_STATS_SIZE]),
+	                         XMMSV_DICT_ENTRY_INT ("duration", values[XMMS_MEDIALIB_STATS_DURATION]),
+	                         XMMSV_DICT_ENTRY_INT ("playtime", values[XMMS_MEDIALIB_STATS_PLAYTIME]),
+	                         XMMSV_DICT_ENTRY ("clients", xmms_ipc_client_queue_stats ()),
+	                         XMMSV_DICT_END);
+}
+
+/**
+ * Return the call counts and latencies of every command
+ */
+static xmmsv_t *
+xmms_main_client_command_stats (xmms_object_t *object, xmms_error_t *error)
 {
-	xmmsv_t *coll, *universe, *spec, *ret;
-	xmms_medialib_session_t *session;
-
-	/* Fetch the size in bytes and duration in milliseconds for the whole media library */
-	universe = xmmsv_new_coll (XMMS_COLLECTION_TYPE_UNIVERSE);
-
-	coll = xmmsv_new_coll (XMMS_COLLECTION_TYPE_MATCH);
-	xmmsv_coll_attribute_set_string (coll, "field", "status");
-	xmmsv_coll_attribute_set_string (coll, "value", "1");
-	xmmsv_coll_add_operand (coll, universe);
-	xmmsv_unref (universe);
-
-	spec = xmmsv_build_dict (
-		XMMSV_DICT_ENTRY_STR ("type", "metadata"),
-		XMMSV_DICT_ENTRY ("fields", xmmsv_build_list (
-			XMMSV_LIST_ENTRY_STR ("duration"),
-			XMMSV_LIST_ENTRY_STR ("size"),
-			XMMSV_LIST_END)),
-		XMMSV_DICT_ENTRY ("get", xmmsv_build_list (
-			XMMSV_LIST_ENTRY_STR ("field"),
-			XMMSV_LIST_ENTRY_STR ("value"),
-			XMMSV_LIST_END)),
-		XMMSV_DICT_ENTRY_STR ("aggregate", "sum"),
-		XMMSV_DICT_END);
-
-	do {
-		session = xmms_medialib_session_begin_ro (mainobj->medialib_object);
-		ret = xmms_medialib_query (session, coll, spec, error);
-	} while (!xmms_medialib_session_commit (session));
-
-	xmmsv_dict_entry_get_int64 (ret, "size", size);
-	xmmsv_dict_entry_get_int64 (ret, "duration", duration);
-
-	xmmsv_unref (spec);
-	xmmsv_unref (ret);
+	return xmms_ipc_command_stats ();
 }
 
 static void
-query_total_playtime (xmms_main_t *mainobj, xmms_error_t *error,
-                                 int64_t *playtime)
+xmms_main_client_reset_command_stats (xmms_object_t *object, xmms_error_t *error)
 {
-	xmmsv_t *coll, *universe, *spec, *ret, *value;
-	xmms_medialib_session_t *session;
-	xmmsv_dict_iter_t *iter;
-	const gchar *key;
-
-	/* Fetch the sum of duration clustered by timesplayed, for timesplayed > 0 */
-	universe = xmmsv_new_coll (XMMS_COLLECTION_TYPE_UNIVERSE);
-
-	coll = xmmsv_new_coll (XMMS_COLLECTION_TYPE_GREATER);
-	xmmsv_coll_attribute_set_string (coll, "field", "timesplayed");
-	xmmsv_coll_attribute_set_string (coll, "value", "0");
-	xmmsv_coll_add_operand (coll, universe);
-	xmmsv_unref (universe);
-
-	spec = xmmsv_build_dict (
-		XMMSV_DICT_ENTRY_STR ("type", "cluster-dict"),
-		XMMSV_DICT_ENTRY_STR ("cluster-by", "value"),
-		XMMSV_DICT_ENTRY_STR ("cluster-field", "timesplayed"),
-		XMMSV_DICT_ENTRY ("data", xmmsv_build_dict (
-			XMMSV_DICT_ENTRY_STR ("type", "metadata"),
-			XMMSV_DICT_ENTRY ("fields", xmmsv_build_list (
-				XMMSV_LIST_ENTRY_STR ("duration"),
-				XMMSV_LIST_END)),
-			XMMSV_DICT_ENTRY ("get", xmmsv_build_list (
-				XMMSV_LIST_ENTRY_STR ("value"),
-				XMMSV_LIST_END)),
-			XMMSV_DICT_ENTRY_STR ("aggregate", "sum"),
-			XMMSV_DICT_END)),
-		XMMSV_DICT_END);
-
-	do {
-		session = xmms_medialib_session_begin_ro (mainobj->medialib_object);
-		ret = xmms_medialib_query (session, coll, spec, error);
-	} while (!xmms_medialib_session_commit (session));
-
-	xmmsv_get_dict_iter (ret, &iter);
-	while (xmmsv_dict_iter_pair (iter, &key, &value)) {
-		int64_t sum, timesplayed;
-		gchar *endptr = NULL;
-
-		if (xmmsv_get_int64 (value, &sum)) {
-			timesplayed = strtol (key, &endptr, 10);
-			if (*endptr == '\0')
-				*playtime += timesplayed * sum;
-		}
-
-		xmmsv_dict_iter_next (iter);
-	}
-
-	xmmsv_unref (spec);
-	xmmsv_unref (ret);
+	xmms_ipc_command_stats_reset ();
 }
 
 /**
- * This returns the main stats for the server
+ * Recompute the library statistics from scratch, and repair the
+ * incrementally maintained ones if they were out of sync.
  */
 static xmmsv_t *
-xmms_main_client_stats (xmms_object_t *object, xmms_error_t *error)
+xmms_main_client_verify_stats (xmms_object_t *object, xmms_error_t *error)
 {
 	xmms_main_t *mainobj = (xmms_main_t *) object;
-	gint uptime = time (NULL) - mainobj->starttime;
-	int64_t size, duration, playtime;
+	gint64 values[XMMS_MEDIALIB_STATS_END];
+	gboolean consistent;
 
-	size = duration = playtime = 0;
+	consistent = xmms_medialib_stats_verify (mainobj->medialib_object,
+	                                         values, error);
 
-	query_total_playtime (mainobj, error, &playtime);
-	query_total_size_duration (mainobj, error, &size, &duration);
-
-	return xmmsv_build_dict (XMMSV_DICT_ENTRY_STR ("version", XMMS_VERSION),
-	                         XMMSV_DICT_ENTRY_INT ("uptime", uptime),
-	                         XMMSV_DICT_ENTRY_INT ("size", size),
-	                         XMMSV_DICT_ENTRY_INT ("duration", duration),
-	                         XMMSV_DICT_ENTRY_INT ("playtime", playtime),
+	return xmmsv_build_dict (XMMSV_DICT_ENTRY_INT ("size", values[XMMS_MEDIALIB_STATS_SIZE]),
+	                         XMMSV_DICT_ENTRY_INT ("duration", values[XMMS_MEDIALIB_STATS_DURATION]),
+	                         XMMSV_DICT_ENTRY_INT ("playtime", values[XMMS_MEDIALIB_STATS_PLAYTIME]),
+	                         XMMSV_DICT_ENTRY_INT ("consistent", consistent),
 	                         XMMSV_DICT_END);
 }
 
@@ -384,6 +326,9 @@ xmms_main_destroy (xmms_object_t *object)
 	cv = xmms_config_lookup ("core.shutdownpath");
 	do_scriptdir (xmms_config_property_get_string (cv), "stop");
 
+	/* Deliver what's queued while the emitting objects are still alive */
+	xmms_object_dispatch_stop ();
+
 	xmms_object_unref (mainobj->xform_object);
 	xmms_object_unref (mainobj->visualization_object);
 	xmms_object_unref (mainobj->output_object);
@@ -425,6 +370,39 @@ xmms_main_client_hello (xmms_object_t *object, gint protocolver, const gchar *cl
 	return id;
 }
 
+/**
+ * @internal Function to record which optional protocol features a client
+ * understands, e.g. batched playlist change broadcasts.
+ */
+static void
+xmms_main_client_set_capabilities (xmms_object_t *object, gint32 capabilities,
+                                   gint32 client, xmms_error_t *error)
+{
+	xmms_ipc_client_set_capabilities (client, capabilities, error);
+}
+
+/**
+ * @internal Function to set up the shared memory segment large replies
+ * to a local client are placed in.
+ */
+static gchar *
+xmms_main_client_shm_attach (xmms_object_t *object, gint32 client,
+                             xmms_error_t *error)
+{
+	return xmms_ipc_client_shm_attach (client, error);
+}
+
+/**
+ * @internal Function to run several commands from one message, saving
+ * the client a round trip per command.
+ */
+static xmmsv_t *
+xmms_main_client_batch (xmms_object_t *object, xmmsv_t *commands,
+                        gint32 client, uint32_t cookie, xmms_error_t *error)
+{
+	return xmms_ipc_batch_call (client, cookie, commands, error);
+}
+
 static gboolean
 kill_server (gpointer object) {
 	xmms_main_t *mainobj = (xmms_main_t *) object;
@@ -641,6 +619,32 @@ main (int argc, char **argv)
 		ipcpath = xmms_config_property_get_string (cv);
 	}
 
+	/* Replies of at least this many bytes go through shared memory to
+	 * local clients that ask for it, in a segment of at most
+	 * ipc_shm_max_size megabytes */
+	xmms_config_property_register ("core.ipc_shm_threshold", "65536",
+	                               NULL, NULL);
+	xmms_config_property_register ("core.ipc_shm_max_size", "256",
+	                               NULL, NULL);
+
+	/* Replies of at least this many bytes are compressed for clients
+	 * that ask for it, 0 to never compress */
+	xmms_config_property_register ("core.ipc_compress_threshold", "4096",
+	                               NULL, NULL);
+
+	/* Kilobytes waiting to be written to a client before broadcasts to
+	 * it are coalesced, and before it is disconnected. 0 for no limit */
+	xmms_config_property_register ("core.ipc_queue_soft_limit", "1024",
+	                               NULL, NULL);
+	xmms_config_property_register ("core.ipc_queue_hard_limit", "65536",
+	                               NULL, NULL);
+
+	/* Count calls and latencies of each command, see command_stats */
+	cv = xmms_config_property_register ("core.ipc_command_stats", "1",
+	                                    on_config_ipc_command_stats_change,
+	                                    NULL);
+	xmms_ipc_command_stats_enable (!!xmms_config_property_get_int (cv));
+
 	if (!xmms_ipc_setup_server (ipcpath)) {
 		xmms_ipc_shutdown ();
 		xmms_log_fatal ("IPC failed to init!");
@@ -650,6 +654,13 @@ main (int argc, char **argv)
 		exit (EXIT_FAILURE);
 	}
 
+	/* Emit signals from latency sensitive threads on a dispatcher thread */
+	cv = xmms_config_property_register ("core.signal_dispatcher", "1",
+	                                    NULL, NULL);
+	if (xmms_config_property_get_int (cv)) {
+		xmms_object_dispatch_start ();
+	}
+
 	mainobj = xmms_object_new (xmms_main_t, xmms_main_destroy);
 
 	mainobj->medialib_object = xmms_medialib_init ();
@@ -159,9 +159,11 @@ xmms_mediainfo_reader_thread (gpointer data)
 
 	xmms_mediainfo_reader_t *mrt = (xmms_mediainfo_reader_t *) data;
 
-	xmms_object_emit (XMMS_OBJECT (mrt),
-	                  XMMS_IPC_SIGNAL_MEDIAINFO_READER_STATUS,
-	                  xmmsv_new_int (XMMS_MEDIAINFO_READER_STATUS_RUNNING));
+	/* Queued like the unindexed count, so that clients get them in order */
+	xmms_object_emit_queued (XMMS_OBJECT (mrt),
+	                         XMMS_IPC_SIGNAL_MEDIAINFO_READER_STATUS,
+	                         xmmsv_new_int (XMMS_MEDIAINFO_READER_STATUS_RUNNING),
+	                         FALSE);
 
 	f = _xmms_stream_type_new (XMMS_STREAM_TYPE_BEGIN,
 	                           XMMS_STREAM_TYPE_MIMETYPE,
@@ -181,9 +183,10 @@ xmms_mediainfo_reader_thread (gpointer data)
 
 		if (!entry) {
 			xmms_medialib_session_abort (session);
-			xmms_object_emit (XMMS_OBJECT (mrt),
-			                  XMMS_IPC_SIGNAL_MEDIAINFO_READER_STATUS,
-			                  xmmsv_new_int (XMMS_MEDIAINFO_READER_STATUS_IDLE));
+			xmms_object_emit_queued (XMMS_OBJECT (mrt),
+			                         XMMS_IPC_SIGNAL_MEDIAINFO_READER_STATUS,
+			                         xmmsv_new_int (XMMS_MEDIAINFO_READER_STATUS_IDLE),
+			                         FALSE);
 
 			g_mutex_lock (&mrt->mutex);
 			g_cond_wait (&mrt->cond, &mrt->mutex);
@@ -191,9 +194,10 @@ xmms_mediainfo_reader_thread (gpointer data)
 
 			num = 0;
 
-			xmms_object_emit (XMMS_OBJECT (mrt),
-			                  XMMS_IPC_SIGNAL_MEDIAINFO_READER_STATUS,
-			                  xmmsv_new_int (XMMS_MEDIAINFO_READER_STATUS_RUNNING));
+			xmms_object_emit_queued (XMMS_OBJECT (mrt),
+			                         XMMS_IPC_SIGNAL_MEDIAINFO_READER_STATUS,
+			                         xmmsv_new_int (XMMS_MEDIAINFO_READER_STATUS_RUNNING),
+			                         FALSE);
 			continue;
 		}
 
@@ -201,9 +205,10 @@ xmms_mediainfo_reader_thread (gpointer data)
 		                                                    XMMS_MEDIALIB_ENTRY_PROPERTY_STATUS);
 
 		if (num == 0) {
-			xmms_object_emit (XMMS_OBJECT (mrt),
-			                  XMMS_IPC_SIGNAL_MEDIAINFO_READER_UNINDEXED,
-			                  xmmsv_new_int (xmms_medialib_num_not_resolved (session)));
+			xmms_object_emit_queued (XMMS_OBJECT (mrt),
+			                         XMMS_IPC_SIGNAL_MEDIAINFO_READER_UNINDEXED,
+			                         xmmsv_new_int (xmms_medialib_num_not_resolved (session)),
+			                         TRUE);
 			num = 10;
 		} else {
 			num--;
@@ -80,6 +80,28 @@ struct xmms_medialib_St {
 	xmms_object_t object;
 	s4_t *s4;
 	s4_sourcepref_t *default_sp;
+
+	/* id sets of materialized collections, provided by the collection DAG */
+	xmms_medialib_materialized_func_t materialized;
+	gpointer materialized_udata;
+
+	/* drops removed entries from the playlists, provided by the playlist */
+	xmms_medialib_removed_func_t removed;
+	gpointer removed_udata;
+
+	/* changes to the library statistics not yet written to the database,
+	 * kept here so that sessions don't all update the same entity */
+	GMutex stats_mutex;
+	gint64 stats_pending[XMMS_MEDIALIB_STATS_END];
+	gint64 stats_pending_since;
+
+	/* writes the changes once they are old enough, also while idle */
+	GThread *stats_thread;
+	GCond stats_cond;
+	gboolean stats_running;
+
+	/* serializes the writers of the stored statistics */
+	GMutex stats_flush_mutex;
 };
 
 static void
@@ -89,14 +111,88 @@ xmms_medialib_destroy (xmms_object_t *object)
 
 	XMMS_DBG ("Deactivating medialib object.");
 
+	g_mutex_lock (&mlib->stats_mutex);
+	mlib->stats_running = FALSE;
+	g_cond_signal (&mlib->stats_cond);
+	g_mutex_unlock (&mlib->stats_mutex);
+	g_thread_join (mlib->stats_thread);
+
+	xmms_medialib_stats_flush (mlib, TRUE);
+
 	s4_sourcepref_unref (mlib->default_sp);
 	s4_close (mlib->s4);
 
+	g_mutex_clear (&mlib->stats_mutex);
+	g_mutex_clear (&mlib->stats_flush_mutex);
+	g_cond_clear (&mlib->stats_cond);
+
 	xmms_medialib_unregister_ipc_commands ();
 }
 
 #define XMMS_MEDIALIB_SOURCE_SERVER "server"
 
+/* seconds changes to the library statistics are kept in memory */
+#define XMMS_MEDIALIB_STATS_FLUSH_INTERVAL 5
+
+/**
+ * Background writer, flushes the changes to the library statistics once
+ * they are XMMS_MEDIALIB_STATS_FLUSH_INTERVAL old, so that they are not
+ * left in memory until the next commit.
+ */
+static gpointer
+xmms_medialib_stats_thread (gpointer udata)
+{
+	xmms_medialib_t *medialib = (xmms_medialib_t *) udata;
+	gint64 deadline;
+
+	g_mutex_lock (&medialib->stats_mutex);
+	while (medialib->stats_running) {
+		if (medialib->stats_pending_since == 0) {
+			g_cond_wait (&medialib->stats_cond, &medialib->stats_mutex);
+			continue;
+		}
+
+		deadline = medialib->stats_pending_since +
+		           XMMS_MEDIALIB_STATS_FLUSH_INTERVAL * G_USEC_PER_SEC;
+		if (g_get_monotonic_time () < deadline) {
+			g_cond_wait_until (&medialib->stats_cond, &medialib->stats_mutex,
+			                   deadline);
+			continue;
+		}
+
+		g_mutex_unlock (&medialib->stats_mutex);
+		xmms_medialib_stats_flush (medialib, TRUE);
+		g_mutex_lock (&medialib->stats_mutex);
+	}
+	g_mutex_unlock (&medialib->stats_mutex);
+
+	return NULL;
+}
+
+/**
+ * Compute the library statistics once if the medialib has never stored
+ * them, for example when created by an older version.
+ */
+static void
+xmms_medialib_stats_init (xmms_medialib_t *medialib)
+{
+	gint64 values[XMMS_MEDIALIB_STATS_END];
+	xmms_medialib_session_t *session;
+	xmms_error_t err;
+	gboolean found;
+
+	do {
+		session = xmms_medialib_session_begin_ro (medialib);
+		found = xmms_medialib_session_stats_get (session, values);
+	} while (!xmms_medialib_session_commit (session));
+
+	if (!found) {
+		XMMS_DBG ("Computing library statistics.");
+		xmms_error_reset (&err);
+		xmms_medialib_stats_verify (medialib, values, &err);
+	}
+}
+
 /**
  * Initialize the medialib and open the database file.
  *
@@ -119,6 +215,10 @@ xmms_medialib_init (void)
 
 	medialib = xmms_object_new (xmms_medialib_t, xmms_medialib_destroy);
 
+	g_mutex_init (&medialib->stats_mutex);
+	g_mutex_init (&medialib->stats_flush_mutex);
+	g_cond_init (&medialib->stats_cond);
+
 	xmms_medialib_register_ipc_commands (XMMS_OBJECT (medialib));
 
 	path = XMMS_BUILD_PATH ("medialib.s4");
@@ -135,6 +235,13 @@ xmms_medialib_init (void)
 	medialib->s4 = xmms_medialib_database_open (medialib_path, indices);
 	medialib->default_sp = s4_sourcepref_create (xmmsv_default_source_pref);
 
+	xmms_medialib_stats_init (medialib);
+
+	medialib->stats_running = TRUE;
+	medialib->stats_thread = g_thread_new ("x2 medialib stats",
+	                                       xmms_medialib_stats_thread,
+	                                       medialib);
+
 	return medialib;
 }
 
@@ -144,6 +251,69 @@ xmms_medialib_get_source_preferences (xmms_medialib_t *medialib)
 	return s4_sourcepref_ref (medialib->default_sp);
 }
 
+/**
+ * Set the function used to look up the id set kept for a collection,
+ * letting queries skip evaluating it.
+ *
+ * @param medialib The medialib.
+ * @param func The lookup function, or NULL to remove it.
+ * @param udata User data passed to the function.
+ */
+void
+xmms_medialib_materialized_func_set (xmms_medialib_t *medialib,
+                                     xmms_medialib_materialized_func_t func,
+                                     gpointer udata)
+{
+	medialib->materialized = func;
+	medialib->materialized_udata = udata;
+}
+
+/**
+ * Look up the id set kept for a collection.
+ *
+ * @returns A new reference to a table with the ids as keys, or NULL
+ * if the collection has to be evaluated.
+ */
+GHashTable *
+xmms_medialib_get_materialized (xmms_medialib_t *medialib, xmmsv_t *coll)
+{
+	if (medialib->materialized == NULL) {
+		return NULL;
+	}
+
+	return medialib->materialized (coll, medialib->materialized_udata);
+}
+
+/**
+ * Set the function told about the entries each committed session
+ * removed, all at once rather than one signal at a time.
+ *
+ * @param medialib The medialib.
+ * @param func The function, or NULL to remove it.
+ * @param udata User data passed to the function.
+ */
+void
+xmms_medialib_removed_func_set (xmms_medialib_t *medialib,
+                                xmms_medialib_removed_func_t func,
+                                gpointer udata)
+{
+	medialib->removed = func;
+	medialib->removed_udata = udata;
+}
+
+/**
+ * Tell about the entries a committed session removed.
+ *
+ * @param entries A set of entry ids, as keys of a direct hash table.
+ */
+void
+xmms_medialib_entries_removed (xmms_medialib_t *medialib, GHashTable *entries)
+{
+	if (medialib->removed != NULL) {
+		medialib->removed (entries, medialib->removed_udata);
+	}
+}
+
 s4_t *
 xmms_medialib_get_database_backend (xmms_medialib_t *medialib)
 {
@@ -1183,6 +1353,369 @@ xmms_medialib_check_id (xmms_medialib_session_t *session,
 }
 
 
+/**
+ * Check if a property contributes to the library statistics.
+ *
+ * @param key The property to check.
+ * @returns TRUE if changing the property may change the statistics.
+ */
+gboolean
+xmms_medialib_stats_is_tracked (const gchar *key)
+{
+	return strcmp (key, XMMS_MEDIALIB_ENTRY_PROPERTY_STATUS) == 0 ||
+	       strcmp (key, XMMS_MEDIALIB_ENTRY_PROPERTY_SIZE) == 0 ||
+	       strcmp (key, XMMS_MEDIALIB_ENTRY_PROPERTY_DURATION) == 0 ||
+	       strcmp (key, XMMS_MEDIALIB_ENTRY_PROPERTY_TIMESPLAYED) == 0;
+}
+
+/**
+ * Compute the contribution of a single entry to the library statistics,
+ * using the same rules as the full aggregation queries below.
+ *
+ * @param session The medialib session.
+ * @param entry The entry to compute the contribution of.
+ * @param values Filled with the XMMS_MEDIALIB_STATS_END contributions.
+ */
+void
+xmms_medialib_entry_stats_get (xmms_medialib_session_t *session,
+                               xmms_medialib_entry_t entry,
+                               gint64 *values)
+{
+	gint status, size, duration, timesplayed;
+
+	status = xmms_medialib_entry_property_get_int (session, entry,
+	                                               XMMS_MEDIALIB_ENTRY_PROPERTY_STATUS);
+	size = xmms_medialib_entry_property_get_int (session, entry,
+	                                             XMMS_MEDIALIB_ENTRY_PROPERTY_SIZE);
+	duration = xmms_medialib_entry_property_get_int (session, entry,
+	                                                 XMMS_MEDIALIB_ENTRY_PROPERTY_DURATION);
+	timesplayed = xmms_medialib_entry_property_get_int (session, entry,
+	                                                    XMMS_MEDIALIB_ENTRY_PROPERTY_TIMESPLAYED);
+
+	/* missing properties are reported as -1 */
+	size = MAX (size, 0);
+	duration = MAX (duration, 0);
+
+	values[XMMS_MEDIALIB_STATS_SIZE] = 0;
+	values[XMMS_MEDIALIB_STATS_DURATION] = 0;
+	values[XMMS_MEDIALIB_STATS_PLAYTIME] = 0;
+
+	if (status == XMMS_MEDIALIB_ENTRY_STATUS_OK) {
+		values[XMMS_MEDIALIB_STATS_SIZE] = size;
+		values[XMMS_MEDIALIB_STATS_DURATION] = duration;
+	}
+
+	if (timesplayed > 0) {
+		values[XMMS_MEDIALIB_STATS_PLAYTIME] = (gint64) timesplayed * duration;
+	}
+}
+
+/* Fetch the size in bytes and duration in milliseconds for the whole media library */
+static xmmsv_t *
+xmms_medialib_stats_query_size_duration (xmms_medialib_session_t *session,
+                                         xmms_error_t *err)
+{
+	xmmsv_t *coll, *universe, *spec, *ret;
+
+	universe = xmmsv_new_coll (XMMS_COLLECTION_TYPE_UNIVERSE);
+
+	coll = xmmsv_new_coll (XMMS_COLLECTION_TYPE_MATCH);
+	xmmsv_coll_attribute_set_string (coll, "field", "status");
+	xmmsv_coll_attribute_set_string (coll, "value", "1");
+	xmmsv_coll_add_operand (coll, universe);
+	xmmsv_unref (universe);
+
+	spec = xmmsv_build_dict (
+		XMMSV_DICT_ENTRY_STR ("type", "metadata"),
+		XMMSV_DICT_ENTRY ("fields", xmmsv_build_list (
+			XMMSV_LIST_ENTRY_STR ("duration"),
+			XMMSV_LIST_ENTRY_STR ("size"),
+			XMMSV_LIST_END)),
+		XMMSV_DICT_ENTRY ("get", xmmsv_build_list (
+			XMMSV_LIST_ENTRY_STR ("field"),
+			XMMSV_LIST_ENTRY_STR ("value"),
+			XMMSV_LIST_END)),
+		XMMSV_DICT_ENTRY_STR ("aggregate", "sum"),
+		XMMSV_DICT_END);
+
+	ret = xmms_medialib_query (session, coll, spec, err);
+
+	xmmsv_unref (spec);
+	xmmsv_unref (coll);
+
+	return ret;
+}
+
+/* Fetch the sum of duration clustered by timesplayed, for timesplayed > 0 */
+static xmmsv_t *
+xmms_medialib_stats_query_playtime (xmms_medialib_session_t *session,
+                                    xmms_error_t *err)
+{
+	xmmsv_t *coll, *universe, *spec, *ret;
+
+	universe = xmmsv_new_coll (XMMS_COLLECTION_TYPE_UNIVERSE);
+
+	coll = xmmsv_new_coll (XMMS_COLLECTION_TYPE_GREATER);
+	xmmsv_coll_attribute_set_string (coll, "field", "timesplayed");
+	xmmsv_coll_attribute_set_string (coll, "value", "0");
+	xmmsv_coll_add_operand (coll, universe);
+	xmmsv_unref (universe);
+
+	spec = xmmsv_build_dict (
+		XMMSV_DICT_ENTRY_STR ("type", "cluster-dict"),
+		XMMSV_DICT_ENTRY_STR ("cluster-by", "value"),
+		XMMSV_DICT_ENTRY_STR ("cluster-field", "timesplayed"),
+		XMMSV_DICT_ENTRY ("data", xmmsv_build_dict (
+			XMMSV_DICT_ENTRY_STR ("type", "metadata"),
+			XMMSV_DICT_ENTRY ("fields", xmmsv_build_list (
+				XMMSV_LIST_ENTRY_STR ("duration"),
+				XMMSV_LIST_END)),
+			XMMSV_DICT_ENTRY ("get", xmmsv_build_list (
+				XMMSV_LIST_ENTRY_STR ("value"),
+				XMMSV_LIST_END)),
+			XMMSV_DICT_ENTRY_STR ("aggregate", "sum"),
+			XMMSV_DICT_END)),
+		XMMSV_DICT_END);
+
+	ret = xmms_medialib_query (session, coll, spec, err);
+
+	xmmsv_unref (spec);
+	xmmsv_unref (coll);
+
+	return ret;
+}
+
+/* Convert the results of the full aggregation queries into statistics */
+static void
+xmms_medialib_stats_from_results (xmmsv_t *size_duration, xmmsv_t *playtime,
+                                  gint64 *values)
+{
+	xmmsv_dict_iter_t *iter;
+	xmmsv_t *value;
+	const gchar *key;
+
+	values[XMMS_MEDIALIB_STATS_SIZE] = 0;
+	values[XMMS_MEDIALIB_STATS_DURATION] = 0;
+	values[XMMS_MEDIALIB_STATS_PLAYTIME] = 0;
+
+	if (size_duration != NULL) {
+		xmmsv_dict_entry_get_int64 (size_duration, "size",
+		                            &values[XMMS_MEDIALIB_STATS_SIZE]);
+		xmmsv_dict_entry_get_int64 (size_duration, "duration",
+		                            &values[XMMS_MEDIALIB_STATS_DURATION]);
+	}
+
+	if (playtime == NULL || !xmmsv_get_dict_iter (playtime, &iter)) {
+		return;
+	}
+
+	while (xmmsv_dict_iter_pair (iter, &key, &value)) {
+		int64_t sum, timesplayed;
+		gchar *endptr = NULL;
+
+		if (xmmsv_get_int64 (value, &sum)) {
+			timesplayed = strtol (key, &endptr, 10);
+			if (*endptr == '\0')
+				values[XMMS_MEDIALIB_STATS_PLAYTIME] += timesplayed * sum;
+		}
+
+		xmmsv_dict_iter_next (iter);
+	}
+}
+
+/**
+ * Take the lock that makes committing a session and accounting for its
+ * changes to the library statistics one step.
+ */
+void
+xmms_medialib_stats_lock (xmms_medialib_t *medialib)
+{
+	g_mutex_lock (&medialib->stats_mutex);
+}
+
+void
+xmms_medialib_stats_unlock (xmms_medialib_t *medialib)
+{
+	g_mutex_unlock (&medialib->stats_mutex);
+}
+
+/**
+ * Account for the changes a committed session made to the library
+ * statistics. They are kept in memory until the next flush.
+ *
+ * Must be called with the statistics lock held.
+ *
+ * @param medialib The medialib.
+ * @param delta The XMMS_MEDIALIB_STATS_END changes to add.
+ */
+void
+xmms_medialib_stats_add (xmms_medialib_t *medialib, const gint64 *delta)
+{
+	gint i;
+
+	if (medialib->stats_pending_since == 0) {
+		medialib->stats_pending_since = g_get_monotonic_time ();
+		g_cond_signal (&medialib->stats_cond);
+	}
+
+	for (i = 0; i < XMMS_MEDIALIB_STATS_END; i++) {
+		medialib->stats_pending[i] += delta[i];
+	}
+}
+
+/**
+ * Write the changes to the library statistics kept in memory to the
+ * database, in a transaction of their own. It does not reference the
+ * medialib, so that the destroy function can flush what is left.
+ *
+ * Unless forced, nothing is written before the changes are
+ * XMMS_MEDIALIB_STATS_FLUSH_INTERVAL old, or while another thread is
+ * writing the statistics.
+ *
+ * @param medialib The medialib.
+ * @param force Write the changes now.
+ */
+void
+xmms_medialib_stats_flush (xmms_medialib_t *medialib, gboolean force)
+{
+	gint64 delta[XMMS_MEDIALIB_STATS_END];
+	gint64 values[XMMS_MEDIALIB_STATS_END];
+	xmms_medialib_session_t *session;
+	gboolean due;
+	gint i;
+
+	if (force) {
+		g_mutex_lock (&medialib->stats_flush_mutex);
+	} else if (!g_mutex_trylock (&medialib->stats_flush_mutex)) {
+		return;
+	}
+
+	g_mutex_lock (&medialib->stats_mutex);
+	due = medialib->stats_pending_since != 0 &&
+	      (force || g_get_monotonic_time () - medialib->stats_pending_since >=
+	                XMMS_MEDIALIB_STATS_FLUSH_INTERVAL * G_USEC_PER_SEC);
+	if (due) {
+		for (i = 0; i < XMMS_MEDIALIB_STATS_END; i++) {
+			delta[i] = medialib->stats_pending[i];
+			medialib->stats_pending[i] = 0;
+		}
+		medialib->stats_pending_since = 0;
+	}
+	g_mutex_unlock (&medialib->stats_mutex);
+
+	if (due) {
+		do {
+			session = xmms_medialib_session_begin_internal (medialib);
+			xmms_medialib_session_stats_get (session, values);
+			for (i = 0; i < XMMS_MEDIALIB_STATS_END; i++) {
+				values[i] += delta[i];
+			}
+			xmms_medialib_session_stats_set (session, values);
+		} while (!xmms_medialib_session_commit (session));
+	}
+
+	g_mutex_unlock (&medialib->stats_flush_mutex);
+}
+
+/**
+ * Retrieve the library statistics. This does not scan the medialib, the
+ * statistics are kept up to date when entries are changed.
+ *
+ * @param medialib The medialib.
+ * @param values Filled with the XMMS_MEDIALIB_STATS_END statistics.
+ */
+void
+xmms_medialib_stats_get (xmms_medialib_t *medialib, gint64 *values)
+{
+	xmms_medialib_session_t *session;
+	gint i;
+
+	/* a flush must not move changes between the two halves */
+	g_mutex_lock (&medialib->stats_flush_mutex);
+
+	do {
+		session = xmms_medialib_session_begin_ro (medialib);
+		xmms_medialib_session_stats_get (session, values);
+	} while (!xmms_medialib_session_commit (session));
+
+	g_mutex_lock (&medialib->stats_mutex);
+	for (i = 0; i < XMMS_MEDIALIB_STATS_END; i++) {
+		values[i] += medialib->stats_pending[i];
+	}
+	g_mutex_unlock (&medialib->stats_mutex);
+
+	g_mutex_unlock (&medialib->stats_flush_mutex);
+}
+
+/**
+ * Recompute the library statistics from scratch and compare them with
+ * the incrementally maintained ones, which are replaced if they differ.
+ *
+ * @param medialib The medialib.
+ * @param values Filled with the recomputed statistics.
+ * @param err If an error occurs, a message is stored in it.
+ * @returns TRUE if the stored statistics were correct.
+ */
+gboolean
+xmms_medialib_stats_verify (xmms_medialib_t *medialib, gint64 *values,
+                            xmms_error_t *err)
+{
+	gint64 stored[XMMS_MEDIALIB_STATS_END];
+	gint64 pending[XMMS_MEDIALIB_STATS_END];
+	xmms_medialib_session_t *session;
+	xmmsv_t *size_duration, *playtime;
+	gboolean found, consistent;
+	gint i;
+
+	g_mutex_lock (&medialib->stats_flush_mutex);
+
+	do {
+		/* The pending changes of the sessions committed before this one
+		 * began are part of what it sees, the later ones are not. */
+		g_mutex_lock (&medialib->stats_mutex);
+		session = xmms_medialib_session_begin (medialib);
+		memcpy (pending, medialib->stats_pending, sizeof (pending));
+		g_mutex_unlock (&medialib->stats_mutex);
+
+		size_duration = xmms_medialib_stats_query_size_duration (session, err);
+		playtime = xmms_medialib_stats_query_playtime (session, err);
+		xmms_medialib_stats_from_results (size_duration, playtime, values);
+
+		if (size_duration != NULL) {
+			xmmsv_unref (size_duration);
+		}
+
+		if (playtime != NULL) {
+			xmmsv_unref (playtime);
+		}
+
+		found = xmms_medialib_session_stats_get (session, stored);
+
+		consistent = found;
+		for (i = 0; i < XMMS_MEDIALIB_STATS_END; i++) {
+			if (stored[i] + pending[i] != values[i]) {
+				consistent = FALSE;
+			}
+		}
+
+		if (!consistent && xmms_error_isok (err)) {
+			/* keep the pending changes, they will be flushed on top */
+			for (i = 0; i < XMMS_MEDIALIB_STATS_END; i++) {
+				stored[i] = values[i] - pending[i];
+			}
+			xmms_medialib_session_stats_set (session, stored);
+		}
+	} while (!xmms_medialib_session_commit (session));
+
+	g_mutex_unlock (&medialib->stats_flush_mutex);
+
+	if (found && !consistent) {
+		xmms_log_info ("Library statistics were out of sync, recomputed them.");
+	}
+
+	return consistent;
+}
+
 /**
  * Returns a random entry from a collection
  *
@@ -74,7 +74,8 @@ idlist_filter (const s4_val_t *value, s4_condition_t *cond)
  * Creates a new resultset where the order is the same as in the idlist
  *
  * @param set The resultset to sort. It will be freed by this function
- * @param idlist The idlist to order by
+ * @param idlist The idlist to order by, either a list of ids or an
+ * idlist collection
  * @return A new set with the same order as the idlist
  */
 static s4_resultset_t *
@@ -97,10 +98,19 @@ xmms_medialib_result_sort_idlist (s4_resultset_t *set, xmmsv_t *idlist)
 
 	ret = s4_resultset_create (s4_resultset_get_colcount (set));
 
-	for (i = 0; xmmsv_list_get_int (idlist, i, &ival); i++) {
-		row = g_hash_table_lookup (row_table, GINT_TO_POINTER (ival));
-		if (row != NULL) {
-			s4_resultset_add_row (ret, row);
+	if (xmmsv_is_type (idlist, XMMSV_TYPE_COLL)) {
+		for (i = 0; xmmsv_coll_idlist_get_index (idlist, i, &ival); i++) {
+			row = g_hash_table_lookup (row_table, GINT_TO_POINTER (ival));
+			if (row != NULL) {
+				s4_resultset_add_row (ret, row);
+			}
+		}
+	} else {
+		for (i = 0; xmmsv_list_get_int (idlist, i, &ival); i++) {
+			row = g_hash_table_lookup (row_table, GINT_TO_POINTER (ival));
+			if (row != NULL) {
+				s4_resultset_add_row (ret, row);
+			}
 		}
 	}
 
@@ -264,7 +274,7 @@ create_idlist_filter (xmms_medialib_session_t *session, GHashTable *id_table)
 	sourcepref = xmms_medialib_session_get_source_preferences (session);
 
 	condition = s4_cond_new_custom_filter (idlist_filter, id_table,
-	                                       (free_func_t) g_hash_table_destroy,
+	                                       (free_func_t) g_hash_table_unref,
 	                                       "song_id", sourcepref, 0, 0,
 	                                       S4_COND_PARENT);
 
@@ -408,10 +418,11 @@ filter_condition (xmms_medialib_session_t *session,
 	s4_val_free (value);
 	s4_sourcepref_unref (sp);
 
+	/* Without an operand, filter all media */
+	operand = NULL;
 	operands = xmmsv_coll_operands_get (coll);
-	xmmsv_list_get (operands, 0, &operand);
 
-	if (!is_universe (operand)) {
+	if (xmmsv_list_get (operands, 0, &operand) && !is_universe (operand)) {
 		s4_condition_t *op_cond = cond;
 		cond = s4_cond_new_combiner (S4_COMBINE_AND);
 		s4_cond_add_operand (cond, op_cond);
@@ -431,12 +442,11 @@ idlist_condition (xmms_medialib_session_t *session,
 {
 	GHashTable *id_table;
 	gint32 i, ival;
-	xmmsv_t *child_order, *idlist;
-
-	idlist = xmmsv_coll_idlist_get (coll);
+	xmmsv_t *child_order;
 
+	/* Order by the collection itself, to keep its ids packed */
 	child_order = xmmsv_build_dict (XMMSV_DICT_ENTRY_INT ("type", SORT_TYPE_LIST),
-	                                XMMSV_DICT_ENTRY ("list", xmmsv_ref (idlist)),
+	                                XMMSV_DICT_ENTRY ("list", xmmsv_ref (coll)),
 	                                XMMSV_DICT_END);
 
 	xmmsv_list_append (order, child_order);
@@ -891,6 +901,7 @@ reference_condition (xmms_medialib_session_t *session, xmmsv_t *coll,
                      xmms_fetch_info_t *fetch, xmmsv_t *order)
 {
 	xmmsv_t *operands, *reference;
+	GHashTable *id_table;
 
 	if (is_universe (coll)) {
 		return universe_condition (session, coll, fetch, order);
@@ -902,6 +913,15 @@ reference_condition (xmms_medialib_session_t *session, xmmsv_t *coll,
 		g_assert_not_reached ();
 	}
 
+	/* Use the kept id set of a materialized collection, unless the
+	 * ordering of the collection matters */
+	if (!has_order (reference)) {
+		id_table = xmms_medialib_session_get_materialized (session, reference);
+		if (id_table != NULL) {
+			return create_idlist_filter (session, id_table);
+		}
+	}
+
 	return collection_to_condition  (session, reference, fetch, order);
 }
 
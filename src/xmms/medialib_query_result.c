@@ -16,483 +16,481 @@
 
 #include <xmmspriv/xmms_fetch_info.h>
 #include <xmmspriv/xmms_fetch_spec.h>
+#include <xmmscpriv/xmmsv.h>
 #include "s4.h"
 
 #include <glib.h>
 #include <glib/gstdio.h>
+#include <string.h>
 
 xmmsv_t *xmms_medialib_query_to_xmmsv (s4_resultset_t *set, xmms_fetch_spec_t *spec);
 
+/* What the conversion of one result shares between its parts */
 typedef struct {
+	xmmsv_string_pool_t *pool;
+	/* cluster value -> cluster number + 1, emptied after each use */
+	GHashTable *clusters;
+	/* cluster values that are numbers, printed */
+	GStringChunk *numbers;
+} query_state_t;
+
+/* The clusters of some rows, each a range of the rows array */
+typedef struct {
+	GPtrArray *keys;
+	gint *offsets;
+	const s4_resultrow_t **rows;
+} cluster_t;
+
+static xmmsv_t *query_to_xmmsv (const s4_resultrow_t **rows, gint count, xmms_fetch_spec_t *spec, query_state_t *state);
+
+/* A single value read from an S4 result, either a string or an integer */
+typedef struct {
+	const gchar *str;
+	gint32 num;
+} column_value_t;
+
+/* The running state of an aggregate function. Values are kept as plain
+ * C types and only converted to xmmsv_t once all rows have been seen. */
+typedef struct {
+	gboolean has_value;
+	column_value_t value;
 	gint64 sum;
 	gint n;
-} avg_data_t;
+	GArray *values;
+	GHashTable *seen;
+} aggregate_state_t;
 
+/* The rows sharing the same keys, one per leaf in the result */
 typedef struct {
-	xmmsv_t *data;
-	gint n;
-} random_data_t;
+	gchar *keys[METADATA_END - 1];
+	gint depth;
+	aggregate_state_t state;
+} aggregate_group_t;
 
+/* Hash-groups the values by their keys, remembering the order in which
+ * the groups were first seen. */
 typedef struct {
-	GHashTable *ht;
-	xmmsv_t *list;
-} set_data_t;
+	GHashTable *table;
+	GPtrArray *groups;
+	gint depth;
+	aggregate_function_t aggr_func;
+} aggregate_t;
 
-static xmmsv_t *
-aggregate_first (xmmsv_t *current, gint int_value, const gchar *str_value)
+static guint
+aggregate_group_hash (gconstpointer key)
 {
-	if (current != NULL) {
-		return current;
-	}
+	const aggregate_group_t *group = key;
+	guint hash = 0;
+	gint i;
 
-	if (str_value != NULL) {
-		current = xmmsv_new_string (str_value);
-	} else {
-		current = xmmsv_new_int (int_value);
+	for (i = 0; i < group->depth; i++) {
+		hash = hash * 31 + g_str_hash (group->keys[i]);
 	}
 
-	return current;
+	return hash;
 }
 
-static xmmsv_t *
-aggregate_list (xmmsv_t *current, gint int_value, const gchar *str_value)
+static gboolean
+aggregate_group_equal (gconstpointer a, gconstpointer b)
 {
-	if (current == NULL) {
-		current = xmmsv_new_list ();
-	}
+	const aggregate_group_t *group_a = a;
+	const aggregate_group_t *group_b = b;
+	gint i;
 
-	if (str_value != NULL) {
-		xmmsv_list_append_string (current, str_value);
-	} else {
-		xmmsv_list_append_int (current, int_value);
+	for (i = 0; i < group_a->depth; i++) {
+		if (strcmp (group_a->keys[i], group_b->keys[i]) != 0) {
+			return FALSE;
+		}
 	}
 
-	return current;
+	return TRUE;
 }
 
-static xmmsv_t *
-aggregate_set (xmmsv_t *current, gint int_value, const gchar *str_value)
+static void
+aggregate_group_free (aggregate_group_t *group)
 {
-	set_data_t *data;
-	xmmsv_t *value;
-	gpointer key;
-	guint length;
-
-	if (current == NULL) {
-		set_data_t init = {
-			.ht = g_hash_table_new (NULL, NULL),
-			.list = xmmsv_new_list ()
-		};
-		current = xmmsv_new_bin ((guchar *) &init, sizeof (set_data_t));
-	}
-
-	xmmsv_get_bin (current, (const guchar **) &data, &length);
+	gint i;
 
-	if (str_value != NULL) {
-		value = xmmsv_new_string (str_value);
-		key = (gpointer) str_value;
-	} else {
-		value = xmmsv_new_int (int_value);
-		key = GINT_TO_POINTER (int_value);
+	for (i = 0; i < group->depth; i++) {
+		g_free (group->keys[i]);
 	}
 
-	if (g_hash_table_lookup (data->ht, key) == NULL) {
-		g_hash_table_insert (data->ht, key, value);
-		xmmsv_list_append (data->list, value);
+	if (group->state.values != NULL) {
+		g_array_free (group->state.values, TRUE);
 	}
 
-	xmmsv_unref (value);
+	if (group->state.seen != NULL) {
+		g_hash_table_destroy (group->state.seen);
+	}
 
-	return current;
+	g_free (group);
 }
 
-static xmmsv_t *
-aggregate_sum (xmmsv_t *current, gint int_value, const gchar *str_value)
+static aggregate_t *
+aggregate_new (gint depth, aggregate_function_t aggr_func)
 {
-	int64_t old_value = 0;
-
-	if (str_value != NULL) {
-		/* 'sum' only applies to numbers */
-		return current;
-	}
+	aggregate_t *aggr;
 
-	if (current != NULL) {
-		xmmsv_get_int64 (current, &old_value);
-	}
+	aggr = g_new0 (aggregate_t, 1);
+	aggr->table = g_hash_table_new (aggregate_group_hash, aggregate_group_equal);
+	aggr->groups = g_ptr_array_new_with_free_func ((GDestroyNotify) aggregate_group_free);
+	aggr->depth = depth;
+	aggr->aggr_func = aggr_func;
 
-	return xmmsv_new_int (old_value + int_value);
+	return aggr;
 }
 
-static xmmsv_t *
-aggregate_min (xmmsv_t *current, gint int_value, const gchar *str_value)
+static void
+aggregate_free (aggregate_t *aggr)
 {
-	gint old_value;
+	g_hash_table_destroy (aggr->table);
+	g_ptr_array_free (aggr->groups, TRUE);
+	g_free (aggr);
+}
 
-	if (str_value != NULL) {
-		/* 'min' only applies to numbers */
-		return current;
+static void
+aggregate_state_append (aggregate_state_t *state, const column_value_t *value)
+{
+	if (state->values == NULL) {
+		state->values = g_array_new (FALSE, FALSE, sizeof (column_value_t));
 	}
 
-	if (current == NULL) {
-		return xmmsv_new_int (int_value);
-	}
+	g_array_append_val (state->values, *value);
+}
 
-	xmmsv_get_int (current, &old_value);
+/* Feeds one value to an aggregate function */
+static void
+aggregate_state_update (aggregate_state_t *state, aggregate_function_t aggr_func,
+                        const column_value_t *value)
+{
+	gpointer key;
 
-	if (old_value > int_value) {
-		return xmmsv_new_int (int_value);
-	}
+	switch (aggr_func) {
+		case AGGREGATE_FIRST:
+			if (!state->has_value) {
+				state->value = *value;
+				state->has_value = TRUE;
+			}
+			break;
+		case AGGREGATE_SUM:
+			/* 'sum' only applies to numbers */
+			if (value->str == NULL) {
+				state->sum += value->num;
+				state->has_value = TRUE;
+			}
+			break;
+		case AGGREGATE_MAX:
+			/* 'max' only applies to numbers */
+			if (value->str == NULL &&
+			    (!state->has_value || state->value.num < value->num)) {
+				state->value = *value;
+				state->has_value = TRUE;
+			}
+			break;
+		case AGGREGATE_MIN:
+			/* 'min' only applies to numbers */
+			if (value->str == NULL &&
+			    (!state->has_value || state->value.num > value->num)) {
+				state->value = *value;
+				state->has_value = TRUE;
+			}
+			break;
+		case AGGREGATE_SET:
+			if (state->seen == NULL) {
+				state->seen = g_hash_table_new (NULL, NULL);
+			}
+
+			if (value->str != NULL) {
+				key = (gpointer) value->str;
+			} else {
+				key = GINT_TO_POINTER (value->num);
+			}
 
-	return current;
+			if (g_hash_table_lookup (state->seen, key) == NULL) {
+				g_hash_table_insert (state->seen, key, GINT_TO_POINTER (TRUE));
+				aggregate_state_append (state, value);
+			}
+			state->has_value = TRUE;
+			break;
+		case AGGREGATE_LIST:
+			aggregate_state_append (state, value);
+			state->has_value = TRUE;
+			break;
+		case AGGREGATE_RANDOM:
+			state->n++;
+			if (g_random_int_range (0, state->n) == 0) {
+				state->value = *value;
+			}
+			state->has_value = TRUE;
+			break;
+		case AGGREGATE_AVG:
+			if (value->str == NULL) {
+				state->n++;
+				state->sum += value->num;
+			}
+			state->has_value = TRUE;
+			break;
+		default:
+			g_assert_not_reached ();
+	}
 }
 
 static xmmsv_t *
-aggregate_max (xmmsv_t *current, gint int_value, const gchar *str_value)
+column_value_to_xmmsv (const column_value_t *value, xmmsv_string_pool_t *pool)
 {
-	gint old_value;
-
-	if (str_value != NULL) {
-		/* 'max' only applies to numbers */
-		return current;
+	if (value->str != NULL) {
+		return xmmsv_string_pool_new_string (pool, value->str);
 	}
 
-	if (current == NULL) {
-		return xmmsv_new_int (int_value);
-	}
+	return xmmsv_new_int (value->num);
+}
 
-	xmmsv_get_int (current, &old_value);
+/* Converts the state of an aggregate function into its final value */
+static xmmsv_t *
+aggregate_state_to_xmmsv (const aggregate_state_t *state,
+                          aggregate_function_t aggr_func,
+                          xmmsv_string_pool_t *pool)
+{
+	const column_value_t *value;
+	xmmsv_t *ret, *item;
+	guint i;
 
-	if (old_value < int_value) {
-		return xmmsv_new_int (int_value);
+	switch (aggr_func) {
+		case AGGREGATE_FIRST:
+		case AGGREGATE_MIN:
+		case AGGREGATE_MAX:
+		case AGGREGATE_RANDOM:
+			if (state->has_value) {
+				ret = column_value_to_xmmsv (&state->value, pool);
+			} else {
+				ret = xmmsv_new_none ();
+			}
+			break;
+		case AGGREGATE_SUM:
+			if (state->has_value) {
+				ret = xmmsv_new_int (state->sum);
+			} else {
+				ret = xmmsv_new_none ();
+			}
+			break;
+		case AGGREGATE_LIST:
+		case AGGREGATE_SET:
+			ret = xmmsv_new_list ();
+			for (i = 0; state->values != NULL && i < state->values->len; i++) {
+				value = &g_array_index (state->values, column_value_t, i);
+				item = column_value_to_xmmsv (value, pool);
+				xmmsv_list_append (ret, item);
+				xmmsv_unref (item);
+			}
+			break;
+		case AGGREGATE_AVG:
+			if (state->has_value) {
+				ret = xmmsv_new_float (state->n ? state->sum * 1.0 / state->n : 0);
+			} else {
+				ret = xmmsv_new_none ();
+			}
+			break;
+		default:
+			g_assert_not_reached ();
 	}
 
-	return current;
+	return ret;
 }
 
-static xmmsv_t *
-aggregate_random (xmmsv_t *current, gint int_value, const gchar *str_value)
+/* Adds a value to the group identified by the keys */
+static void
+aggregate_add (aggregate_t *aggr, const gchar **keys, const column_value_t *value)
 {
-	random_data_t *data;
-	guint length;
+	aggregate_group_t lookup, *group;
+	gint i;
 
-	if (current == NULL) {
-		random_data_t init = { 0 };
-		current = xmmsv_new_bin ((guchar *) &init, sizeof (random_data_t));
+	lookup.depth = aggr->depth;
+	for (i = 0; i < aggr->depth; i++) {
+		lookup.keys[i] = (gchar *) keys[i];
 	}
 
-	xmmsv_get_bin (current, (const guchar **) &data, &length);
-
-	data->n++;
-
-	if (g_random_int_range (0, data->n) == 0) {
-		if (data->data != NULL) {
-			xmmsv_unref (data->data);
+	group = g_hash_table_lookup (aggr->table, &lookup);
+	if (group == NULL) {
+		group = g_new0 (aggregate_group_t, 1);
+		group->depth = aggr->depth;
+		for (i = 0; i < aggr->depth; i++) {
+			group->keys[i] = g_strdup (keys[i]);
 		}
 
-		if (str_value != NULL) {
-			data->data = xmmsv_new_string (str_value);
-		} else {
-			data->data = xmmsv_new_int (int_value);
-		}
+		g_hash_table_insert (aggr->table, group, group);
+		g_ptr_array_add (aggr->groups, group);
 	}
 
-	return current;
+	aggregate_state_update (&group->state, aggr->aggr_func, value);
 }
 
+/* Builds the result of the aggregation. All but the last key are used
+ * as keys in nested dicts, the aggregated values are the leafs. */
 static xmmsv_t *
-aggregate_average (xmmsv_t *current, gint int_value, const gchar *str_value)
+aggregate_to_xmmsv (aggregate_t *aggr, xmmsv_string_pool_t *pool)
 {
-	avg_data_t *data;
-	guint length;
+	aggregate_state_t empty = { 0 };
+	aggregate_group_t *group;
+	xmmsv_t *ret, *dict, *child, *value;
+	guint i;
+	gint j;
+
+	if (aggr->depth == 0) {
+		if (aggr->groups->len == 0) {
+			return aggregate_state_to_xmmsv (&empty, aggr->aggr_func, pool);
+		}
 
-	if (current == NULL) {
-		avg_data_t init = { 0 };
-		current = xmmsv_new_bin ((guchar *) &init, sizeof (avg_data_t));
+		group = g_ptr_array_index (aggr->groups, 0);
+		return aggregate_state_to_xmmsv (&group->state, aggr->aggr_func, pool);
 	}
 
-	xmmsv_get_bin (current, (const guchar **) &data, &length);
+	ret = xmmsv_new_dict ();
+
+	for (i = 0; i < aggr->groups->len; i++) {
+		group = g_ptr_array_index (aggr->groups, i);
+
+		dict = ret;
+		for (j = 0; j < aggr->depth - 1; j++) {
+			if (!xmmsv_dict_get (dict, group->keys[j], &child)) {
+				child = xmmsv_new_dict ();
+				_xmmsv_string_pool_dict_set (pool, dict, group->keys[j], child);
+				xmmsv_unref (child);
+			}
+			dict = child;
+		}
 
-	if (str_value == NULL) {
-		data->n++;
-		data->sum += int_value;
+		/* Numeric aggregates over strings only do not produce a value */
+		if (group->state.has_value) {
+			value = aggregate_state_to_xmmsv (&group->state, aggr->aggr_func, pool);
+			_xmmsv_string_pool_dict_set (pool, dict, group->keys[j], value);
+			xmmsv_unref (value);
+		}
 	}
 
-	return current;
+	return ret;
 }
 
-/* Converts an S4 result (a column) into an xmmsv values */
-static void *
-result_to_xmmsv (xmmsv_t *ret, gint32 id, const s4_result_t *res,
-                 xmms_fetch_spec_t *spec)
+/* Feeds all the values of an S4 result (a column) to the aggregation */
+static void
+result_aggregate (aggregate_t *aggr, gint32 id, const s4_result_t *res,
+                  xmms_fetch_spec_t *spec)
 {
-	static xmmsv_t * (*aggregate_functions[AGGREGATE_END])(xmmsv_t *c, gint i, const gchar *s) = {
-		aggregate_first,
-		aggregate_sum,
-		aggregate_max,
-		aggregate_min,
-		aggregate_set,
-		aggregate_list,
-		aggregate_random,
-		aggregate_average
-	};
+	/* Big enough to hold 2^32 with minus sign */
+	gchar buffers[METADATA_END - 1][12];
+	const gchar *keys[METADATA_END - 1];
+	column_value_t value = { NULL, 0 };
 	const s4_val_t *val;
-	xmmsv_t *dict, *current;
-	const gchar *str_value, *key = NULL;
-	gint32 i, int_value;
-	xmmsv_t *newval;
-
-	g_return_val_if_fail (spec->data.metadata.get_size > 0, ret);
-	g_return_val_if_fail (spec->data.metadata.get_size <= METADATA_END, ret);
-	g_return_val_if_fail (spec->data.metadata.aggr_func >= 0, ret);
-	g_return_val_if_fail (spec->data.metadata.aggr_func < AGGREGATE_END, ret);
+	gint i;
 
 	/* Loop through all the values the column has */
-	while (res != NULL) {
-		dict = ret;
-		current = ret;
+	for (; res != NULL; res = s4_result_next (res)) {
 
 		/* Loop through the list of what to get ("key", "source", ..) */
 		for (i = 0; i < spec->data.metadata.get_size; i++) {
-			str_value = NULL;
-			int_value = 0;
+			value.str = NULL;
+			value.num = 0;
 
-			/* Fill str_value with the correct value if it is a string
-			 * or int_value if it is an integer
-			 */
 			switch (spec->data.metadata.get[i]) {
 				case METADATA_KEY:
-					str_value = s4_result_get_key (res);
+					value.str = s4_result_get_key (res);
 					break;
 				case METADATA_SOURCE:
-					str_value = s4_result_get_src (res);
-					if (str_value == NULL)
-						str_value = "server";
+					value.str = s4_result_get_src (res);
+					if (value.str == NULL)
+						value.str = "server";
 					break;
 				case METADATA_ID:
-					int_value = id;
+					value.num = id;
 					break;
 				case METADATA_VALUE:
 					val = s4_result_get_val (res);
 
-					if (!s4_val_get_int (val, &int_value)) {
-						s4_val_get_str (val, &str_value);
+					if (!s4_val_get_int (val, &value.num)) {
+						s4_val_get_str (val, &value.str);
 					}
 					break;
 				default:
 					g_assert_not_reached ();
 			}
 
-			/* If this is not the last property to get we use this property
-			 * as a key in a dict
-			 */
+			/* All but the last property are used as keys, as strings */
 			if (i < (spec->data.metadata.get_size - 1)) {
-				/* Convert integers to strings */
-				if (str_value == NULL) {
-					/* Big enough to hold 2^32 with minus sign */
-					gchar buf[12];
-					g_sprintf (buf, "%i", int_value);
-					key = buf;
+				if (value.str == NULL) {
+					g_snprintf (buffers[i], sizeof (buffers[i]), "%i", value.num);
+					keys[i] = buffers[i];
 				} else {
-					key = str_value;
-				}
-
-				/* Make sure the root dict exists */
-				if (dict == NULL) {
-					ret = dict = xmmsv_new_dict ();
-				}
-
-				/* If this dict contains dicts we have to create a new
-				 * dict if one does not exists for the key yet
-				 */
-				if (!xmmsv_dict_get (dict, key, &current))
-					current = NULL;
-
-				if (i < (spec->data.metadata.get_size - 2)) {
-					if (current == NULL) {
-						current = xmmsv_new_dict ();
-						xmmsv_dict_set (dict, key, current);
-						xmmsv_unref (current);
-					}
-					dict = current;
-				}
-			}
-		}
-
-		newval = aggregate_functions[spec->data.metadata.aggr_func](current, int_value, str_value);
-
-		/* Update the previous dict (if there is one) */
-		if (newval != current) {
-			if (i > 1) {
-				xmmsv_dict_set (dict, key, newval);
-				xmmsv_unref (newval);
-			} else {
-				ret = newval;
-				if (current != NULL) {
-					xmmsv_unref (current);
+					keys[i] = value.str;
 				}
 			}
 		}
 
-		res = s4_result_next (res);
+		aggregate_add (aggr, keys, &value);
 	}
-
-	return ret;
 }
 
-/* Converts the temporary value returned by result_to_xmmsv into the real value */
+/* Converts rows of an S4 resultset to an xmmsv using the fetch specification */
 static xmmsv_t *
-aggregate_data (xmmsv_t *value, aggregate_function_t aggr_func)
+metadata_to_xmmsv (const s4_resultrow_t **rows, gint count,
+                   xmms_fetch_spec_t *spec, query_state_t *state)
 {
-	const random_data_t *random_data;
-	const avg_data_t *avg_data;
-	const set_data_t *set_data;
-	gconstpointer data;
+	aggregate_t *aggr;
 	xmmsv_t *ret;
-	guint len;
-
-	ret = NULL;
-	data = NULL;
-
-	if (value != NULL && xmmsv_is_type (value, XMMSV_TYPE_BIN))
-		xmmsv_get_bin (value, (const guchar **) &data, &len);
-
-	switch (aggr_func) {
-		case AGGREGATE_FIRST:
-		case AGGREGATE_MIN:
-		case AGGREGATE_MAX:
-		case AGGREGATE_SUM:
-			if (value != NULL) {
-				ret = xmmsv_ref (value);
-			} else {
-				ret = xmmsv_new_none ();
-			}
-			break;
-		case AGGREGATE_LIST:
-			if (value != NULL) {
-				ret = xmmsv_ref (value);
-			} else {
-				ret = xmmsv_new_list ();
-			}
-			break;
-		case AGGREGATE_RANDOM:
-			random_data = data;
-			if (random_data != NULL) {
-				ret = random_data->data;
-			} else {
-				ret = xmmsv_new_none ();
-			}
-			break;
-		case AGGREGATE_SET:
-			set_data = data;
-			if (set_data != NULL) {
-				g_hash_table_destroy (set_data->ht);
-				ret = set_data->list;
-			} else {
-				ret = xmmsv_new_list ();
-			}
-			break;
-		case AGGREGATE_AVG:
-			avg_data = data;
-			if (avg_data != NULL) {
-				ret = xmmsv_new_float (avg_data->n ? avg_data->sum * 1.0 / avg_data->n : 0);
-			} else {
-				ret = xmmsv_new_none ();
-			}
-			break;
-		default:
-			g_assert_not_reached ();
-	}
-
-	if (value != NULL) {
-		xmmsv_unref (value);
-	}
-
-	return ret;
-}
-
-/* Applies an aggregation function to the leafs in an xmmsv dict tree */
-static xmmsv_t *
-aggregate_result (xmmsv_t *val, gint depth, aggregate_function_t aggr_func)
-{
-	xmmsv_dict_iter_t *it;
-
-	if (depth == 0) {
-		return aggregate_data (val, aggr_func);
-	}
-
-	if (val == NULL && depth > 0) {
-		return xmmsv_new_dict();
-	}
-
-	/* If it's a dict we call this function recursively on all its values */
-	xmmsv_get_dict_iter (val, &it);
-
-	while (xmmsv_dict_iter_valid (it)) {
-		xmmsv_t *entry;
-
-		xmmsv_dict_iter_pair (it, NULL, &entry);
-		xmmsv_ref (entry);
-
-		entry = aggregate_result (entry, depth - 1, aggr_func);
-		xmmsv_dict_iter_set (it, entry);
-		xmmsv_unref (entry);
-
-		xmmsv_dict_iter_next (it);
-	}
+	gint i;
 
-	return val;
-}
+	g_return_val_if_fail (spec->data.metadata.get_size > 0, NULL);
+	g_return_val_if_fail (spec->data.metadata.get_size <= METADATA_END, NULL);
+	g_return_val_if_fail (spec->data.metadata.aggr_func >= 0, NULL);
+	g_return_val_if_fail (spec->data.metadata.aggr_func < AGGREGATE_END, NULL);
 
-/* Converts an S4 resultset to an xmmsv using the fetch specification */
-static xmmsv_t *
-metadata_to_xmmsv (s4_resultset_t *set, xmms_fetch_spec_t *spec)
-{
-	const s4_resultrow_t *row;
-	xmmsv_t *ret = NULL;
-	gint i;
+	aggr = aggregate_new (spec->data.metadata.get_size - 1,
+	                      spec->data.metadata.aggr_func);
 
 	/* Loop over the rows in the resultset */
-	for (i = 0; s4_resultset_get_row (set, i, &row); i++) {
-		gint32 id, j;
+	for (i = 0; i < count; i++) {
+		const s4_result_t *res;
+		gint32 id = 0, j;
 
-		s4_val_get_int (s4_result_get_val (s4_resultset_get_result (set, i, 0)), &id);
-		for (j = 0; j < spec->data.metadata.col_count; j++) {
-			const s4_result_t *res;
+		if (s4_resultrow_get_col (rows[i], 0, &res)) {
+			s4_val_get_int (s4_result_get_val (res), &id);
+		}
 
-			if (s4_resultrow_get_col (row, spec->data.metadata.cols[j], &res)) {
-				ret = result_to_xmmsv (ret, id, res, spec);
+		for (j = 0; j < spec->data.metadata.col_count; j++) {
+			if (s4_resultrow_get_col (rows[i], spec->data.metadata.cols[j], &res)) {
+				result_aggregate (aggr, id, res, spec);
 			}
 		}
 	}
 
-	return aggregate_result (ret, spec->data.metadata.get_size - 1,
-	                         spec->data.metadata.aggr_func);
-}
+	ret = aggregate_to_xmmsv (aggr, state->pool);
+	aggregate_free (aggr);
 
+	return ret;
+}
 
-/* Divides an S4 set into a list of smaller sets with
- * the same values for the cluster attributes
+/* Divides rows into clusters with the same values for the cluster
+ * attributes, keeping the order of the rows and of the clusters as they
+ * were first seen. The rows are grouped by pointer, nothing is copied.
  */
 static void
-cluster_set (s4_resultset_t *set, xmms_fetch_spec_t *spec,
-             GHashTable *table, GList **list)
+cluster_rows (const s4_resultrow_t **rows, gint count, xmms_fetch_spec_t *spec,
+              query_state_t *state, cluster_t *clusters)
 {
-	const s4_resultrow_t *row;
-	gint position;
-
-	/* Run through all the rows in the result set.
-	 * Uses a hash table to find the correct cluster to put the row in
-	 */
-	for (position = 0; s4_resultset_get_row (set, position, &row); position++) {
-		s4_resultset_t *cluster;
+	gint *assigned, *fill;
+	gint i;
+
+	assigned = g_new (gint, count);
+	clusters->keys = g_ptr_array_new ();
+
+	for (i = 0; i < count; i++) {
 		const s4_result_t *res;
 		const gchar *value = spec->data.cluster.fallback;
 		gchar buf[12];
+		gpointer n;
 
 		if (spec->data.cluster.type == CLUSTER_BY_POSITION) {
-			g_snprintf (buf, sizeof (buf), "%i", position);
+			g_snprintf (buf, sizeof (buf), "%i", i);
 			value = buf;
-		} else if (s4_resultrow_get_col (row, spec->data.cluster.column, &res)) {
+		} else if (s4_resultrow_get_col (rows[i], spec->data.cluster.column, &res)) {
 			const s4_val_t *val = s4_result_get_val (res);
 			if (!s4_val_get_str (val, &value)) {
 				gint32 ival;
@@ -504,125 +502,124 @@ cluster_set (s4_resultset_t *set, xmms_fetch_spec_t *spec,
 
 		if (value == NULL) {
 			/* value not found, and no fallback provided */
+			assigned[i] = -1;
 			continue;
 		}
 
-		cluster = g_hash_table_lookup (table, value);
-		if (cluster == NULL) {
-			cluster = s4_resultset_create (s4_resultset_get_colcount (set));
-			g_hash_table_insert (table, g_strdup (value), cluster);
-			*list = g_list_prepend (*list, cluster);
+		if (value == buf) {
+			value = g_string_chunk_insert_const (state->numbers, buf);
 		}
-		s4_resultset_add_row (cluster, row);
-	}
-}
-
-static GList *
-cluster_list (s4_resultset_t *set, xmms_fetch_spec_t *spec)
-{
-	GHashTable *table;
-	GList *list = NULL;
-
-	table = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
-	cluster_set (set, spec, table, &list);
-	g_hash_table_destroy (table);
-
-	return g_list_reverse (list);
-}
-
-static GHashTable *
-cluster_dict (s4_resultset_t *set, xmms_fetch_spec_t *spec)
-{
-	GHashTable *table;
-	GList *list = NULL;
-
-	table = g_hash_table_new_full (g_str_hash, g_str_equal,
-	                               g_free, (GDestroyNotify) s4_resultset_free);
-
-	cluster_set (set, spec, table, &list);
-	g_list_free (list);
 
-	return table;
-}
-
-static xmmsv_t *
-convert_ghashtable_to_xmmsv (GHashTable *table, xmms_fetch_spec_t *spec)
-{
-	GHashTableIter iter;
-	s4_resultset_t *value;
-	const gchar *key;
-	xmmsv_t *ret;
-
-	g_hash_table_iter_init (&iter, table);
-
-	ret = xmmsv_new_dict ();
+		n = g_hash_table_lookup (state->clusters, value);
+		if (n == NULL) {
+			g_ptr_array_add (clusters->keys, (gpointer) value);
+			n = GINT_TO_POINTER (clusters->keys->len);
+			g_hash_table_insert (state->clusters, (gpointer) value, n);
+		}
+		assigned[i] = GPOINTER_TO_INT (n) - 1;
+	}
 
-	while (g_hash_table_iter_next (&iter, (gpointer *) &key, (gpointer *) &value)) {
-		xmmsv_t *converted;
+	/* the table is free for the clusters of the clusters */
+	g_hash_table_remove_all (state->clusters);
 
-		if (value == NULL) {
-			continue;
+	/* Lay the clusters out one after the other in a single array */
+	clusters->offsets = g_new0 (gint, clusters->keys->len + 1);
+	for (i = 0; i < count; i++) {
+		if (assigned[i] >= 0) {
+			clusters->offsets[assigned[i] + 1]++;
 		}
-
-		converted = xmms_medialib_query_to_xmmsv (value, spec);
-		xmmsv_dict_set (ret, key, converted);
-		xmmsv_unref (converted);
+	}
+	for (i = 0; i < clusters->keys->len; i++) {
+		clusters->offsets[i + 1] += clusters->offsets[i];
 	}
 
-	if (xmmsv_dict_get_size (ret) == 0) {
-		xmmsv_unref (ret);
-		ret = NULL;
+	fill = g_new (gint, clusters->keys->len + 1);
+	memcpy (fill, clusters->offsets, sizeof (gint) * (clusters->keys->len + 1));
+	clusters->rows = g_new (const s4_resultrow_t *, clusters->offsets[clusters->keys->len]);
+	for (i = 0; i < count; i++) {
+		if (assigned[i] >= 0) {
+			clusters->rows[fill[assigned[i]]++] = rows[i];
+		}
 	}
 
-	return ret;
+	g_free (fill);
+	g_free (assigned);
 }
 
-/* Converts an S4 resultset into an xmmsv_t, based on the fetch specification */
-xmmsv_t *
-xmms_medialib_query_to_xmmsv (s4_resultset_t *set, xmms_fetch_spec_t *spec)
+static void
+cluster_clear (cluster_t *clusters)
+{
+	g_ptr_array_free (clusters->keys, TRUE);
+	g_free (clusters->offsets);
+	g_free (clusters->rows);
+}
+
+static xmmsv_t *
+query_to_xmmsv (const s4_resultrow_t **rows, gint count,
+                xmms_fetch_spec_t *spec, query_state_t *state)
 {
-	GHashTable *set_table;
-	GList *sets;
+	cluster_t clusters;
 	xmmsv_t *val, *ret = NULL;
-	gint i;
+	gint i, start;
 
 	switch (spec->type) {
 		case FETCH_COUNT:
-			ret = xmmsv_new_int (s4_resultset_get_rowcount (set));
+			ret = xmmsv_new_int (count);
 			break;
 		case FETCH_METADATA:
-			ret = metadata_to_xmmsv (set, spec);
+			ret = metadata_to_xmmsv (rows, count, spec, state);
 			break;
 		case FETCH_ORGANIZE:
 			ret = xmmsv_new_dict ();
 
 			for (i = 0; i < spec->data.organize.count; i++) {
-				val = xmms_medialib_query_to_xmmsv (set, spec->data.organize.data[i]);
+				val = query_to_xmmsv (rows, count, spec->data.organize.data[i], state);
 				if (val != NULL) {
-					xmmsv_dict_set (ret, spec->data.organize.keys[i], val);
+					_xmmsv_string_pool_dict_set (state->pool, ret, spec->data.organize.keys[i], val);
 					xmmsv_unref (val);
 				}
 			}
 			break;
 		case FETCH_CLUSTER_LIST:
-			sets = cluster_list (set, spec);
-			ret = xmmsv_new_list ();
-			for (; sets != NULL; sets = g_list_delete_link (sets, sets)) {
-				set = sets->data;
+			cluster_rows (rows, count, spec, state, &clusters);
 
-				val = xmms_medialib_query_to_xmmsv (set, spec->data.cluster.data);
+			ret = xmmsv_new_list ();
+			for (i = 0; i < clusters.keys->len; i++) {
+				start = clusters.offsets[i];
+				val = query_to_xmmsv (clusters.rows + start,
+				                      clusters.offsets[i + 1] - start,
+				                      spec->data.cluster.data, state);
 				if (val != NULL) {
 					xmmsv_list_append (ret, val);
 					xmmsv_unref (val);
 				}
-				s4_resultset_free (set);
 			}
+
+			cluster_clear (&clusters);
 			break;
 		case FETCH_CLUSTER_DICT:
-			set_table = cluster_dict (set, spec);
-			ret = convert_ghashtable_to_xmmsv (set_table, spec->data.cluster.data);
+			cluster_rows (rows, count, spec, state, &clusters);
+
+			ret = xmmsv_new_dict ();
+			for (i = 0; i < clusters.keys->len; i++) {
+				start = clusters.offsets[i];
+				val = query_to_xmmsv (clusters.rows + start,
+				                      clusters.offsets[i + 1] - start,
+				                      spec->data.cluster.data, state);
+				if (val != NULL) {
+					_xmmsv_string_pool_dict_set (state->pool, ret,
+					                             g_ptr_array_index (clusters.keys, i),
+					                             val);
+					xmmsv_unref (val);
+				}
+			}
+
+			cluster_clear (&clusters);
 
-			g_hash_table_destroy (set_table);
+			if (xmmsv_dict_get_size (ret) == 0) {
+				xmmsv_unref (ret);
+				ret = NULL;
+			}
 			break;
 		default:
 			g_assert_not_reached ();
@@ -630,3 +627,34 @@ xmms_medialib_query_to_xmmsv (s4_resultset_t *set, xmms_fetch_spec_t *spec)
 
 	return ret;
 }
+
+/* Converts an S4 resultset into an xmmsv_t, based on the fetch specification.
+ * The strings repeating in the result, like the keys of each entry, are
+ * only kept once. */
+xmmsv_t *
+xmms_medialib_query_to_xmmsv (s4_resultset_t *set, xmms_fetch_spec_t *spec)
+{
+	const s4_resultrow_t **rows;
+	query_state_t state;
+	xmmsv_t *ret;
+	gint count, i;
+
+	count = s4_resultset_get_rowcount (set);
+	rows = g_new (const s4_resultrow_t *, MAX (count, 1));
+	for (i = 0; i < count; i++) {
+		s4_resultset_get_row (set, i, &rows[i]);
+	}
+
+	state.pool = xmmsv_string_pool_new ();
+	state.clusters = g_hash_table_new (g_str_hash, g_str_equal);
+	state.numbers = g_string_chunk_new (256);
+
+	ret = query_to_xmmsv (rows, count, spec, &state);
+
+	g_string_chunk_free (state.numbers);
+	g_hash_table_destroy (state.clusters);
+	xmmsv_string_pool_free (state.pool);
+	g_free (rows);
+
+	return ret;
+}
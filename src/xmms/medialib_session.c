@@ -18,6 +18,17 @@
 #include <xmms/xmms_object.h>
 #include <string.h>
 
+/* The library statistics are stored on a separate entity so that
+ * they are never matched by song_id conditions. */
+#define XMMS_MEDIALIB_STATS_ENTITY "library_stats"
+#define XMMS_MEDIALIB_STATS_SOURCE "server"
+
+static const gchar *stats_keys[XMMS_MEDIALIB_STATS_END] = {
+	"size",
+	"duration",
+	"playtime"
+};
+
 struct xmms_medialib_session_St {
 	xmms_medialib_t *medialib;
 	s4_transaction_t *trans;
@@ -25,20 +36,25 @@ struct xmms_medialib_session_St {
 	GHashTable *updated;
 	GHashTable *removed;
 	xmmsv_t *vals;
+	gboolean stats_changed;
+	gint64 stats_delta[XMMS_MEDIALIB_STATS_END];
+	/* the medialib is not referenced, see xmms_medialib_session_begin_internal */
+	gboolean internal;
 };
 
 static void xmms_medialib_session_free (xmms_medialib_session_t *session);
 static void xmms_medialib_session_free_full (xmms_medialib_session_t *session);
 
 static GHashTable *xmms_medialib_session_get_table (GHashTable **table);
+static void xmms_medialib_session_stats_track (xmms_medialib_session_t *session, xmms_medialib_entry_t entry, const gint64 *before);
 
 static void xmms_medialib_entry_send_added (xmms_medialib_t *medialib, xmms_medialib_entry_t entry);
 static void xmms_medialib_entry_send_update (xmms_medialib_t *medialib, xmms_medialib_entry_t entry);
 static void xmms_medialib_entry_send_removed (xmms_medialib_t *medialib, xmms_medialib_entry_t entry);
 
 static xmms_medialib_session_t *
-xmms_medialib_session_begin_internal (xmms_medialib_t *medialib,
-                                      s4_transaction_flag_t flags)
+xmms_medialib_session_begin_flags (xmms_medialib_t *medialib,
+                                   s4_transaction_flag_t flags)
 {
 	xmms_medialib_session_t *ret = g_new0 (xmms_medialib_session_t, 1);
 
@@ -51,16 +67,35 @@ xmms_medialib_session_begin_internal (xmms_medialib_t *medialib,
 	return ret;
 }
 
+/**
+ * Begin a session for the medialib's own bookkeeping, which does not
+ * reference the medialib. It can be used while the medialib is being
+ * destroyed, and must be over before the database is closed.
+ */
+xmms_medialib_session_t *
+xmms_medialib_session_begin_internal (xmms_medialib_t *medialib)
+{
+	xmms_medialib_session_t *ret = g_new0 (xmms_medialib_session_t, 1);
+
+	ret->medialib = medialib;
+	ret->internal = TRUE;
+
+	s4_t *s4 = xmms_medialib_get_database_backend (medialib);
+	ret->trans = s4_begin (s4, 0);
+
+	return ret;
+}
+
 xmms_medialib_session_t *
 xmms_medialib_session_begin (xmms_medialib_t *medialib)
 {
-	return xmms_medialib_session_begin_internal (medialib, 0);
+	return xmms_medialib_session_begin_flags (medialib, 0);
 }
 
 xmms_medialib_session_t *
 xmms_medialib_session_begin_ro (xmms_medialib_t *medialib)
 {
-	return xmms_medialib_session_begin_internal (medialib, S4_TRANS_READONLY);
+	return xmms_medialib_session_begin_flags (medialib, S4_TRANS_READONLY);
 }
 
 void
@@ -76,7 +111,20 @@ xmms_medialib_session_commit (xmms_medialib_session_t *session)
 	GHashTableIter iter;
 	gpointer key;
 
-	if (!s4_commit (session->trans)) {
+	if (session->stats_changed) {
+		/* Accounting for the changes as the transaction becomes visible
+		 * lets a recount tell which changes it has seen. */
+		xmms_medialib_stats_lock (session->medialib);
+		if (!s4_commit (session->trans)) {
+			xmms_medialib_stats_unlock (session->medialib);
+			xmms_medialib_session_free_full (session);
+			return FALSE;
+		}
+		xmms_medialib_stats_add (session->medialib, session->stats_delta);
+		xmms_medialib_stats_unlock (session->medialib);
+
+		xmms_medialib_stats_flush (session->medialib, FALSE);
+	} else if (!s4_commit (session->trans)) {
 		xmms_medialib_session_free_full (session);
 		return FALSE;
 	}
@@ -93,6 +141,8 @@ xmms_medialib_session_commit (xmms_medialib_session_t *session)
 	}
 
 	if (session->removed != NULL) {
+		xmms_medialib_entries_removed (session->medialib, session->removed);
+
 		g_hash_table_iter_init (&iter, session->removed);
 
 		while (g_hash_table_iter_next (&iter, &key, NULL)) {
@@ -124,6 +174,13 @@ xmms_medialib_session_get_source_preferences (xmms_medialib_session_t *session)
 	return xmms_medialib_get_source_preferences (session->medialib);
 }
 
+GHashTable *
+xmms_medialib_session_get_materialized (xmms_medialib_session_t *session,
+                                        xmmsv_t *coll)
+{
+	return xmms_medialib_get_materialized (session->medialib, coll);
+}
+
 s4_resultset_t *
 xmms_medialib_session_query (xmms_medialib_session_t *session,
                              s4_fetchspec_t *specification,
@@ -148,6 +205,13 @@ xmms_medialib_session_property_set (xmms_medialib_session_t *session,
 	s4_val_t *song_id;
 	gint result;
 	GHashTable *events;
+	gint64 before[XMMS_MEDIALIB_STATS_END];
+	gboolean tracked;
+
+	tracked = xmms_medialib_stats_is_tracked (key);
+	if (tracked) {
+		xmms_medialib_entry_stats_get (session, entry, before);
+	}
 
 	song_id = s4_val_new_int (entry);
 
@@ -178,6 +242,10 @@ xmms_medialib_session_property_set (xmms_medialib_session_t *session,
 
 	s4_val_free (song_id);
 
+	if (tracked) {
+		xmms_medialib_session_stats_track (session, entry, before);
+	}
+
 	if (strcmp (key, XMMS_MEDIALIB_ENTRY_PROPERTY_URL) == 0) {
 		events = xmms_medialib_session_get_table (&session->added);
 	} else {
@@ -201,12 +269,23 @@ xmms_medialib_session_property_unset (xmms_medialib_session_t *session,
 	GHashTable *events;
 	s4_val_t *song_id;
 	gint result;
+	gint64 before[XMMS_MEDIALIB_STATS_END];
+	gboolean tracked;
+
+	tracked = xmms_medialib_stats_is_tracked (key);
+	if (tracked) {
+		xmms_medialib_entry_stats_get (session, entry, before);
+	}
 
 	song_id = s4_val_new_int (entry);
 	result = s4_del (session->trans, "song_id", song_id,
 	                 key, value, source);
 	s4_val_free (song_id);
 
+	if (tracked) {
+		xmms_medialib_session_stats_track (session, entry, before);
+	}
+
 	if (strcmp (key, XMMS_MEDIALIB_ENTRY_PROPERTY_URL) == 0) {
 		events = xmms_medialib_session_get_table (&session->removed);
 	} else {
@@ -220,6 +299,119 @@ xmms_medialib_session_property_unset (xmms_medialib_session_t *session,
 	return result;
 }
 
+/**
+ * Read the library statistics stored in the medialib.
+ *
+ * @param session The session to read from.
+ * @param values Filled with the XMMS_MEDIALIB_STATS_END statistics.
+ * @returns TRUE if the statistics have been stored before.
+ */
+gboolean
+xmms_medialib_session_stats_get (xmms_medialib_session_t *session,
+                                 gint64 *values)
+{
+	const s4_result_t *res;
+	s4_condition_t *cond;
+	s4_fetchspec_t *spec;
+	s4_resultset_t *set;
+	s4_val_t *stats_id;
+	const gchar *str;
+	gboolean found = FALSE;
+	gint i;
+
+	stats_id = s4_val_new_int (0);
+
+	cond = s4_cond_new_filter (S4_FILTER_EQUAL, XMMS_MEDIALIB_STATS_ENTITY,
+	                           stats_id, NULL, S4_CMP_CASELESS, S4_COND_PARENT);
+
+	spec = s4_fetchspec_create ();
+	for (i = 0; i < XMMS_MEDIALIB_STATS_END; i++) {
+		s4_fetchspec_add (spec, stats_keys[i], NULL, S4_FETCH_DATA);
+	}
+
+	set = s4_query (session->trans, spec, cond);
+
+	for (i = 0; i < XMMS_MEDIALIB_STATS_END; i++) {
+		values[i] = 0;
+
+		res = s4_resultset_get_result (set, 0, i);
+		if (res != NULL && s4_val_get_str (s4_result_get_val (res), &str)) {
+			values[i] = g_ascii_strtoll (str, NULL, 10);
+			found = TRUE;
+		}
+	}
+
+	s4_resultset_free (set);
+	s4_fetchspec_free (spec);
+	s4_cond_free (cond);
+	s4_val_free (stats_id);
+
+	return found;
+}
+
+/**
+ * Replace the library statistics stored in the medialib.
+ *
+ * The values are stored as strings as they do not fit in the 32 bit
+ * integers of s4.
+ *
+ * @param session The session to write to.
+ * @param values The XMMS_MEDIALIB_STATS_END statistics to store.
+ */
+void
+xmms_medialib_session_stats_set (xmms_medialib_session_t *session,
+                                 const gint64 *values)
+{
+	gint64 old_values[XMMS_MEDIALIB_STATS_END];
+	s4_val_t *stats_id, *value;
+	gboolean found;
+	gchar *str;
+	gint i;
+
+	found = xmms_medialib_session_stats_get (session, old_values);
+
+	stats_id = s4_val_new_int (0);
+
+	for (i = 0; i < XMMS_MEDIALIB_STATS_END; i++) {
+		if (found) {
+			str = g_strdup_printf ("%" G_GINT64_FORMAT, old_values[i]);
+			value = s4_val_new_string (str);
+			s4_del (session->trans, XMMS_MEDIALIB_STATS_ENTITY, stats_id,
+			        stats_keys[i], value, XMMS_MEDIALIB_STATS_SOURCE);
+			s4_val_free (value);
+			g_free (str);
+		}
+
+		str = g_strdup_printf ("%" G_GINT64_FORMAT, values[i]);
+		value = s4_val_new_string (str);
+		s4_add (session->trans, XMMS_MEDIALIB_STATS_ENTITY, stats_id,
+		        stats_keys[i], value, XMMS_MEDIALIB_STATS_SOURCE);
+		s4_val_free (value);
+		g_free (str);
+	}
+
+	s4_val_free (stats_id);
+}
+
+/* Account for the change of an entry's contribution to the statistics */
+static void
+xmms_medialib_session_stats_track (xmms_medialib_session_t *session,
+                                   xmms_medialib_entry_t entry,
+                                   const gint64 *before)
+{
+	gint64 after[XMMS_MEDIALIB_STATS_END];
+	gint i;
+
+	xmms_medialib_entry_stats_get (session, entry, after);
+
+	for (i = 0; i < XMMS_MEDIALIB_STATS_END; i++) {
+		if (after[i] != before[i]) {
+			session->stats_delta[i] += after[i] - before[i];
+			session->stats_changed = TRUE;
+		}
+	}
+}
+
 void
 xmms_medialib_session_track_garbage (xmms_medialib_session_t *session,
                                      xmmsv_t *data)
@@ -246,7 +438,8 @@ xmms_medialib_session_free_full (xmms_medialib_session_t *session)
 static void
 xmms_medialib_session_free (xmms_medialib_session_t *session)
 {
-	xmms_object_unref (session->medialib);
+	if (!session->internal)
+		xmms_object_unref (session->medialib);
 
 	if (session->added != NULL)
 		g_hash_table_unref (session->added);
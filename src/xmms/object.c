@@ -37,6 +37,30 @@ typedef struct {
 	gpointer userdata;
 } xmms_object_handler_entry_t;
 
+/**
+ * A signal waiting in the dispatch queue.
+ */
+typedef struct {
+	xmms_object_t *object;
+	guint32 signalid;
+	xmmsv_t *data;
+	gboolean coalesce;
+} xmms_object_emission_t;
+
+/**
+ * The dispatcher thread calling the handlers of queued signals, in the
+ * order they were queued.
+ */
+static struct {
+	GThread *thread;
+	GMutex mutex;
+	GCond cond;
+	GQueue queue;
+	/* last queued emission of each object, only those may be coalesced */
+	GHashTable *last;
+	gboolean running;
+} dispatcher;
+
 static gboolean
 cleanup_signal_list (gpointer key, gpointer value, gpointer data)
 {
@@ -69,13 +93,6 @@ xmms_object_cleanup (xmms_object_t *object)
 		g_tree_destroy (object->signals);
 	}
 
-	if (object->cmds) {
-		/* We don't need to free the commands themselves -- they are
-		 * stored in read-only memory.
-		 */
-		g_tree_destroy (object->cmds);
-	}
-
 	g_mutex_clear (&object->mutex);
 }
 
@@ -225,6 +242,137 @@ xmms_object_emit (xmms_object_t *object, guint32 signalid, xmmsv_t *data)
 	xmmsv_unref (data);
 }
 
+/**
+  * Queue a signal to be emitted from the dispatcher thread, so that the
+  * handlers (IPC broadcasts and such) don't run on the emitting thread.
+  *
+  * Signals of an object are emitted in the order they were queued. If
+  * coalesce is set and the last signal queued for the object is the same
+  * coalescable signal, its data is replaced instead, as only the latest
+  * value matters (playtime, volume...).
+  *
+  * Without a running dispatcher, the signal is emitted right away.
+  *
+  * @param object the object to signal on.
+  * @param signalid the signalid to emit
+  * @param data the data that should be sent to the handler.
+  * @param coalesce whether a pending emission may be replaced.
+  */
+
+void
+xmms_object_emit_queued (xmms_object_t *object, guint32 signalid,
+                         xmmsv_t *data, gboolean coalesce)
+{
+	xmms_object_emission_t *emission;
+
+	g_return_if_fail (object);
+	g_return_if_fail (XMMS_IS_OBJECT (object));
+
+	g_mutex_lock (&dispatcher.mutex);
+
+	if (!dispatcher.running) {
+		g_mutex_unlock (&dispatcher.mutex);
+		xmms_object_emit (object, signalid, data);
+		return;
+	}
+
+	emission = g_hash_table_lookup (dispatcher.last, object);
+	if (coalesce && emission != NULL && emission->coalesce &&
+	    emission->signalid == signalid) {
+		xmmsv_unref (emission->data);
+		emission->data = data;
+		g_mutex_unlock (&dispatcher.mutex);
+		return;
+	}
+
+	emission = g_new0 (xmms_object_emission_t, 1);
+	emission->object = xmms_object_ref (object);
+	emission->signalid = signalid;
+	emission->data = data;
+	emission->coalesce = coalesce;
+
+	g_queue_push_tail (&dispatcher.queue, emission);
+	g_hash_table_insert (dispatcher.last, object, emission);
+
+	g_cond_signal (&dispatcher.cond);
+	g_mutex_unlock (&dispatcher.mutex);
+}
+
+static gpointer
+xmms_object_dispatch_thread (gpointer udata)
+{
+	xmms_object_emission_t *emission;
+
+	g_mutex_lock (&dispatcher.mutex);
+
+	while (dispatcher.running || !g_queue_is_empty (&dispatcher.queue)) {
+		emission = g_queue_pop_head (&dispatcher.queue);
+		if (emission == NULL) {
+			g_cond_wait (&dispatcher.cond, &dispatcher.mutex);
+			continue;
+		}
+
+		if (g_hash_table_lookup (dispatcher.last, emission->object) == emission) {
+			g_hash_table_remove (dispatcher.last, emission->object);
+		}
+
+		g_mutex_unlock (&dispatcher.mutex);
+
+		xmms_object_emit (emission->object, emission->signalid, emission->data);
+		xmms_object_unref (emission->object);
+		g_free (emission);
+
+		g_mutex_lock (&dispatcher.mutex);
+	}
+
+	g_mutex_unlock (&dispatcher.mutex);
+
+	return NULL;
+}
+
+/**
+  * Start the dispatcher thread for #xmms_object_emit_queued.
+  */
+
+void
+xmms_object_dispatch_start (void)
+{
+	g_return_if_fail (dispatcher.thread == NULL);
+
+	g_mutex_lock (&dispatcher.mutex);
+	g_queue_init (&dispatcher.queue);
+	dispatcher.last = g_hash_table_new (NULL, NULL);
+	dispatcher.running = TRUE;
+	g_mutex_unlock (&dispatcher.mutex);
+
+	dispatcher.thread = g_thread_new ("x2 dispatcher",
+	                                  xmms_object_dispatch_thread, NULL);
+}
+
+/**
+  * Emit the queued signals and stop the dispatcher thread, later queued
+  * signals are emitted right away.
+  */
+
+void
+xmms_object_dispatch_stop (void)
+{
+	if (dispatcher.thread == NULL) {
+		return;
+	}
+
+	g_mutex_lock (&dispatcher.mutex);
+	dispatcher.running = FALSE;
+	g_cond_signal (&dispatcher.cond);
+	g_mutex_unlock (&dispatcher.mutex);
+
+	g_thread_join (dispatcher.thread);
+	dispatcher.thread = NULL;
+
+	g_hash_table_destroy (dispatcher.last);
+	dispatcher.last = NULL;
+}
+
 /**
  * Initialize a command argument.
  */
@@ -238,58 +386,90 @@ xmms_object_cmd_arg_init (xmms_object_cmd_arg_t *arg)
 	xmms_error_reset (&arg->error);
 }
 
-static gint
-compare_cmd_key (gconstpointer a, gconstpointer b)
-{
-	guint aa = GPOINTER_TO_INT (a);
-	guint bb = GPOINTER_TO_INT (b);
-
-	if (aa < bb)
-		return -1;
-	else if (aa > bb)
-		return 1;
-	else
-		return 0;
-}
-
 /**
   * Add a command that could be called from the client API to a object.
   *
   * @param object The object that should have the method.
   * @param cmdid A command id.
-  * @param desc A command description.
+  * @param desc A command description, usually generated from ipc.xml.
+  * It is not copied and has to outlive the object.
   */
 void
 xmms_object_cmd_add (xmms_object_t *object, guint cmdid,
-                     const xmms_object_cmd_func_t func)
+                     const xmms_object_cmd_desc_t *desc)
 {
 	g_return_if_fail (object);
-	g_return_if_fail (func);
+	g_return_if_fail (desc);
+	g_return_if_fail (desc->func);
+	g_return_if_fail (desc->nargs <= XMMS_OBJECT_CMD_MAX_ARGS);
+	g_return_if_fail (cmdid >= XMMS_IPC_COMMAND_FIRST);
+	g_return_if_fail (cmdid < XMMS_IPC_COMMAND_FIRST + XMMS_IPC_COMMAND_OBJECT_MAX);
+
+	object->cmds[cmdid - XMMS_IPC_COMMAND_FIRST] = desc;
+}
+
+/**
+  * Find a command added to an object.
+  *
+  * @returns the command description, or NULL if there is none.
+  */
+const xmms_object_cmd_desc_t *
+xmms_object_cmd_lookup (xmms_object_t *object, guint cmdid)
+{
+	g_return_val_if_fail (object, NULL);
 
-	if (!object->cmds)
-		object->cmds = g_tree_new (compare_cmd_key);
+	if (cmdid < XMMS_IPC_COMMAND_FIRST ||
+	    cmdid >= XMMS_IPC_COMMAND_FIRST + XMMS_IPC_COMMAND_OBJECT_MAX) {
+		return NULL;
+	}
 
-	g_tree_insert (object->cmds, GUINT_TO_POINTER (cmdid),
-	               (gpointer) func);
+	return object->cmds[cmdid - XMMS_IPC_COMMAND_FIRST];
 }
 
 /**
   * Call a command with argument.
+  *
+  * The arguments are checked against the command description first,
+  * a mismatch is set as error on arg and the command isn't run.
   */
 
 void
 xmms_object_cmd_call (xmms_object_t *object, guint cmdid, xmms_object_cmd_arg_t *arg)
 {
-	xmms_object_cmd_func_t func;
+	const xmms_object_cmd_desc_t *desc;
+	xmmsv_t *value;
+	gint i;
 
 	g_return_if_fail (object);
 
-	if (object->cmds) {
-		func = g_tree_lookup (object->cmds, GUINT_TO_POINTER (cmdid));
+	desc = xmms_object_cmd_lookup (object, cmdid);
+	if (!desc) {
+		return;
+	}
+
+	if (xmmsv_list_get_size (arg->args) != desc->nargs) {
+		XMMS_DBG ("Wrong number of arguments to command %d (%d)",
+		          cmdid, xmmsv_list_get_size (arg->args));
+		xmms_error_set (&arg->error, XMMS_ERROR_INVAL,
+		                "Wrong number of arguments");
+		return;
+	}
+
+	for (i = 0; i < desc->nargs; i++) {
+		if (desc->args[i] == XMMS_OBJECT_CMD_ARG_ANY) {
+			continue;
+		}
 
-		if (func)
-			func (object, arg);
+		xmmsv_list_get (arg->args, i, &value);
+		if (xmmsv_get_type (value) != desc->args[i]) {
+			XMMS_DBG ("Wrong type of arg %d to command %d", i, cmdid);
+			xmms_error_set (&arg->error, XMMS_ERROR_INVAL,
+			                "Wrong type of argument");
+			return;
+		}
 	}
+
+	desc->func (object, arg);
 }
 
 xmmsv_t *
@@ -368,9 +548,8 @@ __int_xmms_object_new (gint size, xmms_object_destroy_func_t destfunc)
 
 	g_mutex_init (&ret->mutex);
 
-	/* don't create the trees for the signals and the commands yet.
-	 * instead we instantiate those when we need them the first
-	 * time.
+	/* don't create the tree for the signals yet. instead we
+	 * instantiate it when we need it the first time.
 	 */
 
 	xmms_object_ref (ret);
@@ -239,9 +239,9 @@ update_playtime (xmms_output_t *output, int advance)
 		guint ms = xmms_sample_bytes_to_ms (output->format,
 		                                    output->played - buffersize);
 		if ((ms / 100) != (output->played_time / 100)) {
-			xmms_object_emit (XMMS_OBJECT (output),
-			                  XMMS_IPC_SIGNAL_PLAYBACK_PLAYTIME,
-			                  xmmsv_new_int (ms));
+			xmms_object_emit_queued (XMMS_OBJECT (output),
+			                         XMMS_IPC_SIGNAL_PLAYBACK_PLAYTIME,
+			                         xmmsv_new_int (ms), TRUE);
 		}
 		output->played_time = ms;
 
@@ -314,9 +314,9 @@ song_changed (void *data)
 	if (arg->flush)
 		xmms_output_flush (arg->output);
 
-	xmms_object_emit (XMMS_OBJECT (arg->output),
-	                  XMMS_IPC_SIGNAL_PLAYBACK_CURRENT_ID,
-	                  xmmsv_new_int (entry));
+	xmms_object_emit_queued (XMMS_OBJECT (arg->output),
+	                         XMMS_IPC_SIGNAL_PLAYBACK_CURRENT_ID,
+	                         xmmsv_new_int (entry), FALSE);
 
 	return TRUE;
 }
@@ -840,9 +840,9 @@ xmms_output_status_set (xmms_output_t *output, gint status)
 				ret = FALSE;
 			}
 
-			xmms_object_emit (XMMS_OBJECT (output),
-			                  XMMS_IPC_SIGNAL_PLAYBACK_STATUS,
-			                  xmmsv_new_int (output->status));
+			xmms_object_emit_queued (XMMS_OBJECT (output),
+			                         XMMS_IPC_SIGNAL_PLAYBACK_STATUS,
+			                         xmmsv_new_int (output->status), FALSE);
 		}
 	}
 
@@ -1212,14 +1212,14 @@ xmms_output_monitor_volume_thread (gpointer data)
 		     !xmms_volume_map_equal (&old, &cur))) {
 			/* emit the broadcast */
 			if (cur.status) {
-				xmms_object_emit (XMMS_OBJECT (output),
-				                  XMMS_IPC_SIGNAL_PLAYBACK_VOLUME_CHANGED,
-				                  xmms_volume_map_to_dict (&cur));
+				xmms_object_emit_queued (XMMS_OBJECT (output),
+				                         XMMS_IPC_SIGNAL_PLAYBACK_VOLUME_CHANGED,
+				                         xmms_volume_map_to_dict (&cur), TRUE);
 			} else {
 				/** @todo When bug 691 is solved, emit an error here */
-				xmms_object_emit (XMMS_OBJECT (output),
-				                  XMMS_IPC_SIGNAL_PLAYBACK_VOLUME_CHANGED,
-				                  xmmsv_new_none ());
+				xmms_object_emit_queued (XMMS_OBJECT (output),
+				                         XMMS_IPC_SIGNAL_PLAYBACK_VOLUME_CHANGED,
+				                         xmmsv_new_none (), TRUE);
 			}
 		}
 
@@ -31,6 +31,7 @@
 #include <xmms/xmms_ipc.h>
 #include <xmms/xmms_config.h>
 
+#include <xmmspriv/xmms_ipc.h>
 #include <xmmspriv/xmms_medialib.h>
 #include <xmmspriv/xmms_collection.h>
 #include <xmmspriv/xmms_playlist.h>
@@ -50,6 +51,7 @@ static gboolean xmms_playlist_remove_unlocked (xmms_playlist_t *playlist, const
 static void xmms_playlist_client_move_entry (xmms_playlist_t *playlist, const gchar *plname, gint32 pos, gint32 newpos, xmms_error_t *err);
 static gint xmms_playlist_client_set_next_rel (xmms_playlist_t *playlist, gint32 pos, xmms_error_t *error);
 static gint xmms_playlist_set_current_position_do (xmms_playlist_t *playlist, gint32 pos, xmms_error_t *err);
+static void xmms_playlist_insert_entries (xmms_playlist_t *playlist, const gchar *plname, gint32 pos, xmmsv_t *ids, xmms_error_t *err);
 
 static void xmms_playlist_client_insert_url (xmms_playlist_t *playlist, const gchar *plname, gint32 pos, const gchar *url, xmms_error_t *error);
 static void xmms_playlist_client_insert_collection (xmms_playlist_t *playlist, const gchar *plname, gint32 pos, xmmsv_t *coll, xmms_error_t *error);
@@ -66,6 +68,7 @@ static gint xmms_playlist_coll_get_size (xmmsv_t *plcoll);
 static void xmms_playlist_update_unlocked (xmms_playlist_t *playlist, const gchar *plname);
 static void xmms_playlist_update_queue (xmms_playlist_t *playlist, const gchar *plname, xmmsv_t *coll);
 static void xmms_playlist_update_partyshuffle (xmms_playlist_t *playlist, const gchar *plname, xmmsv_t *coll);
+static void xmms_playlist_index_sync (xmms_playlist_t *playlist);
 
 static void xmms_playlist_register_ipc_commands (xmms_object_t *playlist_object);
 
@@ -73,6 +76,7 @@ static void xmms_playlist_current_pos_msg_send (xmms_playlist_t *playlist, xmmsv
 static xmmsv_t *xmms_playlist_current_pos_msg_new (xmms_playlist_t *playlist, gint32 pos, const gchar *plname);
 
 static void xmms_playlist_changed_msg_send (xmms_playlist_t *playlist, xmmsv_t *dict);
+static xmmsv_t *xmms_playlist_changed_msg_expand (xmmsv_t *dict);
 static xmmsv_t *xmms_playlist_changed_msg_new (xmms_playlist_t *playlist, xmms_playlist_changed_action_t type, xmms_medialib_entry_t id, const gchar *plname);
 
 #define XMMS_PLAYLIST_CHANGED_MSG(type, id, name) xmms_playlist_changed_msg_send (playlist, xmms_playlist_changed_msg_new (playlist, type, id, name))
@@ -101,8 +105,37 @@ struct xmms_playlist_St {
 	GMutex mutex;
 
 	xmms_medialib_t *medialib;
+
+	/* id -> the playlists the entry is in, for the playlists in
+	 * 'indexed' (a set of referenced playlist collections). An entry in
+	 * a single playlist, once, maps to that collection itself, any other
+	 * to a tagged xmms_playlist_index_refs_t, see INDEX_REFS. */
+	GHashTable *index;
+	GHashTable *indexed;
+
+	/* set when playlists may have been replaced or removed through the
+	 * collection API, so that 'indexed' holds on to stale collections */
+	gint index_stale;
 };
 
+/** How many times an entry appears in a playlist */
+typedef struct {
+	xmmsv_t *plcoll;
+	gint count;
+} xmms_playlist_index_ref_t;
+
+/** The playlists an entry appears in, if more than one or more than once */
+typedef struct {
+	gint len;
+	gint size;
+	xmms_playlist_index_ref_t refs[];
+} xmms_playlist_index_refs_t;
+
+/* Collections are aligned, so the low bit tells the two kinds apart */
+#define INDEX_IS_REFS(v) (GPOINTER_TO_SIZE (v) & 1)
+#define INDEX_REFS(v) ((xmms_playlist_index_refs_t *) (GPOINTER_TO_SIZE (v) & ~(gsize) 1))
+#define INDEX_TAG(r) GSIZE_TO_POINTER (GPOINTER_TO_SIZE (r) | 1)
+
 #include "playlist_ipc.c"
 
 static void
@@ -176,6 +209,7 @@ xmms_playlist_update_partyshuffle (xmms_playlist_t *playlist,
                                    const gchar *plname, xmmsv_t *coll)
 {
 	gint history, upcoming, currpos, size;
+	const gchar *weight;
 	xmmsv_t *src;
 
 	XMMS_DBG ("PLAYLIST: Update partyshuffle.");
@@ -188,6 +222,11 @@ xmms_playlist_update_partyshuffle (xmms_playlist_t *playlist,
 		upcoming = XMMS_DEFAULT_PARTYSHUFFLE_UPCOMING;
 	}
 
+	/* Optionally favour media by an integer property, e.g. "rating" */
+	if (!xmmsv_coll_attribute_get_string (coll, "weight", &weight)) {
+		weight = NULL;
+	}
+
 	currpos = xmms_playlist_coll_get_currpos (coll);
 	while (currpos > history) {
 		/* Removing entries is fast enough to be processed at once. */
@@ -197,13 +236,15 @@ xmms_playlist_update_partyshuffle (xmms_playlist_t *playlist,
 
 	g_return_if_fail(xmmsv_list_get (xmmsv_coll_operands_get (coll), 0, &src));
 
-	/* Since getting random media can be slow on huge medialibs, we refill only
-	 * one entry at a time. This let other threads a chance to get the lock on
-	 * the playlist object as soon as possible. */
+	/* Random media are drawn from the ids kept for the source, but keeping
+	 * them up to date after medialib changes may take a while, so we refill
+	 * only one entry at a time. This let other threads a chance to get the
+	 * lock on the playlist object as soon as possible. */
 	size = xmms_playlist_coll_get_size (coll);
 	if (size < currpos + 1 + upcoming) {
 		xmms_medialib_entry_t randentry;
-		randentry = xmms_collection_get_random_media (playlist->colldag, src);
+		randentry = xmms_collection_get_weighted_random_media (playlist->colldag,
+		                                                       src, weight);
 		if (randentry > 0) {
 			xmms_playlist_add_entry_unlocked (playlist, plname, coll, randentry, NULL);
 		}
@@ -221,57 +262,371 @@ void
 xmms_playlist_update (xmms_playlist_t *playlist, const gchar *plname)
 {
 	g_mutex_lock (&playlist->mutex);
+	if (g_atomic_int_compare_and_exchange (&playlist->index_stale, TRUE, FALSE)) {
+		xmms_playlist_index_sync (playlist);
+	}
 	xmms_playlist_update_unlocked (playlist, plname);
 	g_mutex_unlock (&playlist->mutex);
 }
 
 
-typedef struct {
-	xmms_playlist_t *pls;
+/**
+ * Block playlist edits. The changes of an edit, and the signals telling
+ * about it, are complete before this returns.
+ */
+void
+xmms_playlist_lock (xmms_playlist_t *playlist)
+{
+	g_mutex_lock (&playlist->mutex);
+}
+
+void
+xmms_playlist_unlock (xmms_playlist_t *playlist)
+{
+	g_mutex_unlock (&playlist->mutex);
+}
+
+static void
+xmms_playlist_edit_lock (gboolean lock, gpointer udata)
+{
+	xmms_playlist_t *playlist = (xmms_playlist_t *) udata;
+
+	if (lock) {
+		xmms_playlist_lock (playlist);
+	} else {
+		xmms_playlist_unlock (playlist);
+	}
+}
+
+static xmms_playlist_index_refs_t *
+xmms_playlist_index_refs_grow (xmms_playlist_index_refs_t *refs)
+{
+	gint size = refs ? refs->size * 2 : 2;
+
+	refs = g_realloc (refs, sizeof (xmms_playlist_index_refs_t) +
+	                        size * sizeof (xmms_playlist_index_ref_t));
+	refs->size = size;
+
+	return refs;
+}
+
+static void
+xmms_playlist_index_add (xmms_playlist_t *playlist, xmmsv_t *plcoll,
+                         xmms_medialib_entry_t entry)
+{
+	xmms_playlist_index_refs_t *refs;
+	gpointer value;
+	gint i;
+
+	value = g_hash_table_lookup (playlist->index, GINT_TO_POINTER (entry));
+	if (value == NULL) {
+		g_hash_table_insert (playlist->index, GINT_TO_POINTER (entry), plcoll);
+		return;
+	}
+
+	if (INDEX_IS_REFS (value)) {
+		refs = INDEX_REFS (value);
+	} else {
+		refs = xmms_playlist_index_refs_grow (NULL);
+		refs->refs[0].plcoll = value;
+		refs->refs[0].count = 1;
+		refs->len = 1;
+	}
+
+	for (i = 0; i < refs->len; i++) {
+		if (refs->refs[i].plcoll == plcoll) {
+			refs->refs[i].count++;
+			break;
+		}
+	}
+
+	if (i == refs->len) {
+		if (refs->len == refs->size) {
+			refs = xmms_playlist_index_refs_grow (refs);
+		}
+		refs->refs[i].plcoll = plcoll;
+		refs->refs[i].count = 1;
+		refs->len++;
+	}
+
+	g_hash_table_steal (playlist->index, GINT_TO_POINTER (entry));
+	g_hash_table_insert (playlist->index, GINT_TO_POINTER (entry), INDEX_TAG (refs));
+}
+
+static void
+xmms_playlist_index_remove (xmms_playlist_t *playlist, xmmsv_t *plcoll,
+                            xmms_medialib_entry_t entry)
+{
+	xmms_playlist_index_refs_t *refs;
+	gpointer value;
+	gint i;
+
+	value = g_hash_table_lookup (playlist->index, GINT_TO_POINTER (entry));
+	if (value == NULL) {
+		return;
+	}
+
+	if (!INDEX_IS_REFS (value)) {
+		if (value == plcoll) {
+			g_hash_table_remove (playlist->index, GINT_TO_POINTER (entry));
+		}
+		return;
+	}
+
+	refs = INDEX_REFS (value);
+
+	for (i = 0; i < refs->len; i++) {
+		if (refs->refs[i].plcoll == plcoll) {
+			if (--refs->refs[i].count == 0) {
+				refs->refs[i] = refs->refs[--refs->len];
+			}
+			break;
+		}
+	}
+
+	/* back to the plain collection once it is the only one left */
+	if (refs->len == 1 && refs->refs[0].count == 1) {
+		g_hash_table_insert (playlist->index, GINT_TO_POINTER (entry),
+		                     refs->refs[0].plcoll);
+	} else if (refs->len == 0) {
+		g_hash_table_remove (playlist->index, GINT_TO_POINTER (entry));
+	}
+}
+
+static void
+xmms_playlist_index_add_coll (xmms_playlist_t *playlist, xmmsv_t *plcoll)
+{
 	xmms_medialib_entry_t entry;
-} playlist_remove_context_t;
+	gint i;
+
+	for (i = 0; xmmsv_coll_idlist_get_index (plcoll, i, &entry); i++) {
+		xmms_playlist_index_add (playlist, plcoll, entry);
+	}
+
+	g_hash_table_insert (playlist->indexed, plcoll, xmmsv_ref (plcoll));
+}
 
 static void
-remove_from_playlist (gpointer key, gpointer value, gpointer udata)
+xmms_playlist_index_remove_coll (xmms_playlist_t *playlist, xmmsv_t *plcoll)
 {
-	playlist_remove_context_t *ctx = (playlist_remove_context_t *) udata;
-	xmmsv_t *coll = (xmmsv_t *) value;
-	const gchar *name = (const gchar *) key;
+	xmms_medialib_entry_t entry;
+	gint i;
+
+	for (i = 0; xmmsv_coll_idlist_get_index (plcoll, i, &entry); i++) {
+		xmms_playlist_index_remove (playlist, plcoll, entry);
+	}
+
+	g_hash_table_remove (playlist->indexed, plcoll);
+}
+
+static void
+xmms_playlist_index_free_refs (gpointer data)
+{
+	if (INDEX_IS_REFS (data)) {
+		g_free (INDEX_REFS (data));
+	}
+}
+
+static void
+collect_playlist_coll (gpointer key, gpointer value, gpointer udata)
+{
+	g_hash_table_insert ((GHashTable *) udata, value, value);
+}
+
+/**
+ * Bring the index up to date with the playlists namespace.
+ *
+ * Changes made through the playlist object are applied to the index as
+ * they happen. Playlists saved, loaded or removed through the collection
+ * API replace the collection itself, so only collections that appeared
+ * or disappeared since the last call have to be (un)indexed.
+ */
+static void
+xmms_playlist_index_sync (xmms_playlist_t *playlist)
+{
+	GHashTableIter iter;
+	GHashTable *current;
+	GList *stale = NULL, *n;
+	gpointer key;
+
+	current = g_hash_table_new (NULL, NULL);
+
+	xmms_collection_foreach_in_namespace (playlist->colldag,
+	                                      XMMS_COLLECTION_NSID_PLAYLISTS,
+	                                      collect_playlist_coll, current);
 
-	xmms_medialib_entry_t val;
-	gint32 i;
+	g_hash_table_iter_init (&iter, playlist->indexed);
+	while (g_hash_table_iter_next (&iter, &key, NULL)) {
+		if (!g_hash_table_lookup (current, key)) {
+			stale = g_list_prepend (stale, key);
+		}
+	}
+
+	for (n = stale; n; n = g_list_next (n)) {
+		xmms_playlist_index_remove_coll (playlist, n->data);
+	}
+	g_list_free (stale);
 
-	for (i = 0; xmmsv_coll_idlist_get_index (coll, i, &val); i++) {
-		if (val == ctx->entry) {
-			XMMS_DBG ("removing entry on pos %d in %s", i, name);
-			xmms_playlist_remove_unlocked (ctx->pls, name, coll, i, NULL);
-			i--; /* reset it */
+	g_hash_table_iter_init (&iter, current);
+	while (g_hash_table_iter_next (&iter, &key, NULL)) {
+		if (!g_hash_table_lookup (playlist->indexed, key)) {
+			xmms_playlist_index_add_coll (playlist, key);
 		}
 	}
+
+	g_hash_table_destroy (current);
+}
+
+static gboolean
+xmms_playlist_index_has_coll (xmms_playlist_t *playlist, xmmsv_t *plcoll)
+{
+	return g_hash_table_lookup (playlist->indexed, plcoll) != NULL;
 }
 
+/**
+ * Remove all occurrences of a set of entries from a playlist in a
+ * single pass, and send one notification for the whole change.
+ */
 static void
-on_medialib_entry_removed (xmms_object_t *object, xmmsv_t *val, gpointer udata)
+xmms_playlist_compact_unlocked (xmms_playlist_t *playlist, const gchar *plname,
+                                xmmsv_t *plcoll, GHashTable *entries)
+{
+	xmms_medialib_entry_t entry;
+	gint i, j, size, currpos, removed, before_currpos, last_pos = -1;
+	xmmsv_t *dict;
+
+	currpos = xmms_playlist_coll_get_currpos (plcoll);
+	size = xmms_playlist_coll_get_size (plcoll);
+
+	removed = 0;
+	before_currpos = 0;
+
+	for (i = 0, j = 0; i < size; i++) {
+		xmmsv_coll_idlist_get_index (plcoll, i, &entry);
+
+		if (g_hash_table_lookup (entries, GINT_TO_POINTER (entry)) != NULL) {
+			XMMS_DBG ("removing entry on pos %d in %s", i, plname);
+			xmms_playlist_index_remove (playlist, plcoll, entry);
+			if (currpos != -1 && i <= currpos) {
+				before_currpos++;
+			}
+			last_pos = i;
+			removed++;
+			continue;
+		}
+
+		if (i != j) {
+			xmmsv_coll_idlist_set_index (plcoll, j, entry);
+		}
+		j++;
+	}
+
+	if (removed == 0) {
+		return;
+	}
+
+	for (i = size - 1; i >= j; i--) {
+		xmmsv_coll_idlist_remove (plcoll, i);
+	}
+
+	if (removed == 1) {
+		dict = xmms_playlist_changed_msg_new (playlist, XMMS_PLAYLIST_CHANGED_REMOVE, 0, plname);
+		xmmsv_dict_set_int (dict, "position", last_pos);
+		xmms_playlist_changed_msg_send (playlist, dict);
+	} else {
+		XMMS_PLAYLIST_CHANGED_MSG (XMMS_PLAYLIST_CHANGED_REPLACE, 0, plname);
+	}
+
+	if (before_currpos > 0) {
+		currpos = MAX (0, currpos - before_currpos);
+		xmms_collection_set_int_attr (plcoll, "position", currpos);
+		XMMS_PLAYLIST_CURRPOS_MSG (currpos, plname);
+	}
+}
+
+typedef struct {
+	xmms_playlist_t *playlist;
+	GHashTable *affected;
+	GHashTable *entries;
+} playlist_remove_context_t;
+
+static void
+remove_from_playlist (gpointer key, gpointer value, gpointer udata)
+{
+	playlist_remove_context_t *ctx = (playlist_remove_context_t *) udata;
+
+	/* Aliases share the collection, only compact it once */
+	if (g_hash_table_remove (ctx->affected, value)) {
+		xmms_playlist_compact_unlocked (ctx->playlist, (const gchar *) key,
+		                                (xmmsv_t *) value, ctx->entries);
+	}
+}
+
+/**
+ * Remove a set of medialib entries from all playlists.
+ *
+ * Only the playlists that contain any of the entries are touched, each
+ * of them in a single pass.
+ *
+ * @param playlist The playlist object.
+ * @param entries A set of entry ids, as keys of a direct hash table.
+ */
+void
+xmms_playlist_remove_entries (xmms_playlist_t *playlist, GHashTable *entries)
 {
-	xmms_playlist_t *playlist = (xmms_playlist_t *) udata;
 	playlist_remove_context_t ctx;
-	gint entry;
+	xmms_playlist_index_refs_t *refs;
+	GHashTableIter iter;
+	gpointer key, value;
+	gint i;
 
 	g_return_if_fail (playlist);
-	g_return_if_fail (xmmsv_get_int (val, &entry));
-
-	ctx.pls = playlist;
-	ctx.entry = entry;
+	g_return_if_fail (entries);
 
 	g_mutex_lock (&playlist->mutex);
 
-	xmms_collection_foreach_in_namespace (playlist->colldag,
-	                                      XMMS_COLLECTION_NSID_PLAYLISTS,
-	                                      remove_from_playlist, &ctx);
+	xmms_playlist_index_sync (playlist);
+
+	ctx.playlist = playlist;
+	ctx.entries = entries;
+	ctx.affected = g_hash_table_new (NULL, NULL);
+
+	g_hash_table_iter_init (&iter, entries);
+	while (g_hash_table_iter_next (&iter, &key, NULL)) {
+		value = g_hash_table_lookup (playlist->index, key);
+		if (value == NULL) {
+			continue;
+		}
+
+		if (!INDEX_IS_REFS (value)) {
+			g_hash_table_insert (ctx.affected, value, value);
+			continue;
+		}
+
+		refs = INDEX_REFS (value);
+		for (i = 0; i < refs->len; i++) {
+			g_hash_table_insert (ctx.affected, refs->refs[i].plcoll,
+			                     refs->refs[i].plcoll);
+		}
+	}
+
+	if (g_hash_table_size (ctx.affected) > 0) {
+		xmms_collection_foreach_in_namespace (playlist->colldag,
+		                                      XMMS_COLLECTION_NSID_PLAYLISTS,
+		                                      remove_from_playlist, &ctx);
+	}
+
+	g_hash_table_destroy (ctx.affected);
 
 	g_mutex_unlock (&playlist->mutex);
 }
 
+static void
+on_medialib_entries_removed (GHashTable *entries, gpointer udata)
+{
+	xmms_playlist_remove_entries ((xmms_playlist_t *) udata, entries);
+}
+
 static void
 on_collection_changed (xmms_object_t *object, xmmsv_t *val, gpointer udata)
 {
@@ -289,6 +644,11 @@ on_collection_changed (xmms_object_t *object, xmmsv_t *val, gpointer udata)
 
 	g_return_if_fail (xmmsv_dict_entry_get_string (val, "name", &name));
 
+	/* This runs with the collection DAG locked, so the playlist lock can't
+	 * be taken here. The update this message triggers drops the replaced
+	 * or removed collection from the index instead. */
+	g_atomic_int_set (&playlist->index_stale, TRUE);
+
 	XMMS_PLAYLIST_CHANGED_MSG (XMMS_PLAYLIST_CHANGED_UPDATE, 0, name);
 }
 
@@ -305,6 +665,9 @@ xmms_playlist_init (xmms_medialib_t *medialib, xmms_coll_dag_t *colldag)
 	g_mutex_init (&ret->mutex);
 
 	xmms_playlist_register_ipc_commands (XMMS_OBJECT (ret));
+	xmms_ipc_broadcast_compat_register (XMMS_IPC_SIGNAL_PLAYLIST_CHANGED,
+	                                    XMMS_IPC_CAPABILITY_PLAYLIST_CHANGED_BATCH,
+	                                    xmms_playlist_changed_msg_expand);
 
 	val = xmms_config_property_register ("playlist.repeat_one", "0",
 	                                     on_playlist_r_one_changed, ret);
@@ -320,9 +683,19 @@ xmms_playlist_init (xmms_medialib_t *medialib, xmms_coll_dag_t *colldag)
 	xmms_object_ref (colldag);
 	ret->colldag = colldag;
 
-	xmms_object_connect (XMMS_OBJECT (ret->medialib),
-	                     XMMS_IPC_SIGNAL_MEDIALIB_ENTRY_REMOVED,
-	                     on_medialib_entry_removed, ret);
+	ret->index = g_hash_table_new_full (NULL, NULL, NULL,
+	                                    xmms_playlist_index_free_refs);
+	ret->indexed = g_hash_table_new_full (NULL, NULL, NULL,
+	                                      (GDestroyNotify) xmmsv_unref);
+
+	/* all the entries a session removed at once, each playlist is
+	 * compacted a single time */
+	xmms_medialib_removed_func_set (ret->medialib,
+	                                on_medialib_entries_removed, ret);
+
+	/* collections are copied while no playlist is being edited */
+	xmms_collection_edit_lock_func_set (ret->colldag,
+	                                    xmms_playlist_edit_lock, ret);
 
 	xmms_object_connect (XMMS_OBJECT (ret->colldag),
 	                     XMMS_IPC_SIGNAL_COLLECTION_CHANGED,
@@ -555,6 +928,7 @@ static gboolean
 xmms_playlist_remove_unlocked (xmms_playlist_t *playlist, const gchar *plname,
                                xmmsv_t *plcoll, gint pos, xmms_error_t *err)
 {
+	xmms_medialib_entry_t entry;
 	gint currpos;
 	xmmsv_t *dict;
 
@@ -562,11 +936,16 @@ xmms_playlist_remove_unlocked (xmms_playlist_t *playlist, const gchar *plname,
 
 	currpos = xmms_playlist_coll_get_currpos (plcoll);
 
-	if (!xmmsv_coll_idlist_remove (plcoll, pos)) {
+	if (!xmmsv_coll_idlist_get_index (plcoll, pos, &entry) ||
+	    !xmmsv_coll_idlist_remove (plcoll, pos)) {
 		if (err) xmms_error_set (err, XMMS_ERROR_NOENT, "Entry was not in list!");
 		return FALSE;
 	}
 
+	if (xmms_playlist_index_has_coll (playlist, plcoll)) {
+		xmms_playlist_index_remove (playlist, plcoll, entry);
+	}
+
 	dict = xmms_playlist_changed_msg_new (playlist, XMMS_PLAYLIST_CHANGED_REMOVE, 0, plname);
 	xmmsv_dict_set_int (dict, "position", pos);
 	xmms_playlist_changed_msg_send (playlist, dict);
@@ -720,20 +1099,19 @@ xmms_playlist_client_rinsert (xmms_playlist_t *playlist, const gchar *plname, gi
                               const gchar *path, xmms_error_t *err)
 {
 	xmms_medialib_entry_t entry;
-	xmmsv_t *idlist;
-	xmmsv_list_iter_t *it;
-	xmmsv_t *list;
+	xmmsv_t *idlist, *ids;
+	gint i;
 
 	idlist = xmms_medialib_add_recursive (playlist->medialib, path, err);
-	list = xmmsv_coll_idlist_get (idlist);
 
-	xmmsv_get_list_iter (list, &it);
-	xmmsv_list_iter_last (it);
-	while (xmmsv_list_iter_entry_int (it, &entry)) {
-		xmms_playlist_insert_entry (playlist, plname, pos, entry, err);
-		xmmsv_list_iter_prev (it);
+	ids = xmmsv_new_list ();
+	for (i = 0; xmmsv_coll_idlist_get_index (idlist, i, &entry); i++) {
+		xmmsv_list_append_int (ids, entry);
 	}
 
+	xmms_playlist_insert_entries (playlist, plname, pos, ids, err);
+
+	xmmsv_unref (ids);
 	xmmsv_unref (idlist);
 }
 
@@ -751,27 +1129,120 @@ static void
 xmms_playlist_client_insert_collection (xmms_playlist_t *playlist, const gchar *plname,
                                         gint32 pos, xmmsv_t *coll, xmms_error_t *err)
 {
+	xmms_medialib_session_t *session;
 	xmms_medialib_entry_t mid;
-	xmmsv_list_iter_t *it;
-	xmmsv_t *list;
+	xmmsv_t *list, *ids;
+	gboolean invalid;
+	gint i;
 
 	list = xmms_collection_query_ids (playlist->colldag, coll, err);
 	if (xmms_error_iserror (err)) {
 		return;
 	}
 
-	xmmsv_get_list_iter (list, &it);
+	ids = xmmsv_new_list ();
+
+	do {
+		session = xmms_medialib_session_begin_ro (playlist->medialib);
+
+		xmmsv_list_clear (ids);
+		invalid = FALSE;
+
+		for (i = 0; xmmsv_list_get_int (list, i, &mid); i++) {
+			if (xmms_medialib_check_id (session, mid)) {
+				xmmsv_list_append_int (ids, mid);
+			} else {
+				invalid = TRUE;
+			}
+		}
+	} while (!xmms_medialib_session_commit (session));
 
-	xmmsv_list_iter_last (it);
+	xmms_playlist_insert_entries (playlist, plname, pos, ids, err);
 
-	while (xmmsv_list_iter_entry_int (it, &mid)) {
-		xmms_playlist_insert_entry (playlist, plname, pos, mid, err);
-		xmmsv_list_iter_prev (it);
+	if (invalid && !xmms_error_iserror (err)) {
+		xmms_error_set (err, XMMS_ERROR_NOENT,
+		                "That is not a valid medialib id!");
 	}
 
+	xmmsv_unref (ids);
 	xmmsv_unref (list);
 }
 
+/**
+ * Insert a list of entries at a given position in the playlist, or
+ * append them if the position is -1, without validating them.
+ *
+ * All entries are inserted under a single lock and announced with one
+ * XMMS_PLAYLIST_CHANGED_INSERT_RANGE message, which clients that
+ * haven't opted in to batched notifications see expanded into one
+ * XMMS_PLAYLIST_CHANGED_INSERT per entry, or XMMS_PLAYLIST_CHANGED_ADD
+ * if the entries were appended.
+ */
+static void
+xmms_playlist_insert_entries (xmms_playlist_t *playlist, const gchar *plname,
+                              gint32 pos, xmmsv_t *ids, xmms_error_t *err)
+{
+	xmms_medialib_entry_t id;
+	xmmsv_t *plcoll, *dict;
+	gboolean indexed;
+	gint currpos, count, len, i;
+
+	count = xmmsv_list_get_size (ids);
+	if (count == 0) {
+		return;
+	}
+
+	g_mutex_lock (&playlist->mutex);
+
+	plcoll = xmms_playlist_get_coll (playlist, plname, err);
+	if (plcoll == NULL) {
+		g_mutex_unlock (&playlist->mutex);
+		return;
+	}
+
+	len = xmms_playlist_coll_get_size (plcoll);
+	if (pos == -1) {
+		pos = len;
+	}
+
+	if (pos < 0 || pos > len) {
+		xmms_error_set (err, XMMS_ERROR_GENERIC,
+		                "Could not insert entry outside of playlist!");
+		g_mutex_unlock (&playlist->mutex);
+		return;
+	}
+
+	indexed = xmms_playlist_index_has_coll (playlist, plcoll);
+
+	for (i = 0; xmmsv_list_get_int (ids, i, &id); i++) {
+		if (pos == len) {
+			xmmsv_coll_idlist_append (plcoll, id);
+		} else {
+			xmmsv_coll_idlist_insert (plcoll, pos + i, id);
+		}
+
+		if (indexed) {
+			xmms_playlist_index_add (playlist, plcoll, id);
+		}
+	}
+
+	dict = xmms_playlist_changed_msg_new (playlist, XMMS_PLAYLIST_CHANGED_INSERT_RANGE, 0, plname);
+	xmmsv_dict_set_int (dict, "position", pos);
+	xmmsv_dict_set_int (dict, "append", pos == len);
+	xmmsv_dict_set (dict, "ids", ids);
+	xmms_playlist_changed_msg_send (playlist, dict);
+
+	/** update position once client is familiar with the new items. */
+	currpos = xmms_playlist_coll_get_currpos (plcoll);
+	if (pos <= currpos) {
+		currpos += count;
+		xmms_collection_set_int_attr (plcoll, "position", currpos);
+		XMMS_PLAYLIST_CURRPOS_MSG (currpos, plname);
+	}
+
+	g_mutex_unlock (&playlist->mutex);
+}
+
 /**
  * Insert an entry at a given position in the playlist without
  * validating it.
@@ -819,8 +1290,13 @@ xmms_playlist_insert_entry (xmms_playlist_t *playlist, const gchar *plname,
 		g_mutex_unlock (&playlist->mutex);
 		return;
 	}
+
 	xmmsv_coll_idlist_insert (plcoll, pos, file);
 
+	if (xmms_playlist_index_has_coll (playlist, plcoll)) {
+		xmms_playlist_index_add (playlist, plcoll, file);
+	}
+
 	/** propagate the MID ! */
 	dict = xmms_playlist_changed_msg_new (playlist, XMMS_PLAYLIST_CHANGED_INSERT, file, plname);
 	xmmsv_dict_set_int (dict, "position", pos);
@@ -881,19 +1357,19 @@ xmms_playlist_client_radd (xmms_playlist_t *playlist, const gchar *plname,
                            const gchar *path, xmms_error_t *err)
 {
 	xmms_medialib_entry_t entry;
-	xmmsv_t *idlist;
-	xmmsv_list_iter_t *it;
-	xmmsv_t *list;
+	xmmsv_t *idlist, *ids;
+	gint i;
 
 	idlist = xmms_medialib_add_recursive (playlist->medialib, path, err);
-	list = xmmsv_coll_idlist_get (idlist);
 
-	xmmsv_get_list_iter (list, &it);
-	while (xmmsv_list_iter_entry_int (it, &entry)) {
-		xmms_playlist_add_entry (playlist, plname, entry, err);
-		xmmsv_list_iter_next (it);
+	ids = xmmsv_new_list ();
+	for (i = 0; xmmsv_coll_idlist_get_index (idlist, i, &entry); i++) {
+		xmmsv_list_append_int (ids, entry);
 	}
 
+	xmms_playlist_insert_entries (playlist, plname, -1, ids, err);
+
+	xmmsv_unref (ids);
 	xmmsv_unref (idlist);
 }
 
@@ -902,15 +1378,14 @@ xmms_playlist_client_add_collection (xmms_playlist_t *playlist, const gchar *pln
                                      xmmsv_t *coll, xmms_error_t *err)
 {
 	xmmsv_t *res;
-	int32_t id;
-	int i;
 
 	res = xmms_collection_query_ids (playlist->colldag, coll, err);
-
-	for (i = 0; xmmsv_list_get_int (res, i, &id); i++) {
-		xmms_playlist_add_entry (playlist, plname, id, err);
+	if (xmms_error_iserror (err)) {
+		return;
 	}
 
+	xmms_playlist_insert_entries (playlist, plname, -1, res, err);
+
 	xmmsv_unref (res);
 }
 
@@ -950,8 +1425,13 @@ xmms_playlist_add_entry_unlocked (xmms_playlist_t *playlist,
 	xmmsv_t *dict;
 
 	prev_size = xmms_playlist_coll_get_size (plcoll);
+
 	xmmsv_coll_idlist_append (plcoll, file);
 
+	if (xmms_playlist_index_has_coll (playlist, plcoll)) {
+		xmms_playlist_index_add (playlist, plcoll, file);
+	}
+
 	/** propagate the MID ! */
 	dict = xmms_playlist_changed_msg_new (playlist, XMMS_PLAYLIST_CHANGED_ADD, file, plname);
 	xmmsv_dict_set_int (dict, "position", prev_size);
@@ -1092,6 +1572,7 @@ xmms_playlist_client_replace (xmms_playlist_t *playlist, const gchar *plname,
 	xmmsv_t *plcoll;
 	xmmsv_t *result;
 	gint current_position, i;
+	gboolean indexed;
 
 	g_return_if_fail (playlist);
 	g_return_if_fail (coll);
@@ -1114,6 +1595,11 @@ xmms_playlist_client_replace (xmms_playlist_t *playlist, const gchar *plname,
 		return;
 	}
 
+	indexed = xmms_playlist_index_has_coll (playlist, plcoll);
+	if (indexed) {
+		xmms_playlist_index_remove_coll (playlist, plcoll);
+	}
+
 	xmmsv_coll_idlist_clear (plcoll);
 
 	current_position = -1;
@@ -1124,6 +1610,10 @@ xmms_playlist_client_replace (xmms_playlist_t *playlist, const gchar *plname,
 		xmmsv_coll_idlist_append (plcoll, id);
 	}
 
+	if (indexed) {
+		xmms_playlist_index_add_coll (playlist, plcoll);
+	}
+
 	switch (action) {
 		case XMMS_PLAYLIST_CURRENT_ID_FORGET:
 			current_position = -1;
@@ -1158,7 +1648,7 @@ xmms_playlist_client_list_entries (xmms_playlist_t *playlist, const gchar *plnam
 	xmmsv_t *entries = NULL;
 	xmmsv_t *plcoll;
 	xmms_medialib_entry_t entry;
-	xmmsv_list_iter_t *it;
+	gint i;
 
 	g_return_val_if_fail (playlist, NULL);
 
@@ -1172,15 +1662,9 @@ xmms_playlist_client_list_entries (xmms_playlist_t *playlist, const gchar *plnam
 
 	entries = xmmsv_new_list ();
 
-	xmmsv_get_list_iter (xmmsv_coll_idlist_get (plcoll), &it);
-	for (xmmsv_list_iter_first (it);
-	     xmmsv_list_iter_valid (it);
-	     xmmsv_list_iter_next (it)) {
-
-		xmmsv_list_iter_entry_int (it, &entry);
+	for (i = 0; xmmsv_coll_idlist_get_index (plcoll, i, &entry); i++) {
 		xmmsv_list_append_int (entries, entry);
 	}
-	xmmsv_list_iter_explicit_destroy (it);
 
 	g_mutex_unlock (&playlist->mutex);
 
@@ -1210,14 +1694,16 @@ xmms_playlist_destroy (xmms_object_t *object)
 	val = xmms_config_lookup ("playlist.repeat_all");
 	xmms_config_property_callback_remove (val, on_playlist_r_all_changed, playlist);
 
-	xmms_object_disconnect (XMMS_OBJECT (playlist->medialib),
-	                        XMMS_IPC_SIGNAL_MEDIALIB_ENTRY_REMOVED,
-	                        on_medialib_entry_removed, playlist);
+	xmms_medialib_removed_func_set (playlist->medialib, NULL, NULL);
+	xmms_collection_edit_lock_func_set (playlist->colldag, NULL, NULL);
 
 	xmms_object_disconnect (XMMS_OBJECT (playlist->colldag),
 	                        XMMS_IPC_SIGNAL_COLLECTION_CHANGED,
 	                        on_collection_changed, playlist);
 
+	g_hash_table_destroy (playlist->index);
+	g_hash_table_destroy (playlist->indexed);
+
 	xmms_object_unref (playlist->colldag);
 	xmms_object_unref (playlist->medialib);
 
@@ -1350,6 +1836,50 @@ xmms_playlist_changed_msg_send (xmms_playlist_t *playlist, xmmsv_t *dict)
 	                  dict);
 }
 
+/**
+ * Expand a batched change message into the per-entry messages sent
+ * to clients that don't understand it.
+ */
+static xmmsv_t *
+xmms_playlist_changed_msg_expand (xmmsv_t *dict)
+{
+	xmmsv_t *ids, *ret, *entry;
+	const gchar *plname;
+	gint type, pos, append, id, i;
+
+	if (!xmmsv_dict_entry_get_int (dict, "type", &type) ||
+	    type != XMMS_PLAYLIST_CHANGED_INSERT_RANGE) {
+		return NULL;
+	}
+
+	if (!xmmsv_dict_entry_get_string (dict, "name", &plname) ||
+	    !xmmsv_dict_entry_get_int (dict, "position", &pos) ||
+	    !xmmsv_dict_get (dict, "ids", &ids)) {
+		return NULL;
+	}
+
+	/* appending used to be announced as one add per entry */
+	if (xmmsv_dict_entry_get_int (dict, "append", &append) && append) {
+		type = XMMS_PLAYLIST_CHANGED_ADD;
+	} else {
+		type = XMMS_PLAYLIST_CHANGED_INSERT;
+	}
+
+	ret = xmmsv_new_list ();
+
+	for (i = 0; xmmsv_list_get_int (ids, i, &id); i++) {
+		entry = xmmsv_build_dict (XMMSV_DICT_ENTRY_INT ("type", type),
+		                          XMMSV_DICT_ENTRY_STR ("name", plname),
+		                          XMMSV_DICT_ENTRY_INT ("id", id),
+		                          XMMSV_DICT_ENTRY_INT ("position", pos + i),
+		                          XMMSV_DICT_END);
+		xmmsv_list_append (ret, entry);
+		xmmsv_unref (entry);
+	}
+
+	return ret;
+}
+
 static void
 xmms_playlist_current_pos_msg_send (xmms_playlist_t *playlist,
                                     xmmsv_t *dict)
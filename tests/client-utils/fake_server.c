@@ -0,0 +1,156 @@
+/*  XMMS2 - X Music Multiplexer System
+ *  Copyright (C) 2003-2020 XMMS2 Team
+ *
+ *  PLUGINS ARE NOT CONSIDERED TO BE DERIVED WORK !!!
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#include "fake_server.h"
+
+static char path[128];
+static int listener = -1;
+
+static int
+fake_read (xmms_ipc_transport_t *ipct, char *buffer, int len)
+{
+	return recv (ipct->fd, buffer, len, 0);
+}
+
+static int
+fake_write (xmms_ipc_transport_t *ipct, char *buffer, int len)
+{
+	return send (ipct->fd, buffer, len, 0);
+}
+
+/**
+ * Listen on a fresh unix socket for clients of the fake server.
+ *
+ * @returns 1 on success, 0 otherwise.
+ */
+int
+fake_server_listen (const char *name)
+{
+	struct sockaddr_un addr;
+
+	/* the fake server hangs up with replies still on the way */
+	signal (SIGPIPE, SIG_IGN);
+
+	snprintf (path, sizeof (path), "/tmp/xmms-test-%s-%d", name, (int) getpid ());
+	unlink (path);
+
+	memset (&addr, 0, sizeof (addr));
+	addr.sun_family = AF_UNIX;
+	strncpy (addr.sun_path, path, sizeof (addr.sun_path) - 1);
+
+	listener = socket (AF_UNIX, SOCK_STREAM, 0);
+	if (listener < 0) {
+		return 0;
+	}
+
+	return bind (listener, (struct sockaddr *) &addr, sizeof (addr)) == 0 &&
+	       listen (listener, 1) == 0;
+}
+
+void
+fake_server_close (void)
+{
+	close (listener);
+	listener = -1;
+	unlink (path);
+}
+
+/**
+ * Fork a stand-in for the daemon, which accepts one connection and
+ * runs func on it. The child exits when func returns, unless func
+ * exits with a status of its own.
+ */
+pid_t
+fake_server_start (fake_server_func_t func, void *udata)
+{
+	xmms_ipc_transport_t ipct;
+	pid_t pid;
+
+	pid = fork ();
+	if (pid == 0) {
+		memset (&ipct, 0, sizeof (ipct));
+		ipct.fd = accept (listener, NULL, NULL);
+		ipct.read_func = fake_read;
+		ipct.write_func = fake_write;
+
+		if (ipct.fd >= 0) {
+			func (&ipct, udata);
+		}
+
+		_exit (0);
+	}
+
+	return pid;
+}
+
+/**
+ * Wait for the fake server to exit.
+ *
+ * @returns its exit status, or -1 if it didn't exit.
+ */
+int
+fake_server_wait (pid_t pid)
+{
+	int status;
+
+	if (waitpid (pid, &status, 0) != pid) {
+		return -1;
+	}
+
+	return WIFEXITED (status) ? WEXITSTATUS (status) : -1;
+}
+
+/**
+ * Connect a client to the fake server.
+ *
+ * @returns the connection, or NULL if it couldn't connect.
+ */
+xmmsc_connection_t *
+fake_server_connect (void)
+{
+	xmmsc_connection_t *c;
+	char url[160];
+
+	snprintf (url, sizeof (url), "unix://%s", path);
+
+	c = xmmsc_init ("test");
+	if (!xmmsc_connect (c, url)) {
+		xmmsc_unref (c);
+		return NULL;
+	}
+
+	return c;
+}
+
+/* Monotonic time in seconds */
+double
+fake_server_now (void)
+{
+	struct timespec ts;
+
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
@@ -0,0 +1,38 @@
+/*  XMMS2 - X Music Multiplexer System
+ *  Copyright (C) 2003-2020 XMMS2 Team
+ *
+ *  PLUGINS ARE NOT CONSIDERED TO BE DERIVED WORK !!!
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ */
+
+#ifndef __FAKE_SERVER_H__
+#define __FAKE_SERVER_H__
+
+#include <sys/types.h>
+
+#include <xmmsclient/xmmsclient.h>
+#include <xmmsc/xmmsc_ipc_transport.h>
+
+/* Serves one client connection, in a child process */
+typedef void (*fake_server_func_t) (xmms_ipc_transport_t *ipct, void *udata);
+
+int fake_server_listen (const char *name);
+void fake_server_close (void);
+
+pid_t fake_server_start (fake_server_func_t func, void *udata);
+int fake_server_wait (pid_t pid);
+
+xmmsc_connection_t *fake_server_connect (void);
+
+double fake_server_now (void);
+
+#endif
@@ -0,0 +1,510 @@
+/*  XMMS2 - X Music Multiplexer System
+ *  Copyright (C) 2003-2020 XMMS2 Team
+ *
+ *  PLUGINS ARE NOT CONSIDERED TO BE DERIVED WORK !!!
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ */
+
+#include "xcu.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/select.h>
+
+#include <xmmsclient/xmmsclient.h>
+#include <xmmsc/xmmsc_idnumbers.h>
+#include <xmmsc/xmmsc_ipc_msg.h>
+#include <xmmsc/xmmsc_ipc_transport.h>
+
+#include "client-utils/fake_server.h"
+
+#define OUTSTANDING 50000
+#define BATCHED 500
+#define ROUNDS 20
+#define PART_SIZE 4096
+#define PART_ENTRIES 10000
+
+static void
+fake_reply_value (xmms_ipc_transport_t *ipct, uint32_t cookie, xmmsv_t *val)
+{
+	xmms_ipc_msg_t *msg;
+
+	msg = xmms_ipc_msg_new (XMMS_IPC_OBJECT_MAIN, XMMS_IPC_COMMAND_REPLY);
+	xmms_ipc_msg_set_cookie (msg, cookie);
+	xmms_ipc_msg_put_value (msg, val);
+
+	while (!xmms_ipc_msg_write_transport (msg, ipct, NULL));
+
+	xmms_ipc_msg_destroy (msg);
+}
+
+static void
+fake_reply (xmms_ipc_transport_t *ipct, uint32_t cookie, int value)
+{
+	xmmsv_t *val;
+
+	val = xmmsv_new_int (value);
+	fake_reply_value (ipct, cookie, val);
+	xmmsv_unref (val);
+}
+
+/* Answer each command in a batch with its position */
+static void
+fake_reply_batch (xmms_ipc_transport_t *ipct, xmms_ipc_msg_t *msg)
+{
+	xmmsv_t *args, *commands, *results;
+	int i;
+
+	results = xmmsv_new_list ();
+
+	if (xmms_ipc_msg_get_value (msg, &args)) {
+		if (xmmsv_list_get (args, 0, &commands)) {
+			for (i = 0; i < xmmsv_list_get_size (commands); i++) {
+				xmmsv_list_append_int (results, i);
+			}
+		}
+		xmmsv_unref (args);
+	}
+
+	fake_reply_value (ipct, xmms_ipc_msg_get_cookie (msg), results);
+	xmmsv_unref (results);
+}
+
+/* A stand-in for the daemon. Answers hello and batches right away and
+ * every other request once batch requests have arrived, in the order
+ * they were sent. Exits when the client disconnects.
+ */
+static void
+fake_server (xmms_ipc_transport_t *ipct, void *udata)
+{
+	int batch = *(int *) udata;
+	uint32_t *cookies;
+	int pending = 0, i;
+
+	cookies = calloc (batch, sizeof (uint32_t));
+
+	while (ipct->fd >= 0) {
+		xmms_ipc_msg_t *msg = xmms_ipc_msg_alloc ();
+		bool disconnected = false;
+
+		if (!xmms_ipc_msg_read_transport (msg, ipct, &disconnected)) {
+			xmms_ipc_msg_destroy (msg);
+			break;
+		}
+
+		if (xmms_ipc_msg_get_object (msg) == XMMS_IPC_OBJECT_MAIN &&
+		    xmms_ipc_msg_get_cmd (msg) == XMMS_IPC_COMMAND_MAIN_HELLO) {
+			fake_reply (ipct, xmms_ipc_msg_get_cookie (msg), 1);
+		} else if (xmms_ipc_msg_get_object (msg) == XMMS_IPC_OBJECT_MAIN &&
+		           xmms_ipc_msg_get_cmd (msg) == XMMS_IPC_COMMAND_MAIN_BATCH) {
+			fake_reply_batch (ipct, msg);
+		} else {
+			cookies[pending++] = xmms_ipc_msg_get_cookie (msg);
+		}
+
+		xmms_ipc_msg_destroy (msg);
+
+		if (pending == batch) {
+			for (i = 0; i < pending; i++) {
+				fake_reply (ipct, cookies[i], i);
+			}
+			pending = 0;
+		}
+	}
+
+	free (cookies);
+}
+
+static pid_t
+batch_server_start (int batch)
+{
+	return fake_server_start (fake_server, &batch);
+}
+
+/* Send a reply in REPLY_PART pieces, with the reply to another cookie
+ * in the middle of them, optionally compressing the reply first */
+static void
+fake_reply_parts (xmms_ipc_transport_t *ipct, uint32_t cookie, xmmsv_t *val,
+                  uint32_t urgent_cookie, int compress)
+{
+	xmms_ipc_msg_t *msg;
+	const unsigned char *data;
+	unsigned int len, offset;
+
+	msg = xmms_ipc_msg_new (XMMS_IPC_OBJECT_MAIN, XMMS_IPC_COMMAND_REPLY);
+	xmms_ipc_msg_set_cookie (msg, cookie);
+	xmms_ipc_msg_put_value (msg, val);
+
+	if (compress) {
+		xmms_ipc_msg_t *compressed = xmms_ipc_msg_compress (msg);
+		if (compressed) {
+			xmms_ipc_msg_destroy (msg);
+			msg = compressed;
+		}
+	}
+
+	data = xmms_ipc_msg_get_data (msg, &len);
+
+	for (offset = 0; offset < len; offset += PART_SIZE) {
+		xmms_ipc_msg_t *part;
+		xmmsv_t *bin;
+
+		if (offset == len / PART_SIZE / 2 * PART_SIZE) {
+			fake_reply (ipct, urgent_cookie, 1);
+		}
+
+		part = xmms_ipc_msg_new (XMMS_IPC_OBJECT_MAIN, XMMS_IPC_COMMAND_REPLY_PART);
+		xmms_ipc_msg_set_cookie (part, cookie);
+
+		bin = xmmsv_new_bin (data + offset, len - offset < PART_SIZE ? len - offset : PART_SIZE);
+		xmms_ipc_msg_put_value (part, bin);
+		xmmsv_unref (bin);
+
+		while (!xmms_ipc_msg_write_transport (part, ipct, NULL));
+		xmms_ipc_msg_destroy (part);
+	}
+
+	xmms_ipc_msg_destroy (msg);
+}
+
+/* Answers hello, then a large query and a small command sent after it,
+ * the way the daemon answers bulk queries and control commands */
+static void
+fake_server_parts (xmms_ipc_transport_t *ipct, void *udata)
+{
+	int compress = *(int *) udata;
+	uint32_t cookies[2];
+	xmmsv_t *list;
+	int pending = 0, i;
+
+	while (pending < 2) {
+		xmms_ipc_msg_t *msg = xmms_ipc_msg_alloc ();
+		bool disconnected = false;
+
+		if (!xmms_ipc_msg_read_transport (msg, ipct, &disconnected)) {
+			_exit (1);
+		}
+
+		if (xmms_ipc_msg_get_cmd (msg) == XMMS_IPC_COMMAND_MAIN_HELLO) {
+			fake_reply (ipct, xmms_ipc_msg_get_cookie (msg), 1);
+		} else {
+			cookies[pending++] = xmms_ipc_msg_get_cookie (msg);
+		}
+
+		xmms_ipc_msg_destroy (msg);
+	}
+
+	list = xmmsv_new_list ();
+	for (i = 0; i < PART_ENTRIES; i++) {
+		xmmsv_list_append_int (list, i);
+	}
+
+	fake_reply_parts (ipct, cookies[0], list, cookies[1], compress);
+	xmmsv_unref (list);
+
+	/* wait for the client to go away */
+	while (recv (ipct->fd, cookies, sizeof (cookies), 0) > 0);
+}
+
+/* Run the connection until counter reaches target or it disconnects */
+static int
+pump (xmmsc_connection_t *c, int *counter, int target)
+{
+	int fd = xmmsc_io_fd_get (c);
+
+	while (*counter < target) {
+		fd_set rfds, wfds;
+
+		FD_ZERO (&rfds);
+		FD_ZERO (&wfds);
+		FD_SET (fd, &rfds);
+		if (xmmsc_io_want_out (c)) {
+			FD_SET (fd, &wfds);
+		}
+
+		if (select (fd + 1, &rfds, &wfds, NULL, NULL) < 0) {
+			return 0;
+		}
+
+		if (FD_ISSET (fd, &wfds) && !xmmsc_io_out_handle (c)) {
+			return 0;
+		}
+
+		if (FD_ISSET (fd, &rfds) && !xmmsc_io_in_handle (c)) {
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+static void
+flush (xmmsc_connection_t *c)
+{
+	int fd = xmmsc_io_fd_get (c);
+
+	while (xmmsc_io_want_out (c)) {
+		fd_set wfds;
+
+		FD_ZERO (&wfds);
+		FD_SET (fd, &wfds);
+
+		if (select (fd + 1, NULL, &wfds, NULL, NULL) < 0 ||
+		    !xmmsc_io_out_handle (c)) {
+			break;
+		}
+	}
+}
+
+static int
+count_reply (xmmsv_t *val, void *udata)
+{
+	int *counter = udata;
+
+	(*counter)++;
+
+	return 1;
+}
+
+static int
+count_signal (xmmsv_t *val, void *udata)
+{
+	int *counter = udata;
+
+	(*counter)++;
+
+	/* restart once */
+	return *counter < 2;
+}
+
+SETUP (result_dispatch) {
+	CU_ASSERT_TRUE (fake_server_listen ("results"));
+	return 0;
+}
+
+CLEANUP () {
+	fake_server_close ();
+	return 0;
+}
+
+static xmmsc_connection_t *
+connect_to_fake_server (void)
+{
+	xmmsc_connection_t *c;
+
+	c = fake_server_connect ();
+	CU_ASSERT_PTR_NOT_NULL_FATAL (c);
+
+	return c;
+}
+
+CASE (test_dispatch_outstanding_results)
+{
+	xmmsc_connection_t *c;
+	xmmsc_result_t **results;
+	int counter = 0, i;
+	double start, elapsed;
+	pid_t pid;
+
+	pid = batch_server_start (OUTSTANDING);
+	c = connect_to_fake_server ();
+
+	results = calloc (OUTSTANDING, sizeof (xmmsc_result_t *));
+	for (i = 0; i < OUTSTANDING; i++) {
+		results[i] = xmmsc_playback_current_id (c);
+		xmmsc_result_notifier_set (results[i], count_reply, &counter);
+	}
+
+	flush (c);
+
+	/* replies arrive oldest first while all results are outstanding */
+	start = fake_server_now ();
+	CU_ASSERT_TRUE (pump (c, &counter, OUTSTANDING));
+	elapsed = fake_server_now () - start;
+
+	CU_ASSERT_EQUAL (counter, OUTSTANDING);
+
+	printf ("\n%d replies with %d outstanding results: %.3f ms, %.3f us per reply\n",
+	        counter, OUTSTANDING, elapsed * 1e3, elapsed * 1e6 / OUTSTANDING);
+
+	for (i = 0; i < OUTSTANDING; i++) {
+		xmmsc_result_unref (results[i]);
+	}
+	free (results);
+
+	xmmsc_unref (c);
+	fake_server_wait (pid);
+}
+
+CASE (test_dispatch_restarted_signal)
+{
+	xmmsc_connection_t *c;
+	xmmsc_result_t *res;
+	int counter = 0;
+	pid_t pid;
+
+	pid = batch_server_start (1);
+	c = connect_to_fake_server ();
+
+	/* the restarted signal is sent with a new cookie, and the reply
+	 * to that cookie must still find the result */
+	res = xmmsc_signal_playback_playtime (c);
+	xmmsc_result_notifier_set (res, count_signal, &counter);
+
+	CU_ASSERT_TRUE (pump (c, &counter, 2));
+	CU_ASSERT_EQUAL (counter, 2);
+
+	xmmsc_result_unref (res);
+
+	xmmsc_unref (c);
+	fake_server_wait (pid);
+}
+
+static int
+check_batched_reply (xmmsv_t *val, void *udata)
+{
+	int *counter = udata;
+	int64_t position;
+
+	/* each command gets its own entry of the batch reply */
+	if (xmmsv_get_int64 (val, &position) && position == *counter) {
+		(*counter)++;
+	}
+
+	return 1;
+}
+
+CASE (test_dispatch_batched_commands)
+{
+	xmmsc_connection_t *c;
+	xmmsc_result_t *res;
+	int counter, round, i;
+	double start, single, batched;
+	pid_t pid;
+
+	pid = batch_server_start (1);
+	c = connect_to_fake_server ();
+
+	/* one round trip per command */
+	counter = 0;
+	start = fake_server_now ();
+	for (i = 0; i < BATCHED * ROUNDS; i++) {
+		res = xmmsc_playback_current_id (c);
+		xmmsc_result_notifier_set (res, count_reply, &counter);
+		xmmsc_result_unref (res);
+
+		CU_ASSERT_TRUE (pump (c, &counter, i + 1));
+	}
+	single = fake_server_now () - start;
+
+	/* one round trip per batch */
+	start = fake_server_now ();
+	for (round = 0; round < ROUNDS; round++) {
+		counter = 0;
+
+		xmmsc_batch_begin (c);
+		for (i = 0; i < BATCHED; i++) {
+			res = xmmsc_playback_current_id (c);
+			xmmsc_result_notifier_set (res, check_batched_reply, &counter);
+			xmmsc_result_unref (res);
+		}
+		xmmsc_result_unref (xmmsc_batch_end (c));
+
+		CU_ASSERT_TRUE (pump (c, &counter, BATCHED));
+		CU_ASSERT_EQUAL (counter, BATCHED);
+	}
+	batched = fake_server_now () - start;
+
+	printf ("\n%d commands one at a time: %.3f ms, in batches of %d: %.3f ms\n",
+	        BATCHED * ROUNDS, single * 1e3, BATCHED, batched * 1e3);
+
+	xmmsc_unref (c);
+	fake_server_wait (pid);
+}
+
+static int
+check_parts_reply (xmmsv_t *val, void *udata)
+{
+	int *order = udata;
+	int64_t entry;
+	int i;
+
+	for (i = 0; i < PART_ENTRIES; i++) {
+		if (!xmmsv_list_get_int64 (val, i, &entry) || entry != i) {
+			return 1;
+		}
+	}
+
+	/* the small reply must have arrived first */
+	if (xmmsv_list_get_size (val) == PART_ENTRIES && *order == 1) {
+		*order = 2;
+	}
+
+	return 1;
+}
+
+static int
+check_urgent_reply (xmmsv_t *val, void *udata)
+{
+	int *order = udata;
+
+	if (*order == 0) {
+		*order = 1;
+	}
+
+	return 1;
+}
+
+static void
+dispatch_reply_parts (int compress)
+{
+	xmmsc_connection_t *c;
+	xmmsc_result_t *res;
+	int order = 0;
+	pid_t pid;
+
+	pid = fake_server_start (fake_server_parts, &compress);
+
+	c = connect_to_fake_server ();
+
+	res = xmmsc_playlist_list_entries (c, NULL);
+	xmmsc_result_notifier_set (res, check_parts_reply, &order);
+	xmmsc_result_unref (res);
+
+	res = xmmsc_playback_pause (c);
+	xmmsc_result_notifier_set (res, check_urgent_reply, &order);
+	xmmsc_result_unref (res);
+
+	CU_ASSERT_TRUE (pump (c, &order, 2));
+	CU_ASSERT_EQUAL (order, 2);
+
+	xmmsc_unref (c);
+	fake_server_wait (pid);
+}
+
+CASE (test_dispatch_reply_parts)
+{
+	dispatch_reply_parts (0);
+}
+
+CASE (test_dispatch_compressed_reply_parts)
+{
+	if (!xmms_ipc_msg_compress_supported ()) {
+		return;
+	}
+
+	dispatch_reply_parts (1);
+}
@@ -0,0 +1,494 @@
+/*  XMMS2 - X Music Multiplexer System
+ *  Copyright (C) 2003-2020 XMMS2 Team
+ *
+ *  PLUGINS ARE NOT CONSIDERED TO BE DERIVED WORK !!!
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ */
+
+#include "xcu.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+
+#include <xmmsclient/xmmsclient.h>
+#include <xmmsc/xmmsc_idnumbers.h>
+#include <xmmsc/xmmsc_ipc_msg.h>
+#include <xmmsc/xmmsc_ipc_shm.h>
+#include <xmmsc/xmmsc_ipc_transport.h>
+
+#include "client-utils/fake_server.h"
+
+/* the daemon defaults */
+#define SHM_THRESHOLD 65536
+#define SHM_INITIAL_SIZE (1024 * 1024)
+#define SHM_MAX_SIZE (256 * 1024 * 1024)
+
+/* size of one synthetic medialib entry in a reply */
+#define ENTRY_SIZE 1024
+
+#define MAX_REPLIES 16
+
+#define SHM_UNUSED 100
+#define SHM_UNRELEASED 101
+
+static char shm_name[64];
+
+typedef struct fake_shm_St {
+	int fd;
+	unsigned char *base;
+	size_t size;
+	uint64_t head;
+	uint64_t produced;
+	int grown;
+} fake_shm_t;
+
+/* Cached replies, keyed by their requested size */
+static struct {
+	int size;
+	xmms_ipc_msg_t *msg;
+} replies[MAX_REPLIES];
+
+static void
+fake_send (xmms_ipc_transport_t *ipct, xmms_ipc_msg_t *msg)
+{
+	const unsigned char *data;
+	unsigned int len, done = 0;
+
+	data = xmms_ipc_msg_get_data (msg, &len);
+	while (done < len) {
+		int ret = send (ipct->fd, data + done, len - done, 0);
+		if (ret <= 0) {
+			_exit (2);
+		}
+		done += ret;
+	}
+}
+
+static void
+fake_reply (xmms_ipc_transport_t *ipct, uint32_t cookie, xmmsv_t *val)
+{
+	xmms_ipc_msg_t *msg;
+
+	msg = xmms_ipc_msg_new (XMMS_IPC_OBJECT_MAIN, XMMS_IPC_COMMAND_REPLY);
+	xmms_ipc_msg_set_cookie (msg, cookie);
+	xmms_ipc_msg_put_value (msg, val);
+	xmmsv_unref (val);
+
+	fake_send (ipct, msg);
+	xmms_ipc_msg_destroy (msg);
+}
+
+/* A list of medialib entries, ENTRY_SIZE bytes each once serialized */
+static xmms_ipc_msg_t *
+synthetic_medialib_reply (int size)
+{
+	xmms_ipc_msg_t *msg;
+	xmmsv_t *list;
+	char comment[ENTRY_SIZE];
+	int i, count;
+
+	count = size / ENTRY_SIZE;
+	if (count < 1) {
+		count = 1;
+	}
+
+	list = xmmsv_new_list ();
+	for (i = 0; i < count; i++) {
+		char url[64], title[64];
+		xmmsv_t *entry;
+
+		snprintf (url, sizeof (url), "file:///music/%06d.flac", i);
+		snprintf (title, sizeof (title), "Track %06d", i);
+		memset (comment, 'a' + i % 26, sizeof (comment));
+		comment[ENTRY_SIZE - 200] = '\0';
+
+		entry = xmmsv_build_dict (XMMSV_DICT_ENTRY_INT ("id", i + 1),
+		                          XMMSV_DICT_ENTRY_STR ("url", url),
+		                          XMMSV_DICT_ENTRY_STR ("artist", "Artist"),
+		                          XMMSV_DICT_ENTRY_STR ("album", "Album"),
+		                          XMMSV_DICT_ENTRY_STR ("title", title),
+		                          XMMSV_DICT_ENTRY_INT ("duration", 180000),
+		                          XMMSV_DICT_ENTRY_STR ("comment", comment),
+		                          XMMSV_DICT_END);
+		xmmsv_list_append (list, entry);
+		xmmsv_unref (entry);
+	}
+
+	msg = xmms_ipc_msg_new (XMMS_IPC_OBJECT_MEDIALIB, XMMS_IPC_COMMAND_REPLY);
+	xmms_ipc_msg_put_value (msg, list);
+	xmmsv_unref (list);
+
+	return msg;
+}
+
+static xmms_ipc_msg_t *
+cached_reply (int size)
+{
+	int i;
+
+	for (i = 0; i < MAX_REPLIES && replies[i].msg; i++) {
+		if (replies[i].size == size) {
+			return replies[i].msg;
+		}
+	}
+
+	if (i == MAX_REPLIES) {
+		_exit (3);
+	}
+
+	replies[i].size = size;
+	replies[i].msg = synthetic_medialib_reply (size);
+
+	return replies[i].msg;
+}
+
+static void
+fake_shm_map (fake_shm_t *shm, size_t size)
+{
+	if (shm->base) {
+		munmap (shm->base, shm->size);
+	}
+
+	if (ftruncate (shm->fd, size) == -1) {
+		_exit (4);
+	}
+
+	shm->base = mmap (NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, shm->fd, 0);
+	shm->size = size;
+}
+
+/* Mirrors xmms_ipc_shm_place in the daemon */
+static xmms_ipc_msg_t *
+fake_shm_place (fake_shm_t *shm, xmms_ipc_msg_t *msg)
+{
+	xmms_ipc_shm_header_t *header;
+	const unsigned char *data;
+	xmms_ipc_msg_t *desc;
+	xmmsv_t *val;
+	uint64_t consumed, offset, aligned;
+	unsigned int len;
+
+	data = xmms_ipc_msg_get_data (msg, &len);
+	if (len < SHM_THRESHOLD) {
+		return NULL;
+	}
+
+	aligned = XMMS_IPC_SHM_ALIGN (len);
+
+	header = (xmms_ipc_shm_header_t *) shm->base;
+	consumed = __atomic_load_n (&header->consumed, __ATOMIC_ACQUIRE);
+
+	if (consumed == shm->produced) {
+		shm->head = XMMS_IPC_SHM_DATA_OFFSET;
+	}
+
+	if (shm->head + aligned > shm->size) {
+		size_t size = shm->size;
+
+		if (shm->head != XMMS_IPC_SHM_DATA_OFFSET) {
+			return NULL;
+		}
+
+		while (size < XMMS_IPC_SHM_DATA_OFFSET + aligned && size < SHM_MAX_SIZE) {
+			size *= 2;
+		}
+
+		if (XMMS_IPC_SHM_DATA_OFFSET + aligned > size) {
+			return NULL;
+		}
+
+		fake_shm_map (shm, size);
+		shm->grown++;
+		header = (xmms_ipc_shm_header_t *) shm->base;
+	}
+
+	offset = shm->head;
+	memcpy (shm->base + offset, data, len);
+
+	shm->head += aligned;
+	shm->produced += aligned;
+	__atomic_store_n (&header->produced, shm->produced, __ATOMIC_RELEASE);
+
+	desc = xmms_ipc_msg_new (xmms_ipc_msg_get_object (msg),
+	                         XMMS_IPC_COMMAND_SHM_REPLY);
+	xmms_ipc_msg_set_cookie (desc, xmms_ipc_msg_get_cookie (msg));
+
+	val = xmmsv_build_list (XMMSV_LIST_ENTRY_INT (offset),
+	                        XMMSV_LIST_ENTRY_INT (len),
+	                        XMMSV_LIST_END);
+	xmms_ipc_msg_put_value (desc, val);
+	xmmsv_unref (val);
+
+	return desc;
+}
+
+static int64_t
+request_arg (xmms_ipc_msg_t *msg)
+{
+	xmmsv_t *args;
+	int64_t value = 0;
+
+	if (xmms_ipc_msg_get_value (msg, &args)) {
+		xmmsv_list_get_int64 (args, 0, &value);
+		xmmsv_unref (args);
+	}
+
+	return value;
+}
+
+/* A stand-in for the daemon. Answers medialib info requests for id N
+ * with a synthetic medialib listing of about N bytes, through shared
+ * memory once the client has asked for it. Exits when the client
+ * disconnects, with the number of times the segment grew as status, or
+ * SHM_UNUSED / SHM_UNRELEASED if the segment wasn't used or the client
+ * didn't release every reply placed in it.
+ */
+static void
+fake_server (xmms_ipc_transport_t *ipct, void *udata)
+{
+	xmms_ipc_shm_header_t *header;
+	fake_shm_t shm;
+	int use_shm = 0;
+
+	memset (&shm, 0, sizeof (shm));
+	shm.fd = -1;
+
+	while (ipct->fd >= 0) {
+		xmms_ipc_msg_t *msg = xmms_ipc_msg_alloc ();
+		bool disconnected = false;
+		uint32_t cookie, object, cmd;
+
+		if (!xmms_ipc_msg_read_transport (msg, ipct, &disconnected)) {
+			xmms_ipc_msg_destroy (msg);
+			break;
+		}
+
+		cookie = xmms_ipc_msg_get_cookie (msg);
+		object = xmms_ipc_msg_get_object (msg);
+		cmd = xmms_ipc_msg_get_cmd (msg);
+
+		if (object == XMMS_IPC_OBJECT_MAIN && cmd == XMMS_IPC_COMMAND_MAIN_HELLO) {
+			fake_reply (ipct, cookie, xmmsv_new_int (1));
+		} else if (object == XMMS_IPC_OBJECT_MAIN && cmd == XMMS_IPC_COMMAND_MAIN_SHM_ATTACH) {
+			shm.fd = shm_open (shm_name, O_RDWR | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR);
+			fake_shm_map (&shm, SHM_INITIAL_SIZE);
+			header = (xmms_ipc_shm_header_t *) shm.base;
+			header->magic = XMMS_IPC_SHM_MAGIC;
+			shm.head = XMMS_IPC_SHM_DATA_OFFSET;
+			fake_reply (ipct, cookie, xmmsv_new_string (shm_name));
+		} else if (object == XMMS_IPC_OBJECT_MAIN && cmd == XMMS_IPC_COMMAND_MAIN_SET_CAPABILITIES) {
+			use_shm = shm.base && (request_arg (msg) & XMMS_IPC_CAPABILITY_SHM_REPLY);
+			fake_reply (ipct, cookie, xmmsv_new_none ());
+		} else {
+			xmms_ipc_msg_t *reply, *desc = NULL;
+
+			reply = cached_reply (request_arg (msg));
+			xmms_ipc_msg_set_cookie (reply, cookie);
+
+			if (use_shm) {
+				desc = fake_shm_place (&shm, reply);
+			}
+
+			if (desc) {
+				fake_send (ipct, desc);
+				xmms_ipc_msg_destroy (desc);
+			} else {
+				fake_send (ipct, reply);
+			}
+		}
+
+		xmms_ipc_msg_destroy (msg);
+	}
+
+	if (shm.base) {
+		header = (xmms_ipc_shm_header_t *) shm.base;
+		shm_unlink (shm_name);
+
+		if (shm.produced == 0) {
+			_exit (SHM_UNUSED);
+		}
+
+		if (header->consumed != shm.produced) {
+			_exit (SHM_UNRELEASED);
+		}
+	}
+
+	_exit (shm.grown);
+}
+
+SETUP (shm_reply) {
+	snprintf (shm_name, sizeof (shm_name), "/xmms2-test-%d", (int) getpid ());
+	shm_unlink (shm_name);
+
+	CU_ASSERT_TRUE (fake_server_listen ("shm"));
+
+	return 0;
+}
+
+CLEANUP () {
+	fake_server_close ();
+	shm_unlink (shm_name);
+	return 0;
+}
+
+static xmmsc_connection_t *
+connect_to_fake_server (int shm)
+{
+	xmmsc_connection_t *c;
+
+	c = fake_server_connect ();
+	CU_ASSERT_PTR_NOT_NULL_FATAL (c);
+
+	if (shm) {
+		CU_ASSERT_TRUE (xmmsc_shm_attach (c));
+	}
+
+	return c;
+}
+
+/* Fetch a listing of about size bytes, returns the number of entries */
+static int
+fetch (xmmsc_connection_t *c, int size)
+{
+	xmmsc_result_t *res;
+	xmmsv_t *val, *entry;
+	const char *url;
+	char expected[64];
+	int count, last;
+
+	res = xmmsc_medialib_get_info (c, size);
+	xmmsc_result_wait (res);
+	val = xmmsc_result_get_value (res);
+
+	count = xmmsv_list_get_size (val);
+	last = count - 1;
+
+	/* spot check the last entry */
+	snprintf (expected, sizeof (expected), "file:///music/%06d.flac", last);
+	if (!xmmsv_list_get (val, last, &entry) ||
+	    !xmmsv_dict_entry_get_string (entry, "url", &url) ||
+	    strcmp (url, expected) != 0) {
+		count = -1;
+	}
+
+	xmmsc_result_unref (res);
+
+	return count;
+}
+
+CASE (test_shm_reply_matches_socket)
+{
+	xmmsc_connection_t *c;
+	pid_t pid;
+
+	pid = fake_server_start (fake_server, NULL);
+	c = connect_to_fake_server (1);
+
+	/* small replies still go through the socket */
+	CU_ASSERT_EQUAL (fetch (c, 4 * 1024), 4);
+	CU_ASSERT_EQUAL (fetch (c, 512 * 1024), 512);
+
+	/* and capabilities set later on keep shared memory going */
+	xmmsc_result_unref (xmmsc_main_set_capabilities (c, XMMS_IPC_CAPABILITY_PLAYLIST_CHANGED_BATCH));
+	CU_ASSERT_EQUAL (fetch (c, 512 * 1024), 512);
+
+	xmmsc_unref (c);
+
+	/* shared memory was used and every reply released */
+	CU_ASSERT_EQUAL (fake_server_wait (pid), 0);
+}
+
+CASE (test_shm_reply_reuse_and_grow)
+{
+	xmmsc_connection_t *c;
+	pid_t pid;
+	int i;
+
+	pid = fake_server_start (fake_server, NULL);
+	c = connect_to_fake_server (1);
+
+	/* every reply is released before the next one, so they all reuse
+	 * the beginning of the segment */
+	for (i = 0; i < 32; i++) {
+		CU_ASSERT_EQUAL (fetch (c, 768 * 1024), 768);
+	}
+
+	/* larger than the initial segment, the client has to remap */
+	CU_ASSERT_EQUAL (fetch (c, 4 * 1024 * 1024), 4096);
+	CU_ASSERT_EQUAL (fetch (c, 768 * 1024), 768);
+
+	xmmsc_unref (c);
+
+	/* grown once, for the large reply */
+	CU_ASSERT_EQUAL (fake_server_wait (pid), 1);
+}
+
+static double
+throughput (int shm, int size, int iterations)
+{
+	xmmsc_connection_t *c;
+	double start, elapsed;
+	pid_t pid;
+	int i, status;
+
+	pid = fake_server_start (fake_server, NULL);
+	c = connect_to_fake_server (shm);
+
+	/* let the daemon build the reply outside of the timing */
+	fetch (c, size);
+
+	start = fake_server_now ();
+	for (i = 0; i < iterations; i++) {
+		CU_ASSERT_EQUAL (fetch (c, size), size < ENTRY_SIZE ? 1 : size / ENTRY_SIZE);
+	}
+	elapsed = fake_server_now () - start;
+
+	xmmsc_unref (c);
+
+	status = fake_server_wait (pid);
+	CU_ASSERT_TRUE (status != SHM_UNRELEASED);
+	CU_ASSERT_TRUE (!shm || size < SHM_THRESHOLD || status != SHM_UNUSED);
+
+	return elapsed / iterations;
+}
+
+CASE (test_shm_reply_throughput)
+{
+	int size;
+
+	printf ("\n%10s %12s %12s %12s %12s\n", "size",
+	        "socket ms", "socket MB/s", "shm ms", "shm MB/s");
+
+	for (size = 1024; size <= 100 * 1024 * 1024; size *= 10) {
+		double sock, shm;
+		int iterations;
+
+		/* about 20 MB transferred per run */
+		iterations = 20 * 1024 * 1024 / size;
+		iterations = iterations > 1000 ? 1000 : iterations;
+		iterations = iterations < 1 ? 1 : iterations;
+
+		sock = throughput (0, size, iterations);
+		shm = throughput (1, size, iterations);
+
+		printf ("%10d %12.3f %12.1f %12.3f %12.1f\n", size,
+		        sock * 1e3, size / sock / (1024 * 1024),
+		        shm * 1e3, size / shm / (1024 * 1024));
+	}
+}
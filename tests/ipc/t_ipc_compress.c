@@ -0,0 +1,263 @@
+/*  XMMS2 - X Music Multiplexer System
+ *  Copyright (C) 2003-2020 XMMS2 Team
+ *
+ *  PLUGINS ARE NOT CONSIDERED TO BE DERIVED WORK !!!
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ */
+
+#include "xcu.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include <xmmsc/xmmsv.h>
+#include <xmmsc/xmmsc_idnumbers.h>
+#include <xmmsc/xmmsc_ipc_msg.h>
+
+#define ENTRIES 5000
+#define ROUNDS 20
+
+SETUP (ipc_compress) {
+	return 0;
+}
+
+CLEANUP () {
+	return 0;
+}
+
+/* What a medialib query for a library view typically returns */
+static xmmsv_t *
+query_result (int entries)
+{
+	xmmsv_t *list, *entry;
+	char artist[64], album[64], title[64], url[256];
+	int i;
+
+	list = xmmsv_new_list ();
+
+	for (i = 0; i < entries; i++) {
+		snprintf (artist, sizeof (artist), "Artist %d", i / 120);
+		snprintf (album, sizeof (album), "Album %d", i / 12);
+		snprintf (title, sizeof (title), "Track %d of album %d", i % 12 + 1, i / 12);
+		snprintf (url, sizeof (url), "file:///home/user/Music/%s/%s/%02d%%20-%%20Track.flac",
+		          artist, album, i % 12 + 1);
+
+		entry = xmmsv_build_dict (
+			XMMSV_DICT_ENTRY_INT ("id", i + 1),
+			XMMSV_DICT_ENTRY_STR ("artist", artist),
+			XMMSV_DICT_ENTRY_STR ("album", album),
+			XMMSV_DICT_ENTRY_STR ("title", title),
+			XMMSV_DICT_ENTRY_INT ("tracknr", i % 12 + 1),
+			XMMSV_DICT_ENTRY_INT ("duration", 180000 + (i * 7919) % 120000),
+			XMMSV_DICT_ENTRY_STR ("url", url),
+			XMMSV_DICT_END);
+
+		xmmsv_list_append (list, entry);
+		xmmsv_unref (entry);
+	}
+
+	return list;
+}
+
+static xmms_ipc_msg_t *
+reply_new (uint32_t cookie, xmmsv_t *val)
+{
+	xmms_ipc_msg_t *msg;
+
+	msg = xmms_ipc_msg_new (XMMS_IPC_OBJECT_COLLECTION, XMMS_IPC_COMMAND_REPLY);
+	xmms_ipc_msg_set_cookie (msg, cookie);
+	xmms_ipc_msg_put_value (msg, val);
+
+	return msg;
+}
+
+/* The message as the other end reads it, valid as long as msg is */
+static xmms_ipc_msg_t *
+received (xmms_ipc_msg_t *msg)
+{
+	const unsigned char *data;
+	unsigned int len;
+
+	data = xmms_ipc_msg_get_data (msg, &len);
+
+	return xmms_ipc_msg_new_ro (data, len);
+}
+
+CASE (test_compress_round_trip)
+{
+	xmms_ipc_msg_t *msg, *compressed, *wire, *restored;
+	const unsigned char *data;
+	unsigned char *raw;
+	unsigned int len, clen, rlen;
+	xmmsv_t *val, *result;
+
+	if (!xmms_ipc_msg_compress_supported ()) {
+		return;
+	}
+
+	val = query_result (ENTRIES);
+	msg = reply_new (42, val);
+	data = xmms_ipc_msg_get_data (msg, &len);
+
+	compressed = xmms_ipc_msg_compress (msg);
+	CU_ASSERT_PTR_NOT_NULL_FATAL (compressed);
+	CU_ASSERT_EQUAL (xmms_ipc_msg_get_cmd (compressed), XMMS_IPC_COMMAND_COMPRESSED);
+	CU_ASSERT_EQUAL (xmms_ipc_msg_get_object (compressed), XMMS_IPC_OBJECT_COLLECTION);
+	CU_ASSERT_EQUAL (xmms_ipc_msg_get_cookie (compressed), 42);
+
+	xmms_ipc_msg_get_data (compressed, &clen);
+	CU_ASSERT (clen < len / 4);
+
+	/* the original message comes back byte for byte */
+	wire = received (compressed);
+	raw = xmms_ipc_msg_decompress (wire, &rlen);
+	xmms_ipc_msg_destroy (wire);
+	CU_ASSERT_PTR_NOT_NULL_FATAL (raw);
+	CU_ASSERT_EQUAL (rlen, len);
+	CU_ASSERT_EQUAL (memcmp (raw, data, len), 0);
+
+	restored = xmms_ipc_msg_new_ro (raw, rlen);
+	CU_ASSERT_PTR_NOT_NULL_FATAL (restored);
+	CU_ASSERT_EQUAL (xmms_ipc_msg_get_cmd (restored), XMMS_IPC_COMMAND_REPLY);
+	CU_ASSERT_EQUAL (xmms_ipc_msg_get_cookie (restored), 42);
+	CU_ASSERT_TRUE (xmms_ipc_msg_get_value (restored, &result));
+	CU_ASSERT_EQUAL (xmmsv_list_get_size (result), ENTRIES);
+
+	xmmsv_unref (result);
+	xmms_ipc_msg_destroy (restored);
+	free (raw);
+
+	xmms_ipc_msg_destroy (compressed);
+	xmms_ipc_msg_destroy (msg);
+	xmmsv_unref (val);
+}
+
+CASE (test_compress_incompressible)
+{
+	xmms_ipc_msg_t *msg;
+	unsigned char noise[4096];
+	xmmsv_t *val;
+	unsigned int i, x = 1;
+
+	if (!xmms_ipc_msg_compress_supported ()) {
+		return;
+	}
+
+	for (i = 0; i < sizeof (noise); i++) {
+		x = x * 1103515245 + 12345;
+		noise[i] = x >> 16;
+	}
+
+	val = xmmsv_new_bin (noise, sizeof (noise));
+	msg = reply_new (1, val);
+
+	/* nothing to gain, the message goes out as it is */
+	CU_ASSERT_PTR_NULL (xmms_ipc_msg_compress (msg));
+
+	xmms_ipc_msg_destroy (msg);
+	xmmsv_unref (val);
+}
+
+CASE (test_decompress_corrupt)
+{
+	xmms_ipc_msg_t *msg, *wire;
+	unsigned char garbage[64];
+	unsigned int len;
+	xmmsv_t *val;
+
+	if (!xmms_ipc_msg_compress_supported ()) {
+		return;
+	}
+
+	memset (garbage, 0x5a, sizeof (garbage));
+
+	msg = xmms_ipc_msg_new (XMMS_IPC_OBJECT_MAIN, XMMS_IPC_COMMAND_COMPRESSED);
+	val = xmmsv_new_bin (garbage, sizeof (garbage));
+	xmms_ipc_msg_put_value (msg, val);
+	xmmsv_unref (val);
+
+	wire = received (msg);
+	CU_ASSERT_PTR_NULL (xmms_ipc_msg_decompress (wire, &len));
+	xmms_ipc_msg_destroy (wire);
+
+	xmms_ipc_msg_destroy (msg);
+
+	msg = xmms_ipc_msg_new (XMMS_IPC_OBJECT_MAIN, XMMS_IPC_COMMAND_COMPRESSED);
+	val = xmmsv_new_int (1);
+	xmms_ipc_msg_put_value (msg, val);
+	xmmsv_unref (val);
+
+	wire = received (msg);
+	CU_ASSERT_PTR_NULL (xmms_ipc_msg_decompress (wire, &len));
+	xmms_ipc_msg_destroy (wire);
+
+	xmms_ipc_msg_destroy (msg);
+}
+
+static double
+cpu_now (void)
+{
+	return (double) clock () / CLOCKS_PER_SEC;
+}
+
+CASE (test_compress_query_results)
+{
+	xmms_ipc_msg_t *msg, *compressed = NULL, *wire;
+	unsigned char *raw;
+	unsigned int len, clen, rlen;
+	double start, deflate_time, inflate_time, mb;
+	xmmsv_t *val;
+	int i;
+
+	if (!xmms_ipc_msg_compress_supported ()) {
+		return;
+	}
+
+	val = query_result (ENTRIES);
+	msg = reply_new (1, val);
+	xmms_ipc_msg_get_data (msg, &len);
+
+	start = cpu_now ();
+	for (i = 0; i < ROUNDS; i++) {
+		if (compressed) {
+			xmms_ipc_msg_destroy (compressed);
+		}
+		compressed = xmms_ipc_msg_compress (msg);
+	}
+	deflate_time = cpu_now () - start;
+
+	CU_ASSERT_PTR_NOT_NULL_FATAL (compressed);
+	xmms_ipc_msg_get_data (compressed, &clen);
+
+	start = cpu_now ();
+	for (i = 0; i < ROUNDS; i++) {
+		wire = received (compressed);
+		raw = xmms_ipc_msg_decompress (wire, &rlen);
+		CU_ASSERT_PTR_NOT_NULL (raw);
+		xmms_ipc_msg_destroy (wire);
+		free (raw);
+	}
+	inflate_time = cpu_now () - start;
+
+	mb = (double) len * ROUNDS / (1024 * 1024);
+
+	printf ("\nquery result of %d entries: %u bytes raw, %u bytes compressed (%.1f%%),"
+	        " %.2f ms CPU per MB to compress, %.2f ms to decompress\n",
+	        ENTRIES, len, clen, 100.0 * clen / len,
+	        1000 * deflate_time / mb, 1000 * inflate_time / mb);
+
+	xmms_ipc_msg_destroy (compressed);
+	xmms_ipc_msg_destroy (msg);
+	xmmsv_unref (val);
+}
@@ -0,0 +1,299 @@
+/*  XMMS2 - X Music Multiplexer System
+ *  Copyright (C) 2003-2020 XMMS2 Team
+ *
+ *  PLUGINS ARE NOT CONSIDERED TO BE DERIVED WORK !!!
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ */
+
+#include "xcu.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <xmmsc/xmmsv.h>
+#include <xmmsc/xmmsc_ipc_msg.h>
+#include <xmmsc/xmmsc_ipc_transport.h>
+
+#define REPLIES 10000
+
+/* Stand-in transport on top of a socketpair. Counts the calls that
+ * reach the socket and optionally limits the number of bytes each
+ * call accepts to force short writes. Whatever arrives at the other
+ * end of the pair is collected right away so the socket buffer never
+ * fills up. Writes to fd -1 are discarded.
+ */
+typedef struct stub_St {
+	int calls;
+	int limit;
+
+	int peer;
+	unsigned char *buffer;
+	int len;
+	int size;
+} stub_t;
+
+static int
+stub_drain (stub_t *stub, int ret)
+{
+	int n;
+
+	while (stub->len < stub->size &&
+	       (n = recv (stub->peer, stub->buffer + stub->len,
+	                  stub->size - stub->len, MSG_DONTWAIT)) > 0) {
+		stub->len += n;
+	}
+
+	return ret;
+}
+
+static int
+stub_write (xmms_ipc_transport_t *ipct, char *buffer, int len)
+{
+	stub_t *stub = ipct->data;
+
+	stub->calls++;
+
+	if (stub->limit && len > stub->limit)
+		len = stub->limit;
+
+	if (ipct->fd < 0)
+		return len;
+
+	return stub_drain (stub, send (ipct->fd, buffer, len, 0));
+}
+
+static int
+stub_writev (xmms_ipc_transport_t *ipct, xmms_ipc_iovec_t *iov, int iovcnt)
+{
+	stub_t *stub = ipct->data;
+	struct iovec vec[XMMS_IPC_IOVEC_MAX];
+	struct msghdr mh;
+	int i, total = 0;
+
+	stub->calls++;
+
+	for (i = 0; i < iovcnt; i++) {
+		vec[i].iov_base = iov[i].base;
+		vec[i].iov_len = iov[i].len;
+
+		if (stub->limit && total + iov[i].len >= stub->limit) {
+			vec[i].iov_len = stub->limit - total;
+			total = stub->limit;
+			i++;
+			break;
+		}
+
+		total += iov[i].len;
+	}
+
+	if (ipct->fd < 0)
+		return total;
+
+	memset (&mh, 0, sizeof (mh));
+	mh.msg_iov = vec;
+	mh.msg_iovlen = i;
+
+	return stub_drain (stub, sendmsg (ipct->fd, &mh, 0));
+}
+
+static void
+stub_init (xmms_ipc_transport_t *ipct, stub_t *stub, int *fds,
+           unsigned char *buffer, int size, int limit, int vectored)
+{
+	memset (ipct, 0, sizeof (xmms_ipc_transport_t));
+	memset (stub, 0, sizeof (stub_t));
+
+	stub->limit = limit;
+	stub->peer = fds ? fds[1] : -1;
+	stub->buffer = buffer;
+	stub->size = size;
+
+	ipct->fd = fds ? fds[0] : -1;
+	ipct->data = stub;
+	ipct->write_func = stub_write;
+	if (vectored)
+		ipct->writev_func = stub_writev;
+}
+
+static xmms_ipc_msg_t *
+reply_new (int i)
+{
+	xmms_ipc_msg_t *msg;
+	xmmsv_t *value;
+
+	msg = xmms_ipc_msg_new (i % 7, i % 3);
+	xmms_ipc_msg_set_cookie (msg, i);
+
+	switch (i % 3) {
+		case 0:
+			value = xmmsv_new_int (i);
+			break;
+		case 1:
+			value = xmmsv_new_string ("some reply with a string payload");
+			break;
+		default:
+			value = xmmsv_build_dict (XMMSV_DICT_ENTRY_INT ("id", i),
+			                          XMMSV_DICT_ENTRY_STR ("title", "title"),
+			                          XMMSV_DICT_END);
+			break;
+	}
+
+	xmms_ipc_msg_put_value (msg, value);
+	xmmsv_unref (value);
+
+	return msg;
+}
+
+/* Write count replies one at a time, the way the server used to */
+static int
+write_single (xmms_ipc_transport_t *ipct, int count)
+{
+	int i;
+
+	for (i = 0; i < count; i++) {
+		xmms_ipc_msg_t *msg = reply_new (i);
+		bool disconnected = false;
+
+		while (!xmms_ipc_msg_write_transport (msg, ipct, &disconnected)) {
+			if (disconnected) {
+				xmms_ipc_msg_destroy (msg);
+				return 0;
+			}
+		}
+
+		xmms_ipc_msg_destroy (msg);
+	}
+
+	return 1;
+}
+
+/* Write count replies in batches, the way the server does now */
+static int
+write_batched (xmms_ipc_transport_t *ipct, int count)
+{
+	xmms_ipc_msg_t *msgs[XMMS_IPC_IOVEC_MAX];
+	int queued = 0, next = 0, written, i;
+
+	while (next < count || queued) {
+		bool disconnected = false;
+
+		while (next < count && queued < XMMS_IPC_IOVEC_MAX) {
+			msgs[queued++] = reply_new (next++);
+		}
+
+		written = xmms_ipc_msg_write_transport_many (msgs, queued, ipct,
+		                                             &disconnected);
+		if (disconnected) {
+			for (i = 0; i < queued; i++)
+				xmms_ipc_msg_destroy (msgs[i]);
+			return 0;
+		}
+
+		for (i = 0; i < written; i++)
+			xmms_ipc_msg_destroy (msgs[i]);
+
+		memmove (msgs, msgs + written, (queued - written) * sizeof (xmms_ipc_msg_t *));
+		queued -= written;
+	}
+
+	return 1;
+}
+
+static void
+compare_with_single (int count, int limit, int vectored)
+{
+	xmms_ipc_transport_t ipct;
+	stub_t stub;
+	unsigned char *expected, *actual;
+	int size = count * 128, explen, actlen;
+	int a[2], b[2];
+
+	expected = calloc (1, size);
+	actual = calloc (1, size);
+
+	CU_ASSERT_EQUAL (socketpair (AF_UNIX, SOCK_STREAM, 0, a), 0);
+	CU_ASSERT_EQUAL (socketpair (AF_UNIX, SOCK_STREAM, 0, b), 0);
+
+	stub_init (&ipct, &stub, a, expected, size, 0, 0);
+	CU_ASSERT_TRUE (write_single (&ipct, count));
+	explen = stub.len;
+
+	stub_init (&ipct, &stub, b, actual, size, limit, vectored);
+	CU_ASSERT_TRUE (write_batched (&ipct, count));
+	actlen = stub.len;
+
+	CU_ASSERT_TRUE (explen > 0);
+	CU_ASSERT_EQUAL (explen, actlen);
+	CU_ASSERT_EQUAL (memcmp (expected, actual, explen), 0);
+
+	close (a[0]);
+	close (a[1]);
+	close (b[0]);
+	close (b[1]);
+
+	free (expected);
+	free (actual);
+}
+
+SETUP (ipc_msg) {
+	return 0;
+}
+
+CLEANUP () {
+	return 0;
+}
+
+CASE (test_write_transport_many_matches_single)
+{
+	compare_with_single (200, 0, 1);
+}
+
+CASE (test_write_transport_many_short_writes)
+{
+	/* short writes that end both inside headers and inside payloads */
+	compare_with_single (200, 7, 1);
+	compare_with_single (200, 37, 1);
+	compare_with_single (200, 1000, 1);
+}
+
+CASE (test_write_transport_many_fallback)
+{
+	/* transports without a vectored write only get the first buffer */
+	compare_with_single (200, 0, 0);
+	compare_with_single (200, 11, 0);
+}
+
+CASE (test_write_transport_many_syscalls)
+{
+	xmms_ipc_transport_t ipct;
+	stub_t stub;
+	int single, batched;
+
+	stub_init (&ipct, &stub, NULL, NULL, 0, 0, 1);
+	CU_ASSERT_TRUE (write_single (&ipct, REPLIES));
+	single = stub.calls;
+
+	stub_init (&ipct, &stub, NULL, NULL, 0, 0, 1);
+	CU_ASSERT_TRUE (write_batched (&ipct, REPLIES));
+	batched = stub.calls;
+
+	printf ("\n%d replies: %d writes one by one, %d vectored writes\n",
+	        REPLIES, single, batched);
+
+	CU_ASSERT_EQUAL (single, REPLIES);
+	CU_ASSERT_EQUAL (batched, (REPLIES + XMMS_IPC_IOVEC_MAX - 1) / XMMS_IPC_IOVEC_MAX);
+}
@@ -0,0 +1,220 @@
+/*  XMMS2 - X Music Multiplexer System
+ *  Copyright (C) 2003-2020 XMMS2 Team
+ *
+ *  PLUGINS ARE NOT CONSIDERED TO BE DERIVED WORK !!!
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ */
+
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "ipc_server.h"
+
+#include <xmmspriv/xmms_log.h>
+#include <xmmspriv/xmms_ipc.h>
+#include <xmmspriv/xmms_config.h>
+
+static xmms_object_t *playback, *collection;
+static xmmsv_t *bulk;
+static gchar path[128];
+static gint connected;
+
+static void
+on_client_connected (xmms_object_t *obj, xmmsv_t *val, gpointer udata)
+{
+	gint32 id;
+
+	if (xmmsv_get_int32 (val, &id)) {
+		g_atomic_int_set (&connected, id);
+	}
+}
+
+static void
+fake_pause (xmms_object_t *object, xmms_object_cmd_arg_t *arg)
+{
+	arg->retval = xmmsv_new_none ();
+}
+
+static void
+fake_stop (xmms_object_t *object, xmms_object_cmd_arg_t *arg)
+{
+	xmms_error_set (&arg->error, XMMS_ERROR_GENERIC, "not playing");
+}
+
+static void
+fake_query (xmms_object_t *object, xmms_object_cmd_arg_t *arg)
+{
+	arg->retval = xmmsv_ref (bulk);
+}
+
+static const xmms_object_cmd_desc_t fake_pause_desc = { fake_pause, 0 };
+static const xmms_object_cmd_desc_t fake_stop_desc = { fake_stop, 0 };
+static const xmms_object_cmd_desc_t fake_query_desc = { fake_query, 0 };
+
+gboolean
+xmms_ipc_test_server_start (const gchar *name, gint entries)
+{
+	gchar url[160], entry[XMMS_IPC_TEST_ENTRY_SIZE];
+	gint i;
+
+	/* clients hang up with messages still queued */
+	signal (SIGPIPE, SIG_IGN);
+
+	xmms_ipc_init ();
+	xmms_log_init (0);
+	xmms_config_init ("memory://");
+
+	playback = xmms_object_new (xmms_object_t, NULL);
+	xmms_object_cmd_add (playback, XMMS_IPC_COMMAND_PLAYBACK_PAUSE, &fake_pause_desc);
+	xmms_object_cmd_add (playback, XMMS_IPC_COMMAND_PLAYBACK_STOP, &fake_stop_desc);
+	xmms_ipc_object_register (XMMS_IPC_OBJECT_PLAYBACK, playback);
+
+	collection = xmms_object_new (xmms_object_t, NULL);
+	xmms_object_cmd_add (collection, XMMS_IPC_COMMAND_COLLECTION_QUERY, &fake_query_desc);
+	xmms_ipc_object_register (XMMS_IPC_OBJECT_COLLECTION, collection);
+
+	memset (entry, 'x', sizeof (entry) - 1);
+	entry[sizeof (entry) - 1] = '\0';
+
+	bulk = xmmsv_new_list ();
+	for (i = 0; i < entries; i++) {
+		xmmsv_list_append_string (bulk, entry);
+	}
+
+	xmms_object_connect (XMMS_OBJECT (xmms_ipc_manager_get ()),
+	                     XMMS_IPC_SIGNAL_IPC_MANAGER_CLIENT_CONNECTED,
+	                     on_client_connected, NULL);
+
+	g_snprintf (path, sizeof (path), "/tmp/xmms-test-%s-%d", name, (gint) getpid ());
+	g_snprintf (url, sizeof (url), "unix://%s", path);
+	unlink (path);
+
+	return xmms_ipc_setup_server (url);
+}
+
+void
+xmms_ipc_test_server_stop (void)
+{
+	xmms_object_disconnect (XMMS_OBJECT (xmms_ipc_manager_get ()),
+	                        XMMS_IPC_SIGNAL_IPC_MANAGER_CLIENT_CONNECTED,
+	                        on_client_connected, NULL);
+
+	xmms_ipc_object_unregister (XMMS_IPC_OBJECT_COLLECTION);
+	xmms_ipc_object_unregister (XMMS_IPC_OBJECT_PLAYBACK);
+	xmms_object_unref (collection);
+	xmms_object_unref (playback);
+	xmmsv_unref (bulk);
+
+	xmms_config_shutdown ();
+	xmms_ipc_shutdown ();
+
+	unlink (path);
+}
+
+/* Connect a client that talks to the server through the returned
+ * socket, setting id to its client id, or 0 if it didn't connect */
+gint
+xmms_ipc_test_connect (gint32 *id)
+{
+	struct sockaddr_un addr;
+	gint64 deadline;
+	gint fd;
+
+	memset (&addr, 0, sizeof (addr));
+	addr.sun_family = AF_UNIX;
+	g_strlcpy (addr.sun_path, path, sizeof (addr.sun_path));
+
+	g_atomic_int_set (&connected, 0);
+
+	fd = socket (AF_UNIX, SOCK_STREAM, 0);
+	if (connect (fd, (struct sockaddr *) &addr, sizeof (addr)) != 0) {
+		*id = 0;
+		return fd;
+	}
+
+	/* the listener is served from the default main context */
+	deadline = g_get_monotonic_time () + 5 * G_USEC_PER_SEC;
+	while (!g_atomic_int_get (&connected) && g_get_monotonic_time () < deadline) {
+		g_main_context_iteration (NULL, FALSE);
+		g_usleep (1000);
+	}
+
+	*id = g_atomic_int_get (&connected);
+
+	return fd;
+}
+
+static int
+test_read (xmms_ipc_transport_t *ipct, char *buffer, int len)
+{
+	return recv (ipct->fd, buffer, len, 0);
+}
+
+static int
+test_write (xmms_ipc_transport_t *ipct, char *buffer, int len)
+{
+	return send (ipct->fd, buffer, len, 0);
+}
+
+/* Connect a client announcing capabilities, to be read and written
+ * through ipct. Returns its client id, or 0 if it didn't connect. */
+gint32
+xmms_ipc_test_transport_connect (xmms_ipc_transport_t *ipct,
+                                 guint32 capabilities)
+{
+	xmms_error_t err;
+	gint32 id;
+
+	memset (ipct, 0, sizeof (*ipct));
+	ipct->fd = xmms_ipc_test_connect (&id);
+	ipct->read_func = test_read;
+	ipct->write_func = test_write;
+
+	if (id == 0) {
+		return 0;
+	}
+
+	xmms_error_reset (&err);
+	xmms_ipc_client_set_capabilities (id, capabilities, &err);
+	if (xmms_error_iserror (&err)) {
+		return 0;
+	}
+
+	return id;
+}
+
+/* Send a command with args, which are taken over */
+gboolean
+xmms_ipc_test_send (gint fd, guint32 object, guint32 cmd, guint32 cookie,
+                    xmmsv_t *args)
+{
+	xmms_ipc_msg_t *msg;
+	const unsigned char *data;
+	unsigned int len;
+	gboolean ret;
+
+	msg = xmms_ipc_msg_new (object, cmd);
+	xmms_ipc_msg_set_cookie (msg, cookie);
+	xmms_ipc_msg_put_value (msg, args);
+	xmmsv_unref (args);
+
+	data = xmms_ipc_msg_get_data (msg, &len);
+	ret = send (fd, data, len, 0) == len;
+
+	xmms_ipc_msg_destroy (msg);
+
+	return ret;
+}
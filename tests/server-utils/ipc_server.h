@@ -0,0 +1,38 @@
+/*  XMMS2 - X Music Multiplexer System
+ *  Copyright (C) 2003-2020 XMMS2 Team
+ *
+ *  PLUGINS ARE NOT CONSIDERED TO BE DERIVED WORK !!!
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ */
+
+#ifndef __IPC_SERVER_H__
+#define __IPC_SERVER_H__
+
+#include <glib.h>
+
+#include <xmms/xmms_object.h>
+#include <xmmsc/xmmsc_ipc_transport.h>
+
+/* size of one synthetic medialib entry in a query reply */
+#define XMMS_IPC_TEST_ENTRY_SIZE 1024
+
+/* Serves a fake playback object, whose pause succeeds and stop fails,
+ * and a fake collection object, whose query replies with entries
+ * strings of XMMS_IPC_TEST_ENTRY_SIZE bytes, on a fresh unix socket. */
+gboolean xmms_ipc_test_server_start (const gchar *name, gint entries);
+void xmms_ipc_test_server_stop (void);
+
+gint xmms_ipc_test_connect (gint32 *id);
+gint32 xmms_ipc_test_transport_connect (xmms_ipc_transport_t *ipct, guint32 capabilities);
+gboolean xmms_ipc_test_send (gint fd, guint32 object, guint32 cmd, guint32 cookie, xmmsv_t *args);
+
+#endif
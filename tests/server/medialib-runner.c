@@ -31,6 +31,103 @@
 
 #include <memory_status.h>
 
+#ifdef G_OS_UNIX
+#include <sys/resource.h>
+#endif
+
+#ifdef __GLIBC__
+#include <malloc.h>
+
+extern void *__libc_malloc (size_t size);
+extern void *__libc_calloc (size_t nmemb, size_t size);
+extern void *__libc_realloc (void *ptr, size_t size);
+extern void __libc_free (void *ptr);
+
+/* Counts heap allocations made while benchmarking a query, and the
+ * most heap it held on to at once. Queries may allocate from several
+ * threads, so everything is updated atomically. */
+static gint allocation_counting;
+static gint allocation_count;
+static gint64 allocation_live_bytes;
+static gint64 allocation_peak_bytes;
+
+static void
+allocation_account (gint64 bytes)
+{
+	gint64 live, peak;
+
+	live = __atomic_add_fetch (&allocation_live_bytes, bytes, __ATOMIC_RELAXED);
+	peak = __atomic_load_n (&allocation_peak_bytes, __ATOMIC_RELAXED);
+	while (live > peak &&
+	       !__atomic_compare_exchange_n (&allocation_peak_bytes, &peak, live, TRUE,
+	                                     __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+static void
+allocation_counting_start (void)
+{
+	g_atomic_int_set (&allocation_count, 0);
+	__atomic_store_n (&allocation_live_bytes, 0, __ATOMIC_RELAXED);
+	__atomic_store_n (&allocation_peak_bytes, 0, __ATOMIC_RELAXED);
+	g_atomic_int_set (&allocation_counting, TRUE);
+}
+
+static void
+allocation_counting_stop (void)
+{
+	g_atomic_int_set (&allocation_counting, FALSE);
+}
+
+void *
+malloc (size_t size)
+{
+	void *ptr = __libc_malloc (size);
+	if (ptr != NULL && g_atomic_int_get (&allocation_counting)) {
+		g_atomic_int_inc (&allocation_count);
+		allocation_account (malloc_usable_size (ptr));
+	}
+	return ptr;
+}
+
+void *
+calloc (size_t nmemb, size_t size)
+{
+	void *ptr = __libc_calloc (nmemb, size);
+	if (ptr != NULL && g_atomic_int_get (&allocation_counting)) {
+		g_atomic_int_inc (&allocation_count);
+		allocation_account (malloc_usable_size (ptr));
+	}
+	return ptr;
+}
+
+void *
+realloc (void *ptr, size_t size)
+{
+	gboolean counting = g_atomic_int_get (&allocation_counting);
+	gint64 old_size = 0;
+	void *ret;
+
+	if (counting && ptr != NULL)
+		old_size = malloc_usable_size (ptr);
+
+	ret = __libc_realloc (ptr, size);
+
+	if (counting && (ret != NULL || size == 0)) {
+		g_atomic_int_inc (&allocation_count);
+		allocation_account ((ret != NULL ? malloc_usable_size (ret) : 0) - old_size);
+	}
+	return ret;
+}
+
+void
+free (void *ptr)
+{
+	if (ptr != NULL && g_atomic_int_get (&allocation_counting))
+		allocation_account (-(gint64) malloc_usable_size (ptr));
+	__libc_free (ptr);
+}
+#endif
+
 typedef void (*xmms_path_predicate)(const gchar *filename, xmmsv_t *list);
 
 typedef gboolean (*xmms_test_predicate)(xmms_medialib_t *medialib, const gchar *name,
@@ -41,6 +138,7 @@ typedef gboolean (*xmms_test_predicate)(xmms_medialib_t *medialib, const gchar *
 typedef struct xmms_test_args_St {
 	enum {
 		PERFORMANCE,
+		BENCHMARK,
 		UNITTEST
 	} variant;
 	enum {
@@ -50,8 +148,18 @@ typedef struct xmms_test_args_St {
 	const gchar *database_path;
 	const gchar *testcase_path;
 	gboolean debug;
+	gint entries;
+	gint artists;
+	gint albums;
+	gint sources;
+	gint seed;
+	gint iterations;
 } xmms_test_args_t;
 
+static const gchar *benchmark_genres[] = {
+	"Rock", "Pop", "Jazz", "Electronic", "Classical", "Metal", "Folk", "Hip-Hop"
+};
+
 static void
 simple_log_handler (const gchar *log_domain, GLogLevelFlags log_level,
                     const gchar *message, gpointer user_data)
@@ -161,6 +269,43 @@ filter_testcase (const gchar *path, xmmsv_t *list)
 }
 
 
+static void
+filter_benchmark (const gchar *path, xmmsv_t *list)
+{
+	gchar *content, *filename;
+	xmmsv_t *dict, *data, *coll;
+
+	if (!g_str_has_suffix (path, ".json"))
+		return;
+
+	g_assert (g_file_get_contents (path, &content, NULL, NULL));
+	dict = xmmsv_from_json (content);
+	if (dict == NULL) {
+		g_error ("Could not parse '%s'!\n", path);
+		g_assert_not_reached ();
+	}
+	g_free (content);
+
+	g_assert (xmmsv_dict_has_key (dict, "collection"));
+	g_assert (xmmsv_dict_has_key (dict, "specification"));
+
+	g_assert (xmmsv_dict_get (dict, "collection", &data));
+	g_assert (xmmsv_is_type (data, XMMSV_TYPE_DICT));
+
+	coll = xmmsv_coll_from_dict (data);
+
+	xmmsv_dict_set (dict, "collection", coll);
+	xmmsv_unref (coll);
+
+	filename = g_path_get_basename (path);
+	xmmsv_dict_set_string (dict, "name", filename);
+	g_free (filename);
+
+	xmmsv_list_append (list, dict);
+	xmmsv_unref (dict);
+}
+
+
 /**
  * TODO: Should check for '/' in the key, and set source if found.
  */
@@ -440,6 +585,277 @@ run_performance_tests (xmmsv_t *databases, xmmsv_t *testcases, gint format)
 }
 
 
+/**
+ * Fill the medialib with a synthetic library.
+ *
+ * Every entry belongs to one of args->albums albums, which in turn
+ * belong to one of args->artists artists. Sources beyond the first add
+ * alternative titles and genres, like tag plugins would. The same seed
+ * always produces the same library.
+ *
+ * @returns FALSE if the entries could not be added.
+ */
+static gboolean
+populate_synthetic_medialib (xmms_medialib_t *medialib, xmms_test_args_t *args)
+{
+	xmms_medialib_session_t *session = NULL;
+	GRand *rand;
+	gint i, j;
+
+	rand = g_rand_new_with_seed (args->seed);
+
+	for (i = 0; i < args->entries; i++) {
+		xmms_medialib_entry_t entry;
+		xmms_error_t err;
+		gint album, artist;
+		gchar *value;
+
+		/* Keep transactions at a reasonable size */
+		if (session == NULL) {
+			session = xmms_medialib_session_begin (medialib);
+		}
+
+		xmms_error_reset (&err);
+
+		value = g_strdup_printf ("file:///benchmark/%d.mp3", i + 1);
+		entry = xmms_medialib_entry_new (session, value, &err);
+		g_free (value);
+
+		if (xmms_error_iserror (&err)) {
+			g_printerr ("Could not add entry %d: %s\n", i + 1,
+			            xmms_error_message_get (&err));
+			xmms_medialib_session_abort (session);
+			g_rand_free (rand);
+			return FALSE;
+		}
+
+		album = g_rand_int_range (rand, 0, args->albums);
+		artist = album % args->artists;
+
+		value = g_strdup_printf ("Artist %d", artist);
+		xmms_medialib_entry_property_set_str (session, entry, XMMS_MEDIALIB_ENTRY_PROPERTY_ARTIST, value);
+		g_free (value);
+
+		value = g_strdup_printf ("Album %d", album);
+		xmms_medialib_entry_property_set_str (session, entry, XMMS_MEDIALIB_ENTRY_PROPERTY_ALBUM, value);
+		g_free (value);
+
+		value = g_strdup_printf ("Title %d", i);
+		xmms_medialib_entry_property_set_str (session, entry, XMMS_MEDIALIB_ENTRY_PROPERTY_TITLE, value);
+		g_free (value);
+
+		xmms_medialib_entry_property_set_str (session, entry, XMMS_MEDIALIB_ENTRY_PROPERTY_GENRE,
+		                                      benchmark_genres[album % G_N_ELEMENTS (benchmark_genres)]);
+		xmms_medialib_entry_property_set_int (session, entry, XMMS_MEDIALIB_ENTRY_PROPERTY_TRACKNR,
+		                                      g_rand_int_range (rand, 1, 20));
+		xmms_medialib_entry_property_set_int (session, entry, XMMS_MEDIALIB_ENTRY_PROPERTY_DURATION,
+		                                      g_rand_int_range (rand, 60000, 600000));
+		xmms_medialib_entry_property_set_int (session, entry, XMMS_MEDIALIB_ENTRY_PROPERTY_SIZE,
+		                                      g_rand_int_range (rand, 1000000, 20000000));
+		xmms_medialib_entry_property_set_int (session, entry, XMMS_MEDIALIB_ENTRY_PROPERTY_TIMESPLAYED,
+		                                      g_rand_int_range (rand, 0, 50));
+
+		for (j = 1; j < args->sources; j++) {
+			gchar *source;
+
+			source = g_strdup_printf ("plugin/benchmark%d", j);
+
+			value = g_strdup_printf ("Title %d (%d)", i, j);
+			xmms_medialib_entry_property_set_str_source (session, entry, XMMS_MEDIALIB_ENTRY_PROPERTY_TITLE,
+			                                             value, source);
+			g_free (value);
+
+			xmms_medialib_entry_property_set_str_source (session, entry, XMMS_MEDIALIB_ENTRY_PROPERTY_GENRE,
+			                                             benchmark_genres[g_rand_int_range (rand, 0, G_N_ELEMENTS (benchmark_genres))],
+			                                             source);
+			g_free (source);
+		}
+
+		if ((i + 1) % 1000 == 0) {
+			if (!xmms_medialib_session_commit (session)) {
+				g_printerr ("Could not commit the entries up to %d\n", i + 1);
+				g_rand_free (rand);
+				return FALSE;
+			}
+			session = NULL;
+		}
+	}
+
+	g_rand_free (rand);
+
+	if (session != NULL && !xmms_medialib_session_commit (session)) {
+		g_printerr ("Could not commit the entries up to %d\n", args->entries);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+
+static glong
+peak_rss (void)
+{
+#ifdef G_OS_UNIX
+	struct rusage usage;
+
+	if (getrusage (RUSAGE_SELF, &usage) == 0) {
+		return usage.ru_maxrss;
+	}
+#endif
+
+	return -1;
+}
+
+
+static gint
+compare_durations (gconstpointer a, gconstpointer b)
+{
+	const gint64 *da = a;
+	const gint64 *db = b;
+
+	return (*da > *db) - (*da < *db);
+}
+
+
+/**
+ * Benchmark predicate
+ */
+static gboolean
+run_benchmark_test (xmms_medialib_t *medialib, const gchar *name, xmmsv_t *coll,
+                    xmmsv_t *specification, xmms_test_args_t *args)
+{
+	gint64 *durations, t0, peak_heap = -1;
+	gint i, allocations = 0;
+	gboolean success = TRUE;
+
+	durations = g_new0 (gint64, args->iterations);
+
+	for (i = 0; i < args->iterations; i++) {
+		xmms_medialib_session_t *session;
+		xmms_error_t err;
+		xmmsv_t *ret;
+
+		xmms_error_reset (&err);
+
+#ifdef __GLIBC__
+		allocation_counting_start ();
+#endif
+
+		t0 = g_get_monotonic_time ();
+
+		session = xmms_medialib_session_begin (medialib);
+		ret = xmms_medialib_query (session, coll, specification, &err);
+		xmms_medialib_session_commit (session);
+
+		durations[i] = g_get_monotonic_time () - t0;
+
+#ifdef __GLIBC__
+		allocation_counting_stop ();
+		allocations += g_atomic_int_get (&allocation_count);
+		peak_heap = MAX (peak_heap, __atomic_load_n (&allocation_peak_bytes,
+		                                             __ATOMIC_RELAXED));
+#endif
+
+		if (ret != NULL) {
+			xmmsv_unref (ret);
+		}
+
+		if (xmms_error_iserror (&err)) {
+			if (args->format == FORMAT_PRETTY) {
+				g_print ("* Test %s\n", name);
+				g_print ("   - Query failed: %s\n", xmms_error_message_get (&err));
+			} else {
+				g_print ("\"%s\",0,0,0,0,0\n", name);
+			}
+			success = FALSE;
+			break;
+		}
+	}
+
+	if (success) {
+		gint64 p50, p99;
+
+		qsort (durations, args->iterations, sizeof (gint64), compare_durations);
+
+		p50 = durations[(args->iterations - 1) * 50 / 100];
+		p99 = durations[(args->iterations - 1) * 99 / 100];
+
+		if (args->format == FORMAT_PRETTY) {
+			g_print ("* Test %s\n", name);
+			g_print ("   - p50: %.3fms\n", p50 / 1000.0);
+			g_print ("   - p99: %.3fms\n", p99 / 1000.0);
+#ifdef __GLIBC__
+			g_print ("   - Peak heap growth: %" G_GINT64_FORMAT "kB\n", peak_heap / 1024);
+			g_print ("   - Allocations: %d\n", allocations / args->iterations);
+#endif
+		} else {
+			g_print ("\"%s\",1,%" G_GINT64_FORMAT ",%" G_GINT64_FORMAT ",%" G_GINT64_FORMAT ",%d\n",
+			         name, p50, p99, peak_heap < 0 ? peak_heap : peak_heap / 1024,
+			         allocations / args->iterations);
+		}
+	}
+
+	g_free (durations);
+
+	return success;
+}
+
+
+static gboolean
+run_benchmark (xmmsv_t *testcases, xmms_test_args_t *args)
+{
+	xmms_medialib_t *medialib;
+	xmmsv_list_iter_t *it;
+	xmmsv_t *dict;
+	gboolean result = TRUE;
+	gint64 t0;
+
+	xmms_ipc_init ();
+	xmms_config_init ("memory://");
+	xmms_config_property_register ("medialib.path", "memory://", NULL, NULL);
+
+	medialib = xmms_medialib_init ();
+
+	if (args->format == FORMAT_PRETTY) {
+		g_print ("Generating %d entries (%d artists, %d albums, %d sources, seed %d)\n",
+		         args->entries, args->artists, args->albums, args->sources, args->seed);
+	}
+
+	t0 = g_get_monotonic_time ();
+	if (!populate_synthetic_medialib (medialib, args)) {
+		xmms_object_unref (medialib);
+		xmms_config_shutdown ();
+		xmms_ipc_shutdown ();
+		return FALSE;
+	}
+
+	if (args->format == FORMAT_PRETTY) {
+		g_print ("   - Time elapsed: %.3fs\n", (g_get_monotonic_time () - t0) / (gdouble) G_USEC_PER_SEC);
+		g_print ("   - Peak RSS: %ldkB\n", peak_rss ());
+	}
+
+	xmmsv_get_list_iter (testcases, &it);
+	while (xmmsv_list_iter_entry (it, &dict)) {
+		xmmsv_t *specification, *coll;
+		const gchar *name;
+
+		xmmsv_dict_entry_get_string (dict, "name", &name);
+		xmmsv_dict_get (dict, "specification", &specification);
+		xmmsv_dict_get (dict, "collection", &coll);
+
+		result &= run_benchmark_test (medialib, name, coll, specification, args);
+
+		xmmsv_list_iter_next (it);
+	}
+
+	xmms_object_unref (medialib);
+	xmms_config_shutdown ();
+	xmms_ipc_shutdown ();
+
+	return result;
+}
+
+
 static void
 parse_command_line (gint argc, gchar **argv, xmms_test_args_t *args)
 {
@@ -449,13 +865,19 @@ parse_command_line (gint argc, gchar **argv, xmms_test_args_t *args)
 	GError *error = NULL;
 
 	args->database_path = "tests/server/databases";
-	args->testcase_path = "tests/server/medialib";
+	args->testcase_path = NULL;
+	args->entries = 1000000;
+	args->artists = 5000;
+	args->albums = 50000;
+	args->sources = 2;
+	args->seed = 1;
+	args->iterations = 10;
 
 	const GOptionEntry options[] = {
 		{
 			"variant", 'v', 0,
 			G_OPTION_ARG_STRING, &variant,
-			"'performance' or 'unittest' (default).", "<variant>"
+			"'performance', 'benchmark' or 'unittest' (default).", "<variant>"
 		},
 		{
 			"format", 'f', 0,
@@ -477,6 +899,36 @@ parse_command_line (gint argc, gchar **argv, xmms_test_args_t *args)
 			G_OPTION_ARG_NONE, &args->debug,
 			"Enable debug logging.", NULL
 		},
+		{
+			"entries", 'n', 0,
+			G_OPTION_ARG_INT, &args->entries,
+			"Number of synthetic entries to benchmark with.", "<count>"
+		},
+		{
+			"artists", 'a', 0,
+			G_OPTION_ARG_INT, &args->artists,
+			"Number of distinct synthetic artists.", "<count>"
+		},
+		{
+			"albums", 'b', 0,
+			G_OPTION_ARG_INT, &args->albums,
+			"Number of distinct synthetic albums.", "<count>"
+		},
+		{
+			"sources", 's', 0,
+			G_OPTION_ARG_INT, &args->sources,
+			"Number of sources setting synthetic properties.", "<count>"
+		},
+		{
+			"seed", 'r', 0,
+			G_OPTION_ARG_INT, &args->seed,
+			"Seed for generating the synthetic library.", "<seed>"
+		},
+		{
+			"iterations", 'i', 0,
+			G_OPTION_ARG_INT, &args->iterations,
+			"Number of times each benchmark query is run.", "<count>"
+		},
 		{
 			NULL
 		}
@@ -494,10 +946,26 @@ parse_command_line (gint argc, gchar **argv, xmms_test_args_t *args)
 
 	if (strcmp (variant, "performance") == 0) {
 		args->variant = PERFORMANCE;
+	} else if (strcmp (variant, "benchmark") == 0) {
+		args->variant = BENCHMARK;
 	} else {
 		args->variant = UNITTEST;
 	}
 
+	if (args->testcase_path == NULL) {
+		if (args->variant == BENCHMARK) {
+			args->testcase_path = "tests/server/benchmark";
+		} else {
+			args->testcase_path = "tests/server/medialib";
+		}
+	}
+
+	if (args->entries < 1 || args->artists < 1 || args->albums < 1 ||
+	    args->sources < 1 || args->iterations < 1) {
+		g_print ("Benchmark counts must be positive.\n");
+		exit (EXIT_FAILURE);
+	}
+
 	if (strcmp (format, "pretty") == 0) {
 		args->format = FORMAT_PRETTY;
 	} else {
@@ -513,6 +981,7 @@ parse_command_line (gint argc, gchar **argv, xmms_test_args_t *args)
  * - load a number of tests from json files
  * - by default, run tests as unit tests
  * - optionally run tests as performance tests, but then require a db directory
+ * - optionally benchmark queries against a generated synthetic library
  */
 gint
 main (gint argc, gchar **argv)
@@ -527,14 +996,27 @@ main (gint argc, gchar **argv)
 
 	g_log_set_default_handler (simple_log_handler, (gpointer) &args);
 
-	g_debug ("Test variant: %s", args.variant == UNITTEST ? "unit test" : "performance test");
+	g_debug ("Test variant: %s", args.variant == UNITTEST ? "unit test" :
+	         args.variant == BENCHMARK ? "benchmark" : "performance test");
 	g_debug ("Output format: %s", args.format == FORMAT_PRETTY ? "pretty" : "csv");
 	g_debug ("Database path: %s", args.database_path);
 	g_debug ("Testcase path: %s", args.testcase_path);
 
-	testcases = scan_path (args.testcase_path, filter_testcase);
+	if (args.variant == BENCHMARK) {
+		testcases = scan_path (args.testcase_path, filter_benchmark);
+	} else {
+		testcases = scan_path (args.testcase_path, filter_testcase);
+	}
+
+	if (args.variant == BENCHMARK) {
+		if (args.format == FORMAT_CSV)
+			g_print ("\"test\",\"success\",\"p50\",\"p99\",\"peak_heap\",\"allocations\"\n");
+		else
+			g_print (" - Running Benchmark -\n");
 
-	if (args.variant == PERFORMANCE) {
+		if (!run_benchmark (testcases, &args))
+			exit_code = EXIT_FAILURE;
+	} else if (args.variant == PERFORMANCE) {
 		if (args.format == FORMAT_CSV)
 			g_print ("\"dataset\",\"test\",\"success\",\"duration\"\n");
 		else
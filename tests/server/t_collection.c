@@ -303,6 +303,185 @@ CASE (test_client_find)
 	xmmsv_unref (result);
 }
 
+CASE (test_client_find_invalidate)
+{
+	xmms_medialib_session_t *session;
+	xmms_medialib_entry_t entry;
+	xmmsv_t *universe, *equals, *reference, *idlist;
+	xmmsv_t *result;
+	const gchar *string;
+
+	entry = xmms_mock_entry (medialib, 1, "Red Fang", "Red Fang", "Prehistoric Dog");
+
+	universe = xmmsv_new_coll (XMMS_COLLECTION_TYPE_UNIVERSE);
+	equals = xmmsv_new_coll (XMMS_COLLECTION_TYPE_EQUALS);
+	xmmsv_coll_attribute_set_string (equals, "field", "artist");
+	xmmsv_coll_attribute_set_string (equals, "value", "Red Fang");
+	xmmsv_coll_add_operand (equals, universe);
+	xmmsv_unref (universe);
+
+	result = XMMS_IPC_CALL (dag, XMMS_IPC_COMMAND_COLLECTION_SAVE,
+	                        xmmsv_new_string ("Artist"),
+	                        xmmsv_new_string (XMMS_COLLECTION_NS_COLLECTIONS),
+	                        xmmsv_ref (equals));
+	xmmsv_unref (result);
+	xmmsv_unref (equals);
+
+	idlist = xmmsv_new_coll (XMMS_COLLECTION_TYPE_IDLIST);
+	result = XMMS_IPC_CALL (dag, XMMS_IPC_COMMAND_COLLECTION_SAVE,
+	                        xmmsv_new_string ("Target"),
+	                        xmmsv_new_string (XMMS_COLLECTION_NS_COLLECTIONS),
+	                        xmmsv_ref (idlist));
+	xmmsv_unref (result);
+	xmmsv_unref (idlist);
+
+	reference = xmmsv_new_coll (XMMS_COLLECTION_TYPE_REFERENCE);
+	xmmsv_coll_attribute_set_string (reference, "reference", "Target");
+	xmmsv_coll_attribute_set_string (reference, "namespace", XMMS_COLLECTION_NS_COLLECTIONS);
+	result = XMMS_IPC_CALL (dag, XMMS_IPC_COMMAND_COLLECTION_SAVE,
+	                        xmmsv_new_string ("Reference"),
+	                        xmmsv_new_string (XMMS_COLLECTION_NS_COLLECTIONS),
+	                        xmmsv_ref (reference));
+	xmmsv_unref (result);
+	xmmsv_unref (reference);
+
+	/* only the filter matches, the result is now cached */
+	result = XMMS_IPC_CALL (dag, XMMS_IPC_COMMAND_COLLECTION_FIND,
+	                        xmmsv_new_int (entry),
+	                        xmmsv_new_string (XMMS_COLLECTION_NS_COLLECTIONS));
+	CU_ASSERT_EQUAL (1, xmmsv_list_get_size (result));
+	CU_ASSERT (xmmsv_list_get_string (result, 0, &string));
+	CU_ASSERT_STRING_EQUAL ("Artist", string);
+	xmmsv_unref (result);
+
+	/* updating the target also invalidates the reference to it */
+	idlist = xmmsv_new_coll (XMMS_COLLECTION_TYPE_IDLIST);
+	xmmsv_coll_idlist_append (idlist, entry);
+	result = XMMS_IPC_CALL (dag, XMMS_IPC_COMMAND_COLLECTION_SAVE,
+	                        xmmsv_new_string ("Target"),
+	                        xmmsv_new_string (XMMS_COLLECTION_NS_COLLECTIONS),
+	                        xmmsv_ref (idlist));
+	xmmsv_unref (result);
+	xmmsv_unref (idlist);
+
+	result = XMMS_IPC_CALL (dag, XMMS_IPC_COMMAND_COLLECTION_FIND,
+	                        xmmsv_new_int (entry),
+	                        xmmsv_new_string (XMMS_COLLECTION_NS_COLLECTIONS));
+	CU_ASSERT_EQUAL (3, xmmsv_list_get_size (result));
+	xmmsv_unref (result);
+
+	/* changing the media invalidates its results */
+	do {
+		session = xmms_medialib_session_begin (medialib);
+		xmms_medialib_entry_property_set_str (session, entry,
+		                                      XMMS_MEDIALIB_ENTRY_PROPERTY_ARTIST,
+		                                      "Kyuss");
+	} while (!xmms_medialib_session_commit (session));
+
+	result = XMMS_IPC_CALL (dag, XMMS_IPC_COMMAND_COLLECTION_FIND,
+	                        xmmsv_new_int (entry),
+	                        xmmsv_new_string (XMMS_COLLECTION_NS_COLLECTIONS));
+	CU_ASSERT_EQUAL (2, xmmsv_list_get_size (result));
+	CU_ASSERT (xmmsv_list_get_string (result, 0, &string));
+	CU_ASSERT (strcmp ("Target", string) == 0 || strcmp ("Reference", string) == 0);
+	CU_ASSERT (xmmsv_list_get_string (result, 1, &string));
+	CU_ASSERT (strcmp ("Target", string) == 0 || strcmp ("Reference", string) == 0);
+	xmmsv_unref (result);
+}
+
+CASE (test_materialized)
+{
+	xmms_medialib_session_t *session;
+	xmms_medialib_entry_t first, second;
+	xmmsv_t *universe, *equals, *reference;
+	xmmsv_t *result;
+	xmms_error_t err;
+	gint id;
+
+	first = xmms_mock_entry (medialib, 1, "Red Fang", "Red Fang", "Prehistoric Dog");
+
+	universe = xmmsv_new_coll (XMMS_COLLECTION_TYPE_UNIVERSE);
+	equals = xmmsv_new_coll (XMMS_COLLECTION_TYPE_EQUALS);
+	xmmsv_coll_attribute_set_string (equals, "field", "artist");
+	xmmsv_coll_attribute_set_string (equals, "value", "Red Fang");
+	xmmsv_coll_attribute_set_string (equals, "materialized", "true");
+	xmmsv_coll_add_operand (equals, universe);
+	xmmsv_unref (universe);
+
+	result = XMMS_IPC_CALL (dag, XMMS_IPC_COMMAND_COLLECTION_SAVE,
+	                        xmmsv_new_string ("Red Fang"),
+	                        xmmsv_new_string (XMMS_COLLECTION_NS_COLLECTIONS),
+	                        xmmsv_ref (equals));
+	xmmsv_unref (result);
+	xmmsv_unref (equals);
+
+	reference = xmmsv_new_coll (XMMS_COLLECTION_TYPE_REFERENCE);
+	xmmsv_coll_attribute_set_string (reference, "reference", "Red Fang");
+	xmmsv_coll_attribute_set_string (reference, "namespace", XMMS_COLLECTION_NS_COLLECTIONS);
+
+	/* computes the id set */
+	xmms_error_reset (&err);
+	result = xmms_collection_query_ids (dag, reference, &err);
+	CU_ASSERT_EQUAL (1, xmmsv_list_get_size (result));
+	CU_ASSERT (xmmsv_list_get_int (result, 0, &id));
+	CU_ASSERT_EQUAL (first, id);
+	xmmsv_unref (result);
+
+	CU_ASSERT_EQUAL (first, xmms_collection_get_random_media (dag, reference));
+
+	/* both changes are picked up by re-testing the changed media */
+	do {
+		session = xmms_medialib_session_begin (medialib);
+		xmms_medialib_entry_property_set_str (session, first,
+		                                      XMMS_MEDIALIB_ENTRY_PROPERTY_ARTIST,
+		                                      "Kyuss");
+	} while (!xmms_medialib_session_commit (session));
+
+	second = xmms_mock_entry (medialib, 2, "Red Fang", "Red Fang", "Reverse Thunder");
+
+	xmms_error_reset (&err);
+	result = xmms_collection_query_ids (dag, reference, &err);
+	CU_ASSERT_EQUAL (1, xmmsv_list_get_size (result));
+	CU_ASSERT (xmmsv_list_get_int (result, 0, &id));
+	CU_ASSERT_EQUAL (second, id);
+	xmmsv_unref (result);
+
+	CU_ASSERT_EQUAL (second, xmms_collection_get_random_media (dag, reference));
+
+	xmmsv_unref (reference);
+}
+
+CASE (test_weighted_random_media)
+{
+	xmms_medialib_session_t *session;
+	xmms_medialib_entry_t light, heavy, entry;
+	xmmsv_t *universe;
+	gint i, hits = 0;
+
+	light = xmms_mock_entry (medialib, 1, "Red Fang", "Red Fang", "Prehistoric Dog");
+	heavy = xmms_mock_entry (medialib, 2, "Red Fang", "Red Fang", "Reverse Thunder");
+
+	do {
+		session = xmms_medialib_session_begin (medialib);
+		xmms_medialib_entry_property_set_int (session, heavy, "rating", 99);
+	} while (!xmms_medialib_session_commit (session));
+
+	universe = xmmsv_new_coll (XMMS_COLLECTION_TYPE_UNIVERSE);
+
+	/* weights are 1 and 100, drawn from a fixed sequence */
+	g_random_set_seed (37);
+	for (i = 0; i < 200; i++) {
+		entry = xmms_collection_get_weighted_random_media (dag, universe, "rating");
+		CU_ASSERT (entry == light || entry == heavy);
+		if (entry == heavy) {
+			hits++;
+		}
+	}
+	CU_ASSERT (hits > 150);
+
+	xmmsv_unref (universe);
+}
+
 CASE (test_client_list)
 {
 	xmmsv_t *universe, *idlist;
@@ -507,6 +686,78 @@ CASE (test_client_query_infos2)
 	xmmsv_unref (ordered);
 }
 
+CASE (test_client_query_cursor)
+{
+	xmmsv_t *universe, *ordered, *order, *fetch;
+	xmmsv_t *expected, *result;
+	gint32 cursor, count;
+
+	xmms_mock_entry (medialib, 1, "Red Fang", "Red Fang", "Prehistoric Dog");
+	xmms_mock_entry (medialib, 2, "Red Fang", "Red Fang", "Reverse Thunder");
+	xmms_mock_entry (medialib, 3, "Red Fang", "Red Fang", "Night Destroyer");
+
+	universe = xmmsv_new_coll (XMMS_COLLECTION_TYPE_UNIVERSE);
+
+	order = xmmsv_build_list (XMMSV_LIST_ENTRY_STR ("tracknr"),
+	                          XMMSV_LIST_END);
+
+	ordered = xmmsv_coll_add_order_operators (universe, order);
+	xmmsv_unref (universe);
+	xmmsv_unref (order);
+
+	fetch = xmmsv_from_xson ("{ 'type': 'metadata', 'fields': ['title'], 'get': ['value'] }");
+
+	result = XMMS_IPC_CALL (dag, XMMS_IPC_COMMAND_COLLECTION_QUERY_OPEN,
+	                        xmmsv_ref (ordered), xmmsv_ref (fetch));
+	CU_ASSERT (xmmsv_is_type (result, XMMSV_TYPE_DICT));
+	CU_ASSERT (xmmsv_dict_entry_get_int (result, "id", &cursor));
+	CU_ASSERT (xmmsv_dict_entry_get_int (result, "count", &count));
+	CU_ASSERT_EQUAL (3, count);
+	xmmsv_unref (result);
+
+	result = XMMS_IPC_CALL (dag, XMMS_IPC_COMMAND_COLLECTION_QUERY_FETCH,
+	                        xmmsv_new_int (cursor), xmmsv_new_int (2));
+	expected = xmmsv_from_xson ("['Prehistoric Dog', 'Reverse Thunder']");
+	CU_ASSERT (xmmsv_compare (expected, result));
+	xmmsv_unref (expected);
+	xmmsv_unref (result);
+
+	result = XMMS_IPC_CALL (dag, XMMS_IPC_COMMAND_COLLECTION_QUERY_FETCH,
+	                        xmmsv_new_int (cursor), xmmsv_new_int (2));
+	expected = xmmsv_from_xson ("['Night Destroyer']");
+	CU_ASSERT (xmmsv_compare (expected, result));
+	xmmsv_unref (expected);
+	xmmsv_unref (result);
+
+	/* exhausted cursor */
+	result = XMMS_IPC_CALL (dag, XMMS_IPC_COMMAND_COLLECTION_QUERY_FETCH,
+	                        xmmsv_new_int (cursor), xmmsv_new_int (2));
+	CU_ASSERT (xmmsv_is_type (result, XMMSV_TYPE_LIST));
+	CU_ASSERT_EQUAL (0, xmmsv_list_get_size (result));
+	xmmsv_unref (result);
+
+	result = XMMS_IPC_CALL (dag, XMMS_IPC_COMMAND_COLLECTION_QUERY_CLOSE,
+	                        xmmsv_new_int (cursor));
+	CU_ASSERT (xmmsv_is_type (result, XMMSV_TYPE_NONE));
+	xmmsv_unref (result);
+
+	/* closed cursor */
+	result = XMMS_IPC_CALL (dag, XMMS_IPC_COMMAND_COLLECTION_QUERY_FETCH,
+	                        xmmsv_new_int (cursor), xmmsv_new_int (2));
+	CU_ASSERT (xmmsv_is_type (result, XMMSV_TYPE_ERROR));
+	xmmsv_unref (result);
+
+	/* invalid fetch specification */
+	result = XMMS_IPC_CALL (dag, XMMS_IPC_COMMAND_COLLECTION_QUERY_OPEN,
+	                        xmmsv_ref (ordered),
+	                        xmmsv_from_xson ("{ 'type': 'invalid' }"));
+	CU_ASSERT (xmmsv_is_type (result, XMMSV_TYPE_ERROR));
+	xmmsv_unref (result);
+
+	xmmsv_unref (fetch);
+	xmmsv_unref (ordered);
+}
+
 CASE (test_reject_direct_cyclic_collections)
 {
 	xmmsv_t *reference, *result;
@@ -709,12 +960,55 @@ CASE (test_collection_snapshot_restore)
 	xmms_collection_restore (dag, snapshot);
 	xmmsv_unref (snapshot);
 
-	result = xmms_collection_snapshot (dag);
+	result = xmms_collection_snapshot (dag, NULL);
+
+	CU_ASSERT (xmmsv_compare (expected, result));
+
+	xmmsv_unref (result);
+	xmmsv_unref (expected);
+}
+
+CASE (test_collection_snapshot_partial)
+{
+	GHashTable *names[XMMS_COLLECTION_NUM_NAMESPACES];
+	xmmsv_t *playlist, *result, *expected;
+	gint i;
+
+	playlist = xmmsv_new_coll (XMMS_COLLECTION_TYPE_IDLIST);
+	xmmsv_coll_idlist_append (playlist, 1);
+	xmmsv_coll_idlist_append (playlist, 2);
+	xmms_collection_update_pointer (dag, "Changed", XMMS_COLLECTION_NSID_PLAYLISTS, playlist);
+	xmms_collection_update_pointer (dag, "Untouched", XMMS_COLLECTION_NSID_PLAYLISTS, playlist);
+	xmms_collection_update_pointer (dag, XMMS_ACTIVE_PLAYLIST, XMMS_COLLECTION_NSID_PLAYLISTS, playlist);
+
+	for (i = 0; i < XMMS_COLLECTION_NUM_NAMESPACES; i++) {
+		names[i] = g_hash_table_new (g_str_hash, g_str_equal);
+	}
 
+	g_hash_table_add (names[XMMS_COLLECTION_NSID_PLAYLISTS], "Changed");
+	g_hash_table_add (names[XMMS_COLLECTION_NSID_PLAYLISTS], "Removed");
+
+	result = xmms_collection_snapshot_partial (dag, names, NULL);
+
+	/* only the requested names, with missing ones recorded as none */
+	expected = xmmsv_build_dict (XMMSV_DICT_ENTRY ("collections", xmmsv_new_dict ()),
+	                             XMMSV_DICT_ENTRY ("playlists",
+	                                               xmmsv_build_dict (XMMSV_DICT_ENTRY ("Changed", xmmsv_ref (playlist)),
+	                                                                 XMMSV_DICT_ENTRY ("Removed", xmmsv_new_none ()),
+	                                                                 XMMSV_DICT_END)),
+	                             XMMSV_DICT_END);
+
+	CU_ASSERT (xmmsv_dict_has_key (result, "active-playlist"));
+	xmmsv_dict_remove (result, "active-playlist");
 	CU_ASSERT (xmmsv_compare (expected, result));
 
 	xmmsv_unref (result);
 	xmmsv_unref (expected);
+	xmmsv_unref (playlist);
+
+	for (i = 0; i < XMMS_COLLECTION_NUM_NAMESPACES; i++) {
+		g_hash_table_destroy (names[i]);
+	}
 }
 
 static gboolean
@@ -0,0 +1,430 @@
+#include <locale.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <glib/gstdio.h>
+
+#include "xcu.h"
+
+#include <xmmspriv/xmms_log.h>
+#include <xmmspriv/xmms_ipc.h>
+#include <xmmspriv/xmms_config.h>
+#include <xmmspriv/xmms_medialib.h>
+#include <xmmspriv/xmms_collection.h>
+#include <xmmspriv/xmms_collsync.h>
+#include <xmmspriv/xmms_playlist.h>
+
+#include "utils/jsonism.h"
+#include "utils/value_utils.h"
+#include "utils/coll_utils.h"
+#include "server-utils/ipc_call.h"
+#include "server-utils/mlib_utils.h"
+
+static xmms_medialib_t *medialib;
+static xmms_coll_dag_t *colldag;
+static xmms_playlist_t *playlist;
+static xmms_coll_sync_t *collsync;
+
+static gchar *directory;
+static gchar *path;
+static gchar *journal;
+
+SETUP (collsync) {
+	gchar *pattern;
+
+	setlocale (LC_COLLATE, "");
+
+	xmms_ipc_init ();
+	xmms_log_init (0);
+
+	xmms_config_init ("memory://");
+
+	xmms_config_property_register ("medialib.path", "memory://", NULL, NULL);
+	xmms_config_property_register ("playlist.repeat_one", "0", NULL, NULL);
+	xmms_config_property_register ("playlist.repeat_all", "0", NULL, NULL);
+
+	directory = g_dir_make_tmp ("xmms-test-collsync-XXXXXX", NULL);
+	path = g_build_filename (directory, "test.db", NULL);
+	journal = g_strconcat (path, ".journal", NULL);
+
+	pattern = g_build_filename (directory, "${uuid}.db", NULL);
+	xmms_config_property_register ("collection.directory", pattern, NULL, NULL);
+	g_free (pattern);
+
+	medialib = xmms_medialib_init ();
+
+	return 0;
+}
+
+CLEANUP () {
+	xmms_object_unref (medialib); medialib = NULL;
+	xmms_config_shutdown ();
+	xmms_ipc_shutdown ();
+
+	g_unlink (journal);
+	g_unlink (path);
+	g_rmdir (directory);
+
+	g_free (journal); journal = NULL;
+	g_free (path); path = NULL;
+	g_free (directory); directory = NULL;
+
+	return 0;
+}
+
+static void
+collsync_start (void)
+{
+	colldag = xmms_collection_init (medialib);
+	playlist = xmms_playlist_init (medialib, colldag);
+	collsync = xmms_coll_sync_init ("test", colldag, playlist);
+}
+
+/* Shutting down syncs the changes made since the start */
+static void
+collsync_stop (void)
+{
+	xmms_object_unref (collsync); collsync = NULL;
+	xmms_object_unref (playlist); playlist = NULL;
+	xmms_object_unref (colldag); colldag = NULL;
+}
+
+static gchar *
+read_file (const gchar *filename, gsize *length)
+{
+	gchar *contents = NULL;
+
+	CU_ASSERT_TRUE (g_file_get_contents (filename, &contents, length, NULL));
+
+	return contents;
+}
+
+/* Reads the journal as a list of records, and their offsets in the file */
+static xmmsv_t *
+read_journal (GArray *offsets)
+{
+	xmmsv_t *records, *serialized, *record;
+	gsize length, offset;
+	guint32 header;
+	gchar *buffer;
+
+	records = xmmsv_new_list ();
+
+	buffer = read_file (journal, &length);
+	if (buffer == NULL) {
+		return records;
+	}
+
+	for (offset = 0; offset + sizeof (header) <= length; offset += sizeof (header) + header) {
+		memcpy (&header, buffer + offset, sizeof (header));
+		header = GUINT32_FROM_BE (header);
+
+		if (offset + sizeof (header) + header > length) {
+			break;
+		}
+
+		serialized = xmmsv_new_bin ((const guchar *) buffer + offset + sizeof (header), header);
+		record = xmmsv_deserialize (serialized);
+		xmmsv_unref (serialized);
+
+		if (record == NULL) {
+			break;
+		}
+
+		if (offsets != NULL) {
+			g_array_append_val (offsets, offset);
+		}
+
+		xmmsv_list_append (records, record);
+		xmmsv_unref (record);
+	}
+
+	g_free (buffer);
+
+	return records;
+}
+
+static void
+write_journal (xmmsv_t *records)
+{
+	xmmsv_t *record, *serialized;
+	const guchar *buffer;
+	guint32 header;
+	guint length;
+	FILE *fp;
+	gint i;
+
+	fp = g_fopen (journal, "wb");
+	CU_ASSERT_PTR_NOT_NULL_FATAL (fp);
+
+	for (i = 0; xmmsv_list_get (records, i, &record); i++) {
+		serialized = xmmsv_serialize (record);
+		xmmsv_get_bin (serialized, &buffer, &length);
+
+		header = GUINT32_TO_BE (length);
+		CU_ASSERT_EQUAL (1, fwrite (&header, sizeof (header), 1, fp));
+		CU_ASSERT_EQUAL (length, fwrite (buffer, 1, length, fp));
+
+		xmmsv_unref (serialized);
+	}
+
+	CU_ASSERT_EQUAL (0, fclose (fp));
+}
+
+static void
+add_entries (gint first, gint count)
+{
+	xmms_medialib_entry_t entry;
+	xmms_error_t err;
+	gint i;
+
+	xmms_error_reset (&err);
+
+	for (i = first; i < first + count; i++) {
+		entry = xmms_mock_entry (medialib, i, "Red Fang", "Red Fang", "Wires");
+		xmms_playlist_add_entry (playlist, "Default", entry, &err);
+		CU_ASSERT_FALSE (xmms_error_iserror (&err));
+	}
+}
+
+static void
+assert_entries (const gchar *xson)
+{
+	xmmsv_t *result, *expected;
+
+	result = XMMS_IPC_CALL (playlist, XMMS_IPC_COMMAND_PLAYLIST_LIST_ENTRIES,
+	                        xmmsv_new_string ("Default"));
+	expected = xmmsv_from_xson (xson);
+	CU_ASSERT (xmmsv_compare (expected, result));
+	xmmsv_unref (result);
+	xmmsv_unref (expected);
+}
+
+static void
+move_entry (gint from, gint to)
+{
+	xmmsv_t *result;
+
+	result = XMMS_IPC_CALL (playlist, XMMS_IPC_COMMAND_PLAYLIST_MOVE_ENTRY,
+	                        xmmsv_new_string ("Default"),
+	                        xmmsv_new_int (from),
+	                        xmmsv_new_int (to));
+	CU_ASSERT (xmmsv_is_type (result, XMMSV_TYPE_NONE));
+	xmmsv_unref (result);
+}
+
+CASE (test_journal_write)
+{
+	xmmsv_t *records, *record, *playlists, *ops, *op, *ids, *expected;
+	gchar *before, *after;
+	gsize before_length, after_length;
+	const gchar *type;
+
+	/* Nothing on disk yet, the first sync writes a snapshot */
+	collsync_start ();
+	collsync_stop ();
+
+	before = read_file (path, &before_length);
+
+	records = read_journal (NULL);
+	CU_ASSERT_EQUAL (1, xmmsv_list_get_size (records));
+	xmmsv_unref (records);
+
+	collsync_start ();
+	add_entries (1, 2);
+	move_entry (1, 0);
+	collsync_stop ();
+
+	/* The edits went to the journal, leaving the snapshot alone */
+	after = read_file (path, &after_length);
+	CU_ASSERT_EQUAL (before_length, after_length);
+	CU_ASSERT (memcmp (before, after, before_length) == 0);
+	g_free (before);
+	g_free (after);
+
+	records = read_journal (NULL);
+	CU_ASSERT_EQUAL (2, xmmsv_list_get_size (records));
+
+	CU_ASSERT_TRUE (xmmsv_list_get (records, 1, &record));
+
+	/* ...as the edits, not as a copy of the playlist */
+	if (xmmsv_dict_get (record, "playlists", &playlists)) {
+		CU_ASSERT_FALSE (xmmsv_dict_has_key (playlists, "Default"));
+	}
+
+	CU_ASSERT_TRUE (xmmsv_dict_get (record, "ops", &ops));
+	CU_ASSERT_TRUE (xmmsv_list_get (ops, 0, &op));
+	CU_ASSERT_TRUE (xmmsv_dict_entry_get_string (op, "op", &type));
+	CU_ASSERT_STRING_EQUAL ("insert", type);
+	CU_ASSERT_TRUE (xmmsv_dict_get (op, "ids", &ids));
+	expected = xmmsv_from_xson ("[1, 2]");
+	CU_ASSERT (xmmsv_compare (expected, ids));
+	xmmsv_unref (expected);
+
+	CU_ASSERT_TRUE (xmmsv_list_get (ops, 1, &op));
+	CU_ASSERT_TRUE (xmmsv_dict_entry_get_string (op, "op", &type));
+	CU_ASSERT_STRING_EQUAL ("move", type);
+
+	xmmsv_unref (records);
+}
+
+CASE (test_journal_replay)
+{
+	xmmsv_t *result;
+
+	collsync_start ();
+	collsync_stop ();
+
+	collsync_start ();
+	add_entries (1, 3);
+	move_entry (2, 0);
+	collsync_stop ();
+
+	collsync_start ();
+	result = XMMS_IPC_CALL (playlist, XMMS_IPC_COMMAND_PLAYLIST_REMOVE_ENTRY,
+	                        xmmsv_new_string ("Default"),
+	                        xmmsv_new_int (1));
+	CU_ASSERT (xmmsv_is_type (result, XMMSV_TYPE_NONE));
+	xmmsv_unref (result);
+	collsync_stop ();
+
+	/* Both records are replayed on top of the snapshot */
+	collsync_start ();
+	assert_entries ("[3, 2]");
+	collsync_stop ();
+}
+
+CASE (test_journal_position_coalesced)
+{
+	xmmsv_t *records, *record, *ops, *op, *result;
+	const gchar *type;
+	gint i, count, position;
+
+	collsync_start ();
+	collsync_stop ();
+
+	collsync_start ();
+	add_entries (1, 3);
+	for (i = 0; i < 3; i++) {
+		result = XMMS_IPC_CALL (playlist, XMMS_IPC_COMMAND_PLAYLIST_SET_NEXT,
+		                        xmmsv_new_int (i));
+		CU_ASSERT_TRUE (xmmsv_get_int (result, &position));
+		xmmsv_unref (result);
+	}
+	collsync_stop ();
+
+	records = read_journal (NULL);
+	CU_ASSERT_EQUAL (2, xmmsv_list_get_size (records));
+	CU_ASSERT_TRUE (xmmsv_list_get (records, 1, &record));
+	CU_ASSERT_TRUE (xmmsv_dict_get (record, "ops", &ops));
+
+	/* Only the last position made it to the journal */
+	count = 0;
+	for (i = 0; xmmsv_list_get (ops, i, &op); i++) {
+		CU_ASSERT_TRUE (xmmsv_dict_entry_get_string (op, "op", &type));
+		if (strcmp (type, "position") == 0) {
+			CU_ASSERT_TRUE (xmmsv_dict_entry_get_int (op, "position", &position));
+			CU_ASSERT_EQUAL (2, position);
+			count++;
+		}
+	}
+	CU_ASSERT_EQUAL (1, count);
+
+	xmmsv_unref (records);
+}
+
+CASE (test_journal_generation_mismatch)
+{
+	xmmsv_t *records, *record, *header, *serialized, *snapshot;
+	gsize length;
+	gchar *contents;
+	gint generation;
+
+	collsync_start ();
+	collsync_stop ();
+
+	collsync_start ();
+	add_entries (1, 2);
+	collsync_stop ();
+
+	/* Claim the journal belongs to some other snapshot */
+	records = read_journal (NULL);
+	CU_ASSERT_EQUAL (2, xmmsv_list_get_size (records));
+
+	header = xmmsv_build_dict (XMMSV_DICT_ENTRY_INT ("journal-generation", 99),
+	                           XMMSV_DICT_END);
+	CU_ASSERT_TRUE (xmmsv_list_set (records, 0, header));
+	xmmsv_unref (header);
+
+	write_journal (records);
+	xmmsv_unref (records);
+
+	collsync_start ();
+	assert_entries ("[]");
+	collsync_stop ();
+
+	/* A full snapshot is written, and a journal that goes with it */
+	contents = read_file (path, &length);
+	serialized = xmmsv_new_bin ((const guchar *) contents, length);
+	snapshot = xmmsv_deserialize (serialized);
+	xmmsv_unref (serialized);
+	g_free (contents);
+
+	CU_ASSERT_PTR_NOT_NULL_FATAL (snapshot);
+	CU_ASSERT_TRUE (xmmsv_dict_entry_get_int (snapshot, "journal-generation", &generation));
+	CU_ASSERT_NOT_EQUAL (99, generation);
+	xmmsv_unref (snapshot);
+
+	records = read_journal (NULL);
+	CU_ASSERT_EQUAL (1, xmmsv_list_get_size (records));
+	CU_ASSERT_TRUE (xmmsv_list_get (records, 0, &record));
+	CU_ASSERT_TRUE (xmmsv_dict_entry_get_int (record, "journal-generation", &generation));
+	CU_ASSERT_NOT_EQUAL (99, generation);
+	xmmsv_unref (records);
+}
+
+CASE (test_journal_torn_tail)
+{
+	xmmsv_t *records;
+	GArray *offsets;
+	gsize torn;
+
+	collsync_start ();
+	collsync_stop ();
+
+	collsync_start ();
+	add_entries (1, 1);
+	collsync_stop ();
+
+	collsync_start ();
+	add_entries (2, 1);
+	collsync_stop ();
+
+	collsync_start ();
+	add_entries (3, 1);
+	collsync_stop ();
+
+	offsets = g_array_new (FALSE, FALSE, sizeof (gsize));
+	records = read_journal (offsets);
+	CU_ASSERT_EQUAL_FATAL (4, xmmsv_list_get_size (records));
+	xmmsv_unref (records);
+
+	/* Cut the last record short, as a crash while writing it would */
+	torn = g_array_index (offsets, gsize, 3) + 6;
+	g_array_free (offsets, TRUE);
+	CU_ASSERT_EQUAL (0, truncate (journal, torn));
+
+	collsync_start ();
+	assert_entries ("[1, 2]");
+	collsync_stop ();
+
+	/* The journal is started over instead of appended to */
+	records = read_journal (NULL);
+	CU_ASSERT_EQUAL (1, xmmsv_list_get_size (records));
+	xmmsv_unref (records);
+
+	collsync_start ();
+	assert_entries ("[1, 2]");
+	collsync_stop ();
+}
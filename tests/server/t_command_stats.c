@@ -0,0 +1,245 @@
+/*  XMMS2 - X Music Multiplexer System
+ *  Copyright (C) 2003-2020 XMMS2 Team
+ *
+ *  PLUGINS ARE NOT CONSIDERED TO BE DERIVED WORK !!!
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ */
+
+#include "xcu.h"
+
+#include <stdio.h>
+#include <unistd.h>
+
+#include <glib.h>
+
+#include <xmmspriv/xmms_ipc.h>
+#include <xmmsc/xmmsc_ipc_transport.h>
+
+#include "server-utils/ipc_server.h"
+
+#define CALLS 200
+#define FAILURES 50
+#define NOOPS 20000
+
+SETUP (command_stats) {
+	CU_ASSERT_TRUE (xmms_ipc_test_server_start ("command-stats", 0));
+
+	xmms_ipc_command_stats_enable (TRUE);
+	xmms_ipc_command_stats_reset ();
+
+	return 0;
+}
+
+CLEANUP () {
+	xmms_ipc_test_server_stop ();
+
+	return 0;
+}
+
+static void
+test_client_connect (xmms_ipc_transport_t *ipct)
+{
+	CU_ASSERT_NOT_EQUAL (xmms_ipc_test_transport_connect (ipct, 0), 0);
+}
+
+/* Run a command and wait for its reply */
+static void
+test_client_call (xmms_ipc_transport_t *ipct, guint32 cmd, guint32 cookie)
+{
+	xmms_ipc_msg_t *msg;
+	xmmsv_t *args;
+
+	msg = xmms_ipc_msg_new (XMMS_IPC_OBJECT_PLAYBACK, cmd);
+	xmms_ipc_msg_set_cookie (msg, cookie);
+
+	args = xmmsv_new_list ();
+	xmms_ipc_msg_put_value (msg, args);
+	xmmsv_unref (args);
+
+	CU_ASSERT_TRUE (xmms_ipc_msg_write_transport (msg, ipct, NULL));
+	xmms_ipc_msg_destroy (msg);
+
+	msg = xmms_ipc_msg_alloc ();
+	CU_ASSERT_TRUE (xmms_ipc_msg_read_transport (msg, ipct, NULL));
+	CU_ASSERT_EQUAL (xmms_ipc_msg_get_cookie (msg), cookie);
+	xmms_ipc_msg_destroy (msg);
+}
+
+/* The counters of one command, or NULL if it wasn't called */
+static xmmsv_t *
+find_command (xmmsv_t *stats, gint objid, gint cmdid)
+{
+	xmmsv_list_iter_t *it;
+	xmmsv_t *dict;
+	int64_t obj, cmd;
+
+	xmmsv_get_list_iter (stats, &it);
+	while (xmmsv_list_iter_entry (it, &dict)) {
+		if (xmmsv_dict_entry_get_int64 (dict, "object", &obj) && obj == objid &&
+		    xmmsv_dict_entry_get_int64 (dict, "command", &cmd) && cmd == cmdid) {
+			return dict;
+		}
+		xmmsv_list_iter_next (it);
+	}
+
+	return NULL;
+}
+
+static int64_t
+histogram_total (xmmsv_t *dict, const gchar *phase)
+{
+	xmmsv_t *histogram;
+	int64_t count, total = 0;
+	gint i;
+
+	if (!xmmsv_dict_get (dict, phase, &histogram)) {
+		return -1;
+	}
+
+	for (i = 0; xmmsv_list_get_int64 (histogram, i, &count); i++) {
+		total += count;
+	}
+
+	return total;
+}
+
+CASE (test_command_stats_counts)
+{
+	xmms_ipc_transport_t ipct;
+	xmmsv_t *stats, *dict;
+	int64_t value;
+	gint i;
+
+	test_client_connect (&ipct);
+
+	for (i = 0; i < CALLS; i++) {
+		test_client_call (&ipct, XMMS_IPC_COMMAND_PLAYBACK_PAUSE, i + 1);
+	}
+
+	for (i = 0; i < FAILURES; i++) {
+		test_client_call (&ipct, XMMS_IPC_COMMAND_PLAYBACK_STOP, CALLS + i + 1);
+	}
+
+	stats = xmms_ipc_command_stats ();
+	CU_ASSERT_EQUAL (xmmsv_list_get_size (stats), 2);
+
+	dict = find_command (stats, XMMS_IPC_OBJECT_PLAYBACK, XMMS_IPC_COMMAND_PLAYBACK_PAUSE);
+	CU_ASSERT_PTR_NOT_NULL_FATAL (dict);
+	CU_ASSERT_TRUE (xmmsv_dict_entry_get_int64 (dict, "calls", &value));
+	CU_ASSERT_EQUAL (value, CALLS);
+	CU_ASSERT_TRUE (xmmsv_dict_entry_get_int64 (dict, "errors", &value));
+	CU_ASSERT_EQUAL (value, 0);
+	CU_ASSERT_EQUAL (histogram_total (dict, "dispatch"), CALLS);
+	CU_ASSERT_EQUAL (histogram_total (dict, "execute"), CALLS);
+	CU_ASSERT_EQUAL (histogram_total (dict, "serialize"), CALLS);
+
+	/* failed commands are timed too, their error is the reply */
+	dict = find_command (stats, XMMS_IPC_OBJECT_PLAYBACK, XMMS_IPC_COMMAND_PLAYBACK_STOP);
+	CU_ASSERT_PTR_NOT_NULL_FATAL (dict);
+	CU_ASSERT_TRUE (xmmsv_dict_entry_get_int64 (dict, "calls", &value));
+	CU_ASSERT_EQUAL (value, FAILURES);
+	CU_ASSERT_TRUE (xmmsv_dict_entry_get_int64 (dict, "errors", &value));
+	CU_ASSERT_EQUAL (value, FAILURES);
+	CU_ASSERT_EQUAL (histogram_total (dict, "serialize"), FAILURES);
+
+	xmmsv_unref (stats);
+
+	xmms_ipc_command_stats_reset ();
+
+	stats = xmms_ipc_command_stats ();
+	CU_ASSERT_EQUAL (xmmsv_list_get_size (stats), 0);
+	xmmsv_unref (stats);
+
+	close (ipct.fd);
+}
+
+CASE (test_command_stats_batch)
+{
+	xmmsv_t *commands, *results, *stats, *dict;
+	xmms_error_t err;
+	int64_t value;
+
+	xmms_error_reset (&err);
+
+	commands = xmmsv_build_list (
+		XMMSV_LIST_ENTRY (xmmsv_build_list (XMMSV_LIST_ENTRY_INT (XMMS_IPC_OBJECT_PLAYBACK),
+		                                    XMMSV_LIST_ENTRY_INT (XMMS_IPC_COMMAND_PLAYBACK_PAUSE),
+		                                    XMMSV_LIST_ENTRY (xmmsv_new_list ()),
+		                                    XMMSV_LIST_END)),
+		XMMSV_LIST_ENTRY (xmmsv_build_list (XMMSV_LIST_ENTRY_INT (XMMS_IPC_OBJECT_PLAYBACK),
+		                                    XMMSV_LIST_ENTRY_INT (XMMS_IPC_COMMAND_PLAYBACK_STOP),
+		                                    XMMSV_LIST_ENTRY (xmmsv_new_list ()),
+		                                    XMMSV_LIST_END)),
+		XMMSV_LIST_END);
+
+	results = xmms_ipc_batch_call (0, 0, commands, &err);
+	CU_ASSERT_FALSE (xmms_error_iserror (&err));
+	CU_ASSERT_EQUAL (xmmsv_list_get_size (results), 2);
+	xmmsv_unref (results);
+	xmmsv_unref (commands);
+
+	/* batched commands count like ones sent on their own, but share
+	 * the reply of the batch */
+	stats = xmms_ipc_command_stats ();
+
+	dict = find_command (stats, XMMS_IPC_OBJECT_PLAYBACK, XMMS_IPC_COMMAND_PLAYBACK_PAUSE);
+	CU_ASSERT_PTR_NOT_NULL_FATAL (dict);
+	CU_ASSERT_TRUE (xmmsv_dict_entry_get_int64 (dict, "calls", &value));
+	CU_ASSERT_EQUAL (value, 1);
+	CU_ASSERT_EQUAL (histogram_total (dict, "execute"), 1);
+	CU_ASSERT_EQUAL (histogram_total (dict, "serialize"), 0);
+
+	dict = find_command (stats, XMMS_IPC_OBJECT_PLAYBACK, XMMS_IPC_COMMAND_PLAYBACK_STOP);
+	CU_ASSERT_PTR_NOT_NULL_FATAL (dict);
+	CU_ASSERT_TRUE (xmmsv_dict_entry_get_int64 (dict, "errors", &value));
+	CU_ASSERT_EQUAL (value, 1);
+
+	xmmsv_unref (stats);
+}
+
+static gdouble
+noop_loop (xmms_ipc_transport_t *ipct)
+{
+	gint64 start;
+	gint i;
+
+	start = g_get_monotonic_time ();
+	for (i = 0; i < NOOPS; i++) {
+		test_client_call (ipct, XMMS_IPC_COMMAND_PLAYBACK_PAUSE, i + 1);
+	}
+
+	return (gdouble) (g_get_monotonic_time () - start) / NOOPS;
+}
+
+CASE (test_command_stats_overhead)
+{
+	xmms_ipc_transport_t ipct;
+	gdouble without, with;
+	xmmsv_t *stats;
+
+	test_client_connect (&ipct);
+
+	xmms_ipc_command_stats_enable (FALSE);
+	without = noop_loop (&ipct);
+
+	stats = xmms_ipc_command_stats ();
+	CU_ASSERT_EQUAL (xmmsv_list_get_size (stats), 0);
+	xmmsv_unref (stats);
+
+	xmms_ipc_command_stats_enable (TRUE);
+	with = noop_loop (&ipct);
+
+	printf ("\n%d no-op commands: %.3f us per round trip without counters,"
+	        " %.3f us with\n", NOOPS, without, with);
+
+	close (ipct.fd);
+}
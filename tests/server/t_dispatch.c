@@ -0,0 +1,159 @@
+/*  XMMS2 - X Music Multiplexer System
+ *  Copyright (C) 2003-2020 XMMS2 Team
+ *
+ *  PLUGINS ARE NOT CONSIDERED TO BE DERIVED WORK !!!
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ */
+
+#include <stdio.h>
+
+#include "xcu.h"
+
+#include <xmmspriv/xmms_log.h>
+#include <xmmspriv/xmms_ipc.h>
+#include <xmmspriv/xmms_config.h>
+#include <xmmspriv/xmms_medialib.h>
+#include <xmmspriv/xmms_collection.h>
+#include <xmmspriv/xmms_playlist.h>
+#include <xmmspriv/xmms_courier.h>
+
+#include "utils/jsonism.h"
+#include "utils/value_utils.h"
+#include "server-utils/ipc_call.h"
+
+#define DISPATCHES 1000000
+
+static xmms_medialib_t *medialib;
+static xmms_coll_dag_t *colldag;
+static xmms_playlist_t *playlist;
+static xmms_courier_t *courier;
+
+SETUP (dispatch) {
+	xmms_ipc_init ();
+	xmms_log_init (0);
+
+	xmms_config_init ("memory://");
+
+	xmms_config_property_register ("medialib.path", "memory://", NULL, NULL);
+	xmms_config_property_register ("playlist.repeat_one", "0", NULL, NULL);
+	xmms_config_property_register ("playlist.repeat_all", "0", NULL, NULL);
+
+	medialib = xmms_medialib_init ();
+	colldag = xmms_collection_init (medialib);
+	playlist = xmms_playlist_init (medialib, colldag);
+	courier = xmms_courier_init ();
+
+	return 0;
+}
+
+CLEANUP () {
+	xmms_object_unref (courier); courier = NULL;
+	xmms_object_unref (playlist); playlist = NULL;
+	xmms_object_unref (colldag); colldag = NULL;
+	xmms_object_unref (medialib); medialib = NULL;
+	xmms_config_shutdown ();
+	xmms_ipc_shutdown ();
+
+	return 0;
+}
+
+/* Every command in [FIRST, end) is there, and nothing past it */
+static void
+assert_reachable (xmms_object_t *object, guint end)
+{
+	guint cmdid;
+
+	for (cmdid = XMMS_IPC_COMMAND_FIRST; cmdid < end; cmdid++) {
+		CU_ASSERT_PTR_NOT_NULL (xmms_object_cmd_lookup (object, cmdid));
+	}
+
+	CU_ASSERT_PTR_NULL (xmms_object_cmd_lookup (object, XMMS_IPC_COMMAND_FIRST - 1));
+	CU_ASSERT_PTR_NULL (xmms_object_cmd_lookup (object, end));
+}
+
+CASE (test_commands_reachable)
+{
+	assert_reachable (XMMS_OBJECT (medialib), XMMS_IPC_COMMAND_MEDIALIB_END);
+	assert_reachable (XMMS_OBJECT (colldag), XMMS_IPC_COMMAND_COLLECTION_END);
+	assert_reachable (XMMS_OBJECT (playlist), XMMS_IPC_COMMAND_PLAYLIST_END);
+	assert_reachable (XMMS_OBJECT (courier), XMMS_IPC_COMMAND_COURIER_END);
+	assert_reachable (XMMS_OBJECT (xmms_ipc_manager_get ()),
+	                  XMMS_IPC_COMMAND_IPC_MANAGER_END);
+}
+
+CASE (test_arguments_checked)
+{
+	xmmsv_t *result;
+
+	/* expects the name of a playlist */
+	result = XMMS_IPC_CALL (playlist, XMMS_IPC_COMMAND_PLAYLIST_CURRENT_POS,
+	                        xmmsv_new_int (1));
+	CU_ASSERT_TRUE (xmmsv_is_type (result, XMMSV_TYPE_ERROR));
+	xmmsv_unref (result);
+
+	result = XMMS_IPC_CALL (playlist, XMMS_IPC_COMMAND_PLAYLIST_CURRENT_POS,
+	                        xmmsv_new_string (XMMS_ACTIVE_PLAYLIST),
+	                        xmmsv_new_string (XMMS_ACTIVE_PLAYLIST));
+	CU_ASSERT_TRUE (xmmsv_is_type (result, XMMSV_TYPE_ERROR));
+	xmmsv_unref (result);
+
+	/* expects a collection and a fetch specification */
+	result = XMMS_IPC_CALL (colldag, XMMS_IPC_COMMAND_COLLECTION_QUERY,
+	                        xmmsv_new_none (), xmmsv_new_dict ());
+	CU_ASSERT_TRUE (xmmsv_is_type (result, XMMSV_TYPE_ERROR));
+	xmmsv_unref (result);
+}
+
+static void
+noop (xmms_object_t *object, xmms_object_cmd_arg_t *arg)
+{
+	arg->retval = NULL;
+}
+
+static const xmms_object_cmd_desc_t noop_desc = {
+	noop, 2, { XMMSV_TYPE_STRING, XMMSV_TYPE_INT64 }
+};
+
+/* Dispatch commands straight through the table, leaving out the wire */
+CASE (test_dispatch_rate)
+{
+	xmms_object_cmd_arg_t arg;
+	xmms_object_t *object;
+	gint64 start, elapsed;
+	guint cmdid;
+	gint i;
+
+	object = xmms_object_new (xmms_object_t, NULL);
+	for (cmdid = XMMS_IPC_COMMAND_FIRST; cmdid < XMMS_IPC_COMMAND_FIRST + XMMS_IPC_COMMAND_OBJECT_MAX; cmdid++) {
+		xmms_object_cmd_add (object, cmdid, &noop_desc);
+	}
+
+	xmms_object_cmd_arg_init (&arg);
+	arg.args = xmmsv_build_list (XMMSV_LIST_ENTRY_STR ("Default"),
+	                             XMMSV_LIST_ENTRY_INT (1),
+	                             XMMSV_LIST_END);
+
+	start = g_get_monotonic_time ();
+	for (i = 0; i < DISPATCHES; i++) {
+		cmdid = XMMS_IPC_COMMAND_FIRST + i % XMMS_IPC_COMMAND_OBJECT_MAX;
+		xmms_object_cmd_call (object, cmdid, &arg);
+	}
+	elapsed = MAX (g_get_monotonic_time () - start, 1);
+
+	CU_ASSERT_TRUE (xmms_error_isok (&arg.error));
+
+	printf ("\n%d commands dispatched: %.0f per second\n",
+	        DISPATCHES, DISPATCHES * (gdouble) G_USEC_PER_SEC / elapsed);
+
+	xmmsv_unref (arg.args);
+	xmms_object_unref (object);
+}
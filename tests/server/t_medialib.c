@@ -852,3 +852,94 @@ CASE (test_session_locking)
 
 	CU_ASSERT_NOT_EQUAL (status, new_status);
 }
+
+CASE (test_stats)
+{
+	gint64 values[XMMS_MEDIALIB_STATS_END];
+	gint64 verified[XMMS_MEDIALIB_STATS_END];
+	xmms_medialib_session_t *session;
+	xmms_medialib_entry_t first, second;
+	xmms_error_t err;
+
+	xmms_error_reset (&err);
+
+	first = xmms_mock_entry (medialib, 1, "Red Fang", "Red Fang", "Prehistoric Dog");
+	second = xmms_mock_entry (medialib, 2, "Red Fang", "Red Fang", "Reverse Thunder");
+
+	session = xmms_medialib_session_begin (medialib);
+	xmms_medialib_entry_property_set_int (session, first,
+	                                      XMMS_MEDIALIB_ENTRY_PROPERTY_SIZE, 1000);
+	xmms_medialib_entry_property_set_int (session, first,
+	                                      XMMS_MEDIALIB_ENTRY_PROPERTY_DURATION, 200);
+	xmms_medialib_entry_property_set_int (session, second,
+	                                      XMMS_MEDIALIB_ENTRY_PROPERTY_SIZE, 3000);
+	xmms_medialib_entry_property_set_int (session, second,
+	                                      XMMS_MEDIALIB_ENTRY_PROPERTY_DURATION, 400);
+	xmms_medialib_entry_property_set_int (session, second,
+	                                      XMMS_MEDIALIB_ENTRY_PROPERTY_TIMESPLAYED, 3);
+	xmms_medialib_session_commit (session);
+
+	xmms_medialib_stats_get (medialib, values);
+	CU_ASSERT_EQUAL (4000, values[XMMS_MEDIALIB_STATS_SIZE]);
+	CU_ASSERT_EQUAL (600, values[XMMS_MEDIALIB_STATS_DURATION]);
+	CU_ASSERT_EQUAL (1200, values[XMMS_MEDIALIB_STATS_PLAYTIME]);
+
+	/* aborted sessions must not be accounted for */
+	session = xmms_medialib_session_begin (medialib);
+	xmms_medialib_entry_property_set_int (session, first,
+	                                      XMMS_MEDIALIB_ENTRY_PROPERTY_SIZE, 5000);
+	xmms_medialib_session_abort (session);
+
+	/* removed entries no longer count */
+	session = xmms_medialib_session_begin (medialib);
+	xmms_medialib_entry_remove (session, first);
+	xmms_medialib_session_commit (session);
+
+	xmms_medialib_stats_get (medialib, values);
+	CU_ASSERT_EQUAL (3000, values[XMMS_MEDIALIB_STATS_SIZE]);
+	CU_ASSERT_EQUAL (400, values[XMMS_MEDIALIB_STATS_DURATION]);
+	CU_ASSERT_EQUAL (1200, values[XMMS_MEDIALIB_STATS_PLAYTIME]);
+
+	CU_ASSERT_TRUE (xmms_medialib_stats_verify (medialib, verified, &err));
+	CU_ASSERT_EQUAL (values[XMMS_MEDIALIB_STATS_SIZE], verified[XMMS_MEDIALIB_STATS_SIZE]);
+	CU_ASSERT_EQUAL (values[XMMS_MEDIALIB_STATS_DURATION], verified[XMMS_MEDIALIB_STATS_DURATION]);
+	CU_ASSERT_EQUAL (values[XMMS_MEDIALIB_STATS_PLAYTIME], verified[XMMS_MEDIALIB_STATS_PLAYTIME]);
+}
+
+CASE (test_stats_concurrent_sessions)
+{
+	gint64 values[XMMS_MEDIALIB_STATS_END];
+	gint64 verified[XMMS_MEDIALIB_STATS_END];
+	xmms_medialib_session_t *first_session, *second_session;
+	xmms_medialib_entry_t first, second;
+	xmms_error_t err;
+
+	xmms_error_reset (&err);
+
+	first = xmms_mock_entry (medialib, 1, "Red Fang", "Red Fang", "Prehistoric Dog");
+	second = xmms_mock_entry (medialib, 2, "Red Fang", "Red Fang", "Reverse Thunder");
+
+	/* sessions changing different entries must not conflict on the statistics */
+	first_session = xmms_medialib_session_begin (medialib);
+	second_session = xmms_medialib_session_begin (medialib);
+
+	xmms_medialib_entry_property_set_int (first_session, first,
+	                                      XMMS_MEDIALIB_ENTRY_PROPERTY_SIZE, 1000);
+	xmms_medialib_entry_property_set_int (second_session, second,
+	                                      XMMS_MEDIALIB_ENTRY_PROPERTY_SIZE, 3000);
+
+	CU_ASSERT_TRUE (xmms_medialib_session_commit (first_session));
+	CU_ASSERT_TRUE (xmms_medialib_session_commit (second_session));
+
+	xmms_medialib_stats_get (medialib, values);
+	CU_ASSERT_EQUAL (4000, values[XMMS_MEDIALIB_STATS_SIZE]);
+
+	/* written out or not, the changes add up the same */
+	xmms_medialib_stats_flush (medialib, TRUE);
+
+	xmms_medialib_stats_get (medialib, values);
+	CU_ASSERT_EQUAL (4000, values[XMMS_MEDIALIB_STATS_SIZE]);
+
+	CU_ASSERT_TRUE (xmms_medialib_stats_verify (medialib, verified, &err));
+	CU_ASSERT_EQUAL (values[XMMS_MEDIALIB_STATS_SIZE], verified[XMMS_MEDIALIB_STATS_SIZE]);
+}
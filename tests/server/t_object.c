@@ -0,0 +1,140 @@
+/*  XMMS2 - X Music Multiplexer System
+ *  Copyright (C) 2003-2020 XMMS2 Team
+ *
+ *  PLUGINS ARE NOT CONSIDERED TO BE DERIVED WORK !!!
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ */
+
+#include "xcu.h"
+
+#include <glib.h>
+
+#include <xmmspriv/xmms_log.h>
+#include <xmms/xmms_object.h>
+
+#include "utils/jsonism.h"
+#include "utils/value_utils.h"
+
+SETUP (object) {
+	xmms_log_init (0);
+	return 0;
+}
+
+CLEANUP () {
+	return 0;
+}
+
+static GMutex gate_mutex;
+static GCond gate_cond;
+static gint gate_state;
+
+/* Holds up the dispatcher until the gate is opened */
+static void
+gate_handler (xmms_object_t *object, xmmsv_t *val, gpointer udata)
+{
+	g_mutex_lock (&gate_mutex);
+	gate_state = 1;
+	g_cond_broadcast (&gate_cond);
+	while (gate_state != 2) {
+		g_cond_wait (&gate_cond, &gate_mutex);
+	}
+	g_mutex_unlock (&gate_mutex);
+}
+
+static void
+record (xmmsv_t *emissions, const gchar *name, xmmsv_t *val)
+{
+	xmmsv_t *emission;
+
+	emission = xmmsv_build_list (XMMSV_LIST_ENTRY_STR (name),
+	                             XMMSV_LIST_ENTRY (xmmsv_ref (val)),
+	                             XMMSV_LIST_END);
+	xmmsv_list_append (emissions, emission);
+	xmmsv_unref (emission);
+}
+
+static void
+record_status (xmms_object_t *object, xmmsv_t *val, gpointer udata)
+{
+	record ((xmmsv_t *) udata, "status", val);
+}
+
+static void
+record_unindexed (xmms_object_t *object, xmmsv_t *val, gpointer udata)
+{
+	record ((xmmsv_t *) udata, "unindexed", val);
+}
+
+/* Queued signals of an object keep their order, and only a signal that
+ * is last in line takes the value of the same signal queued after it */
+CASE (test_emit_queued_order)
+{
+	xmms_object_t *gate, *object;
+	xmmsv_t *emissions, *expected;
+
+	gate = xmms_object_new (xmms_object_t, NULL);
+	object = xmms_object_new (xmms_object_t, NULL);
+	emissions = xmmsv_new_list ();
+
+	xmms_object_connect (gate, XMMS_IPC_SIGNAL_MEDIAINFO_READER_STATUS,
+	                     gate_handler, NULL);
+	xmms_object_connect (object, XMMS_IPC_SIGNAL_MEDIAINFO_READER_STATUS,
+	                     record_status, emissions);
+	xmms_object_connect (object, XMMS_IPC_SIGNAL_MEDIAINFO_READER_UNINDEXED,
+	                     record_unindexed, emissions);
+
+	gate_state = 0;
+	xmms_object_dispatch_start ();
+
+	xmms_object_emit_queued (gate, XMMS_IPC_SIGNAL_MEDIAINFO_READER_STATUS,
+	                         xmmsv_new_none (), FALSE);
+
+	g_mutex_lock (&gate_mutex);
+	while (gate_state != 1) {
+		g_cond_wait (&gate_cond, &gate_mutex);
+	}
+	g_mutex_unlock (&gate_mutex);
+
+	/* The dispatcher is busy, these all wait in the queue */
+	xmms_object_emit_queued (object, XMMS_IPC_SIGNAL_MEDIAINFO_READER_STATUS,
+	                         xmmsv_new_int (1), FALSE);
+	xmms_object_emit_queued (object, XMMS_IPC_SIGNAL_MEDIAINFO_READER_UNINDEXED,
+	                         xmmsv_new_int (30), TRUE);
+	xmms_object_emit_queued (object, XMMS_IPC_SIGNAL_MEDIAINFO_READER_UNINDEXED,
+	                         xmmsv_new_int (20), TRUE);
+	xmms_object_emit_queued (object, XMMS_IPC_SIGNAL_MEDIAINFO_READER_STATUS,
+	                         xmmsv_new_int (0), FALSE);
+	xmms_object_emit_queued (object, XMMS_IPC_SIGNAL_MEDIAINFO_READER_UNINDEXED,
+	                         xmmsv_new_int (10), TRUE);
+	xmms_object_emit_queued (object, XMMS_IPC_SIGNAL_MEDIAINFO_READER_STATUS,
+	                         xmmsv_new_int (1), FALSE);
+	xmms_object_emit_queued (object, XMMS_IPC_SIGNAL_MEDIAINFO_READER_STATUS,
+	                         xmmsv_new_int (0), FALSE);
+
+	g_mutex_lock (&gate_mutex);
+	gate_state = 2;
+	g_cond_broadcast (&gate_cond);
+	g_mutex_unlock (&gate_mutex);
+
+	/* Emits everything still queued */
+	xmms_object_dispatch_stop ();
+
+	expected = xmmsv_from_xson ("[['status', 1], ['unindexed', 20],"
+	                            " ['status', 0], ['unindexed', 10],"
+	                            " ['status', 1], ['status', 0]]");
+	CU_ASSERT (xmmsv_compare (expected, emissions));
+	xmmsv_unref (expected);
+
+	xmms_object_unref (object);
+	xmms_object_unref (gate);
+	xmmsv_unref (emissions);
+}
@@ -232,10 +232,96 @@ CASE(test_medialib_remove)
 	xmms_future_free (future3);
 }
 
+CASE(test_medialib_remove_duplicates)
+{
+	xmms_medialib_entry_t first, second, entry;
+	xmms_medialib_session_t *session;
+	xmms_error_t err;
+	xmmsv_t *result, *expected;
+	xmms_future_t *future;
+
+	first  = xmms_mock_entry (medialib, 1, "Red Fang", "Red Fang", "Prehistoric Dog");
+	second = xmms_mock_entry (medialib, 2, "Red Fang", "Red Fang", "Reverse Thunder");
+
+	xmms_playlist_add_entry (playlist, XMMS_ACTIVE_PLAYLIST, first, &err);
+	xmms_playlist_add_entry (playlist, XMMS_ACTIVE_PLAYLIST, second, &err);
+	xmms_playlist_add_entry (playlist, XMMS_ACTIVE_PLAYLIST, first, &err);
+	xmms_playlist_add_entry (playlist, XMMS_ACTIVE_PLAYLIST, second, &err);
+
+	future = XMMS_IPC_CHECK_SIGNAL (playlist, XMMS_IPC_SIGNAL_PLAYLIST_CHANGED);
+
+	session = xmms_medialib_session_begin (medialib);
+	xmms_medialib_entry_remove (session, first);
+	xmms_medialib_session_commit (session);
+
+	/* both occurrences are removed with a single notification */
+	result = xmms_future_await (future, 2);
+	expected = xmmsv_from_xson ("[{ 'type': 7, 'name': 'Default' },"
+	                            " { 'type': 8, 'name': 'Default' }]");
+	CU_ASSERT (xmmsv_compare (expected, result));
+	xmmsv_unref (result);
+	xmmsv_unref (expected);
+
+	result = XMMS_IPC_CALL (playlist, XMMS_IPC_COMMAND_PLAYLIST_LIST_ENTRIES,
+	                        xmmsv_new_string (XMMS_ACTIVE_PLAYLIST));
+	CU_ASSERT_EQUAL (2, xmmsv_list_get_size (result));
+	CU_ASSERT_TRUE (xmmsv_list_get_int (result, 0, &entry));
+	CU_ASSERT_EQUAL (second, entry);
+	CU_ASSERT_TRUE (xmmsv_list_get_int (result, 1, &entry));
+	CU_ASSERT_EQUAL (second, entry);
+	xmmsv_unref (result);
+
+	xmms_future_free (future);
+}
+
+CASE(test_medialib_remove_session)
+{
+	xmms_medialib_entry_t first, second, third, entry;
+	xmms_medialib_session_t *session;
+	xmms_error_t err;
+	xmmsv_t *result, *expected;
+	xmms_future_t *future;
+
+	first  = xmms_mock_entry (medialib, 1, "Red Fang", "Red Fang", "Prehistoric Dog");
+	second = xmms_mock_entry (medialib, 2, "Red Fang", "Red Fang", "Reverse Thunder");
+	third  = xmms_mock_entry (medialib, 3, "Red Fang", "Red Fang", "Night Destroyer");
+
+	xmms_playlist_add_entry (playlist, XMMS_ACTIVE_PLAYLIST, first, &err);
+	xmms_playlist_add_entry (playlist, XMMS_ACTIVE_PLAYLIST, second, &err);
+	xmms_playlist_add_entry (playlist, XMMS_ACTIVE_PLAYLIST, third, &err);
+	xmms_playlist_add_entry (playlist, XMMS_ACTIVE_PLAYLIST, first, &err);
+
+	future = XMMS_IPC_CHECK_SIGNAL (playlist, XMMS_IPC_SIGNAL_PLAYLIST_CHANGED);
+
+	session = xmms_medialib_session_begin (medialib);
+	xmms_medialib_entry_remove (session, first);
+	xmms_medialib_entry_remove (session, third);
+	xmms_medialib_session_commit (session);
+
+	/* the entries a session removed go in one pass over the playlist */
+	result = xmms_future_await (future, 2);
+	expected = xmmsv_from_xson ("[{ 'type': 7, 'name': 'Default' },"
+	                            " { 'type': 8, 'name': 'Default' }]");
+	CU_ASSERT (xmmsv_compare (expected, result));
+	xmmsv_unref (result);
+	xmmsv_unref (expected);
+
+	result = XMMS_IPC_CALL (playlist, XMMS_IPC_COMMAND_PLAYLIST_LIST_ENTRIES,
+	                        xmmsv_new_string (XMMS_ACTIVE_PLAYLIST));
+	CU_ASSERT_EQUAL (1, xmmsv_list_get_size (result));
+	CU_ASSERT_TRUE (xmmsv_list_get_int (result, 0, &entry));
+	CU_ASSERT_EQUAL (second, entry);
+	xmmsv_unref (result);
+
+	xmms_future_free (future);
+}
+
 CASE(test_client_add_collection)
 {
 	xmmsv_t *universe, *ordered;
-	xmmsv_t *result, *order;
+	xmmsv_t *result, *order, *signal, *ids;
+	xmms_future_t *future;
+	gint type, position, append;
 
 	xmms_mock_entry (medialib, 1, "Red Fang", "Red Fang", "Prehistoric Dog");
 	xmms_mock_entry (medialib, 2, "Red Fang", "Red Fang", "Reverse Thunder");
@@ -251,12 +337,29 @@ CASE(test_client_add_collection)
 	xmmsv_unref (order);
 	xmmsv_unref (universe);
 
+	future = XMMS_IPC_CHECK_SIGNAL (playlist, XMMS_IPC_SIGNAL_PLAYLIST_CHANGED);
+
 	result = XMMS_IPC_CALL (playlist, XMMS_IPC_COMMAND_PLAYLIST_ADD_COLLECTION,
 	                        xmmsv_new_string ("Default"),
 	                        ordered);
 	CU_ASSERT (xmmsv_is_type (result, XMMSV_TYPE_NONE));
 	xmmsv_unref (result);
 
+	/* both entries are announced with a single INSERT_RANGE */
+	result = xmms_future_await (future, 2);
+	CU_ASSERT (xmmsv_list_get (result, 1, &signal));
+	CU_ASSERT (xmmsv_dict_entry_get_int (signal, "type", &type));
+	CU_ASSERT_EQUAL (XMMS_PLAYLIST_CHANGED_INSERT_RANGE, type);
+	CU_ASSERT (xmmsv_dict_entry_get_int (signal, "position", &position));
+	CU_ASSERT_EQUAL (0, position);
+	/* older clients see the appended entries as adds */
+	CU_ASSERT (xmmsv_dict_entry_get_int (signal, "append", &append));
+	CU_ASSERT_TRUE (append);
+	CU_ASSERT (xmmsv_dict_get (signal, "ids", &ids));
+	CU_ASSERT_EQUAL (2, xmmsv_list_get_size (ids));
+	xmmsv_unref (result);
+	xmms_future_free (future);
+
 	result = XMMS_IPC_CALL (playlist, XMMS_IPC_COMMAND_PLAYLIST_LIST_ENTRIES,
 	                        xmmsv_new_string ("Default"));
 	CU_ASSERT (xmmsv_is_type (result, XMMSV_TYPE_LIST));
@@ -281,6 +384,77 @@ CASE(test_client_add_url)
 	xmmsv_unref (result);
 }
 
+static xmmsv_t *
+batch_command (gint objid, gint cmdid, xmmsv_t *args)
+{
+	return xmmsv_build_list (XMMSV_LIST_ENTRY_INT (objid),
+	                         XMMSV_LIST_ENTRY_INT (cmdid),
+	                         XMMSV_LIST_ENTRY (args),
+	                         XMMSV_LIST_END);
+}
+
+CASE(test_client_batch)
+{
+	xmmsv_t *commands, *batched, *result, *entry;
+	const gchar *batched_error, *error;
+	xmms_error_t err;
+
+	xmms_error_reset (&err);
+
+	/* commands run in order, so the listing sees the added entry */
+	commands = xmmsv_build_list (
+		XMMSV_LIST_ENTRY (batch_command (XMMS_IPC_OBJECT_PLAYLIST,
+		                                 XMMS_IPC_COMMAND_PLAYLIST_ADD_URL,
+		                                 xmmsv_build_list (XMMSV_LIST_ENTRY_STR ("Default"),
+		                                                   XMMSV_LIST_ENTRY_STR ("file:///test/file.mp3"),
+		                                                   XMMSV_LIST_END))),
+		XMMSV_LIST_ENTRY (batch_command (XMMS_IPC_OBJECT_PLAYLIST,
+		                                 XMMS_IPC_COMMAND_PLAYLIST_LIST_ENTRIES,
+		                                 xmmsv_build_list (XMMSV_LIST_ENTRY_STR ("Default"),
+		                                                   XMMSV_LIST_END))),
+		XMMSV_LIST_ENTRY (batch_command (XMMS_IPC_OBJECT_PLAYLIST,
+		                                 XMMS_IPC_COMMAND_PLAYLIST_CURRENT_POS,
+		                                 xmmsv_build_list (XMMSV_LIST_ENTRY_STR ("Missing"),
+		                                                   XMMSV_LIST_END))),
+		XMMSV_LIST_ENTRY (batch_command (XMMS_IPC_OBJECT_MAIN,
+		                                 XMMS_IPC_COMMAND_MAIN_BATCH,
+		                                 xmmsv_new_list ())),
+		XMMSV_LIST_ENTRY_INT (42),
+		XMMSV_LIST_END);
+
+	batched = xmms_ipc_batch_call (0, 0, commands, &err);
+	xmmsv_unref (commands);
+
+	CU_ASSERT_FALSE (xmms_error_iserror (&err));
+	CU_ASSERT_EQUAL (5, xmmsv_list_get_size (batched));
+
+	CU_ASSERT_TRUE (xmmsv_list_get (batched, 0, &entry));
+	CU_ASSERT (xmmsv_is_type (entry, XMMSV_TYPE_NONE));
+
+	/* the same commands sent one at a time give the same results */
+	result = XMMS_IPC_CALL (playlist, XMMS_IPC_COMMAND_PLAYLIST_LIST_ENTRIES,
+	                        xmmsv_new_string ("Default"));
+	CU_ASSERT_TRUE (xmmsv_list_get (batched, 1, &entry));
+	CU_ASSERT (xmmsv_compare (result, entry));
+	xmmsv_unref (result);
+
+	result = XMMS_IPC_CALL (playlist, XMMS_IPC_COMMAND_PLAYLIST_CURRENT_POS,
+	                        xmmsv_new_string ("Missing"));
+	CU_ASSERT_TRUE (xmmsv_list_get (batched, 2, &entry));
+	CU_ASSERT_TRUE (xmmsv_get_error (result, &error));
+	CU_ASSERT_TRUE (xmmsv_get_error (entry, &batched_error));
+	CU_ASSERT_STRING_EQUAL (error, batched_error);
+	xmmsv_unref (result);
+
+	/* nested batches and malformed commands fail on their own */
+	CU_ASSERT_TRUE (xmmsv_list_get (batched, 3, &entry));
+	CU_ASSERT (xmmsv_is_type (entry, XMMSV_TYPE_ERROR));
+	CU_ASSERT_TRUE (xmmsv_list_get (batched, 4, &entry));
+	CU_ASSERT (xmmsv_is_type (entry, XMMSV_TYPE_ERROR));
+
+	xmmsv_unref (batched);
+}
+
 CASE(test_client_replace)
 {
 	xmms_medialib_entry_t first;
@@ -734,3 +908,90 @@ CASE(test_party_shuffle)
 
 	xmms_future_free (future);
 }
+
+static gint editing;
+
+static gpointer
+edit_playlist (gpointer udata)
+{
+	xmms_medialib_entry_t *entries = (xmms_medialib_entry_t *) udata;
+	xmms_error_t err;
+	xmmsv_t *result;
+	gint i;
+
+	xmms_error_reset (&err);
+
+	for (i = 0; i < 2000; i++) {
+		xmms_playlist_add_entry (playlist, "Default", entries[i % 3], &err);
+
+		if (i % 5 == 4) {
+			result = XMMS_IPC_CALL (playlist, XMMS_IPC_COMMAND_PLAYLIST_MOVE_ENTRY,
+			                        xmmsv_new_string ("Default"),
+			                        xmmsv_new_int (0),
+			                        xmmsv_new_int (-1));
+			xmmsv_unref (result);
+		}
+
+		if (i % 7 == 6) {
+			result = XMMS_IPC_CALL (playlist, XMMS_IPC_COMMAND_PLAYLIST_REMOVE_ENTRY,
+			                        xmmsv_new_string ("Default"),
+			                        xmmsv_new_int (0));
+			xmmsv_unref (result);
+		}
+	}
+
+	g_atomic_int_set (&editing, 0);
+
+	return NULL;
+}
+
+CASE(test_copy_while_editing)
+{
+	xmms_medialib_entry_t entries[3];
+	xmms_error_t err;
+	GThread *thread;
+	GArray *ids;
+	xmmsv_t *copy;
+	int64_t id;
+	gint i, size, copies = 0;
+
+	entries[0] = xmms_mock_entry (medialib, 1, "Red Fang", "Red Fang", "Prehistoric Dog");
+	entries[1] = xmms_mock_entry (medialib, 2, "Red Fang", "Red Fang", "Reverse Thunder");
+	entries[2] = xmms_mock_entry (medialib, 3, "Red Fang", "Red Fang", "Night Destroyer");
+
+	ids = g_array_new (FALSE, FALSE, sizeof (int64_t));
+
+	g_atomic_int_set (&editing, 1);
+	thread = g_thread_new ("editor", edit_playlist, entries);
+
+	/* A copy shares the ids of the playlist, but must never see
+	 * the edits made after it was taken. */
+	while (g_atomic_int_get (&editing)) {
+		xmms_error_reset (&err);
+		copy = xmms_collection_client_get (colldag, "Default",
+		                                   XMMS_COLLECTION_NS_PLAYLISTS, &err);
+		CU_ASSERT_PTR_NOT_NULL_FATAL (copy);
+
+		size = xmmsv_coll_idlist_get_size (copy);
+		g_array_set_size (ids, 0);
+		for (i = 0; i < size; i++) {
+			CU_ASSERT (xmmsv_coll_idlist_get_index_int64 (copy, i, &id));
+			g_array_append_val (ids, id);
+		}
+
+		g_thread_yield ();
+
+		CU_ASSERT_EQUAL (size, xmmsv_coll_idlist_get_size (copy));
+		for (i = 0; i < size && xmmsv_coll_idlist_get_index_int64 (copy, i, &id); i++) {
+			CU_ASSERT_EQUAL (g_array_index (ids, int64_t, i), id);
+		}
+
+		xmmsv_unref (copy);
+		copies++;
+	}
+
+	g_thread_join (thread);
+	g_array_free (ids, TRUE);
+
+	CU_ASSERT (copies > 0);
+}
@@ -0,0 +1,258 @@
+/*  XMMS2 - X Music Multiplexer System
+ *  Copyright (C) 2003-2020 XMMS2 Team
+ *
+ *  PLUGINS ARE NOT CONSIDERED TO BE DERIVED WORK !!!
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ */
+
+#include "xcu.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include <glib.h>
+
+#include <xmmspriv/xmms_ipc.h>
+#include <xmmspriv/xmms_config.h>
+#include <xmmsc/xmmsc_ipc_transport.h>
+
+#include "server-utils/ipc_server.h"
+
+#define ENTRY_SIZE XMMS_IPC_TEST_ENTRY_SIZE
+#define ENTRIES 8192
+
+#define PAUSES 100
+
+static gint streaming;
+
+SETUP (priority) {
+	CU_ASSERT_TRUE (xmms_ipc_test_server_start ("priority", ENTRIES));
+	xmms_config_property_register ("core.ipc_compress_threshold", "4096",
+	                               NULL, NULL);
+
+	return 0;
+}
+
+CLEANUP () {
+	xmms_ipc_test_server_stop ();
+
+	return 0;
+}
+
+/* Connect a client announcing capabilities */
+static void
+test_client_connect (xmms_ipc_transport_t *ipct, guint32 capabilities)
+{
+	CU_ASSERT_NOT_EQUAL (xmms_ipc_test_transport_connect (ipct, capabilities), 0);
+}
+
+static void
+test_client_send (xmms_ipc_transport_t *ipct, guint32 object, guint32 cmd,
+                  guint32 cookie)
+{
+	xmms_ipc_msg_t *msg;
+	xmmsv_t *args;
+
+	msg = xmms_ipc_msg_new (object, cmd);
+	xmms_ipc_msg_set_cookie (msg, cookie);
+
+	args = xmmsv_new_list ();
+	xmms_ipc_msg_put_value (msg, args);
+	xmmsv_unref (args);
+
+	CU_ASSERT_TRUE (xmms_ipc_msg_write_transport (msg, ipct, NULL));
+
+	xmms_ipc_msg_destroy (msg);
+}
+
+/* Read one message, returning its cookie and adding its size to bytes */
+static guint32
+test_client_read (xmms_ipc_transport_t *ipct, gsize *bytes)
+{
+	xmms_ipc_msg_t *msg;
+	unsigned int len;
+	guint32 cookie;
+
+	msg = xmms_ipc_msg_alloc ();
+	if (!xmms_ipc_msg_read_transport (msg, ipct, NULL)) {
+		xmms_ipc_msg_destroy (msg);
+		return 0;
+	}
+
+	xmms_ipc_msg_get_data (msg, &len);
+	*bytes += len;
+	cookie = xmms_ipc_msg_get_cookie (msg);
+
+	xmms_ipc_msg_destroy (msg);
+
+	return cookie;
+}
+
+/* Read the reply to cookie, and whatever comes in before it */
+static void
+test_client_wait (xmms_ipc_transport_t *ipct, guint32 cookie, gsize *bytes)
+{
+	guint32 read;
+
+	do {
+		read = test_client_read (ipct, bytes);
+	} while (read && read != cookie);
+}
+
+/*
+ * Send a pause once a large query reply has started coming in on the
+ * same connection, and time how long until the pause is answered.
+ *
+ * @returns the bytes that were read before the pause was answered.
+ */
+static gsize
+pause_behind_query (guint32 capabilities, gdouble *latency)
+{
+	xmms_ipc_transport_t ipct;
+	struct pollfd pfd;
+	gsize bytes = 0;
+	gint64 start;
+
+	test_client_connect (&ipct, capabilities);
+
+	test_client_send (&ipct, XMMS_IPC_OBJECT_COLLECTION,
+	                  XMMS_IPC_COMMAND_COLLECTION_QUERY, 1);
+
+	pfd.fd = ipct.fd;
+	pfd.events = POLLIN;
+	CU_ASSERT_EQUAL (poll (&pfd, 1, 5000), 1);
+
+	start = g_get_monotonic_time ();
+	test_client_send (&ipct, XMMS_IPC_OBJECT_PLAYBACK,
+	                  XMMS_IPC_COMMAND_PLAYBACK_PAUSE, 2);
+	test_client_wait (&ipct, 2, &bytes);
+	*latency = (g_get_monotonic_time () - start) / 1000.0;
+
+	/* the rest of the query reply is dropped with the connection */
+	close (ipct.fd);
+
+	return bytes;
+}
+
+CASE (test_pause_ahead_of_query_reply)
+{
+	gdouble whole, parts;
+	gsize before_whole, before_parts;
+
+	before_whole = pause_behind_query (0, &whole);
+	before_parts = pause_behind_query (XMMS_IPC_CAPABILITY_REPLY_PARTS, &parts);
+
+	/* a whole reply has to be written before the pause is answered,
+	 * one in parts only up to the part being written */
+	CU_ASSERT (before_whole > ENTRIES * ENTRY_SIZE);
+	CU_ASSERT (before_parts < ENTRIES * ENTRY_SIZE / 2);
+
+	printf ("\npause behind a %d kB reply: %.3f ms after %" G_GSIZE_FORMAT " kB,"
+	        " in parts: %.3f ms after %" G_GSIZE_FORMAT " kB\n",
+	        ENTRIES * ENTRY_SIZE / 1024, whole, before_whole / 1024,
+	        parts, before_parts / 1024);
+}
+
+CASE (test_query_reply_compressed)
+{
+	xmms_ipc_transport_t ipct;
+	xmms_ipc_msg_t *msg;
+	unsigned char *raw;
+	unsigned int len, raw_len;
+
+	if (!xmms_ipc_msg_compress_supported ()) {
+		return;
+	}
+
+	test_client_connect (&ipct, XMMS_IPC_CAPABILITY_COMPRESSION);
+
+	test_client_send (&ipct, XMMS_IPC_OBJECT_COLLECTION,
+	                  XMMS_IPC_COMMAND_COLLECTION_QUERY, 1);
+
+	msg = xmms_ipc_msg_alloc ();
+	CU_ASSERT_TRUE_FATAL (xmms_ipc_msg_read_transport (msg, &ipct, NULL));
+	CU_ASSERT_EQUAL (xmms_ipc_msg_get_cmd (msg), XMMS_IPC_COMMAND_COMPRESSED);
+	CU_ASSERT_EQUAL (xmms_ipc_msg_get_cookie (msg), 1);
+
+	xmms_ipc_msg_get_data (msg, &len);
+	CU_ASSERT (len < ENTRIES * ENTRY_SIZE / 100);
+
+	raw = xmms_ipc_msg_decompress (msg, &raw_len);
+	CU_ASSERT_PTR_NOT_NULL_FATAL (raw);
+	CU_ASSERT (raw_len > ENTRIES * ENTRY_SIZE);
+
+	printf ("\n%d kB query reply: %u bytes compressed\n", raw_len / 1024, len);
+
+	free (raw);
+	xmms_ipc_msg_destroy (msg);
+
+	close (ipct.fd);
+}
+
+/* Run large queries back to back until told to stop */
+static gpointer
+stream_queries (gpointer data)
+{
+	xmms_ipc_transport_t *ipct = data;
+	guint32 cookie = 1;
+	gsize bytes = 0;
+
+	while (g_atomic_int_get (&streaming)) {
+		test_client_send (ipct, XMMS_IPC_OBJECT_COLLECTION,
+		                  XMMS_IPC_COMMAND_COLLECTION_QUERY, cookie);
+		test_client_wait (ipct, cookie, &bytes);
+		cookie++;
+	}
+
+	return NULL;
+}
+
+CASE (test_pause_latency_while_streaming)
+{
+	xmms_ipc_transport_t streamer, ipct;
+	GThread *thread;
+	gdouble latency, total = 0, longest = 0;
+	gint64 start;
+	gsize bytes = 0;
+	gint i;
+
+	test_client_connect (&streamer, XMMS_IPC_CAPABILITY_REPLY_PARTS);
+	test_client_connect (&ipct, XMMS_IPC_CAPABILITY_REPLY_PARTS);
+
+	g_atomic_int_set (&streaming, 1);
+	thread = g_thread_new ("streamer", stream_queries, &streamer);
+
+	for (i = 0; i < PAUSES; i++) {
+		start = g_get_monotonic_time ();
+		test_client_send (&ipct, XMMS_IPC_OBJECT_PLAYBACK,
+		                  XMMS_IPC_COMMAND_PLAYBACK_PAUSE, i + 1);
+		test_client_wait (&ipct, i + 1, &bytes);
+		latency = (g_get_monotonic_time () - start) / 1000.0;
+
+		total += latency;
+		longest = MAX (longest, latency);
+
+		g_usleep (1000);
+	}
+
+	g_atomic_int_set (&streaming, 0);
+	g_thread_join (thread);
+
+	printf ("\npause while another client streams %d kB queries:"
+	        " %.3f ms on average, %.3f ms at most\n",
+	        ENTRIES * ENTRY_SIZE / 1024, total / PAUSES, longest);
+
+	close (streamer.fd);
+	close (ipct.fd);
+}
@@ -0,0 +1,357 @@
+/*  XMMS2 - X Music Multiplexer System
+ *  Copyright (C) 2003-2020 XMMS2 Team
+ *
+ *  PLUGINS ARE NOT CONSIDERED TO BE DERIVED WORK !!!
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ */
+
+#include "xcu.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <glib.h>
+
+#include <xmmspriv/xmms_ipc.h>
+#include <xmmspriv/xmms_config.h>
+#include <xmms/xmms_object.h>
+
+#include "server-utils/ipc_server.h"
+
+#define BROADCASTS 50000
+#define PAYLOAD 1024
+#define ENTRIES 4096
+#define PAUSES 100
+
+static xmms_object_t *object;
+
+SETUP (subscription) {
+	CU_ASSERT_TRUE (xmms_ipc_test_server_start ("subscription", ENTRIES));
+
+	/* no limits unless a case sets them */
+	xmms_config_property_register ("core.ipc_queue_soft_limit", "0", NULL, NULL);
+	xmms_config_property_register ("core.ipc_queue_hard_limit", "0", NULL, NULL);
+
+	object = xmms_object_new (xmms_object_t, NULL);
+	xmms_ipc_signal_register (object, XMMS_IPC_SIGNAL_PLAYBACK_PLAYTIME);
+	xmms_ipc_broadcast_register (object, XMMS_IPC_SIGNAL_MEDIALIB_ENTRY_CHANGED);
+
+	return 0;
+}
+
+CLEANUP () {
+	xmms_ipc_broadcast_unregister (XMMS_IPC_SIGNAL_MEDIALIB_ENTRY_CHANGED);
+	xmms_ipc_signal_unregister (XMMS_IPC_SIGNAL_PLAYBACK_PLAYTIME);
+	xmms_object_unref (object);
+
+	xmms_ipc_test_server_stop ();
+
+	return 0;
+}
+
+/* A client that subscribes and then never reads */
+static gint
+slow_client_connect (gint32 *id)
+{
+	gint fd;
+
+	fd = xmms_ipc_test_connect (id);
+	CU_ASSERT_NOT_EQUAL (*id, 0);
+
+	return fd;
+}
+
+static void
+slow_client_send (gint fd, guint32 object, guint32 cmd, guint32 cookie,
+                  xmmsv_t *args)
+{
+	CU_ASSERT_TRUE (xmms_ipc_test_send (fd, object, cmd, cookie, args));
+}
+
+static void
+slow_client_subscribe (gint fd, guint32 cmd, guint32 cookie, xmmsv_t *args)
+{
+	slow_client_send (fd, XMMS_IPC_OBJECT_SIGNAL, cmd, cookie, args);
+}
+
+/* Signals are registered after broadcasts, so once one is pending the
+ * client's subscriptions are all in place */
+static void
+wait_for_pending (guint signalid)
+{
+	gint64 deadline;
+
+	deadline = g_get_monotonic_time () + 5 * G_USEC_PER_SEC;
+	while (!xmms_ipc_has_pending (signalid) && g_get_monotonic_time () < deadline) {
+		g_usleep (1000);
+	}
+
+	CU_ASSERT_TRUE (xmms_ipc_has_pending (signalid));
+}
+
+CASE (test_slow_client_queue_bounded)
+{
+	gint32 throttled, plain;
+	gint throttled_fd, plain_fd, length, longest = 0, i;
+
+	/* coalesced entry updates, and playtime at most once a second */
+	throttled_fd = slow_client_connect (&throttled);
+	slow_client_subscribe (throttled_fd, XMMS_IPC_COMMAND_BROADCAST, 1,
+	                       xmmsv_build_list (XMMSV_LIST_ENTRY_INT (XMMS_IPC_SIGNAL_MEDIALIB_ENTRY_CHANGED),
+	                                         XMMSV_LIST_ENTRY_INT (0),
+	                                         XMMSV_LIST_ENTRY_INT (1),
+	                                         XMMSV_LIST_END));
+	slow_client_subscribe (throttled_fd, XMMS_IPC_COMMAND_SIGNAL, 2,
+	                       xmmsv_build_list (XMMSV_LIST_ENTRY_INT (XMMS_IPC_SIGNAL_PLAYBACK_PLAYTIME),
+	                                         XMMSV_LIST_ENTRY_INT (1000),
+	                                         XMMSV_LIST_END));
+	wait_for_pending (XMMS_IPC_SIGNAL_PLAYBACK_PLAYTIME);
+
+	/* every entry update, the way subscriptions worked before */
+	plain_fd = slow_client_connect (&plain);
+	slow_client_subscribe (plain_fd, XMMS_IPC_COMMAND_BROADCAST, 1,
+	                       xmmsv_build_list (XMMSV_LIST_ENTRY_INT (XMMS_IPC_SIGNAL_MEDIALIB_ENTRY_CHANGED),
+	                                         XMMSV_LIST_END));
+	slow_client_subscribe (plain_fd, XMMS_IPC_COMMAND_SIGNAL, 2,
+	                       xmmsv_build_list (XMMSV_LIST_ENTRY_INT (XMMS_IPC_SIGNAL_MEDIALIB_ENTRY_REMOVED),
+	                                         XMMSV_LIST_END));
+	wait_for_pending (XMMS_IPC_SIGNAL_MEDIALIB_ENTRY_REMOVED);
+
+	/* an import, with playtime ticking along */
+	for (i = 0; i < BROADCASTS; i++) {
+		xmms_object_emit (object, XMMS_IPC_SIGNAL_MEDIALIB_ENTRY_CHANGED,
+		                  xmmsv_new_int (i));
+
+		if (i % 100 == 0) {
+			xmms_object_emit (object, XMMS_IPC_SIGNAL_PLAYBACK_PLAYTIME,
+			                  xmmsv_new_int (i));
+		}
+
+		length = xmms_ipc_client_queue_length (throttled);
+		longest = MAX (longest, length);
+	}
+
+	/* at most one entry update and one playtime waiting */
+	CU_ASSERT (longest <= 2);
+
+	/* while the socket buffer is full, the other client piles up */
+	length = xmms_ipc_client_queue_length (plain);
+	CU_ASSERT (length > BROADCASTS / 2);
+
+	printf ("\nqueued for %d broadcasts: coalesced at most %d, plain %d\n",
+	        BROADCASTS, longest, length);
+
+	close (throttled_fd);
+	close (plain_fd);
+}
+
+/* Wait until the client's queue stops shrinking, once the socket buffer
+ * is full, and return its length */
+static gint
+wait_for_stall (gint32 id)
+{
+	gint64 deadline;
+	gint length, last = -1;
+
+	deadline = g_get_monotonic_time () + 5 * G_USEC_PER_SEC;
+	while (g_get_monotonic_time () < deadline) {
+		length = xmms_ipc_client_queue_length (id);
+		if (length == last) {
+			break;
+		}
+		last = length;
+		g_usleep (50000);
+	}
+
+	return last;
+}
+
+CASE (test_slow_client_coalesced_behind_reply_parts)
+{
+	xmms_error_t err;
+	gint32 id;
+	gint fd, stalled, length, longest = 0, i;
+
+	fd = slow_client_connect (&id);
+
+	xmms_error_reset (&err);
+	xmms_ipc_client_set_capabilities (id, XMMS_IPC_CAPABILITY_REPLY_PARTS, &err);
+	CU_ASSERT_TRUE (xmms_error_isok (&err));
+
+	/* a reply written in parts, and control replies going ahead of it */
+	slow_client_send (fd, XMMS_IPC_OBJECT_COLLECTION,
+	                  XMMS_IPC_COMMAND_COLLECTION_QUERY, 1, xmmsv_new_list ());
+	for (i = 0; i < PAUSES; i++) {
+		slow_client_send (fd, XMMS_IPC_OBJECT_PLAYBACK,
+		                  XMMS_IPC_COMMAND_PLAYBACK_PAUSE, i + 2, xmmsv_new_list ());
+	}
+
+	slow_client_subscribe (fd, XMMS_IPC_COMMAND_BROADCAST, PAUSES + 2,
+	                       xmmsv_build_list (XMMSV_LIST_ENTRY_INT (XMMS_IPC_SIGNAL_MEDIALIB_ENTRY_CHANGED),
+	                                         XMMSV_LIST_ENTRY_INT (0),
+	                                         XMMSV_LIST_ENTRY_INT (1),
+	                                         XMMSV_LIST_END));
+	slow_client_subscribe (fd, XMMS_IPC_COMMAND_SIGNAL, PAUSES + 3,
+	                       xmmsv_build_list (XMMSV_LIST_ENTRY_INT (XMMS_IPC_SIGNAL_PLAYBACK_PLAYTIME),
+	                                         XMMSV_LIST_END));
+	wait_for_pending (XMMS_IPC_SIGNAL_PLAYBACK_PLAYTIME);
+
+	/* more parts and control replies were written than messages were
+	 * queued before them, which must not look like the updates were */
+	stalled = wait_for_stall (id);
+	CU_ASSERT (stalled > 0);
+
+	for (i = 0; i < BROADCASTS; i++) {
+		xmms_object_emit (object, XMMS_IPC_SIGNAL_MEDIALIB_ENTRY_CHANGED,
+		                  xmmsv_new_int (i));
+
+		length = xmms_ipc_client_queue_length (id);
+		longest = MAX (longest, length);
+	}
+
+	/* the rest of the reply, and at most one entry update */
+	CU_ASSERT (longest <= stalled + 1);
+
+	close (fd);
+}
+
+static void
+set_queue_limits (const gchar *soft, const gchar *hard)
+{
+	xmms_config_property_set_data (xmms_config_lookup ("core.ipc_queue_soft_limit"), soft);
+	xmms_config_property_set_data (xmms_config_lookup ("core.ipc_queue_hard_limit"), hard);
+}
+
+/* Resident set size of the test process, in bytes */
+static gint64
+resident_size (void)
+{
+	gchar *contents;
+	gint64 pages = 0;
+
+	if (g_file_get_contents ("/proc/self/statm", &contents, NULL, NULL)) {
+		sscanf (contents, "%*d %" G_GINT64_FORMAT, &pages);
+		g_free (contents);
+	}
+
+	return pages * sysconf (_SC_PAGESIZE);
+}
+
+static gint64
+queued_bytes (gint32 id)
+{
+	xmmsv_list_iter_t *it;
+	xmmsv_t *stats, *dict;
+	gint64 bytes = -1;
+	int64_t value;
+
+	stats = xmms_ipc_client_queue_stats ();
+
+	xmmsv_get_list_iter (stats, &it);
+	while (xmmsv_list_iter_entry (it, &dict)) {
+		if (xmmsv_dict_entry_get_int64 (dict, "id", &value) && value == id &&
+		    xmmsv_dict_entry_get_int64 (dict, "queued_bytes", &value)) {
+			bytes = value;
+		}
+		xmmsv_list_iter_next (it);
+	}
+
+	xmmsv_unref (stats);
+
+	return bytes;
+}
+
+CASE (test_slow_client_soft_limit)
+{
+	gchar payload[PAYLOAD];
+	gint64 before, grown, bytes;
+	gint32 id;
+	gint fd, i;
+
+	set_queue_limits ("64", "0");
+
+	memset (payload, 'x', sizeof (payload) - 1);
+	payload[sizeof (payload) - 1] = '\0';
+
+	/* subscribed to every entry update, and never reading */
+	fd = slow_client_connect (&id);
+	slow_client_subscribe (fd, XMMS_IPC_COMMAND_BROADCAST, 1,
+	                       xmmsv_build_list (XMMSV_LIST_ENTRY_INT (XMMS_IPC_SIGNAL_MEDIALIB_ENTRY_CHANGED),
+	                                         XMMSV_LIST_END));
+	slow_client_subscribe (fd, XMMS_IPC_COMMAND_SIGNAL, 2,
+	                       xmmsv_build_list (XMMSV_LIST_ENTRY_INT (XMMS_IPC_SIGNAL_PLAYBACK_PLAYTIME),
+	                                         XMMSV_LIST_END));
+	wait_for_pending (XMMS_IPC_SIGNAL_PLAYBACK_PLAYTIME);
+
+	before = resident_size ();
+
+	for (i = 0; i < BROADCASTS; i++) {
+		xmms_object_emit (object, XMMS_IPC_SIGNAL_MEDIALIB_ENTRY_CHANGED,
+		                  xmmsv_new_string (payload));
+	}
+
+	grown = resident_size () - before;
+	bytes = queued_bytes (id);
+
+	/* past the soft limit updates are coalesced into one */
+	CU_ASSERT (bytes >= 0);
+	CU_ASSERT (bytes <= 64 * 1024 + 2 * PAYLOAD);
+
+	/* without the limit this would be around BROADCASTS * PAYLOAD */
+	CU_ASSERT (grown < BROADCASTS * PAYLOAD / 8);
+
+	printf ("\n%d broadcasts of %d bytes: %" G_GINT64_FORMAT " bytes queued,"
+	        " resident size grew %" G_GINT64_FORMAT " kB\n",
+	        BROADCASTS, PAYLOAD, bytes, grown / 1024);
+
+	close (fd);
+}
+
+CASE (test_slow_client_hard_limit)
+{
+	gchar payload[PAYLOAD];
+	xmms_error_t err;
+	gint64 deadline;
+	xmmsv_t *val;
+	gint32 id;
+	gint fd;
+
+	set_queue_limits ("0", "64");
+
+	memset (payload, 'x', sizeof (payload) - 1);
+	payload[sizeof (payload) - 1] = '\0';
+
+	fd = slow_client_connect (&id);
+	slow_client_subscribe (fd, XMMS_IPC_COMMAND_BROADCAST, 1,
+	                       xmmsv_build_list (XMMSV_LIST_ENTRY_INT (XMMS_IPC_SIGNAL_COURIER_MESSAGE),
+	                                         XMMSV_LIST_END));
+	slow_client_subscribe (fd, XMMS_IPC_COMMAND_SIGNAL, 2,
+	                       xmmsv_build_list (XMMSV_LIST_ENTRY_INT (XMMS_IPC_SIGNAL_PLAYBACK_PLAYTIME),
+	                                         XMMSV_LIST_END));
+	wait_for_pending (XMMS_IPC_SIGNAL_PLAYBACK_PLAYTIME);
+
+	/* messages for this client alone are never dropped, so the queue
+	 * grows until the client is disconnected */
+	val = xmmsv_new_string (payload);
+	deadline = g_get_monotonic_time () + 5 * G_USEC_PER_SEC;
+	while (xmms_ipc_client_queue_length (id) >= 0 &&
+	       g_get_monotonic_time () < deadline) {
+		xmms_error_reset (&err);
+		xmms_ipc_send_broadcast (XMMS_IPC_SIGNAL_COURIER_MESSAGE, id, val, &err);
+	}
+	xmmsv_unref (val);
+
+	CU_ASSERT_EQUAL (xmms_ipc_client_queue_length (id), -1);
+
+	close (fd);
+}
@@ -253,3 +253,79 @@ CASE (test_coll_idlist)
 
 	xmmsv_unref (c);
 }
+
+CASE (test_coll_idlist_boxed)
+{
+	xmmsv_t *c, *list;
+	int64_t v;
+	int i;
+
+	c = xmmsv_new_coll (XMMS_COLLECTION_TYPE_IDLIST);
+
+	for (i = 0; i < 10; i++) {
+		xmmsv_coll_idlist_append (c, i);
+	}
+
+	CU_ASSERT_TRUE (xmmsv_coll_idlist_move (c, 0, -1));
+	CU_ASSERT_TRUE (xmmsv_coll_idlist_insert (c, 0, 42));
+	CU_ASSERT_TRUE (xmmsv_coll_idlist_set_index (c, 1, 23));
+	CU_ASSERT_FALSE (xmmsv_coll_idlist_insert (c, 12, 1));
+
+	list = xmmsv_coll_idlist_get (c);
+	CU_ASSERT_EQUAL (xmmsv_list_get_size (list), 11);
+
+	CU_ASSERT_TRUE (xmmsv_list_get_int64 (list, 0, &v));
+	CU_ASSERT_EQUAL (42, v);
+	CU_ASSERT_TRUE (xmmsv_list_get_int64 (list, 1, &v));
+	CU_ASSERT_EQUAL (23, v);
+	CU_ASSERT_TRUE (xmmsv_list_get_int64 (list, 10, &v));
+	CU_ASSERT_EQUAL (0, v);
+
+	/* Once boxed, changes go through the list */
+	CU_ASSERT_TRUE (xmmsv_coll_idlist_remove (c, 0));
+	CU_ASSERT_EQUAL (xmmsv_list_get_size (list), 10);
+
+	CU_ASSERT_TRUE (xmmsv_list_append_int (list, 7));
+	CU_ASSERT_TRUE (xmmsv_coll_idlist_get_index_int64 (c, -1, &v));
+	CU_ASSERT_EQUAL (7, v);
+	CU_ASSERT_EQUAL (xmmsv_coll_idlist_get_size (c), 11);
+
+	xmmsv_unref (c);
+}
+
+CASE (test_coll_idlist_copy_on_write)
+{
+	xmmsv_t *c, *copy;
+	int64_t v;
+	int i;
+
+	c = xmmsv_new_coll (XMMS_COLLECTION_TYPE_IDLIST);
+
+	for (i = 0; i < 10; i++) {
+		xmmsv_coll_idlist_append (c, i);
+	}
+
+	copy = xmmsv_copy (c);
+	CU_ASSERT_EQUAL (xmmsv_coll_idlist_get_size (copy), 10);
+
+	/* Modifying either one must not affect the other */
+	CU_ASSERT_TRUE (xmmsv_coll_idlist_set_index (c, 0, 42));
+	CU_ASSERT_TRUE (xmmsv_coll_idlist_get_index_int64 (copy, 0, &v));
+	CU_ASSERT_EQUAL (0, v);
+
+	CU_ASSERT_TRUE (xmmsv_coll_idlist_remove (copy, 9));
+	CU_ASSERT_EQUAL (xmmsv_coll_idlist_get_size (c), 10);
+	CU_ASSERT_EQUAL (xmmsv_coll_idlist_get_size (copy), 9);
+
+	CU_ASSERT_TRUE (xmmsv_coll_idlist_get_index_int64 (c, 0, &v));
+	CU_ASSERT_EQUAL (42, v);
+	CU_ASSERT_TRUE (xmmsv_coll_idlist_get_index_int64 (c, 9, &v));
+	CU_ASSERT_EQUAL (9, v);
+
+	xmmsv_unref (c);
+
+	CU_ASSERT_TRUE (xmmsv_coll_idlist_get_index_int64 (copy, 8, &v));
+	CU_ASSERT_EQUAL (8, v);
+
+	xmmsv_unref (copy);
+}
@@ -0,0 +1,353 @@
+/*  XMMS2 - X Music Multiplexer System
+ *  Copyright (C) 2003-2020 XMMS2 Team
+ *
+ *  PLUGINS ARE NOT CONSIDERED TO BE DERIVED WORK !!!
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ */
+
+#include "xcu.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <xmmsc/xmmsv.h>
+#include <xmmscpriv/xmmsv.h>
+
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+#include <malloc.h>
+#define HAVE_MALLINFO2 1
+#endif
+
+#define ENTRIES 200000
+
+SETUP (string_pool) {
+	return 0;
+}
+
+CLEANUP () {
+	return 0;
+}
+
+CASE (test_string_pool_new_string)
+{
+	xmmsv_string_pool_t *pool;
+	xmmsv_t *a, *b, *c;
+	const char *s;
+
+	pool = xmmsv_string_pool_new ();
+	CU_ASSERT_EQUAL (xmmsv_string_pool_get_size (pool), 0);
+
+	a = xmmsv_string_pool_new_string (pool, "Kraftwerk");
+	b = xmmsv_string_pool_new_string (pool, "Kraftwerk");
+	c = xmmsv_string_pool_new_string (pool, "Neu!");
+
+	CU_ASSERT_PTR_EQUAL (a, b);
+	CU_ASSERT_PTR_NOT_EQUAL (a, c);
+	CU_ASSERT_EQUAL (xmmsv_string_pool_get_size (pool), 2);
+
+	xmmsv_string_pool_free (pool);
+
+	/* the values outlive the pool */
+	CU_ASSERT_TRUE (xmmsv_get_string (a, &s));
+	CU_ASSERT_STRING_EQUAL (s, "Kraftwerk");
+	CU_ASSERT_TRUE (xmmsv_get_string (c, &s));
+	CU_ASSERT_STRING_EQUAL (s, "Neu!");
+
+	xmmsv_unref (a);
+	xmmsv_unref (b);
+	xmmsv_unref (c);
+}
+
+CASE (test_string_pool_grows)
+{
+	xmmsv_string_pool_t *pool;
+	xmmsv_t *first, *again;
+	char buf[32];
+	int i;
+
+	pool = xmmsv_string_pool_new ();
+
+	first = xmmsv_string_pool_new_string (pool, "0");
+	for (i = 1; i < 10000; i++) {
+		snprintf (buf, sizeof (buf), "%d", i);
+		xmmsv_unref (xmmsv_string_pool_new_string (pool, buf));
+	}
+
+	CU_ASSERT_EQUAL (xmmsv_string_pool_get_size (pool), 10000);
+
+	again = xmmsv_string_pool_new_string (pool, "0");
+	CU_ASSERT_PTR_EQUAL (first, again);
+
+	xmmsv_unref (first);
+	xmmsv_unref (again);
+	xmmsv_string_pool_free (pool);
+}
+
+CASE (test_string_pool_dict_set)
+{
+	xmmsv_string_pool_t *pool;
+	xmmsv_t *a, *b, *value;
+	xmmsv_dict_iter_t *it;
+	const char *key_a, *key_b, *s;
+	int64_t i;
+
+	pool = xmmsv_string_pool_new ();
+
+	a = xmmsv_new_dict ();
+	b = xmmsv_new_dict ();
+
+	value = xmmsv_new_int (1);
+	CU_ASSERT_TRUE (_xmmsv_string_pool_dict_set (pool, a, "tracknr", value));
+	CU_ASSERT_TRUE (_xmmsv_string_pool_dict_set (pool, b, "tracknr", value));
+	xmmsv_unref (value);
+
+	/* replacing an entry keeps a single key */
+	value = xmmsv_new_int (2);
+	CU_ASSERT_TRUE (_xmmsv_string_pool_dict_set (pool, a, "tracknr", value));
+	xmmsv_unref (value);
+
+	CU_ASSERT_EQUAL (xmmsv_dict_get_size (a), 1);
+	CU_ASSERT_TRUE (xmmsv_dict_entry_get_int64 (a, "tracknr", &i));
+	CU_ASSERT_EQUAL (i, 2);
+	CU_ASSERT_TRUE (xmmsv_dict_entry_get_int64 (b, "tracknr", &i));
+	CU_ASSERT_EQUAL (i, 1);
+
+	/* both dicts hold the same key */
+	CU_ASSERT_TRUE (xmmsv_get_dict_iter (a, &it));
+	CU_ASSERT_TRUE (xmmsv_dict_iter_pair (it, &key_a, NULL));
+	CU_ASSERT_TRUE (xmmsv_get_dict_iter (b, &it));
+	CU_ASSERT_TRUE (xmmsv_dict_iter_pair (it, &key_b, NULL));
+	CU_ASSERT_PTR_EQUAL (key_a, key_b);
+
+	/* and so does the string value from the pool */
+	value = xmmsv_string_pool_new_string (pool, "tracknr");
+	CU_ASSERT_TRUE (xmmsv_get_string (value, &s));
+	CU_ASSERT_PTR_EQUAL (s, key_a);
+	xmmsv_unref (value);
+
+	xmmsv_string_pool_free (pool);
+
+	CU_ASSERT_TRUE (xmmsv_dict_remove (a, "tracknr"));
+	CU_ASSERT_EQUAL (xmmsv_dict_get_size (a), 0);
+	CU_ASSERT_TRUE (xmmsv_dict_has_key (b, "tracknr"));
+
+	xmmsv_unref (a);
+	xmmsv_unref (b);
+}
+
+CASE (test_string_pool_invalid_utf8)
+{
+	xmmsv_string_pool_t *pool;
+	xmmsv_t *dict, *value;
+
+	pool = xmmsv_string_pool_new ();
+
+	CU_ASSERT_PTR_NULL (xmmsv_string_pool_new_string (pool, "\xff\xfe"));
+
+	/* a dict can still take it as a key, as with xmmsv_dict_set */
+	dict = xmmsv_new_dict ();
+	value = xmmsv_new_none ();
+	CU_ASSERT_TRUE (_xmmsv_string_pool_dict_set (pool, dict, "\xff\xfe", value));
+	CU_ASSERT_TRUE (xmmsv_dict_has_key (dict, "\xff\xfe"));
+	xmmsv_unref (value);
+	xmmsv_unref (dict);
+
+	CU_ASSERT_EQUAL (xmmsv_string_pool_get_size (pool), 0);
+
+	xmmsv_string_pool_free (pool);
+}
+
+/* Sets an entry, consuming the reference to value */
+static void
+pool_set (xmmsv_string_pool_t *pool, xmmsv_t *dict, const char *key, xmmsv_t *value)
+{
+	_xmmsv_string_pool_dict_set (pool, dict, key, value);
+	xmmsv_unref (value);
+}
+
+/* What a medialib query for a library view typically returns */
+static xmmsv_t *
+result_new (int entries, xmmsv_string_pool_t *pool)
+{
+	xmmsv_t *list, *entry;
+	char artist[64], album[64], title[64], url[256];
+	int i;
+
+	list = xmmsv_new_list ();
+
+	for (i = 0; i < entries; i++) {
+		snprintf (artist, sizeof (artist), "Artist %d", i / 120);
+		snprintf (album, sizeof (album), "Album %d", i / 12);
+		snprintf (title, sizeof (title), "Track %d of album %d", i % 12 + 1, i / 12);
+		snprintf (url, sizeof (url), "file:///home/user/Music/%s/%s/%02d%%20-%%20Track.flac",
+		          artist, album, i % 12 + 1);
+
+		if (pool) {
+			entry = xmmsv_new_dict ();
+			pool_set (pool, entry, "id", xmmsv_new_int (i + 1));
+			pool_set (pool, entry, "artist", xmmsv_string_pool_new_string (pool, artist));
+			pool_set (pool, entry, "album", xmmsv_string_pool_new_string (pool, album));
+			pool_set (pool, entry, "title", xmmsv_string_pool_new_string (pool, title));
+			pool_set (pool, entry, "tracknr", xmmsv_new_int (i % 12 + 1));
+			pool_set (pool, entry, "duration", xmmsv_new_int (180000 + (i * 7919) % 120000));
+			pool_set (pool, entry, "url", xmmsv_string_pool_new_string (pool, url));
+		} else {
+			entry = xmmsv_build_dict (
+				XMMSV_DICT_ENTRY_INT ("id", i + 1),
+				XMMSV_DICT_ENTRY_STR ("artist", artist),
+				XMMSV_DICT_ENTRY_STR ("album", album),
+				XMMSV_DICT_ENTRY_STR ("title", title),
+				XMMSV_DICT_ENTRY_INT ("tracknr", i % 12 + 1),
+				XMMSV_DICT_ENTRY_INT ("duration", 180000 + (i * 7919) % 120000),
+				XMMSV_DICT_ENTRY_STR ("url", url),
+				XMMSV_DICT_END);
+		}
+
+		xmmsv_list_append (list, entry);
+		xmmsv_unref (entry);
+	}
+
+	return list;
+}
+
+CASE (test_string_pool_deserialize)
+{
+	xmmsv_string_pool_t *pool;
+	xmmsv_t *result, *serialized, *copy, *first, *second;
+	xmmsv_t *a, *b;
+	xmmsv_dict_iter_t *it;
+	const char *key_a, *key_b;
+
+	result = result_new (24, NULL);
+	serialized = xmmsv_serialize (result);
+
+	/* only values deserialized through a pool share their strings */
+	copy = xmmsv_deserialize (serialized);
+	CU_ASSERT_TRUE (xmmsv_list_get (copy, 0, &first));
+	CU_ASSERT_TRUE (xmmsv_list_get (copy, 1, &second));
+	CU_ASSERT_TRUE (xmmsv_dict_get (first, "artist", &a));
+	CU_ASSERT_TRUE (xmmsv_dict_get (second, "artist", &b));
+	CU_ASSERT_PTR_NOT_EQUAL (a, b);
+	xmmsv_unref (copy);
+
+	pool = xmmsv_string_pool_new ();
+	copy = xmmsv_string_pool_deserialize (pool, serialized);
+	xmmsv_string_pool_free (pool);
+
+	CU_ASSERT_EQUAL (xmmsv_list_get_size (copy), 24);
+
+	/* the first two tracks of an album, by the same artist */
+	CU_ASSERT_TRUE (xmmsv_list_get (copy, 0, &first));
+	CU_ASSERT_TRUE (xmmsv_list_get (copy, 1, &second));
+
+	CU_ASSERT_TRUE (xmmsv_dict_get (first, "artist", &a));
+	CU_ASSERT_TRUE (xmmsv_dict_get (second, "artist", &b));
+	CU_ASSERT_PTR_EQUAL (a, b);
+
+	CU_ASSERT_TRUE (xmmsv_dict_get (first, "title", &a));
+	CU_ASSERT_TRUE (xmmsv_dict_get (second, "title", &b));
+	CU_ASSERT_PTR_NOT_EQUAL (a, b);
+
+	/* the keys are shared between entries */
+	CU_ASSERT_TRUE (xmmsv_get_dict_iter (first, &it));
+	CU_ASSERT_TRUE (xmmsv_dict_iter_find (it, "url"));
+	CU_ASSERT_TRUE (xmmsv_dict_iter_pair (it, &key_a, NULL));
+	CU_ASSERT_TRUE (xmmsv_get_dict_iter (second, &it));
+	CU_ASSERT_TRUE (xmmsv_dict_iter_find (it, "url"));
+	CU_ASSERT_TRUE (xmmsv_dict_iter_pair (it, &key_b, NULL));
+	CU_ASSERT_PTR_EQUAL (key_a, key_b);
+
+	xmmsv_unref (copy);
+	xmmsv_unref (serialized);
+	xmmsv_unref (result);
+}
+
+static long
+heap_in_use (void)
+{
+#ifdef HAVE_MALLINFO2
+	return mallinfo2 ().uordblks;
+#else
+	return -1;
+#endif
+}
+
+static double
+cpu_now (void)
+{
+	return (double) clock () / CLOCKS_PER_SEC;
+}
+
+/* Build a result and free it again, measuring the heap it took */
+static void
+benchmark (const char *name, xmmsv_t *serialized, int pooled)
+{
+	xmmsv_string_pool_t *pool = NULL;
+	double start, built, freed;
+	long before, after;
+	xmmsv_t *result;
+
+	before = heap_in_use ();
+	start = cpu_now ();
+
+	if (pooled) {
+		pool = xmmsv_string_pool_new ();
+	}
+
+	if (serialized && pool) {
+		result = xmmsv_string_pool_deserialize (pool, serialized);
+	} else if (serialized) {
+		result = xmmsv_deserialize (serialized);
+	} else {
+		result = result_new (ENTRIES, pool);
+	}
+
+	if (pool) {
+		xmmsv_string_pool_free (pool);
+	}
+
+	built = cpu_now ();
+	after = heap_in_use ();
+
+	CU_ASSERT_EQUAL (xmmsv_list_get_size (result), ENTRIES);
+	xmmsv_unref (result);
+
+	freed = cpu_now ();
+
+	if (before < 0) {
+		printf ("%-12s built in %4.0f ms, freed in %4.0f ms\n",
+		        name, (built - start) * 1000, (freed - built) * 1000);
+	} else {
+		printf ("%-12s %6.1f MB, built in %4.0f ms, freed in %4.0f ms\n",
+		        name, (after - before) / (1024.0 * 1024.0),
+		        (built - start) * 1000, (freed - built) * 1000);
+	}
+}
+
+CASE (test_string_pool_result_set)
+{
+	xmmsv_t *result, *serialized;
+
+	result = result_new (ENTRIES, NULL);
+	serialized = xmmsv_serialize (result);
+	xmmsv_unref (result);
+
+	printf ("\n%d entry result:\n", ENTRIES);
+
+	benchmark ("copied", NULL, 0);
+	benchmark ("pooled", NULL, 1);
+	benchmark ("deserialized", serialized, 0);
+	benchmark ("deser pooled", serialized, 1);
+
+	xmmsv_unref (serialized);
+}
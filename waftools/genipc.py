@@ -133,6 +133,8 @@ class IpcFoo:
 			enum = IpcEnum(e)
 			self.enums[enum.name] = enum
 
+		max_methods = 0
+
 		for object_element in object_elements:
 			object = IpcObject(object_element)
 			self.objects.append(object)
@@ -147,9 +149,16 @@ class IpcFoo:
 				m = methods_enum.add_member(meth.name.upper(), alias=alias_first)
 				meth.id = m
 				alias_first = None
+			methods_enum.add_member('END', alias=alias_first)
+
+			max_methods = max(max_methods, len(object.methods))
 
 		obj_enum.add_member('END')
 
+		# size of the per object command tables in the server
+		object_max = Constant('IPC_COMMAND_OBJECT_MAX', max_methods)
+		self.constants[object_max.name] = object_max
+
 		for bcsig, obj, type in self.iter_broadcasts_and_signals():
 			m = sig_enum.add_member('%s_%s' % (obj.name.upper(), bcsig.name.upper()))
 			bcsig.id = m
@@ -77,7 +77,7 @@ c_xmmsv_type_t_map = {
     'list': 'XMMSV_TYPE_LIST',
     'dictionary': 'XMMSV_TYPE_DICT',
     'collection': 'XMMSV_TYPE_COLL',
-    'binary': 'XMMSV_TYPE_BINDATA'
+    'binary': 'XMMSV_TYPE_BIN'
 }
 def get_xmmsv_type(typeinfo):
 	if not isinstance(typeinfo, basestring):
@@ -87,6 +87,10 @@ def has_xmmsv_type(typeinfo):
 	if not isinstance(typeinfo, basestring):
 		typeinfo = typeinfo[0]
 	return typeinfo in c_xmmsv_type_t_map
+def get_arg_type(typeinfo):
+	if has_xmmsv_type(typeinfo):
+		return get_xmmsv_type(typeinfo)
+	return 'XMMS_OBJECT_CMD_ARG_ANY'
 
 def _enum_value(member):
 	return 'XMMS_%s' % member.fullname()
@@ -146,6 +150,9 @@ def build(object_name, c_type):
 def method_name_to_cname(n):
 	return "__int_xmms_cmd_%s" % n
 
+def method_name_to_desc(n):
+	return "%s_desc" % method_name_to_cname(n)
+
 def emit_method_define_code(object, method, c_type):
 	full_method_name = 'xmms_%s_client_%s' % (object.name, method.name)
 
@@ -160,28 +167,21 @@ def emit_method_define_code(object, method, c_type):
 	if method.arguments:
 		Indenter.printline("xmmsv_t *t;")
 
-	Indenter.enter("if (xmmsv_list_get_size (arg->args) != %d) {" % len(method.arguments))
-	Indenter.printline('XMMS_DBG ("Wrong number of arguments to %s (%%d)", xmmsv_list_get_size (arg->args));' % method.name)
-	Indenter.printline('xmms_error_set (&arg->error, XMMS_ERROR_INVAL, "Wrong number of arguments to %s");' % method.name)
-	Indenter.printline('return;')
-	Indenter.leave("}")
-
 	for i, a in enumerate(method.arguments):
 		Indenter.printline("%s argval%d;" % (get_type(a.type[0]), i))
 
 	Indenter.printline()
 
+	# The argument count and types were checked against the descriptor
+	# by xmms_object_cmd_call, only the contents are left to check here.
 	for i, a in enumerate(method.arguments):
-		Indenter.enter("if (!xmmsv_list_get (arg->args, %d, &t)) {" % i)
-		Indenter.printline('XMMS_DBG ("Missing arg %d in %s");' % (i, method.name))
-		Indenter.printline('xmms_error_set (&arg->error, XMMS_ERROR_INVAL, "Missing arg %d in %s");' % (i, method.name))
-		Indenter.printline('return;')
-		Indenter.leave("}")
+		Indenter.printline("xmmsv_list_get (arg->args, %d, &t);" % i)
 
 		if a.type[0] == 'list' and len(a.type) > 1 and has_xmmsv_type(a.type[1]):
 			Indenter.enter('if (!xmmsv_list_restrict_type (t, %s)) {' % (get_xmmsv_type(a.type[1])))
 			Indenter.printline('XMMS_DBG("Wrong list content (not %s) for arg %d in %s.");' % (a.type[1], i, method.name))
 			Indenter.printline('xmms_error_set (&arg->error, XMMS_ERROR_INVAL, "Wrong list content (not %s) for arg %d in %s.");' % (a.type[1], i, method.name))
+			Indenter.printline('return;')
 			Indenter.leave('}')
 
 		if get_getter(a.type[0]) is None:
@@ -231,9 +231,17 @@ def emit_method_define_code(object, method, c_type):
 
 	Indenter.leave("}")
 
+	Indenter.printline()
+
+	types = [get_arg_type(a.type[0]) for a in method.arguments]
+
+	Indenter.printline("static const xmms_object_cmd_desc_t %s = {" % method_name_to_desc(method.name))
+	Indenter.printline("\t%s, %d, { %s }" % (method_name_to_cname(method.name), len(types), ", ".join(types or ['0'])))
+	Indenter.printline("};")
+
 	Indenter.printline()
 	Indenter.printline()
 
 
 def emit_method_add_code(object, method):
-	Indenter.printline('xmms_object_cmd_add (%s_object, %s, %s);' % (object.name, _enum_value(method.id), method_name_to_cname (method.name)))
+	Indenter.printline('xmms_object_cmd_add (%s_object, %s, &%s);' % (object.name, _enum_value(method.id), method_name_to_desc(method.name)))